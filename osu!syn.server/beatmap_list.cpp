@@ -0,0 +1,973 @@
+#include "beatmap_list.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <tuple>
+#include <zlib.h>
+#include "binary_io.hpp"
+
+using binary_io::getU32;
+using binary_io::getU64;
+using binary_io::getVarint;
+using binary_io::putU32;
+using binary_io::putU64;
+using binary_io::putVarint;
+
+namespace {
+
+constexpr uint32_t kListMagic = 0x4C42534F; // "OSBL"
+constexpr uint8_t kFormatVersion = 1;
+constexpr uint8_t kCollectionFlag = 1;
+constexpr uint8_t kDownloadedFlag = 1;
+// 与 BeatmapList::Field 的位一一对应
+constexpr const char* kFieldNames[] = {"id", "title", "artist", "creator", "version", "md5", "localPath", "downloaded"};
+
+uint32_t checksum(const char* data, size_t size) {
+    return static_cast<uint32_t>(::crc32(0L, reinterpret_cast<const Bytef*>(data), static_cast<uInt>(size)));
+}
+
+void putString(std::string& out, const std::string& value) {
+    putVarint(out, value.size());
+    out += value;
+}
+
+bool getString(const char*& p, const char* end, std::string& value) {
+    uint64_t length;
+    if (!getVarint(p, end, length) || length > static_cast<uint64_t>(end - p)) {
+        return false;
+    }
+    value.assign(p, static_cast<size_t>(length));
+    p += length;
+    return true;
+}
+
+// 读取头部，返回指向 setId 数组的指针
+bool readHeader(const std::string& data, BeatmapList* list, const char*& p, uint64_t& count) {
+    const char* end = data.data() + data.size();
+    p = data.data();
+    if (data.size() < 10 || getU32(p) != kListMagic || static_cast<uint8_t>(p[4]) != kFormatVersion) {
+        return false;
+    }
+    uint8_t flags = static_cast<uint8_t>(p[5]);
+    p += 6;
+    end -= 4;   // CRC
+
+    std::string name;
+    std::string description;
+    if ((flags & kCollectionFlag) && (!getString(p, end, name) || !getString(p, end, description))) {
+        return false;
+    }
+    if (list) {
+        list->isCollection = flags & kCollectionFlag;
+        list->name = std::move(name);
+        list->description = std::move(description);
+    }
+    return getVarint(p, end, count) && count <= static_cast<uint64_t>(end - p) / 8;
+}
+
+void appendEscaped(std::string& out, const std::string& value) {
+    out.push_back('"');
+    for (char c : value) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<unsigned char>(c));
+                    out += buffer;
+                } else {
+                    out.push_back(c);
+                }
+        }
+    }
+    out.push_back('"');
+}
+
+} // anonymous namespace
+
+uint64_t BeatmapEntry::parseSetId(const std::string& id) {
+    // 只接受规范的十进制表示，保证数值与字符串可以无损互转
+    if (id.empty() || id.size() > 19 || (id.size() > 1 && id[0] == '0')) {
+        return kNoSetId;
+    }
+    uint64_t value = 0;
+    for (char c : id) {
+        if (c < '0' || c > '9') {
+            return kNoSetId;
+        }
+        value = value * 10 + static_cast<uint64_t>(c - '0');
+    }
+    return value;
+}
+
+std::string BeatmapEntry::key() const {
+    if (id.empty() || id == "-1") {
+        return "-1/" + title;
+    }
+    return id;
+}
+
+bool BeatmapEntry::operator==(const BeatmapEntry& other) const {
+    return std::tie(id, title, artist, creator, version, md5, localPath, downloaded) ==
+           std::tie(other.id, other.title, other.artist, other.creator, other.version,
+                    other.md5, other.localPath, other.downloaded);
+}
+
+bool entryLess(const BeatmapEntry& a, const BeatmapEntry& b) {
+    if (a.setId != b.setId) {
+        return a.setId < b.setId;
+    }
+    return a.setId == BeatmapEntry::kNoSetId && a.key() < b.key();
+}
+
+void BeatmapList::canonicalize() {
+    for (auto& entry : entries) {
+        entry.setId = BeatmapEntry::parseSetId(entry.id);
+    }
+    std::stable_sort(entries.begin(), entries.end(), entryLess);
+
+    // 相等键的一段中保留最后一个，即上传中最后出现的条目
+    size_t out = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (i + 1 < entries.size() && !entryLess(entries[i], entries[i + 1])) {
+            continue;
+        }
+        if (out != i) {
+            entries[out] = std::move(entries[i]);
+        }
+        ++out;
+    }
+    entries.resize(out);
+}
+
+std::string BeatmapList::encode() const {
+    std::string out;
+    putU32(out, kListMagic);
+    out.push_back(static_cast<char>(kFormatVersion));
+    out.push_back(static_cast<char>(isCollection ? kCollectionFlag : 0));
+    if (isCollection) {
+        putString(out, name);
+        putString(out, description);
+    }
+    putVarint(out, entries.size());
+    for (const auto& entry : entries) {
+        putU64(out, entry.setId);
+    }
+    for (const auto& entry : entries) {
+        out.push_back(static_cast<char>(entry.downloaded ? kDownloadedFlag : 0));
+        if (entry.setId == BeatmapEntry::kNoSetId) {
+            putString(out, entry.id);
+        }
+        putString(out, entry.title);
+        putString(out, entry.artist);
+        putString(out, entry.creator);
+        putString(out, entry.version);
+        putString(out, entry.md5);
+        putString(out, entry.localPath);
+    }
+    putU32(out, checksum(out.data(), out.size()));
+    return out;
+}
+
+bool BeatmapList::isEncoded(const std::string& data) {
+    return data.size() >= 4 && getU32(data.data()) == kListMagic;
+}
+
+bool BeatmapList::decode(const std::string& data, BeatmapList& list, std::string& errorMessage) {
+    errorMessage = "谱面列表编码损坏";
+    if (data.size() < 10 || checksum(data.data(), data.size() - 4) != getU32(data.data() + data.size() - 4)) {
+        return false;
+    }
+
+    const char* p;
+    uint64_t count;
+    if (!readHeader(data, &list, p, count)) {
+        return false;
+    }
+    const char* end = data.data() + data.size() - 4;
+
+    list.entries.assign(static_cast<size_t>(count), BeatmapEntry());
+    for (auto& entry : list.entries) {
+        entry.setId = getU64(p);
+        p += 8;
+    }
+    for (size_t i = 0; i < list.entries.size(); ++i) {
+        BeatmapEntry& entry = list.entries[i];
+        if (p >= end) {
+            return false;
+        }
+        entry.downloaded = static_cast<uint8_t>(*p++) & kDownloadedFlag;
+        if (entry.setId == BeatmapEntry::kNoSetId) {
+            if (!getString(p, end, entry.id)) {
+                return false;
+            }
+        } else {
+            entry.id = std::to_string(entry.setId);
+        }
+        if (!getString(p, end, entry.title) || !getString(p, end, entry.artist) ||
+            !getString(p, end, entry.creator) || !getString(p, end, entry.version) ||
+            !getString(p, end, entry.md5) || !getString(p, end, entry.localPath)) {
+            return false;
+        }
+        if (i > 0 && !entryLess(list.entries[i - 1], entry)) {
+            return false;   // 不是规范顺序
+        }
+    }
+    if (p != end) {
+        return false;
+    }
+    errorMessage.clear();
+    return true;
+}
+
+bool BeatmapList::parse(const std::string& content, BeatmapList& list, std::string& errorMessage) {
+    if (isEncoded(content)) {
+        return decode(content, list, errorMessage);
+    }
+    BeatmapListParser parser;
+    if (!parser.feed(content.data(), content.size()) || !parser.finish(list)) {
+        errorMessage = parser.error();
+        return false;
+    }
+    return true;
+}
+
+bool BeatmapList::readSetIds(const std::string& data, std::vector<uint64_t>& setIds) {
+    const char* p;
+    uint64_t count;
+    if (!readHeader(data, nullptr, p, count)) {
+        return false;
+    }
+    setIds.resize(static_cast<size_t>(count));
+    for (auto& setId : setIds) {
+        setId = getU64(p);
+        p += 8;
+    }
+    return true;
+}
+
+void BeatmapList::appendEntryJson(std::string& out, const BeatmapEntry& entry, uint32_t fields) {
+    const std::string* strings[] = {&entry.id, &entry.title, &entry.artist, &entry.creator,
+                                    &entry.version, &entry.md5, &entry.localPath};
+    char separator = '{';
+    for (size_t i = 0; i < std::size(strings); i++) {
+        if (fields & (1u << i)) {
+            out += separator;
+            out += '"';
+            out += kFieldNames[i];
+            out += "\":";
+            appendEscaped(out, *strings[i]);
+            separator = ',';
+        }
+    }
+    if (fields & kFieldDownloaded) {
+        out += separator;
+        out += entry.downloaded ? "\"downloaded\":true" : "\"downloaded\":false";
+        separator = ',';
+    }
+    out += separator == '{' ? "{}" : "}";
+}
+
+bool BeatmapList::parseFields(const std::string& spec, uint32_t& fields, std::string& errorMessage) {
+    fields = 0;
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t comma = std::min(spec.find(',', start), spec.size());
+        std::string name = spec.substr(start, comma - start);
+        auto it = std::find(std::begin(kFieldNames), std::end(kFieldNames), name);
+        if (it == std::end(kFieldNames)) {
+            errorMessage = "未知的字段: " + name;
+            return false;
+        }
+        fields |= 1u << (it - std::begin(kFieldNames));
+        start = comma + 1;
+    }
+    return true;
+}
+
+std::string BeatmapList::renderEntries(const std::vector<BeatmapEntry>& entries) {
+    std::string out = "[";
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (i > 0) {
+            out.push_back(',');
+        }
+        appendEntryJson(out, entries[i]);
+    }
+    out.push_back(']');
+    return out;
+}
+
+std::string BeatmapList::renderJson() const {
+    if (!isCollection) {
+        return renderEntries(entries);
+    }
+    std::string out = "{\"name\":";
+    appendEscaped(out, name);
+    out += ",\"description\":";
+    appendEscaped(out, description);
+    out += ",\"beatmaps\":";
+    out += renderEntries(entries);
+    out.push_back('}');
+    return out;
+}
+
+// 把 JSON 事件翻译为谱面列表
+class BeatmapListParser::Builder : public JsonPushParser::Handler {
+public:
+    explicit Builder(size_t maxEntries)
+        : maxEntries_(maxEntries) {}
+
+    BeatmapList list;
+    std::string error;
+
+    bool complete() {
+        if (where_ != Where::Finished) {
+            return fail("谱面列表必须是数组或包含 beatmaps 数组的对象");
+        }
+        return true;
+    }
+
+    bool startObject() override {
+        if (skipValue()) {
+            ++skipDepth_;
+            return true;
+        }
+        switch (where_) {
+            case Where::Root:
+                list.isCollection = true;
+                where_ = Where::Collection;
+                return true;
+            case Where::Entries:
+                if (list.entries.size() >= maxEntries_) {
+                    return fail("谱面条目数超过上限 " + std::to_string(maxEntries_));
+                }
+                list.entries.emplace_back();
+                sawId_ = false;
+                where_ = Where::Entry;
+                return true;
+            default:
+                return typeError();
+        }
+    }
+
+    bool endObject() override {
+        if (skipDepth_ > 0) {
+            --skipDepth_;
+            return true;
+        }
+        if (where_ == Where::Entry) {
+            if (!sawId_) {
+                return fail("第 " + std::to_string(list.entries.size()) + " 个谱面条目缺少 id");
+            }
+            where_ = Where::Entries;
+            return true;
+        }
+        if (!sawBeatmaps_) {
+            return fail("合集对象缺少 beatmaps 数组");
+        }
+        where_ = Where::Finished;
+        return true;
+    }
+
+    bool startArray() override {
+        if (skipValue()) {
+            ++skipDepth_;
+            return true;
+        }
+        if (where_ == Where::Root || (where_ == Where::Collection && field_ == Field::Beatmaps)) {
+            entriesInCollection_ = where_ == Where::Collection;
+            sawBeatmaps_ = true;
+            where_ = Where::Entries;
+            return true;
+        }
+        return typeError();
+    }
+
+    bool endArray() override {
+        if (skipDepth_ > 0) {
+            --skipDepth_;
+            return true;
+        }
+        where_ = entriesInCollection_ ? Where::Collection : Where::Finished;
+        return true;
+    }
+
+    bool key(std::string& name) override {
+        if (skipDepth_ > 0) {
+            return true;
+        }
+        field_ = where_ == Where::Collection ? collectionField(name) : entryField(name);
+        fieldName_ = name;
+        return true;
+    }
+
+    bool string(std::string& value) override {
+        if (skipValue()) {
+            return true;
+        }
+        std::string* target = stringTarget();
+        if (!target) {
+            return typeError();
+        }
+        if (where_ == Where::Entry && field_ == Field::Id) {
+            if (value.empty()) {
+                return fail("谱面条目的 id 不能为空");
+            }
+            sawId_ = true;
+        }
+        *target = std::move(value);
+        return true;
+    }
+
+    bool number(const std::string& text) override {
+        if (skipValue()) {
+            return true;
+        }
+        // 部分导出工具把ID写成数字，但必须是整数
+        if (where_ == Where::Entry && field_ == Field::Id) {
+            if (text.find_first_of(".eE") != std::string::npos) {
+                return fail("谱面条目的 id 必须是整数");
+            }
+            list.entries.back().id = text;
+            sawId_ = true;
+            return true;
+        }
+        return typeError();
+    }
+
+    bool boolean(bool value) override {
+        if (skipValue()) {
+            return true;
+        }
+        if (where_ == Where::Entry && field_ == Field::Downloaded) {
+            list.entries.back().downloaded = value;
+            return true;
+        }
+        return typeError();
+    }
+
+    bool null() override {
+        if (skipValue()) {
+            return true;
+        }
+        // null 视为缺省值
+        return (where_ == Where::Entry || where_ == Where::Collection) && field_ != Field::Beatmaps
+               ? true : typeError();
+    }
+
+private:
+    enum class Where { Root, Collection, Entries, Entry, Finished };
+    enum class Field { Unknown, Name, Description, Beatmaps,
+                       Id, Title, Artist, Creator, Version, Md5, LocalPath, Downloaded };
+
+    static Field collectionField(const std::string& name) {
+        if (name == "name") return Field::Name;
+        if (name == "description") return Field::Description;
+        if (name == "beatmaps") return Field::Beatmaps;
+        return Field::Unknown;
+    }
+
+    static Field entryField(const std::string& name) {
+        if (name == "id") return Field::Id;
+        if (name == "title") return Field::Title;
+        if (name == "artist") return Field::Artist;
+        if (name == "creator") return Field::Creator;
+        if (name == "version") return Field::Version;
+        if (name == "md5") return Field::Md5;
+        if (name == "localPath") return Field::LocalPath;
+        if (name == "downloaded") return Field::Downloaded;
+        return Field::Unknown;
+    }
+
+    // 未知字段的值（可能是嵌套的对象或数组）整体跳过
+    bool skipValue() {
+        if (skipDepth_ > 0) {
+            return true;
+        }
+        if ((where_ == Where::Collection || where_ == Where::Entry) && field_ == Field::Unknown) {
+            return true;
+        }
+        return false;
+    }
+
+    std::string* stringTarget() {
+        if (where_ == Where::Collection) {
+            switch (field_) {
+                case Field::Name: return &list.name;
+                case Field::Description: return &list.description;
+                default: return nullptr;
+            }
+        }
+        if (where_ != Where::Entry) {
+            return nullptr;
+        }
+        BeatmapEntry& entry = list.entries.back();
+        switch (field_) {
+            case Field::Id: return &entry.id;
+            case Field::Title: return &entry.title;
+            case Field::Artist: return &entry.artist;
+            case Field::Creator: return &entry.creator;
+            case Field::Version: return &entry.version;
+            case Field::Md5: return &entry.md5;
+            case Field::LocalPath: return &entry.localPath;
+            default: return nullptr;
+        }
+    }
+
+    bool typeError() {
+        if (where_ == Where::Entries) {
+            return fail("谱面条目必须是对象");
+        }
+        if (where_ == Where::Root) {
+            return fail("谱面列表必须是数组或包含 beatmaps 数组的对象");
+        }
+        return fail("字段 " + fieldName_ + " 的类型错误");
+    }
+
+    bool fail(const std::string& message) {
+        error = message;
+        return false;
+    }
+
+    size_t maxEntries_;
+    Where where_ = Where::Root;
+    Field field_ = Field::Unknown;
+    std::string fieldName_;
+    int skipDepth_ = 0;
+    bool entriesInCollection_ = false;
+    bool sawBeatmaps_ = false;
+    bool sawId_ = false;
+};
+
+BeatmapListParser::BeatmapListParser(const BeatmapListLimits& limits)
+    : builder_(std::make_unique<Builder>(limits.maxEntries))
+    , parser_(*builder_, limits.maxDepth, limits.maxStringLength) {}
+
+BeatmapListParser::~BeatmapListParser() = default;
+
+bool BeatmapListParser::feed(const char* data, size_t size) {
+    return parser_.feed(data, size);
+}
+
+bool BeatmapListParser::finish(BeatmapList& list) {
+    if (!parser_.finish() || !builder_->complete()) {
+        return false;
+    }
+    list = std::move(builder_->list);
+    list.canonicalize();
+    return true;
+}
+
+const std::string& BeatmapListParser::error() const {
+    return parser_.error().empty() ? builder_->error : parser_.error();
+}
+
+EncodedListValidator::EncodedListValidator(const BeatmapListLimits& limits)
+    : limits_(limits) {}
+
+bool EncodedListValidator::feed(const char* data, size_t size) {
+    if (failed_) {
+        return false;
+    }
+    // CRC 覆盖正文，即结尾 4 字节之前的全部数据
+    size_t crcFrom = 0;
+    for (size_t i = 0; i < size; ++i) {
+        bool inBody = step_ != Step::Crc && step_ != Step::Done;
+        if (!step(static_cast<unsigned char>(data[i]))) {
+            failed_ = true;
+            return false;
+        }
+        ++offset_;
+        if (inBody && step_ == Step::Crc) {
+            crc_ = static_cast<uint32_t>(::crc32(crc_, reinterpret_cast<const Bytef*>(data + crcFrom),
+                                                 static_cast<uInt>(i + 1 - crcFrom)));
+            crcFrom = size;
+        }
+    }
+    if (step_ != Step::Crc && step_ != Step::Done) {
+        crc_ = static_cast<uint32_t>(::crc32(crc_, reinterpret_cast<const Bytef*>(data + crcFrom),
+                                             static_cast<uInt>(size - crcFrom)));
+    }
+    return true;
+}
+
+bool EncodedListValidator::finish() {
+    if (failed_) {
+        return false;
+    }
+    if (step_ != Step::Done) {
+        failed_ = true;
+        return fail("谱面列表编码不完整");
+    }
+    return true;
+}
+
+bool EncodedListValidator::readVarint(unsigned char c, uint64_t& value, bool& complete) {
+    if (varintShift_ > 63) {
+        return fail("谱面列表编码损坏: 变长整数过长");
+    }
+    varint_ |= static_cast<uint64_t>(c & 0x7F) << varintShift_;
+    varintShift_ += 7;
+    complete = !(c & 0x80);
+    if (complete) {
+        value = varint_;
+        varint_ = 0;
+        varintShift_ = 0;
+    }
+    return true;
+}
+
+bool EncodedListValidator::step(unsigned char c) {
+    uint64_t value = 0;
+    bool complete = false;
+    switch (step_) {
+        case Step::Header:
+            field_.push_back(static_cast<char>(c));
+            if (field_.size() == 4 && getU32(field_.data()) != kListMagic) {
+                return fail("不是有效的谱面列表编码");
+            }
+            if (field_.size() == 5 && c != kFormatVersion) {
+                return fail("不支持的谱面列表编码版本 " + std::to_string(c));
+            }
+            if (field_.size() == 6) {
+                field_.clear();
+                step_ = (c & kCollectionFlag) ? Step::NameLength : Step::Count;
+            }
+            return true;
+
+        case Step::NameLength:
+        case Step::DescriptionLength:
+        case Step::StringLength:
+            if (!readVarint(c, value, complete)) {
+                return false;
+            }
+            if (!complete) {
+                return true;
+            }
+            if (value > limits_.maxStringLength) {
+                return fail("谱面列表编码中的字符串长度 " + std::to_string(value) + " 超过上限 " +
+                            std::to_string(limits_.maxStringLength));
+            }
+            remaining_ = value;
+            step_ = step_ == Step::NameLength ? Step::Name
+                  : step_ == Step::DescriptionLength ? Step::Description : Step::String;
+            return remaining_ > 0 || endString();
+
+        case Step::Name:
+        case Step::Description:
+        case Step::String:
+            return --remaining_ > 0 || endString();
+
+        case Step::Count:
+            if (!readVarint(c, value, complete)) {
+                return false;
+            }
+            if (!complete) {
+                return true;
+            }
+            if (value > limits_.maxEntries) {
+                return fail("谱面条目数超过上限 " + std::to_string(limits_.maxEntries));
+            }
+            count_ = value;
+            firstWithoutSetId_ = count_;
+            step_ = count_ > 0 ? Step::SetIds : Step::Crc;
+            return true;
+
+        case Step::SetIds: {
+            field_.push_back(static_cast<char>(c));
+            if (field_.size() < 8) {
+                return true;
+            }
+            uint64_t setId = getU64(field_.data());
+            field_.clear();
+            if (index_ > 0 && setId < previousSetId_) {
+                return fail("谱面列表编码损坏: setId 不是升序");
+            }
+            if (setId == BeatmapEntry::kNoSetId && firstWithoutSetId_ == count_) {
+                firstWithoutSetId_ = index_;
+            }
+            previousSetId_ = setId;
+            if (++index_ == count_) {
+                index_ = 0;
+                step_ = Step::EntryFlags;
+            }
+            return true;
+        }
+
+        case Step::EntryFlags:
+            // 没有数值 setId 的条目多一个 id 字符串
+            strings_ = index_ >= firstWithoutSetId_ ? 7 : 6;
+            step_ = Step::StringLength;
+            return true;
+
+        case Step::Crc:
+            field_.push_back(static_cast<char>(c));
+            if (field_.size() == 4) {
+                if (getU32(field_.data()) != crc_) {
+                    return fail("谱面列表编码损坏: 校验和不匹配");
+                }
+                step_ = Step::Done;
+            }
+            return true;
+
+        case Step::Done:
+            return fail("谱面列表编码之后有多余的数据");
+    }
+    return false;
+}
+
+bool EncodedListValidator::endString() {
+    switch (step_) {
+        case Step::Name:
+            step_ = Step::DescriptionLength;
+            break;
+        case Step::Description:
+            step_ = Step::Count;
+            break;
+        default:
+            if (--strings_ > 0) {
+                step_ = Step::StringLength;
+            } else {
+                nextEntry();
+            }
+            break;
+    }
+    return true;
+}
+
+void EncodedListValidator::nextEntry() {
+    step_ = ++index_ < count_ ? Step::EntryFlags : Step::Crc;
+}
+
+bool EncodedListValidator::fail(const std::string& message) {
+    error_ = message + "（偏移 " + std::to_string(offset_) + "）";
+    return false;
+}
+
+// 把增量请求的 JSON 事件翻译为 BeatmapPatch；add 数组内的事件转交 Builder
+class BeatmapPatchParser::Handler : public JsonPushParser::Handler {
+public:
+    explicit Handler(size_t maxEntries)
+        : maxEntries_(maxEntries)
+        , add_(maxEntries) {}
+
+    BeatmapPatch patch;
+    std::string error;
+
+    bool complete() {
+        if (!sawBase_) {
+            return fail("需要 base 版本号（新用户为 0）");
+        }
+        if (sawAdd_) {
+            if (!add_.complete()) {
+                return fail(add_.error);
+            }
+            patch.add = std::move(add_.list);
+            patch.add.canonicalize();
+        }
+        std::sort(patch.removeSetIds.begin(), patch.removeSetIds.end());
+        return true;
+    }
+
+    bool startObject() override {
+        if (addDepth_ > 0) {
+            ++addDepth_;
+            return forward(add_.startObject());
+        }
+        if (skipDepth_ > 0 || (depth_ == 1 && field_ == Field::Unknown)) {
+            ++skipDepth_;
+            return true;
+        }
+        if (depth_ == 0) {
+            depth_ = 1;
+            return true;
+        }
+        return typeError();
+    }
+
+    bool endObject() override {
+        if (addDepth_ > 0) {
+            --addDepth_;
+            return forward(add_.endObject());
+        }
+        if (skipDepth_ > 0) {
+            --skipDepth_;
+            return true;
+        }
+        depth_ = 0;
+        return true;
+    }
+
+    bool startArray() override {
+        if (addDepth_ > 0) {
+            ++addDepth_;
+            return forward(add_.startArray());
+        }
+        if (skipDepth_ > 0 || (depth_ == 1 && field_ == Field::Unknown)) {
+            ++skipDepth_;
+            return true;
+        }
+        if (depth_ == 1 && field_ == Field::Add) {
+            addDepth_ = 1;
+            sawAdd_ = true;
+            return forward(add_.startArray());
+        }
+        if (depth_ == 1 && field_ == Field::Remove) {
+            depth_ = 2;
+            return true;
+        }
+        return typeError();
+    }
+
+    bool endArray() override {
+        if (addDepth_ > 0) {
+            --addDepth_;
+            return forward(add_.endArray());
+        }
+        if (skipDepth_ > 0) {
+            --skipDepth_;
+            return true;
+        }
+        depth_ = 1;
+        return true;
+    }
+
+    bool key(std::string& name) override {
+        if (addDepth_ > 0) {
+            return forward(add_.key(name));
+        }
+        if (skipDepth_ > 0) {
+            return true;
+        }
+        field_ = name == "base" ? Field::Base : name == "add" ? Field::Add
+               : name == "remove" ? Field::Remove : Field::Unknown;
+        if ((field_ == Field::Base && sawBase_) || (field_ == Field::Add && sawAdd_)) {
+            return fail("重复的字段 " + name);
+        }
+        return true;
+    }
+
+    bool string(std::string& value) override {
+        if (addDepth_ > 0) {
+            return forward(add_.string(value));
+        }
+        if (skipValue()) {
+            return true;
+        }
+        if (depth_ == 2) {
+            return removeSetId(value);
+        }
+        return typeError();
+    }
+
+    bool number(const std::string& text) override {
+        if (addDepth_ > 0) {
+            return forward(add_.number(text));
+        }
+        if (skipValue()) {
+            return true;
+        }
+        if (depth_ == 2) {
+            return removeSetId(text);
+        }
+        if (depth_ == 1 && field_ == Field::Base) {
+            // 版本号与 setId 一样只接受规范的十进制整数
+            patch.base = BeatmapEntry::parseSetId(text);
+            sawBase_ = patch.base != BeatmapEntry::kNoSetId;
+            return sawBase_ ? true : typeError();
+        }
+        return typeError();
+    }
+
+    bool boolean(bool value) override {
+        if (addDepth_ > 0) {
+            return forward(add_.boolean(value));
+        }
+        return skipValue() ? true : typeError();
+    }
+
+    bool null() override {
+        if (addDepth_ > 0) {
+            return forward(add_.null());
+        }
+        return skipValue() ? true : typeError();
+    }
+
+private:
+    enum class Field { Unknown, Base, Add, Remove };
+
+    bool skipValue() const {
+        return skipDepth_ > 0 || (depth_ == 1 && field_ == Field::Unknown);
+    }
+
+    bool forward(bool ok) {
+        if (!ok) {
+            error = add_.error;
+        }
+        return ok;
+    }
+
+    bool removeSetId(const std::string& text) {
+        uint64_t setId = BeatmapEntry::parseSetId(text);
+        if (setId == BeatmapEntry::kNoSetId) {
+            return fail("无效的 setId: " + text);
+        }
+        if (patch.removeSetIds.size() >= maxEntries_) {
+            return fail("remove 条目数超过上限 " + std::to_string(maxEntries_));
+        }
+        patch.removeSetIds.push_back(setId);
+        return true;
+    }
+
+    bool typeError() {
+        switch (depth_ == 0 ? Field::Unknown : field_) {
+            case Field::Base: return fail("需要 base 版本号（新用户为 0）");
+            case Field::Add: return fail("add 必须是谱面条目数组");
+            case Field::Remove: return fail(depth_ == 2 ? "无效的 setId" : "remove 必须是 setId 数组");
+            default: return fail("请求体必须是 JSON 对象");
+        }
+    }
+
+    bool fail(const std::string& message) {
+        error = message;
+        return false;
+    }
+
+    size_t maxEntries_;
+    BeatmapListParser::Builder add_;
+    int depth_ = 0;         // 0：根之外，1：根对象内，2：remove 数组内
+    int addDepth_ = 0;      // add 数组内的嵌套深度，大于 0 时事件转交 add_
+    int skipDepth_ = 0;
+    Field field_ = Field::Unknown;
+    bool sawBase_ = false;
+    bool sawAdd_ = false;
+};
+
+// 根对象多占一层嵌套
+BeatmapPatchParser::BeatmapPatchParser(const BeatmapListLimits& limits)
+    : handler_(std::make_unique<Handler>(limits.maxEntries))
+    , parser_(*handler_, limits.maxDepth + 1, limits.maxStringLength) {}
+
+BeatmapPatchParser::~BeatmapPatchParser() = default;
+
+bool BeatmapPatchParser::feed(const char* data, size_t size) {
+    return parser_.feed(data, size);
+}
+
+bool BeatmapPatchParser::finish(BeatmapPatch& patch) {
+    if (!parser_.finish() || !handler_->complete()) {
+        return false;
+    }
+    patch = std::move(handler_->patch);
+    return true;
+}
+
+const std::string& BeatmapPatchParser::error() const {
+    return parser_.error().empty() ? handler_->error : parser_.error();
+}
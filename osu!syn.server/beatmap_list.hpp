@@ -0,0 +1,181 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "json_stream.hpp"
+
+// 谱面列表中的一项，字段与客户端的 osu::BeatmapInfo 一致
+struct BeatmapEntry {
+    static constexpr uint64_t kNoSetId = std::numeric_limits<uint64_t>::max();
+
+    uint64_t setId = kNoSetId;  // id 为规范的十进制数字时的数值形式，否则为 kNoSetId
+    std::string id;
+    std::string title;
+    std::string artist;
+    std::string creator;
+    std::string version;
+    std::string md5;
+    std::string localPath;
+    bool downloaded = false;
+
+    // 规范十进制形式的 ID 对应的数值，否则为 kNoSetId
+    static uint64_t parseSetId(const std::string& id);
+
+    // 去重键：有在线ID时为ID，没有（-1 或为空）时以标题区分
+    std::string key() const;
+
+    bool operator==(const BeatmapEntry& other) const;
+    bool operator!=(const BeatmapEntry& other) const { return !(*this == other); }
+};
+
+// 规范顺序：按 setId 升序，没有数字ID的条目排在最后并按键排序
+bool entryLess(const BeatmapEntry& a, const BeatmapEntry& b);
+
+// 服务器内部使用的规范谱面列表
+// 上传的 JSON 只在入库时解析一次，之后所有服务器端操作（版本、差异等）都基于这种形式；
+// 磁盘上保存为紧凑的二进制编码，JSON 响应按需从中生成。
+//
+// 二进制格式：
+//   u32 魔数 "OSBL"  u8 格式版本  u8 标志(1=合集)
+//   [合集] varint 长度 + 名称, varint 长度 + 描述
+//   varint 条目数
+//   u64 setId[条目数]           已排序，可以不解码字符串直接读取
+//   每个条目: u8 标志(1=已下载) [无数字ID时的 id] title artist creator version md5 localPath
+//             （字符串均为 varint 长度 + UTF-8 字节）
+//   u32 CRC32（覆盖之前的全部字节）
+class BeatmapList {
+public:
+    // 按需输出的字段（投影），与 BeatmapInfo 的 JSON 字段一一对应
+    enum Field : uint32_t {
+        kFieldId = 1u << 0,
+        kFieldTitle = 1u << 1,
+        kFieldArtist = 1u << 2,
+        kFieldCreator = 1u << 3,
+        kFieldVersion = 1u << 4,
+        kFieldMd5 = 1u << 5,
+        kFieldLocalPath = 1u << 6,
+        kFieldDownloaded = 1u << 7,
+        kAllFields = (1u << 8) - 1
+    };
+
+    bool isCollection = false;  // 原始上传为 {name, description, beatmaps} 对象
+    std::string name;
+    std::string description;
+    std::vector<BeatmapEntry> entries;
+
+    // 排序并去重（重复的键保留最后出现的条目）
+    void canonicalize();
+
+    std::string encode() const;
+    static bool decode(const std::string& data, BeatmapList& list, std::string& errorMessage);
+    static bool isEncoded(const std::string& data);
+
+    // 解析任意形式的列表：二进制编码或 JSON（数组或合集对象）
+    static bool parse(const std::string& content, BeatmapList& list, std::string& errorMessage);
+
+    // 只读取已排序的 setId 数组，不解码字符串
+    static bool readSetIds(const std::string& data, std::vector<uint64_t>& setIds);
+
+    // 生成与客户端格式兼容的 JSON
+    std::string renderJson() const;
+    static void appendEntryJson(std::string& out, const BeatmapEntry& entry, uint32_t fields = kAllFields);
+    // 解析逗号分隔的字段名（例如 "id,title"）
+    static bool parseFields(const std::string& spec, uint32_t& fields, std::string& errorMessage);
+    static std::string renderEntries(const std::vector<BeatmapEntry>& entries);
+};
+
+// 上传列表的结构限制，超出时立即停止解析
+struct BeatmapListLimits {
+    size_t maxEntries = 200000;
+    size_t maxStringLength = 4096;
+    size_t maxDepth = 16;
+};
+
+// 流式解析并校验上传的 JSON 列表：数据可以分块送入，不构建 DOM，
+// 第一处违反 BeatmapInfo 结构或限制的位置就会使 feed 返回 false
+class BeatmapListParser {
+public:
+    explicit BeatmapListParser(const BeatmapListLimits& limits = BeatmapListLimits());
+    ~BeatmapListParser();
+
+    bool feed(const char* data, size_t size);
+    // 结束输入并取得规范化后的列表
+    bool finish(BeatmapList& list);
+
+    const std::string& error() const;
+
+private:
+    class Builder;
+    friend class BeatmapPatchParser;
+    std::unique_ptr<Builder> builder_;
+    JsonPushParser parser_;
+};
+
+// 增量校验上传的已编码列表（.list）：数据可以分块送入，在第一个不合法的字段处失败，
+// 不必等整个文件到齐再解码。检查头部、条目数与每个字符串的长度上限、setId 的顺序以及结尾的 CRC；
+// 条目的完整规范顺序仍由保存前的 decode 检查
+class EncodedListValidator {
+public:
+    explicit EncodedListValidator(const BeatmapListLimits& limits = BeatmapListLimits());
+
+    bool feed(const char* data, size_t size);
+    // 输入结束：检查文件是否完整
+    bool finish();
+
+    const std::string& error() const { return error_; }
+
+private:
+    enum class Step { Header, NameLength, Name, DescriptionLength, Description, Count, SetIds,
+                      EntryFlags, StringLength, String, Crc, Done };
+
+    bool step(unsigned char c);
+    bool readVarint(unsigned char c, uint64_t& value, bool& complete);
+    // 当前字符串读完后的下一步
+    bool endString();
+    // 进入下一个条目，或者全部条目读完后进入 CRC
+    void nextEntry();
+    bool fail(const std::string& message);
+
+    BeatmapListLimits limits_;
+    Step step_ = Step::Header;
+    std::string field_;             // 头部、setId 与 CRC 等定长字段已读到的字节
+    uint64_t varint_ = 0;
+    int varintShift_ = 0;
+    uint64_t remaining_ = 0;        // 当前字符串尚未读到的字节数
+    uint64_t count_ = 0;
+    uint64_t index_ = 0;            // 当前 setId 或条目的下标
+    uint64_t previousSetId_ = 0;
+    uint64_t firstWithoutSetId_ = 0;    // setId 升序，此后的条目都没有数值 setId，带 id 字符串
+    int strings_ = 0;               // 当前条目尚未读的字符串数
+    uint32_t crc_ = 0;
+    bool failed_ = false;
+    std::string error_;
+    uint64_t offset_ = 0;
+};
+
+// 增量上传的内容
+struct BeatmapPatch {
+    uint64_t base = 0;
+    BeatmapList add;
+    std::vector<uint64_t> removeSetIds;     // 已排序
+};
+
+// 流式解析增量上传的请求体 {"base": 版本号, "add": [谱面条目...], "remove": [setId...]}，同样不构建 DOM。
+// add 中的事件直接交给整份上传所用的构建器，受同样的结构限制；remove 最多 maxEntries 个
+class BeatmapPatchParser {
+public:
+    explicit BeatmapPatchParser(const BeatmapListLimits& limits = BeatmapListLimits());
+    ~BeatmapPatchParser();
+
+    bool feed(const char* data, size_t size);
+    bool finish(BeatmapPatch& patch);
+
+    const std::string& error() const;
+
+private:
+    class Handler;
+    std::unique_ptr<Handler> handler_;
+    JsonPushParser parser_;
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// 小端序二进制读写工具，供变更日志、快照等磁盘/网络格式使用
+namespace binary_io {
+
+inline void putU32(std::string& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (i * 8)) & 0xFF));
+}
+
+inline void putU64(std::string& out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) out.push_back(static_cast<char>((v >> (i * 8)) & 0xFF));
+}
+
+inline uint16_t getU16(const char* p) {
+    return static_cast<uint16_t>(static_cast<unsigned char>(p[0]) |
+                                 (static_cast<unsigned char>(p[1]) << 8));
+}
+
+inline uint32_t getU32(const char* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v |= static_cast<uint32_t>(static_cast<unsigned char>(p[i])) << (i * 8);
+    return v;
+}
+
+inline uint64_t getU64(const char* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v |= static_cast<uint64_t>(static_cast<unsigned char>(p[i])) << (i * 8);
+    return v;
+}
+
+// LEB128 变长整数，用于紧凑编码的长度字段
+inline void putVarint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+// 从 [p, end) 读取变长整数并前移 p，数据不足或超长时返回 false
+inline bool getVarint(const char*& p, const char* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char byte = static_cast<unsigned char>(*p++);
+        v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace binary_io
@@ -10,8 +10,33 @@ g++ -std=c++17 \
     main.cpp \
     logger.cpp \
     server.cpp \
+    storage.cpp \
+    changelog.cpp \
+    replication.cpp \
+    metrics.cpp \
+    cluster.cpp \
+    list_history.cpp \
+    list_store.cpp \
+    beatmap_list.cpp \
+    json_stream.cpp \
+    snapshot.cpp \
+    checksum_index.cpp \
+    scrubber.cpp \
+    set_id_bitmap.cpp \
+    club.cpp \
+    similarity_index.cpp \
+    event_frontend.cpp \
+    cold_store.cpp \
+    cold_tiering.cpp \
+    index_checkpoint.cpp \
+    holders_index.cpp \
+    dictionary_store.cpp \
+    user_directory.cpp \
+    negative_cache.cpp \
+    mirror_stats.cpp \
     -o build/osu_sync_server \
-    -pthread
+    -pthread \
+    -lz
 
 # 如果编译成功，输出信息
 if [ $? -eq 0 ]; then
@@ -0,0 +1,598 @@
+#include "changelog.hpp"
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+#include "binary_io.hpp"
+
+namespace {
+
+constexpr uint32_t kRecordMagic = 0x4C43534F; // "OSCL"
+constexpr size_t kHeaderSize = 4 + 8 + 8 + 1 + 4 + 4 + 4;
+constexpr uint32_t kMaxPathLength = 4096;
+constexpr uint32_t kMaxDataLength = 1024u * 1024 * 1024;
+constexpr size_t kSeqDigits = 20;   // 分段文件名中的序号补零到固定宽度，按名称排序即按序号排序
+
+using binary_io::getU32;
+using binary_io::getU64;
+using binary_io::putU32;
+using binary_io::putU64;
+
+uint32_t recordChecksum(const std::string& path, const std::string& data) {
+    uLong crc = ::crc32(0L, Z_NULL, 0);
+    crc = ::crc32(crc, reinterpret_cast<const Bytef*>(path.data()), static_cast<uInt>(path.size()));
+    crc = ::crc32(crc, reinterpret_cast<const Bytef*>(data.data()), static_cast<uInt>(data.size()));
+    return static_cast<uint32_t>(crc);
+}
+
+// 从 p 开始解析一条记录；返回值: 1 成功, 0 数据不足, -1 数据损坏
+int decodeRecord(const char* p, size_t available, LogRecord& record, size_t& consumed) {
+    if (available < kHeaderSize) {
+        return 0;
+    }
+    if (getU32(p) != kRecordMagic) {
+        return -1;
+    }
+    uint32_t pathLen = getU32(p + 21);
+    uint32_t dataLen = getU32(p + 25);
+    if (pathLen > kMaxPathLength || dataLen > kMaxDataLength) {
+        return -1;
+    }
+    size_t total = kHeaderSize + pathLen + dataLen;
+    if (available < total) {
+        return 0;
+    }
+
+    record.seq = getU64(p + 4);
+    record.timestampMs = static_cast<int64_t>(getU64(p + 12));
+    record.op = static_cast<LogRecord::Op>(static_cast<uint8_t>(p[20]));
+    record.path.assign(p + kHeaderSize, pathLen);
+    record.data.assign(p + kHeaderSize + pathLen, dataLen);
+
+    if (recordChecksum(record.path, record.data) != getU32(p + 29)) {
+        return -1;
+    }
+    consumed = total;
+    return 1;
+}
+
+int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // anonymous namespace
+
+ChangeLog::ChangeLog(const fs::path& file, std::shared_ptr<Logger> logger, uint64_t segmentBytes)
+    : file_(file)
+    , logger_(logger)
+    , segmentBytes_(segmentBytes) {
+    if (file_.has_parent_path()) {
+        fs::create_directories(file_.parent_path());
+    }
+    recover();
+    if (!segments_.empty()) {
+        out_.open(segments_.back().file, std::ios::binary | std::ios::app);
+        if (!out_) {
+            throw std::runtime_error("无法打开变更日志: " + segments_.back().file.string());
+        }
+    }
+}
+
+fs::path ChangeLog::segmentPath(uint64_t firstSeq) const {
+    std::string digits = std::to_string(firstSeq);
+    fs::path path = file_;
+    path += "." + std::string(kSeqDigits - digits.size(), '0') + digits;
+    return path;
+}
+
+size_t ChangeLog::segmentOf(uint64_t seq) const {
+    auto it = std::upper_bound(segments_.begin(), segments_.end(), seq, [](uint64_t value, const Segment& segment) {
+        return value < segment.firstSeq;
+    });
+    return static_cast<size_t>(it - segments_.begin()) - 1;
+}
+
+std::vector<ChangeLog::Span> ChangeLog::spansFrom(uint64_t seq) const {
+    std::vector<Span> spans;
+    size_t first = segmentOf(seq);
+    for (size_t i = first; i < segments_.size(); i++) {
+        spans.push_back(Span{segments_[i].file, i == first ? offsets_[seq - firstSeq_] : 0, segments_[i].size});
+    }
+    return spans;
+}
+
+void ChangeLog::recover() {
+    std::error_code ec;
+    // 旧版本的单文件日志作为第一个分段接入
+    if (fs::is_regular_file(file_, ec)) {
+        uint64_t seq = 1;
+        {
+            std::ifstream in(file_, std::ios::binary);
+            char header[kHeaderSize];
+            if (in.read(header, kHeaderSize) && getU32(header) == kRecordMagic) {
+                seq = getU64(header + 4);
+            }
+        }
+        fs::rename(file_, segmentPath(seq));
+    }
+
+    {
+        fs::path base = file_;
+        base += ".base";
+        std::ifstream in(base);
+        in >> compactedBase_;
+    }
+
+    std::vector<std::pair<uint64_t, fs::path>> files;
+    std::string prefix = file_.filename().string() + ".";
+    fs::path dir = file_.has_parent_path() ? file_.parent_path() : fs::path(".");
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() == prefix.size() + kSeqDigits && name.compare(0, prefix.size(), prefix) == 0 &&
+            name.find_first_not_of("0123456789", prefix.size()) == std::string::npos) {
+            files.emplace_back(std::stoull(name.substr(prefix.size())), entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    // 启动时只读取记录头，按长度跳过路径与数据，不必把整个日志读入内存；
+    // 崩溃只会损坏尾部，因此只完整校验最后一条记录，其余记录在被读取（复制、快照）时校验
+    std::vector<std::pair<fs::path, uint64_t>> truncated;
+    for (const auto& [firstSeq, file] : files) {
+        uint64_t size = fs::file_size(file, ec);
+        uint64_t valid = ec ? 0 : scanSegment(file, size);
+        if (valid == 0) {
+            fs::remove(file, ec);
+        } else if (valid < size) {
+            truncated.emplace_back(file, size - valid);
+        }
+    }
+
+    if (!offsets_.empty()) {
+        Segment& last = segments_.back();
+        std::ifstream in(last.file, std::ios::binary);
+        std::string record(last.size - offsets_.back(), '\0');
+        in.seekg(static_cast<std::streamoff>(offsets_.back()));
+        LogRecord decoded;
+        size_t consumed = 0;
+        if (!in.read(&record[0], static_cast<std::streamsize>(record.size())) ||
+            decodeRecord(record.data(), record.size(), decoded, consumed) != 1) {
+            truncated.emplace_back(last.file, record.size());
+            last.size = offsets_.back();
+            offsets_.pop_back();
+            headSeq_--;
+            headTimestamp_ = 0;
+            if (last.size == 0) {
+                in.close();
+                fs::remove(last.file, ec);
+                segments_.pop_back();
+            }
+            if (offsets_.empty()) {
+                firstSeq_ = 1;
+                headSeq_ = 0;
+                baseMarker_ = false;
+            } else {
+                std::ifstream previous(segments_.back().file, std::ios::binary);
+                char header[kHeaderSize];
+                previous.seekg(static_cast<std::streamoff>(offsets_.back()));
+                if (previous.read(header, kHeaderSize)) {
+                    headTimestamp_ = static_cast<int64_t>(getU64(header + 12));
+                }
+            }
+        }
+    }
+
+    // 截掉崩溃时写了一半的尾部
+    for (const auto& [file, bytes] : truncated) {
+        for (const auto& segment : segments_) {
+            if (segment.file == file) {
+                logger_->warning("变更日志分段尾部损坏，截断 " + std::to_string(bytes) + " 字节: " + file.string());
+                fs::resize_file(file, segment.size, ec);
+            }
+        }
+    }
+    logger_->info("变更日志已加载，" + std::to_string(segments_.size()) + " 个分段，序号 " +
+                  std::to_string(baseSeq()) + " 至 " + std::to_string(headSeq_));
+}
+
+uint64_t ChangeLog::scanSegment(const fs::path& file, uint64_t size) {
+    std::ifstream in;
+    in.rdbuf()->pubsetbuf(nullptr, 0);
+    in.open(file, std::ios::binary);
+
+    uint64_t offset = 0;
+    char header[kHeaderSize];
+    bool first = true;
+    while (offset + kHeaderSize <= size) {
+        in.seekg(static_cast<std::streamoff>(offset));
+        if (!in.read(header, kHeaderSize) || getU32(header) != kRecordMagic) {
+            break;
+        }
+        uint32_t pathLen = getU32(header + 21);
+        uint32_t dataLen = getU32(header + 25);
+        uint64_t total = kHeaderSize + static_cast<uint64_t>(pathLen) + dataLen;
+        if (pathLen > kMaxPathLength || dataLen > kMaxDataLength || offset + total > size) {
+            break;
+        }
+        uint64_t seq = getU64(header + 4);
+        if (first) {
+            if (!offsets_.empty() && seq != headSeq_ + 1) {
+                std::error_code ec;
+                if (headSeq_ < compactedBase_) {
+                    // 之前的分段完全早于已回收的起点，是回收时未能删除的旧分段
+                    logger_->warning("丢弃回收时未能删除的变更日志分段，序号 " + std::to_string(firstSeq_) +
+                                     " 至 " + std::to_string(headSeq_));
+                    for (const auto& segment : segments_) {
+                        fs::remove(segment.file, ec);
+                    }
+                } else {
+                    // 日志中间缺失或错乱：只保留从这里开始的部分，之前的分段改名留存备查；
+                    // 日志起点随之前移，复制进度早于这里的从节点会收到 410，从快照重新初始化
+                    logger_->error("变更日志损坏：序号 " + std::to_string(headSeq_) + " 之后接着 " +
+                                   std::to_string(seq) + "，之前的分段改名为 .corrupt，从节点需要从快照重新初始化");
+                    for (const auto& segment : segments_) {
+                        fs::path corrupt = segment.file;
+                        corrupt += ".corrupt";
+                        fs::rename(segment.file, corrupt, ec);
+                    }
+                }
+                segments_.clear();
+                offsets_.clear();
+            }
+            if (offsets_.empty()) {
+                firstSeq_ = seq;
+                baseMarker_ = static_cast<LogRecord::Op>(static_cast<uint8_t>(header[20])) == LogRecord::Op::Heartbeat;
+            }
+            segments_.push_back(Segment{seq, file, 0});
+            first = false;
+        } else if (seq != headSeq_ + 1) {
+            break;
+        }
+        offsets_.push_back(offset);
+        headSeq_ = seq;
+        headTimestamp_ = static_cast<int64_t>(getU64(header + 12));
+        offset += total;
+    }
+    if (!first) {
+        segments_.back().size = offset;
+    }
+    return offset;
+}
+
+void ChangeLog::writeRecord(const LogRecord& record) {
+    std::string encoded;
+    encode(record, encoded);
+
+    bool rolled = false;
+    if (segments_.empty() || segments_.back().size >= segmentBytes_) {
+        fs::path file = segmentPath(record.seq);
+        out_.close();
+        out_.clear();
+        out_.open(file, std::ios::binary | std::ios::trunc);
+        if (!out_) {
+            throw std::runtime_error("无法创建变更日志分段: " + file.string());
+        }
+        segments_.push_back(Segment{record.seq, file, 0});
+        rolled = segments_.size() > 1;
+    }
+
+    out_.write(encoded.data(), encoded.size());
+    out_.flush();
+    if (!out_) {
+        throw std::runtime_error("写入变更日志失败");
+    }
+
+    if (offsets_.empty()) {
+        firstSeq_ = record.seq;
+        baseMarker_ = record.op == LogRecord::Op::Heartbeat;
+    }
+    offsets_.push_back(segments_.back().size);
+    segments_.back().size += encoded.size();
+    headSeq_ = record.seq;
+    headTimestamp_ = record.timestampMs;
+
+    if (rolled) {
+        compactLocked();
+    }
+}
+
+uint64_t ChangeLog::append(LogRecord::Op op, const std::string& path, const std::string& data) {
+    LogRecord record;
+    record.op = op;
+    record.path = path;
+    record.data = data;
+    record.timestampMs = nowMs();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        record.seq = headSeq_ + 1;
+        writeRecord(record);
+    }
+    newRecord_.notify_all();
+    return record.seq;
+}
+
+bool ChangeLog::appendReplicated(const LogRecord& record) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (headSeq_ != 0 && record.seq != headSeq_ + 1) {
+            return false;
+        }
+        writeRecord(record);
+    }
+    newRecord_.notify_all();
+    return true;
+}
+
+bool ChangeLog::markBase(uint64_t seq) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (headSeq_ != 0) {
+        return false;
+    }
+    LogRecord marker;
+    marker.op = LogRecord::Op::Heartbeat;
+    marker.seq = seq;
+    marker.timestampMs = nowMs();
+    writeRecord(marker);
+    compactedBase_ = seq;
+    saveCompactedBase();
+    return true;
+}
+
+uint64_t ChangeLog::headSeq() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return headSeq_;
+}
+
+uint64_t ChangeLog::baseSeq() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (offsets_.empty()) {
+        return 0;
+    }
+    // 基准标记本身不携带数据
+    return baseMarker_ ? firstSeq_ : firstSeq_ - 1;
+}
+
+int64_t ChangeLog::headTimestamp() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return headTimestamp_;
+}
+
+uint64_t ChangeLog::totalBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t total = 0;
+    for (const auto& segment : segments_) {
+        total += segment.size;
+    }
+    return total;
+}
+
+std::shared_ptr<ChangeLog::Hold> ChangeLog::hold(uint64_t seq) {
+    auto hold = std::make_shared<Hold>(seq);
+    std::lock_guard<std::mutex> lock(mutex_);
+    holds_.push_back(hold);
+    return hold;
+}
+
+uint64_t ChangeLog::compact() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return compactLocked();
+}
+
+uint64_t ChangeLog::compactLocked() {
+    // 没有保留点时，除正在写入的分段外全部回收
+    uint64_t floor = headSeq_ + 1;
+    int64_t now = nowMs();
+    for (auto it = holds_.begin(); it != holds_.end();) {
+        auto hold = it->lock();
+        if (!hold) {
+            it = holds_.erase(it);
+            continue;
+        }
+        if (!hold->expired(now)) {
+            floor = std::min(floor, hold->seq());
+        }
+        ++it;
+    }
+
+    uint64_t freed = 0;
+    size_t dropped = 0;
+    while (segments_.size() > 1 && segments_[1].firstSeq <= floor) {
+        // 读取方可能仍打开着该文件；删除失败的分段在下次启动时因与日志不连续而被清理
+        std::error_code ec;
+        fs::remove(segments_.front().file, ec);
+        offsets_.erase(offsets_.begin(), offsets_.begin() + static_cast<std::ptrdiff_t>(segments_[1].firstSeq - firstSeq_));
+        firstSeq_ = segments_[1].firstSeq;
+        baseMarker_ = false;
+        freed += segments_.front().size;
+        segments_.pop_front();
+        dropped++;
+    }
+    if (dropped > 0) {
+        compactedBase_ = firstSeq_;
+        saveCompactedBase();
+        logger_->info("变更日志回收 " + std::to_string(dropped) + " 个分段，释放 " + std::to_string(freed / 1024) +
+                      "KB，日志起点序号 " + std::to_string(firstSeq_));
+    }
+    return freed;
+}
+
+void ChangeLog::saveCompactedBase() {
+    fs::path base = file_;
+    base += ".base";
+    fs::path temp = base;
+    temp += ".tmp";
+    {
+        std::ofstream out(temp, std::ios::trunc);
+        out << compactedBase_;
+        if (!out) {
+            logger_->warning("无法写入变更日志起点: " + temp.string());
+            return;
+        }
+    }
+    std::error_code ec;
+    fs::rename(temp, base, ec);
+    if (ec) {
+        logger_->warning("无法写入变更日志起点: " + base.string() + " (" + ec.message() + ")");
+    }
+}
+
+void ChangeLog::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    out_.close();
+    out_.clear();
+    std::error_code ec;
+    for (const auto& segment : segments_) {
+        fs::remove(segment.file, ec);
+    }
+    segments_.clear();
+    offsets_.clear();
+    firstSeq_ = 1;
+    baseMarker_ = false;
+    headSeq_ = 0;
+    headTimestamp_ = 0;
+    logger_->warning("变更日志已清空");
+}
+
+std::vector<LogRecord> ChangeLog::readFrom(uint64_t fromSeq, size_t maxRecords, size_t maxBytes) const {
+    std::vector<LogRecord> records;
+
+    // 早于日志起点的记录已被回收，不能跳过它们继续读取
+    std::vector<Span> spans;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (offsets_.empty() || fromSeq < firstSeq_ || fromSeq > headSeq_) {
+            return records;
+        }
+        spans = spansFrom(fromSeq);
+    }
+
+    // 已写入的记录不会再被修改，因此读取时无需持锁
+    std::string buffer;
+    size_t bytes = 0;
+    char header[kHeaderSize];
+    for (const auto& span : spans) {
+        std::ifstream in(span.file, std::ios::binary);
+        in.seekg(static_cast<std::streamoff>(span.begin));
+        uint64_t position = span.begin;
+        while (records.size() < maxRecords && position < span.end && bytes < maxBytes) {
+            if (!in.read(header, kHeaderSize)) {
+                return records;
+            }
+            size_t bodySize = static_cast<size_t>(getU32(header + 21)) + getU32(header + 25);
+            buffer.assign(header, kHeaderSize);
+            buffer.resize(kHeaderSize + bodySize);
+            if (!in.read(&buffer[kHeaderSize], static_cast<std::streamsize>(bodySize))) {
+                return records;
+            }
+
+            LogRecord record;
+            size_t consumed = 0;
+            if (decodeRecord(buffer.data(), buffer.size(), record, consumed) != 1) {
+                logger_->error("变更日志记录损坏: " + span.file.string() + "，偏移 " + std::to_string(position));
+                return records;
+            }
+            position += consumed;
+            bytes += consumed;
+            records.push_back(std::move(record));
+        }
+        if (position < span.end) {
+            break;
+        }
+    }
+    return records;
+}
+
+bool ChangeLog::pathsAfter(uint64_t seq, std::vector<std::string>& paths) const {
+    std::vector<Span> spans;
+    std::vector<std::pair<size_t, uint64_t>> locations;    // (spans 下标, 偏移)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t base = offsets_.empty() ? 0 : (baseMarker_ ? firstSeq_ : firstSeq_ - 1);
+        if (seq < base || seq > headSeq_) {
+            return false;
+        }
+        if (seq < headSeq_) {
+            spans = spansFrom(seq + 1);
+            size_t span = 0;
+            for (uint64_t s = seq + 1; s <= headSeq_; s++) {
+                uint64_t offset = offsets_[s - firstSeq_];
+                // 进入下一个分段时偏移从头开始
+                if (!locations.empty() && offset <= locations.back().second) {
+                    span++;
+                }
+                locations.emplace_back(span, offset);
+            }
+        }
+    }
+
+    std::ifstream in;
+    size_t opened = spans.size();
+    char header[kHeaderSize];
+    for (const auto& [span, offset] : locations) {
+        if (span != opened) {
+            in.close();
+            in.clear();
+            in.open(spans[span].file, std::ios::binary);
+            opened = span;
+        }
+        in.seekg(static_cast<std::streamoff>(offset));
+        if (!in.read(header, kHeaderSize) || getU32(header) != kRecordMagic) {
+            logger_->error("变更日志记录损坏: " + spans[span].file.string() + "，偏移 " + std::to_string(offset));
+            return false;
+        }
+        if (static_cast<LogRecord::Op>(static_cast<uint8_t>(header[20])) == LogRecord::Op::Heartbeat) {
+            continue;
+        }
+        std::string path(getU32(header + 21), '\0');
+        if (!in.read(&path[0], static_cast<std::streamsize>(path.size()))) {
+            return false;
+        }
+        paths.push_back(std::move(path));
+    }
+    return true;
+}
+
+bool ChangeLog::waitForNewer(uint64_t seq, std::chrono::milliseconds timeout) const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return newRecord_.wait_for(lock, timeout, [&] { return headSeq_ > seq; });
+}
+
+void ChangeLog::encode(const LogRecord& record, std::string& out) {
+    out.reserve(out.size() + kHeaderSize + record.path.size() + record.data.size());
+    putU32(out, kRecordMagic);
+    putU64(out, record.seq);
+    putU64(out, static_cast<uint64_t>(record.timestampMs));
+    out.push_back(static_cast<char>(record.op));
+    putU32(out, static_cast<uint32_t>(record.path.size()));
+    putU32(out, static_cast<uint32_t>(record.data.size()));
+    putU32(out, recordChecksum(record.path, record.data));
+    out += record.path;
+    out += record.data;
+}
+
+void ChangeLog::Decoder::feed(const char* data, size_t size) {
+    // 丢弃已消费的前缀，避免缓冲区无限增长
+    if (offset_ > 0 && offset_ * 2 > buffer_.size()) {
+        buffer_.erase(0, offset_);
+        offset_ = 0;
+    }
+    buffer_.append(data, size);
+}
+
+bool ChangeLog::Decoder::next(LogRecord& record) {
+    if (corrupt_) {
+        return false;
+    }
+    size_t consumed = 0;
+    int result = decodeRecord(buffer_.data() + offset_, buffer_.size() - offset_, record, consumed);
+    if (result < 0) {
+        corrupt_ = true;
+        return false;
+    }
+    if (result == 0) {
+        return false;
+    }
+    offset_ += consumed;
+    return true;
+}
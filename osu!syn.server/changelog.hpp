@@ -0,0 +1,160 @@
+#pragma once
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "logger.hpp"
+
+namespace fs = std::filesystem;
+
+// 变更日志中的一条记录
+struct LogRecord {
+    enum class Op : uint8_t {
+        Put = 1,        // 写入（覆盖）文件
+        Remove = 2,     // 删除文件
+        Heartbeat = 3   // 心跳，仅在复制流中出现，不落盘
+    };
+
+    uint64_t seq = 0;           // 全局递增序号，从1开始
+    int64_t timestampMs = 0;    // 主节点写入时间（毫秒）
+    Op op = Op::Put;
+    std::string path;           // 相对于上传目录的路径
+    std::string data;           // 文件内容（Remove/Heartbeat 为空）
+};
+
+// 只追加的变更日志
+// 磁盘格式与复制流格式相同：[头部][path][data]，头部包含魔数、序号、时间戳、操作、长度和CRC32
+// 日志按大小切分为分段文件（<file>.<首条记录序号>），写满一段后滚动到新的分段。
+// 仍需要旧记录的一方（从节点、进行中的快照、索引检查点）通过保留点声明自己需要的最小序号，
+// 完全早于所有保留点的分段在滚动或 compact() 时删除，日志起点随之前移；
+// 请求更早记录的从节点收到 410，需要从快照重新初始化。
+class ChangeLog {
+public:
+    // 保留点：持有者仍需要序号不小于 seq() 的记录；释放后或过期后不再限制回收
+    class Hold {
+    public:
+        explicit Hold(uint64_t seq) : seq_(seq) {}
+
+        uint64_t seq() const { return seq_; }
+        void update(uint64_t seq) { seq_ = seq; }
+
+        // 在 expiresMs（毫秒时间戳）之后失效，0 表示一直有效
+        void expireAt(int64_t expiresMs) { expiresMs_ = expiresMs; }
+        bool expired(int64_t nowMs) const {
+            int64_t expires = expiresMs_;
+            return expires != 0 && expires < nowMs;
+        }
+
+    private:
+        std::atomic<uint64_t> seq_;
+        std::atomic<int64_t> expiresMs_{0};
+    };
+
+    static constexpr uint64_t kDefaultSegmentBytes = 64ull * 1024 * 1024;
+
+    ChangeLog(const fs::path& file, std::shared_ptr<Logger> logger, uint64_t segmentBytes = kDefaultSegmentBytes);
+
+    // 追加一条本地产生的记录，返回分配的序号
+    uint64_t append(LogRecord::Op op, const std::string& path, const std::string& data);
+
+    // 追加一条从主节点复制来的记录，保留原序号；序号必须紧接当前末尾
+    bool appendReplicated(const LogRecord& record);
+
+    // 在空日志中写入基准标记，使后续记录从 seq + 1 开始（用于从快照恢复）
+    bool markBase(uint64_t seq);
+
+    uint64_t headSeq() const;
+    int64_t headTimestamp() const;
+
+    // 日志中不再包含的最大序号：更早的数据只能通过快照获得
+    uint64_t baseSeq() const;
+
+    // 日志在磁盘上占用的字节数
+    uint64_t totalBytes() const;
+
+    // 声明仍需要序号不小于 seq 的记录，返回的保留点在释放前阻止回收这些记录
+    std::shared_ptr<Hold> hold(uint64_t seq);
+
+    // 删除完全早于所有保留点的分段（正在写入的分段除外），返回释放的字节数
+    uint64_t compact();
+
+    // 删除全部记录，日志回到空的状态（从节点从快照重新初始化前调用）
+    void reset();
+
+    // 序号大于 seq 的全部记录涉及的路径（只读取记录头与路径，不含数据）
+    // seq 早于日志起点或晚于末尾时返回 false
+    bool pathsAfter(uint64_t seq, std::vector<std::string>& paths) const;
+
+    // 读取从 fromSeq 开始的若干条记录
+    std::vector<LogRecord> readFrom(uint64_t fromSeq, size_t maxRecords, size_t maxBytes) const;
+
+    // 等待直到出现序号大于 seq 的记录，超时返回 false
+    bool waitForNewer(uint64_t seq, std::chrono::milliseconds timeout) const;
+
+    // 序列化单条记录（追加到 out）
+    static void encode(const LogRecord& record, std::string& out);
+
+    // 增量解码器：用于从网络流中逐块还原记录
+    class Decoder {
+    public:
+        void feed(const char* data, size_t size);
+        // 取出下一条完整记录；数据不足时返回 false
+        bool next(LogRecord& record);
+        bool corrupt() const { return corrupt_; }
+
+    private:
+        std::string buffer_;
+        size_t offset_ = 0;
+        bool corrupt_ = false;
+    };
+
+private:
+    struct Segment {
+        uint64_t firstSeq = 0;
+        fs::path file;
+        uint64_t size = 0;
+    };
+
+    // 记录所在的文件区间
+    struct Span {
+        fs::path file;
+        uint64_t begin = 0;
+        uint64_t end = 0;
+    };
+
+    void recover();
+    // 扫描一个分段，把其中连续的记录追加到索引；返回分段中有效数据的长度
+    uint64_t scanSegment(const fs::path& file, uint64_t size);
+    void writeRecord(const LogRecord& record);
+    uint64_t compactLocked();
+    // 把已回收到的日志起点写入 <file>.base
+    void saveCompactedBase();
+    fs::path segmentPath(uint64_t firstSeq) const;
+    // 序号为 seq 的记录所在的分段下标，seq 须在日志范围内
+    size_t segmentOf(uint64_t seq) const;
+    // 从序号为 seq 的记录开始到日志末尾的文件区间
+    std::vector<Span> spansFrom(uint64_t seq) const;
+
+    fs::path file_;
+    std::shared_ptr<Logger> logger_;
+    uint64_t segmentBytes_;
+
+    mutable std::mutex mutex_;
+    mutable std::condition_variable newRecord_;
+    std::ofstream out_;                 // 正在写入的分段（segments_ 的最后一个）
+    std::deque<Segment> segments_;
+    std::deque<uint64_t> offsets_;      // offsets_[i] 为序号 firstSeq_ + i 的记录在其分段中的偏移
+    std::vector<std::weak_ptr<Hold>> holds_;
+    uint64_t firstSeq_ = 1;
+    bool baseMarker_ = false;           // 第一条记录是否为快照恢复写入的基准标记
+    uint64_t compactedBase_ = 0;        // 已回收到的日志起点，更早的分段都应已删除；启动时据此识别回收遗留的分段
+    uint64_t headSeq_ = 0;
+    int64_t headTimestamp_ = 0;
+};
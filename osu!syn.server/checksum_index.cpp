@@ -0,0 +1,94 @@
+#include "checksum_index.hpp"
+#include <cstdio>
+#include <zlib.h>
+
+ChecksumIndex::ChecksumIndex(const fs::path& file, std::shared_ptr<Logger> logger)
+    : file_(file)
+    , logger_(logger) {
+    if (file_.has_parent_path()) {
+        fs::create_directories(file_.parent_path());
+    }
+    load();
+    out_.open(file_, std::ios::app);
+    if (!out_) {
+        throw std::runtime_error("无法打开校验和索引: " + file_.string());
+    }
+}
+
+uint32_t ChecksumIndex::compute(const std::string& content) {
+    return static_cast<uint32_t>(::crc32(0L, reinterpret_cast<const Bytef*>(content.data()),
+                                         static_cast<uInt>(content.size())));
+}
+
+void ChecksumIndex::load() {
+    std::ifstream in(file_);
+    std::string line;
+    while (std::getline(in, line)) {
+        // 崩溃时可能留下不完整的最后一行，直接忽略
+        if (line.size() > 11 && line[0] == 'P' && line[1] == ' ' && line[10] == ' ') {
+            checksums_[line.substr(11)] = static_cast<uint32_t>(std::stoul(line.substr(2, 8), nullptr, 16));
+        } else if (line.size() > 2 && line[0] == 'D' && line[1] == ' ') {
+            checksums_.erase(line.substr(2));
+        }
+    }
+    logger_->info("校验和索引已加载，共 " + std::to_string(checksums_.size()) + " 个文件");
+}
+
+void ChecksumIndex::appendLine(const std::string& line) {
+    out_ << line << '\n';
+    out_.flush();
+}
+
+void ChecksumIndex::record(const std::string& relPath, uint32_t crc) {
+    char hex[9];
+    std::snprintf(hex, sizeof(hex), "%08x", crc);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    checksums_[relPath] = crc;
+    appendLine("P " + std::string(hex) + " " + relPath);
+}
+
+void ChecksumIndex::forget(const std::string& relPath) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (checksums_.erase(relPath) > 0) {
+        appendLine("D " + relPath);
+    }
+}
+
+bool ChecksumIndex::lookup(const std::string& relPath, uint32_t& crc) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = checksums_.find(relPath);
+    if (it == checksums_.end()) {
+        return false;
+    }
+    crc = it->second;
+    return true;
+}
+
+size_t ChecksumIndex::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return checksums_.size();
+}
+
+void ChecksumIndex::compact() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fs::path temp = file_;
+    temp += ".tmp";
+
+    {
+        std::ofstream ofs(temp, std::ios::trunc);
+        char hex[9];
+        for (const auto& [path, crc] : checksums_) {
+            std::snprintf(hex, sizeof(hex), "%08x", crc);
+            ofs << "P " << hex << ' ' << path << '\n';
+        }
+        if (!ofs) {
+            logger_->error("重写校验和索引失败");
+            return;
+        }
+    }
+
+    out_.close();
+    fs::rename(temp, file_);
+    out_.open(file_, std::ios::app);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "logger.hpp"
+
+namespace fs = std::filesystem;
+
+// 存储中每个文件的 CRC32，供后台巡检发现静默损坏
+// 磁盘上是一份只追加的文本日志，每行 "P <crc十六进制> <path>" 或 "D <path>"，
+// 以最后一条为准；compact() 把当前内容重写为一份紧凑的日志
+class ChecksumIndex {
+public:
+    ChecksumIndex(const fs::path& file, std::shared_ptr<Logger> logger);
+
+    static uint32_t compute(const std::string& content);
+
+    void record(const std::string& relPath, uint32_t crc);
+    void forget(const std::string& relPath);
+
+    // 查询记录的校验和，没有记录时返回 false
+    bool lookup(const std::string& relPath, uint32_t& crc) const;
+
+    size_t size() const;
+
+    // 重写日志，去掉被覆盖的旧记录
+    void compact();
+
+private:
+    void load();
+    void appendLine(const std::string& line);
+
+    fs::path file_;
+    std::shared_ptr<Logger> logger_;
+
+    mutable std::mutex mutex_;
+    std::ofstream out_;
+    std::unordered_map<std::string, uint32_t> checksums_;
+};
@@ -0,0 +1,350 @@
+#include "club.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <zlib.h>
+
+namespace {
+
+// 单次响应中写给 DataSink 的块大小
+constexpr size_t kChunkBytes = 64 * 1024;
+
+std::vector<std::string> splitUsers(const std::string& value) {
+    std::vector<std::string> users;
+    size_t start = 0;
+    while (start <= value.size()) {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos) {
+            end = value.size();
+        }
+        if (end > start) {
+            users.push_back(value.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    std::sort(users.begin(), users.end());
+    users.erase(std::unique(users.begin(), users.end()), users.end());
+    return users;
+}
+
+}  // namespace
+
+ClubLists::ClubLists(std::shared_ptr<ListStore> lists,
+                     std::shared_ptr<ClusterManager> cluster,
+                     size_t maxMembers,
+                     size_t cachedClubs,
+                     std::shared_ptr<Metrics> metrics,
+                     std::shared_ptr<Logger> logger)
+    : lists_(lists)
+    , cluster_(cluster)
+    , maxMembers_(maxMembers)
+    , cachedClubs_(cachedClubs)
+    , metrics_(metrics)
+    , logger_(logger) {}
+
+void ClubLists::handleClub(const httplib::Request& req, httplib::Response& res) {
+    std::vector<std::string> users = splitUsers(req.get_param_value("users"));
+    if (users.empty()) {
+        res.status = 400;
+        res.set_content("缺少 users 参数", "text/plain; charset=utf-8");
+        return;
+    }
+    if (users.size() > maxMembers_) {
+        res.status = 400;
+        res.set_content("成员数超过上限 " + std::to_string(maxMembers_), "text/plain; charset=utf-8");
+        return;
+    }
+
+    std::string opName = req.has_param("op") ? req.get_param_value("op") : "union";
+    Op op;
+    if (opName == "union") {
+        op = Op::Union;
+    } else if (opName == "intersection") {
+        op = Op::Intersection;
+    } else {
+        res.status = 400;
+        res.set_content("op 必须是 union 或 intersection", "text/plain; charset=utf-8");
+        return;
+    }
+    bool idsOnly = req.get_param_value("format") == "ids";
+
+    std::vector<Member> current(users.size());
+    for (size_t i = 0; i < users.size(); i++) {
+        std::string errorMessage;
+        if (!loadMember(users[i], current[i], errorMessage)) {
+            if (errorMessage.empty()) {
+                res.status = 404;
+                res.set_content("用户不存在: " + users[i], "text/plain; charset=utf-8");
+            } else {
+                logger_->error("读取社团成员列表失败: " + errorMessage);
+                res.status = 502;
+                res.set_content(errorMessage, "text/plain; charset=utf-8");
+            }
+            return;
+        }
+    }
+
+    std::shared_ptr<const Result> result = compute(op, users, std::move(current));
+    metrics_->addCounter("osu_sync_club_requests_total");
+
+    res.set_header("ETag", result->etag);
+    res.set_header("X-Club-Count", std::to_string(result->sets.cardinality()));
+    if (req.get_header_value("If-None-Match") == result->etag) {
+        res.status = 304;
+        return;
+    }
+
+    // 结果可能很大，分块生成，不拼接完整的响应体
+    res.set_chunked_content_provider(
+        "application/json",
+        [result, idsOnly](size_t, httplib::DataSink& sink) {
+            std::string buffer = "[";
+            bool first = true;
+            bool ok = true;
+            BeatmapEntry entry;
+            result->sets.forEach([&](uint32_t setId) {
+                if (!ok) {
+                    return;
+                }
+                if (!first) {
+                    buffer += ',';
+                }
+                first = false;
+                if (idsOnly) {
+                    buffer += std::to_string(setId);
+                } else {
+                    entry.id = std::to_string(setId);
+                    BeatmapList::appendEntryJson(buffer, entry);
+                }
+                if (buffer.size() >= kChunkBytes) {
+                    ok = sink.write(buffer.data(), buffer.size());
+                    buffer.clear();
+                }
+            });
+            buffer += ']';
+            if (ok && sink.write(buffer.data(), buffer.size())) {
+                sink.done();
+            }
+            return ok;
+        });
+}
+
+bool ClubLists::loadMember(const std::string& username, Member& member, std::string& errorMessage) {
+    Member cached;
+    bool haveCached = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = members_.find(username);
+        if (it != members_.end()) {
+            cached = it->second;
+            haveCached = true;
+        }
+    }
+
+    std::string owner = cluster_->remoteOwnerOf(username);
+    if (!owner.empty()) {
+        return fetchRemote(owner, username, haveCached ? &cached : nullptr, member, errorMessage);
+    }
+
+    std::string tag;
+    if (!lists_->fingerprint(username, tag)) {
+        return false;
+    }
+    if (haveCached && cached.tag == tag) {
+        member = cached;
+        return true;
+    }
+
+    std::vector<uint64_t> setIds;
+    if (!lists_->loadSetIds(username, setIds, errorMessage)) {
+        return false;
+    }
+    member.tag = tag;
+    member.bitmap = std::make_shared<SetIdBitmap>(SetIdBitmap::fromSorted(setIds));
+    cacheMember(username, member);
+    return true;
+}
+
+bool ClubLists::fetchRemote(const std::string& owner, const std::string& username,
+                            const Member* cached, Member& member, std::string& errorMessage) {
+    httplib::Client client(owner);
+    client.set_connection_timeout(3, 0);
+    client.set_read_timeout(30, 0);
+
+    // 缓存仍然有效时属主只回复 304
+    httplib::Headers headers = {{"X-Cluster-Internal", "1"}};
+    if (cached) {
+        headers.emplace("If-None-Match", cached->tag);
+    }
+    auto result = client.Get("/download/" + username + "/" + username + ".json", headers);
+    if (!result) {
+        errorMessage = "无法连接成员 " + username + " 的属主 " + owner;
+        return false;
+    }
+    if (result->status == 304 && cached) {
+        member = *cached;
+        return true;
+    }
+    if (result->status == 404) {
+        return false;
+    }
+    BeatmapList list;
+    if (result->status != 200 || !BeatmapList::parse(result->body, list, errorMessage)) {
+        errorMessage = "从 " + owner + " 读取 " + username + " 的列表失败";
+        return false;
+    }
+
+    std::vector<uint64_t> setIds;
+    setIds.reserve(list.entries.size());
+    for (const auto& entry : list.entries) {
+        setIds.push_back(entry.setId);
+    }
+    member.tag = result->get_header_value("ETag");
+    member.bitmap = std::make_shared<SetIdBitmap>(SetIdBitmap::fromSorted(setIds));
+    cacheMember(username, member);
+    return true;
+}
+
+std::shared_ptr<const ClubLists::Result> ClubLists::compute(Op op, const std::vector<std::string>& members,
+                                                            std::vector<Member> current) {
+    std::string key = (op == Op::Union ? "u:" : "i:");
+    for (const auto& member : members) {
+        key += member;
+        key += ',';
+    }
+
+    std::shared_ptr<const Result> previous;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = results_.find(key);
+        if (it != results_.end()) {
+            resultLru_.splice(resultLru_.begin(), resultLru_, it->second.second);
+            previous = it->second.first;
+        }
+    }
+
+    std::vector<size_t> changed;
+    if (previous) {
+        for (size_t i = 0; i < members.size(); i++) {
+            if (previous->tags[i] != current[i].tag) {
+                changed.push_back(i);
+            }
+        }
+        if (changed.empty()) {
+            metrics_->addCounter("osu_sync_club_cache_hits_total");
+            return previous;
+        }
+    }
+
+    auto result = std::make_shared<Result>();
+    // 少数成员更新时，以上一次的结果为基础只处理这些成员的增减
+    if (previous && changed.size() * 2 <= members.size()) {
+        *result = *previous;
+        for (size_t i : changed) {
+            result->tags[i] = current[i].tag;
+            applyChange(*result, i, current[i].bitmap);
+        }
+        metrics_->addCounter("osu_sync_club_incremental_updates_total");
+    } else {
+        result->op = op;
+        result->members = members;
+        for (auto& member : current) {
+            result->tags.push_back(member.tag);
+            result->bitmaps.push_back(member.bitmap);
+        }
+        if (op == Op::Union) {
+            for (const auto& bitmap : result->bitmaps) {
+                result->sets |= *bitmap;
+            }
+        } else {
+            // 从最小的成员开始求交，中间结果最小
+            auto smallest = std::min_element(result->bitmaps.begin(), result->bitmaps.end(),
+                                             [](const auto& a, const auto& b) {
+                                                 return a->cardinality() < b->cardinality();
+                                             });
+            result->sets = **smallest;
+            for (const auto& bitmap : result->bitmaps) {
+                if (bitmap != *smallest) {
+                    result->sets &= *bitmap;
+                }
+            }
+        }
+        metrics_->addCounter("osu_sync_club_full_computes_total");
+    }
+    result->etag = resultTag(op, result->members, result->tags);
+
+    cacheResult(key, result);
+    return result;
+}
+
+void ClubLists::applyChange(Result& result, size_t index, std::shared_ptr<const SetIdBitmap> next) {
+    SetIdBitmap added = *next;
+    added -= *result.bitmaps[index];
+    SetIdBitmap removed = *result.bitmaps[index];
+    removed -= *next;
+    result.bitmaps[index] = next;
+
+    if (result.op == Op::Union) {
+        result.sets |= added;
+        // 只有其他成员都没有的谱面集才从并集中移除
+        removed.forEach([&](uint32_t setId) {
+            for (const auto& bitmap : result.bitmaps) {
+                if (bitmap->contains(setId)) {
+                    return;
+                }
+            }
+            result.sets.remove(setId);
+        });
+    } else {
+        result.sets -= removed;
+        // 新增的谱面集只有全体成员都拥有时才进入交集
+        added.forEach([&](uint32_t setId) {
+            for (const auto& bitmap : result.bitmaps) {
+                if (!bitmap->contains(setId)) {
+                    return;
+                }
+            }
+            result.sets.add(setId);
+        });
+    }
+}
+
+std::string ClubLists::resultTag(Op op, const std::vector<std::string>& members,
+                                 const std::vector<std::string>& tags) {
+    uLong crc = ::crc32(0L, Z_NULL, 0);
+    auto feed = [&crc](const std::string& s) {
+        crc = ::crc32(crc, reinterpret_cast<const Bytef*>(s.data()), static_cast<uInt>(s.size()));
+        crc = ::crc32(crc, reinterpret_cast<const Bytef*>("\n"), 1);
+    };
+    feed(op == Op::Union ? "union" : "intersection");
+    for (size_t i = 0; i < members.size(); i++) {
+        feed(members[i]);
+        feed(tags[i]);
+    }
+    char etag[16];
+    std::snprintf(etag, sizeof(etag), "\"c%08lx\"", crc);
+    return etag;
+}
+
+void ClubLists::cacheMember(const std::string& username, const Member& member) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // 成员位图只是加速用的缓存，超出上限时整体丢弃即可
+    if (members_.size() >= maxMembers_ * 4 && members_.find(username) == members_.end()) {
+        members_.clear();
+    }
+    members_[username] = member;
+}
+
+void ClubLists::cacheResult(const std::string& key, std::shared_ptr<const Result> result) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = results_.find(key);
+    if (it != results_.end()) {
+        resultLru_.erase(it->second.second);
+        results_.erase(it);
+    }
+    while (results_.size() >= cachedClubs_ && !resultLru_.empty()) {
+        results_.erase(resultLru_.back());
+        resultLru_.pop_back();
+    }
+    resultLru_.push_front(key);
+    results_[key] = {std::move(result), resultLru_.begin()};
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "httplib.h"
+#include "cluster.hpp"
+#include "list_store.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "set_id_bitmap.hpp"
+
+// 社团列表：在服务器端对多个用户的谱面集求并集（任一成员拥有）或交集（全体成员共有）
+// 每个成员的列表转换为 setId 位图并按列表版本标识缓存；
+// 结果以成员版本标识为键缓存，只有部分成员更新时按其增量修正上一次的结果。
+class ClubLists {
+public:
+    enum class Op { Union, Intersection };
+
+    ClubLists(std::shared_ptr<ListStore> lists,
+              std::shared_ptr<ClusterManager> cluster,
+              size_t maxMembers,
+              size_t cachedClubs,
+              std::shared_ptr<Metrics> metrics,
+              std::shared_ptr<Logger> logger);
+
+    // GET /club?users=a,b,c&op=union|intersection[&format=ids]
+    void handleClub(const httplib::Request& req, httplib::Response& res);
+
+private:
+    struct Member {
+        std::string tag;
+        std::shared_ptr<const SetIdBitmap> bitmap;
+    };
+
+    struct Result {
+        Op op = Op::Union;
+        std::vector<std::string> members;   // 已排序、去重
+        std::vector<std::string> tags;
+        std::vector<std::shared_ptr<const SetIdBitmap>> bitmaps;
+        SetIdBitmap sets;
+        std::string etag;
+    };
+
+    // 取得成员当前的位图；用户不存在时返回 false 且 errorMessage 为空
+    bool loadMember(const std::string& username, Member& member, std::string& errorMessage);
+    bool fetchRemote(const std::string& owner, const std::string& username,
+                     const Member* cached, Member& member, std::string& errorMessage);
+
+    std::shared_ptr<const Result> compute(Op op, const std::vector<std::string>& members,
+                                          std::vector<Member> current);
+    static void applyChange(Result& result, size_t index, std::shared_ptr<const SetIdBitmap> next);
+    static std::string resultTag(Op op, const std::vector<std::string>& members,
+                                 const std::vector<std::string>& tags);
+
+    void cacheMember(const std::string& username, const Member& member);
+    void cacheResult(const std::string& key, std::shared_ptr<const Result> result);
+
+    std::shared_ptr<ListStore> lists_;
+    std::shared_ptr<ClusterManager> cluster_;
+    size_t maxMembers_;
+    size_t cachedClubs_;
+    std::shared_ptr<Metrics> metrics_;
+    std::shared_ptr<Logger> logger_;
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, Member> members_;
+    std::unordered_map<std::string, std::pair<std::shared_ptr<const Result>, std::list<std::string>::iterator>> results_;
+    std::list<std::string> resultLru_;  // 最近使用的在前
+};
@@ -0,0 +1,420 @@
+#include "cluster.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include "server.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+constexpr auto kRetryDelay = std::chrono::seconds(5);
+
+std::string emptyOwner;
+
+} // anonymous namespace
+
+HashRing::HashRing(const std::vector<std::string>& nodes, int virtualNodes)
+    : nodes_(nodes) {
+    points_.reserve(nodes.size() * virtualNodes);
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        for (int v = 0; v < virtualNodes; ++v) {
+            points_.emplace_back(hash(nodes[i] + "#" + std::to_string(v)), i);
+        }
+    }
+    std::sort(points_.begin(), points_.end());
+}
+
+const std::string& HashRing::ownerOf(const std::string& key) const {
+    if (points_.empty()) {
+        return emptyOwner;
+    }
+    uint64_t h = hash(key);
+    auto it = std::lower_bound(points_.begin(), points_.end(), std::make_pair(h, size_t{0}));
+    if (it == points_.end()) {
+        it = points_.begin();
+    }
+    return nodes_[it->second];
+}
+
+uint64_t HashRing::hash(const std::string& key) {
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    // splitmix64 混合，使相近的虚拟节点名在环上分布均匀
+    h += 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+json ClusterMap::toJson() const {
+    return json{
+        {"epoch", epoch},
+        {"virtualNodes", virtualNodes},
+        {"hash", "fnv1a64-splitmix"},
+        {"nodes", nodes}
+    };
+}
+
+bool ClusterMap::fromJson(const json& j, ClusterMap& map, std::string& errorMessage) {
+    try {
+        ClusterMap result;
+        result.epoch = j.value("epoch", uint64_t{0});
+        result.virtualNodes = j.value("virtualNodes", 128);
+        result.nodes = j.at("nodes").get<std::vector<std::string>>();
+        if (result.virtualNodes <= 0 || result.virtualNodes > 4096) {
+            errorMessage = "virtualNodes 超出范围";
+            return false;
+        }
+        map = std::move(result);
+        return true;
+    } catch (const std::exception& e) {
+        errorMessage = "无效的集群拓扑: " + std::string(e.what());
+        return false;
+    }
+}
+
+ClusterManager::ClusterManager(const std::string& selfUrl,
+                               std::shared_ptr<Storage> storage,
+                               std::shared_ptr<Metrics> metrics,
+                               std::shared_ptr<Logger> logger)
+    : selfUrl_(selfUrl)
+    , storage_(storage)
+    , metrics_(metrics)
+    , logger_(logger) {
+    metrics_->registerGauge("osu_sync_cluster_epoch", [this] {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return static_cast<double>(map_.epoch);
+    });
+    metrics_->registerGauge("osu_sync_cluster_rebalancing", [this] { return rebalancing_ ? 1.0 : 0.0; });
+    metrics_->registerGauge("osu_sync_cluster_pending_transfers", [this] {
+        return static_cast<double>(pendingTransfers_.load());
+    });
+}
+
+ClusterManager::~ClusterManager() {
+    stopping_ = true;
+    if (rebalanceThread_.joinable()) {
+        rebalanceThread_.join();
+    }
+}
+
+void ClusterManager::load(const ClusterMap& configured, const fs::path& stateFile, bool runRebalance) {
+    stateFile_ = stateFile;
+    runRebalance_ = runRebalance;
+
+    ClusterMap map = configured;
+    std::ifstream in(stateFile_);
+    if (in) {
+        try {
+            ClusterMap saved;
+            std::string errorMessage;
+            if (ClusterMap::fromJson(json::parse(in), saved, errorMessage) && saved.epoch >= map.epoch) {
+                map = saved;
+            }
+        } catch (const std::exception& e) {
+            logger_->warning("读取集群状态失败: " + std::string(e.what()));
+        }
+    }
+
+    std::string errorMessage;
+    if (!map.nodes.empty() && !installMap(map, errorMessage)) {
+        throw std::runtime_error(errorMessage);
+    }
+}
+
+bool ClusterManager::enabled() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return !ring_.empty();
+}
+
+bool ClusterManager::installMap(const ClusterMap& map, std::string& errorMessage) {
+    if (std::find(map.nodes.begin(), map.nodes.end(), selfUrl_) == map.nodes.end()) {
+        errorMessage = "集群拓扑中不包含本节点: " + selfUrl_;
+        return false;
+    }
+
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (!ring_.empty() && map.epoch <= map_.epoch) {
+            errorMessage = "拓扑版本过旧: " + std::to_string(map.epoch) + " <= " + std::to_string(map_.epoch);
+            return false;
+        }
+        previousRing_ = ring_;
+        map_ = map;
+        ring_ = HashRing(map.nodes, map.virtualNodes);
+    }
+
+    try {
+        fs::create_directories(stateFile_.parent_path());
+        std::ofstream out(stateFile_);
+        out << map.toJson().dump(4);
+    } catch (const std::exception& e) {
+        logger_->warning("保存集群状态失败: " + std::string(e.what()));
+    }
+
+    logger_->info("已安装集群拓扑，版本 " + std::to_string(map.epoch) + "，节点数 " + std::to_string(map.nodes.size()));
+    if (runRebalance_) {
+        startRebalance();
+    }
+    return true;
+}
+
+bool ClusterManager::redirectIfRemote(const std::string& username,
+                                      const httplib::Request& req,
+                                      httplib::Response& res) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (ring_.empty() || username.empty()) {
+        return false;
+    }
+    const std::string& owner = ring_.ownerOf(username);
+    if (owner == selfUrl_) {
+        return false;
+    }
+
+    std::string target = owner + req.path;
+    if (!req.params.empty()) {
+        target += "?" + httplib::detail::params_to_query_str(req.params);
+    }
+    res.status = 307;
+    res.set_header("Location", target);
+    res.set_header("X-Cluster-Epoch", std::to_string(map_.epoch));
+    res.set_content("该用户由节点 " + owner + " 负责", "text/plain; charset=utf-8");
+    return true;
+}
+
+std::string ClusterManager::remoteOwnerOf(const std::string& username) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (ring_.empty() || username.empty()) {
+        return "";
+    }
+    const std::string& owner = ring_.ownerOf(username);
+    return owner == selfUrl_ ? "" : owner;
+}
+
+std::vector<std::string> ClusterManager::nodes() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return ring_.empty() ? std::vector<std::string>() : map_.nodes;
+}
+
+bool ClusterManager::fetchFromPreviousOwner(const std::string& username) {
+    std::string owner;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        if (previousRing_.empty()) {
+            return false;
+        }
+        owner = previousRing_.ownerOf(username);
+    }
+    if (owner == selfUrl_) {
+        return false;
+    }
+
+    httplib::Client client(owner);
+    client.set_connection_timeout(3, 0);
+    client.set_read_timeout(10, 0);
+    auto result = client.Get("/download/" + username + "/" + username + ".json",
+                             {{"X-Cluster-Internal", "1"}});
+    if (!result || result->status != 200) {
+        return false;
+    }
+
+    BeatmapList list;
+    std::string errorMessage;
+    if (!BeatmapList::parse(result->body, list, errorMessage)) {
+        logger_->error("从旧属主拉取的列表无法解析: " + errorMessage);
+        return false;
+    }
+    if (!storage_->put(ListStore::listPath(username), list.encode(), errorMessage)) {
+        logger_->error("保存从旧属主拉取的列表失败: " + errorMessage);
+        return false;
+    }
+    logger_->info("已从旧属主 " + owner + " 拉取用户 " + username + " 的列表");
+    return true;
+}
+
+void ClusterManager::handleGetMap(const httplib::Request&, httplib::Response& res) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (ring_.empty()) {
+        res.status = 404;
+        res.set_content("未启用集群模式", "text/plain; charset=utf-8");
+        return;
+    }
+    res.set_header("X-Cluster-Epoch", std::to_string(map_.epoch));
+    res.set_content(map_.toJson().dump(), "application/json");
+}
+
+void ClusterManager::handleUpdateMap(const httplib::Request& req, httplib::Response& res) {
+    ClusterMap map;
+    std::string errorMessage;
+    try {
+        if (!ClusterMap::fromJson(json::parse(req.body), map, errorMessage)) {
+            res.status = 400;
+            res.set_content(errorMessage, "text/plain; charset=utf-8");
+            return;
+        }
+    } catch (const std::exception& e) {
+        res.status = 400;
+        res.set_content("无效的JSON: " + std::string(e.what()), "text/plain; charset=utf-8");
+        return;
+    }
+
+    if (!installMap(map, errorMessage)) {
+        res.status = 409;
+        res.set_content(errorMessage, "text/plain; charset=utf-8");
+        return;
+    }
+
+    // 由收到管理请求的节点负责通知其余节点；其余节点收到后版本已相同，不会再次转发
+    if (!req.has_header("X-Cluster-Internal")) {
+        propagateMap(map);
+    }
+    res.set_content(map.toJson().dump(), "application/json");
+}
+
+void ClusterManager::propagateMap(const ClusterMap& map) {
+    std::string body = map.toJson().dump();
+    for (const auto& node : map.nodes) {
+        if (node == selfUrl_) {
+            continue;
+        }
+        httplib::Client client(node);
+        client.set_connection_timeout(3, 0);
+        httplib::Headers headers = {{"X-Cluster-Internal", "1"}, {"X-Admin-Token", Config::getAdminToken()}};
+        auto result = client.Post("/cluster", headers, body, "application/json");
+        if (!result || (result->status != 200 && result->status != 409)) {
+            logger_->warning("通知节点 " + node + " 新拓扑失败");
+        }
+    }
+}
+
+std::string ClusterManager::usernameForPath(const fs::path& relPath) {
+    auto it = relPath.begin();
+    if (it == relPath.end()) {
+        return "";
+    }
+    fs::path first = *it;
+    if (++it == relPath.end()) {
+        return first.extension() == ".json" || first.extension() == ".list" ? first.stem().string() : "";
+    }
+    return first.string();
+}
+
+void ClusterManager::startRebalance() {
+    std::lock_guard<std::mutex> lock(rebalanceMutex_);
+    rebalanceGeneration_++;
+    if (rebalancing_.exchange(true)) {
+        return;  // 正在运行的再平衡线程会在本轮结束后发现新版本
+    }
+    if (rebalanceThread_.joinable()) {
+        rebalanceThread_.join();
+    }
+    rebalanceThread_ = std::thread([this] { rebalanceLoop(); });
+}
+
+void ClusterManager::rebalanceLoop() {
+    logger_->info("开始集群再平衡");
+    while (!stopping_) {
+        uint64_t generation = rebalanceGeneration_;
+        bool complete = rebalancePass();
+
+        {
+            std::lock_guard<std::mutex> lock(rebalanceMutex_);
+            if (complete && generation == rebalanceGeneration_) {
+                rebalancing_ = false;
+                logger_->info("集群再平衡完成");
+                return;
+            }
+        }
+        // 等待重试时不持有 rebalanceMutex_，新的拓扑可以随时安装
+        if (!complete) {
+            std::this_thread::sleep_for(kRetryDelay);
+        }
+    }
+    rebalancing_ = false;
+}
+
+bool ClusterManager::rebalancePass() {
+    // 遍历目录期间不持有锁：只取当前哈希环的副本，拓扑在此期间变化时由下一轮处理
+    HashRing ring;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        ring = ring_;
+    }
+
+    // 收集不再归本节点所有的文件
+    std::vector<std::pair<fs::path, std::string>> moves;
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(storage_->root(), ec);
+         it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec) {
+            break;
+        }
+        if (!it->is_regular_file()) {
+            continue;
+        }
+        fs::path relPath = fs::relative(it->path(), storage_->root());
+        std::string username = usernameForPath(relPath);
+        if (username.empty()) {
+            continue;
+        }
+        const std::string& owner = ring.ownerOf(username);
+        if (owner != selfUrl_) {
+            moves.emplace_back(relPath, owner);
+        }
+    }
+    for (const auto& relPath : storage_->coldFiles()) {
+        std::string username = usernameForPath(relPath);
+        if (!username.empty() && ring.ownerOf(username) != selfUrl_) {
+            moves.emplace_back(relPath, ring.ownerOf(username));
+        }
+    }
+
+    pendingTransfers_ = moves.size();
+    bool complete = true;
+    for (const auto& [relPath, owner] : moves) {
+        if (stopping_) {
+            return false;
+        }
+        if (transferFile(relPath, owner)) {
+            metrics_->addCounter("osu_sync_cluster_transferred_files_total");
+        } else {
+            complete = false;
+        }
+        pendingTransfers_--;
+    }
+    return complete;
+}
+
+bool ClusterManager::transferFile(const fs::path& relPath, const std::string& owner) {
+    std::string content;
+    if (!storage_->read(relPath, content)) {
+        return true;  // 已被删除或移走
+    }
+
+    httplib::Client client(owner);
+    client.set_connection_timeout(3, 0);
+    client.set_write_timeout(30, 0);
+
+    httplib::MultipartFormDataItems items = {
+        {"file", content, relPath.filename().string(), "application/octet-stream"}
+    };
+    // 迁移可能包含版本历史等内部文件，属主凭管理令牌放行
+    httplib::Headers headers = {{"X-Cluster-Transfer", "1"}, {"X-Admin-Token", Config::getAdminToken()}};
+    auto result = client.Post("/upload?filepath=" + httplib::detail::encode_query_param(relPath.generic_string()),
+                              headers, items);
+    if (!result || result->status != 200) {
+        logger_->warning("迁移 " + relPath.generic_string() + " 到 " + owner + " 失败");
+        return false;
+    }
+
+    std::string errorMessage;
+    if (!storage_->remove(relPath, errorMessage)) {
+        logger_->warning("迁移后删除本地文件失败: " + errorMessage);
+    }
+    return true;
+}
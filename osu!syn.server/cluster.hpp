@@ -0,0 +1,107 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "httplib.h"
+#include "3rdparty/nlohmann/json.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "storage.hpp"
+
+// 带虚拟节点的一致性哈希环
+// 哈希算法为 FNV-1a 64 位再经 splitmix64 混合，客户端（osu!sync.core/cluster_map.cpp）必须保持一致
+class HashRing {
+public:
+    HashRing() = default;
+    HashRing(const std::vector<std::string>& nodes, int virtualNodes);
+
+    // 返回 key 所属节点，环为空时返回空字符串
+    const std::string& ownerOf(const std::string& key) const;
+    bool empty() const { return points_.empty(); }
+
+    static uint64_t hash(const std::string& key);
+
+private:
+    std::vector<std::pair<uint64_t, size_t>> points_;  // (哈希值, 节点下标)，按哈希值排序
+    std::vector<std::string> nodes_;
+};
+
+// 集群拓扑，由服务器发布、客户端缓存
+struct ClusterMap {
+    uint64_t epoch = 0;         // 每次变更递增，较大者生效
+    int virtualNodes = 128;
+    std::vector<std::string> nodes;
+
+    nlohmann::json toJson() const;
+    static bool fromJson(const nlohmann::json& j, ClusterMap& map, std::string& errorMessage);
+};
+
+// 按用户名分片的集群管理：路由判断、拓扑发布与在线再平衡
+class ClusterManager {
+public:
+    ClusterManager(const std::string& selfUrl,
+                   std::shared_ptr<Storage> storage,
+                   std::shared_ptr<Metrics> metrics,
+                   std::shared_ptr<Logger> logger);
+    ~ClusterManager();
+
+    // 载入配置中的拓扑，若状态文件中保存了更新的拓扑则以其为准
+    void load(const ClusterMap& configured, const fs::path& stateFile, bool runRebalance);
+
+    bool enabled() const;
+
+    // 若用户不归本节点所有，写入 307 重定向到属主并返回 true
+    bool redirectIfRemote(const std::string& username, const httplib::Request& req, httplib::Response& res) const;
+
+    // 用户的属主地址；归本节点所有或未启用分片时返回空字符串
+    std::string remoteOwnerOf(const std::string& username) const;
+
+    // 当前拓扑中的全部节点（含本节点），未启用分片时为空
+    std::vector<std::string> nodes() const;
+    const std::string& selfUrl() const { return selfUrl_; }
+
+    // 再平衡期间本地缺失时，从上一版拓扑中的属主拉取该用户的列表
+    bool fetchFromPreviousOwner(const std::string& username);
+
+    // GET /cluster
+    void handleGetMap(const httplib::Request& req, httplib::Response& res) const;
+
+    // POST /cluster（管理接口）：安装新拓扑并开始再平衡
+    void handleUpdateMap(const httplib::Request& req, httplib::Response& res);
+
+    // 由存储路径推出所属用户：顶层 <user>.json 或 <user>/ 下的任意文件
+    static std::string usernameForPath(const fs::path& relPath);
+
+private:
+    bool installMap(const ClusterMap& map, std::string& errorMessage);
+    void propagateMap(const ClusterMap& map);
+    void startRebalance();
+    void rebalanceLoop();
+    bool rebalancePass();
+    bool transferFile(const fs::path& relPath, const std::string& owner);
+
+    std::string selfUrl_;
+    std::shared_ptr<Storage> storage_;
+    std::shared_ptr<Metrics> metrics_;
+    std::shared_ptr<Logger> logger_;
+    fs::path stateFile_;
+    bool runRebalance_ = false;
+
+    mutable std::shared_mutex mutex_;
+    ClusterMap map_;
+    HashRing ring_;
+    HashRing previousRing_;
+
+    std::mutex rebalanceMutex_;
+    std::thread rebalanceThread_;
+    std::atomic<bool> stopping_{false};
+    std::atomic<bool> rebalancing_{false};
+    std::atomic<uint64_t> rebalanceGeneration_{0};
+    std::atomic<uint64_t> pendingTransfers_{0};
+};
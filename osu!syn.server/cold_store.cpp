@@ -0,0 +1,390 @@
+#include "cold_store.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include <zlib.h>
+#include "binary_io.hpp"
+#include "checksum_index.hpp"
+
+using binary_io::getU32;
+using binary_io::putU32;
+using binary_io::putU64;
+
+namespace {
+
+constexpr uint32_t kEntryMagic = 0x4B50534F; // "OSPK"
+constexpr size_t kEntryHeaderSize = 4 + 4 + 8 + 8 + 4;
+
+uint64_t entryBytes(const std::string& relPath, uint64_t compressed) {
+    return kEntryHeaderSize + relPath.size() + compressed;
+}
+
+// 打包文件名中的序号，不是打包文件时返回 0
+uint32_t packNumber(const fs::path& path) {
+    std::string stem = path.stem().string();
+    if (path.extension() != ".pack" || stem.size() <= 5 || stem.compare(0, 5, "pack-") != 0 ||
+        stem.find_first_not_of("0123456789", 5) != std::string::npos) {
+        return 0;
+    }
+    return static_cast<uint32_t>(std::stoul(stem.substr(5)));
+}
+
+} // anonymous namespace
+
+ColdStore::ColdStore(const fs::path& dir,
+                     std::shared_ptr<Logger> logger,
+                     std::shared_ptr<DictionaryStore> dictionaries)
+    : dir_(dir)
+    , logger_(logger)
+    , dictionaries_(dictionaries) {
+    fs::create_directories(dir_);
+    load();
+    loadAccessTimes();
+}
+
+fs::path ColdStore::packPath(uint32_t pack) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "pack-%08u.pack", pack);
+    return dir_ / name;
+}
+
+void ColdStore::load() {
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir_, ec)) {
+        uint32_t number = packNumber(entry.path());
+        if (number == 0) {
+            continue;
+        }
+        packs_[number].bytes = entry.file_size(ec);
+        nextPack_ = std::max(nextPack_, number + 1);
+    }
+
+    std::ifstream in(dir_ / "index.log");
+    std::string line;
+    while (std::getline(in, line)) {
+        // 崩溃时可能留下不完整的最后一行，直接忽略
+        if (line.size() > 2 && line[0] == 'D' && line[1] == ' ') {
+            entries_.erase(line.substr(2));
+            continue;
+        }
+        if (line.size() < 2 || line[0] != 'P' || line[1] != ' ') {
+            continue;
+        }
+        std::istringstream fields(line.substr(2));
+        Entry entry;
+        std::string crc;
+        if (!(fields >> entry.pack >> entry.offset >> entry.size >> entry.compressed >> crc) || fields.get() != ' ') {
+            continue;
+        }
+        std::string relPath;
+        std::getline(fields, relPath);
+        if (relPath.empty() || crc.size() != 8) {
+            continue;
+        }
+        entry.crc = static_cast<uint32_t>(std::stoul(crc, nullptr, 16));
+        entries_[relPath] = entry;
+    }
+
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        auto pack = packs_.find(it->second.pack);
+        if (pack == packs_.end() ||
+            it->second.offset + entryBytes(it->first, it->second.compressed) > pack->second.bytes) {
+            logger_->error("冷层条目指向缺失或不完整的打包文件: " + it->first);
+            it = entries_.erase(it);
+            continue;
+        }
+        pack->second.live++;
+        pack->second.liveBytes += entryBytes(it->first, it->second.compressed);
+        ++it;
+    }
+
+    // 写入索引之前崩溃留下的打包文件没有任何存活条目
+    for (auto it = packs_.begin(); it != packs_.end();) {
+        if (it->second.live == 0) {
+            fs::remove(packPath(it->first), ec);
+            it = packs_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    rewriteIndex();
+    logger_->info("冷层已加载: " + std::to_string(entries_.size()) + " 个文件，" +
+                  std::to_string(packs_.size()) + " 个打包文件");
+}
+
+void ColdStore::appendLine(const std::string& line) {
+    out_ << line << '\n';
+    out_.flush();
+}
+
+void ColdStore::rewriteIndex() {
+    fs::path file = dir_ / "index.log";
+    fs::path temp = file;
+    temp += ".tmp";
+
+    {
+        std::ofstream ofs(temp, std::ios::trunc);
+        char crc[9];
+        for (const auto& [relPath, entry] : entries_) {
+            std::snprintf(crc, sizeof(crc), "%08x", entry.crc);
+            ofs << "P " << entry.pack << ' ' << entry.offset << ' ' << entry.size << ' '
+                << entry.compressed << ' ' << crc << ' ' << relPath << '\n';
+        }
+        if (!ofs) {
+            logger_->error("重写冷层索引失败");
+            if (!out_.is_open()) {
+                out_.open(file, std::ios::app);
+            }
+            return;
+        }
+    }
+
+    out_.close();
+    fs::rename(temp, file);
+    out_.open(file, std::ios::app);
+    if (!out_) {
+        throw std::runtime_error("无法打开冷层索引: " + file.string());
+    }
+}
+
+bool ColdStore::contains(const std::string& relPath) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.count(relPath) > 0;
+}
+
+bool ColdStore::read(const std::string& relPath, std::string& content) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(relPath);
+    return it != entries_.end() && readLocked(relPath, it->second, content);
+}
+
+bool ColdStore::readLocked(const std::string& relPath, const Entry& entry, std::string& content) const {
+    std::ifstream in(packPath(entry.pack), std::ios::binary);
+    std::string buffer(entryBytes(relPath, entry.compressed), '\0');
+    in.seekg(static_cast<std::streamoff>(entry.offset));
+    if (!in.read(&buffer[0], static_cast<std::streamsize>(buffer.size())) ||
+        getU32(buffer.data()) != kEntryMagic ||
+        buffer.compare(kEntryHeaderSize, relPath.size(), relPath) != 0) {
+        logger_->error("冷层条目损坏: " + relPath);
+        return false;
+    }
+
+    std::string raw;
+    const char* compressed = buffer.data() + kEntryHeaderSize + relPath.size();
+    bool ok;
+    if (dictionaries_) {
+        ok = dictionaries_->decompress(compressed, entry.compressed, entry.size, raw);
+    } else {
+        raw.assign(entry.size, '\0');
+        uLongf rawSize = static_cast<uLongf>(entry.size);
+        ok = uncompress(reinterpret_cast<Bytef*>(entry.size ? &raw[0] : nullptr), &rawSize,
+                        reinterpret_cast<const Bytef*>(compressed), static_cast<uLong>(entry.compressed)) == Z_OK &&
+             rawSize == entry.size;
+    }
+    if (!ok || ChecksumIndex::compute(raw) != entry.crc) {
+        logger_->error("冷层条目校验失败: " + relPath);
+        return false;
+    }
+    content = std::move(raw);
+    return true;
+}
+
+bool ColdStore::add(const std::vector<std::pair<std::string, std::string>>& files, std::string& errorMessage) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return writePack(files, errorMessage);
+}
+
+bool ColdStore::writePack(const std::vector<std::pair<std::string, std::string>>& files,
+                          std::string& errorMessage) {
+    uint32_t number = nextPack_++;
+    std::string out;
+    std::vector<std::pair<std::string, Entry>> written;
+    auto dictionary = dictionaries_ ? dictionaries_->current() : nullptr;
+    for (const auto& [relPath, raw] : files) {
+        std::string compressed;
+        // 冷层很少读取，用最高压缩级别换取空间
+        if (!DictionaryStore::compress(raw, dictionary.get(), Z_BEST_COMPRESSION, compressed)) {
+            errorMessage = "压缩失败: " + relPath;
+            return false;
+        }
+
+        Entry entry;
+        entry.pack = number;
+        entry.offset = out.size();
+        entry.size = raw.size();
+        entry.compressed = compressed.size();
+        entry.crc = ChecksumIndex::compute(raw);
+        putU32(out, kEntryMagic);
+        putU32(out, static_cast<uint32_t>(relPath.size()));
+        putU64(out, entry.size);
+        putU64(out, entry.compressed);
+        putU32(out, entry.crc);
+        out += relPath;
+        out += compressed;
+        written.emplace_back(relPath, entry);
+    }
+
+    fs::path target = packPath(number);
+    fs::path temp = target;
+    temp += ".tmp";
+    std::ofstream ofs(temp, std::ios::binary | std::ios::trunc);
+    ofs.write(out.data(), static_cast<std::streamsize>(out.size()));
+    ofs.close();
+    std::error_code ec;
+    if (!ofs || (fs::rename(temp, target, ec), ec)) {
+        fs::remove(temp, ec);
+        errorMessage = "写入冷层打包文件失败: " + target.string();
+        return false;
+    }
+
+    Pack& pack = packs_[number];
+    pack.bytes = out.size();
+    char crc[9];
+    for (const auto& [relPath, entry] : written) {
+        forgetLocked(relPath);
+        entries_[relPath] = entry;
+        pack.live++;
+        pack.liveBytes += entryBytes(relPath, entry.compressed);
+        std::snprintf(crc, sizeof(crc), "%08x", entry.crc);
+        appendLine("P " + std::to_string(number) + " " + std::to_string(entry.offset) + " " +
+                   std::to_string(entry.size) + " " + std::to_string(entry.compressed) + " " + crc + " " + relPath);
+    }
+    return true;
+}
+
+void ColdStore::forgetLocked(const std::string& relPath) {
+    auto it = entries_.find(relPath);
+    if (it == entries_.end()) {
+        return;
+    }
+    Pack& pack = packs_[it->second.pack];
+    pack.live--;
+    pack.liveBytes -= entryBytes(relPath, it->second.compressed);
+    entries_.erase(it);
+}
+
+void ColdStore::forget(const std::string& relPath) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.count(relPath) > 0) {
+        forgetLocked(relPath);
+        appendLine("D " + relPath);
+    }
+}
+
+std::vector<std::pair<std::string, uint64_t>> ColdStore::entries() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::pair<std::string, uint64_t>> result;
+    result.reserve(entries_.size());
+    for (const auto& [relPath, entry] : entries_) {
+        result.emplace_back(relPath, entry.size);
+    }
+    return result;
+}
+
+size_t ColdStore::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+uint64_t ColdStore::packedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t bytes = 0;
+    for (const auto& [number, pack] : packs_) {
+        bytes += pack.bytes;
+    }
+    return bytes;
+}
+
+void ColdStore::compact() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<uint32_t> sparse;
+    std::vector<std::pair<std::string, std::string>> survivors;
+    for (const auto& [number, pack] : packs_) {
+        if (pack.live == 0 || pack.liveBytes * 2 >= pack.bytes) {
+            continue;
+        }
+        sparse.push_back(number);
+    }
+    for (const auto& [relPath, entry] : entries_) {
+        if (std::find(sparse.begin(), sparse.end(), entry.pack) == sparse.end()) {
+            continue;
+        }
+        std::string content;
+        if (!readLocked(relPath, entry, content)) {
+            return;     // 不丢弃读不出的条目，留待下次整理
+        }
+        survivors.emplace_back(relPath, std::move(content));
+    }
+
+    std::string errorMessage;
+    if (!survivors.empty() && !writePack(survivors, errorMessage)) {
+        logger_->error("整理冷层失败: " + errorMessage);
+        return;
+    }
+
+    size_t removed = 0;
+    std::error_code ec;
+    for (auto it = packs_.begin(); it != packs_.end();) {
+        if (it->second.live == 0) {
+            fs::remove(packPath(it->first), ec);
+            it = packs_.erase(it);
+            removed++;
+        } else {
+            ++it;
+        }
+    }
+    rewriteIndex();
+    if (removed > 0) {
+        logger_->info("冷层整理完成: 删除 " + std::to_string(removed) + " 个打包文件，重写 " +
+                      std::to_string(survivors.size()) + " 个条目");
+    }
+}
+
+void ColdStore::recordAccess(const std::string& relPath, int64_t seconds) {
+    std::lock_guard<std::mutex> lock(accessMutex_);
+    access_[relPath] = seconds;
+}
+
+bool ColdStore::lastAccess(const std::string& relPath, int64_t& seconds) const {
+    std::lock_guard<std::mutex> lock(accessMutex_);
+    auto it = access_.find(relPath);
+    if (it == access_.end()) {
+        return false;
+    }
+    seconds = it->second;
+    return true;
+}
+
+void ColdStore::forgetAccess(const std::string& relPath) {
+    std::lock_guard<std::mutex> lock(accessMutex_);
+    access_.erase(relPath);
+}
+
+void ColdStore::loadAccessTimes() {
+    std::ifstream in(dir_ / "access.log");
+    int64_t seconds;
+    std::string relPath;
+    while (in >> seconds && in.get() == ' ' && std::getline(in, relPath)) {
+        access_[relPath] = seconds;
+    }
+}
+
+void ColdStore::saveAccessTimes() {
+    fs::path file = dir_ / "access.log";
+    fs::path temp = file;
+    temp += ".tmp";
+    {
+        std::lock_guard<std::mutex> lock(accessMutex_);
+        std::ofstream ofs(temp, std::ios::trunc);
+        for (const auto& [relPath, seconds] : access_) {
+            ofs << seconds << ' ' << relPath << '\n';
+        }
+        if (!ofs) {
+            logger_->error("保存访问时间失败");
+            return;
+        }
+    }
+    std::error_code ec;
+    fs::rename(temp, file, ec);
+}
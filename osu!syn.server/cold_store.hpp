@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "dictionary_store.hpp"
+#include "logger.hpp"
+
+namespace fs = std::filesystem;
+
+// 冷层：长期无人访问的用户列表被压缩后追加到打包文件中，不再占用热层的目录项和空间
+//
+// 目录结构：
+//   pack-<n>.pack  条目*: u32 魔数 u32 pathLen u64 原始大小 u64 压缩大小 u32 CRC32(原始数据) path 压缩数据
+//   index.log      只追加的文本日志，每行 "P <pack> <offset> <原始大小> <压缩大小> <crc十六进制> <path>"
+//                  或 "D <path>"，以最后一条为准
+//   access.log     每行 "<unix 秒> <path>"，列表最近一次被请求的时间，由分层任务定期重写
+//
+// 热层文件存在时总是以热层为准：下沉先写冷层再删除热层文件，提升先写热层再删除冷层记录，
+// 中途崩溃最多留下一份多余的冷层副本，在该文件下次被访问、覆盖或删除时清除。
+// 冷层条目不在上传目录中，后台巡检不会扫描到，读取时按条目的 CRC 校验。
+// 提供压缩字典时新写入的条目以当前字典压缩；压缩数据为 zlib 格式，自带所用字典的 DICTID，
+// 打包格式不变，旧条目与不同字典版本的条目可以混存，整理打包文件时按当前字典重新压缩。
+class ColdStore {
+public:
+    ColdStore(const fs::path& dir,
+              std::shared_ptr<Logger> logger,
+              std::shared_ptr<DictionaryStore> dictionaries = nullptr);
+
+    bool contains(const std::string& relPath) const;
+
+    // 读取并解压冷层中的文件，不存在或校验失败时返回 false
+    bool read(const std::string& relPath, std::string& content) const;
+
+    // 把一批文件写入一个新的打包文件并登记索引
+    bool add(const std::vector<std::pair<std::string, std::string>>& files, std::string& errorMessage);
+
+    // 删除冷层中的记录（文件已回到热层、被覆盖或被删除）
+    void forget(const std::string& relPath);
+
+    // 冷层中全部文件及其原始大小
+    std::vector<std::pair<std::string, uint64_t>> entries() const;
+
+    size_t size() const;
+    uint64_t packedBytes() const;
+
+    // 最近访问时间（unix 秒）
+    void recordAccess(const std::string& relPath, int64_t seconds);
+    bool lastAccess(const std::string& relPath, int64_t& seconds) const;
+    void forgetAccess(const std::string& relPath);
+    void saveAccessTimes();
+
+    // 重写存活条目不足一半的打包文件，删除已空的打包文件，并重写索引日志
+    void compact();
+
+private:
+    struct Entry {
+        uint32_t pack = 0;
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint64_t compressed = 0;
+        uint32_t crc = 0;
+    };
+    struct Pack {
+        size_t live = 0;
+        uint64_t liveBytes = 0;     // 存活条目（含条目头）占用的字节数
+        uint64_t bytes = 0;         // 打包文件大小
+    };
+
+    void load();
+    void loadAccessTimes();
+    void appendLine(const std::string& line);
+    void forgetLocked(const std::string& relPath);
+    fs::path packPath(uint32_t pack) const;
+    bool readLocked(const std::string& relPath, const Entry& entry, std::string& content) const;
+    bool writePack(const std::vector<std::pair<std::string, std::string>>& files, std::string& errorMessage);
+    void rewriteIndex();
+
+    fs::path dir_;
+    std::shared_ptr<Logger> logger_;
+    std::shared_ptr<DictionaryStore> dictionaries_;
+
+    mutable std::mutex mutex_;
+    std::ofstream out_;
+    std::unordered_map<std::string, Entry> entries_;
+    std::map<uint32_t, Pack> packs_;
+    uint32_t nextPack_ = 1;
+
+    mutable std::mutex accessMutex_;
+    std::unordered_map<std::string, int64_t> access_;
+};
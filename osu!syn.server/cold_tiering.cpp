@@ -0,0 +1,130 @@
+#include "cold_tiering.hpp"
+#include <vector>
+
+namespace {
+
+constexpr size_t kBatchFiles = 256;
+
+bool isListPath(const fs::path& path) {
+    return path.extension() == ".list" || path.extension() == ".json";
+}
+
+} // anonymous namespace
+
+ColdTiering::ColdTiering(std::shared_ptr<Storage> storage,
+                         std::chrono::seconds coldAfter,
+                         std::chrono::seconds interval,
+                         std::shared_ptr<Metrics> metrics,
+                         std::shared_ptr<Logger> logger)
+    : storage_(storage)
+    , coldAfter_(coldAfter)
+    , interval_(interval)
+    , metrics_(metrics)
+    , logger_(logger) {
+    metrics_->registerGauge("osu_sync_cold_files", [this] {
+        return static_cast<double>(storage_->coldStore()->size());
+    });
+    metrics_->registerGauge("osu_sync_cold_packed_bytes", [this] {
+        return static_cast<double>(storage_->coldStore()->packedBytes());
+    });
+}
+
+ColdTiering::~ColdTiering() {
+    stop();
+}
+
+void ColdTiering::start() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_ || !storage_->coldStore()) {
+            return;
+        }
+        running_ = true;
+    }
+    thread_ = std::thread([this] { run(); });
+}
+
+void ColdTiering::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void ColdTiering::run() {
+    logger_->info("冷热分层已启动，" + std::to_string(coldAfter_.count() / 3600) + " 小时未访问的列表移入冷层，间隔 " +
+                  std::to_string(interval_.count()) + " 秒");
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait_for(lock, interval_, [this] { return !running_; });
+            if (!running_) {
+                break;
+            }
+        }
+        tierPass();
+    }
+    storage_->coldStore()->saveAccessTimes();
+}
+
+void ColdTiering::tierPass() {
+    const auto& cold = storage_->coldStore();
+    int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    auto fileNow = fs::file_time_type::clock::now();
+
+    std::vector<fs::path> batch;
+    size_t demoted = 0;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(storage_->root(), ec)) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_) {
+                return;
+            }
+        }
+        if (!entry.is_regular_file(ec) || !isListPath(entry.path())) {
+            continue;
+        }
+        fs::path relPath = entry.path().filename();
+        // 改写也算一次访问；没有访问记录时只看修改时间
+        auto mtime = entry.last_write_time(ec);
+        if (ec || fileNow - mtime < coldAfter_) {
+            continue;
+        }
+        int64_t accessed;
+        if (cold->lastAccess(relPath.generic_string(), accessed) && now - accessed < coldAfter_.count()) {
+            continue;
+        }
+        batch.push_back(relPath);
+        if (batch.size() >= kBatchFiles) {
+            demoteBatch(batch, demoted);
+        }
+    }
+    demoteBatch(batch, demoted);
+
+    cold->compact();
+    cold->saveAccessTimes();
+    if (demoted > 0) {
+        metrics_->addCounter("osu_sync_cold_demoted_files_total", static_cast<double>(demoted));
+        logger_->info("冷热分层完成: " + std::to_string(demoted) + " 个列表移入冷层，冷层共 " +
+                      std::to_string(cold->size()) + " 个文件");
+    }
+}
+
+void ColdTiering::demoteBatch(std::vector<fs::path>& batch, size_t& demoted) {
+    if (batch.empty()) {
+        return;
+    }
+    std::string errorMessage;
+    size_t count = storage_->demote(batch, errorMessage);
+    if (count == 0 && !errorMessage.empty()) {
+        logger_->error("移入冷层失败: " + errorMessage);
+    }
+    demoted += count;
+    batch.clear();
+}
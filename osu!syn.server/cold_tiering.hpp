@@ -0,0 +1,42 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "storage.hpp"
+
+// 冷热分层的后台任务
+// 定期找出超过 coldAfter 既没有被请求、也没有被改写的用户列表（上传目录顶层的 .list 与 .json），
+// 成批压缩进冷层的打包文件；随后整理稀疏的打包文件并保存访问时间。
+// 冷层中的列表被请求时由 Storage::touch 提升回热层。
+class ColdTiering {
+public:
+    ColdTiering(std::shared_ptr<Storage> storage,
+                std::chrono::seconds coldAfter,
+                std::chrono::seconds interval,
+                std::shared_ptr<Metrics> metrics,
+                std::shared_ptr<Logger> logger);
+    ~ColdTiering();
+
+    void start();
+    void stop();
+
+private:
+    void run();
+    void tierPass();
+    void demoteBatch(std::vector<fs::path>& batch, size_t& demoted);
+
+    std::shared_ptr<Storage> storage_;
+    std::chrono::seconds coldAfter_;
+    std::chrono::seconds interval_;
+    std::shared_ptr<Metrics> metrics_;
+    std::shared_ptr<Logger> logger_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool running_ = false;
+};
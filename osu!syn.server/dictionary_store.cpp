@@ -0,0 +1,298 @@
+#include "dictionary_store.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+#include "binary_io.hpp"
+
+using binary_io::putVarint;
+
+namespace {
+
+// 客户端 JSON 中每个条目都会出现的部分，放在字典最末尾
+constexpr char kJsonSkeleton[] =
+    "{\"id\":\"\",\"title\":\"\",\"artist\":\"\",\"creator\":\"\",\"version\":\"\",\"md5\":\"\","
+    "\"localPath\":\"\",\"downloaded\":false},{\"id\":\"\",\"title\":\"\",\"artist\":\"\",\"creator\":\"\","
+    "\"version\":\"\",\"md5\":\"\",\"localPath\":\"\",\"downloaded\":true}";
+
+constexpr size_t kMinStringLength = 3;      // deflate 的最短匹配
+constexpr size_t kMaxStringLength = 256;
+
+// 字典文件名中的版本号，不是字典文件时返回 0
+uint32_t dictVersion(const fs::path& path) {
+    std::string stem = path.stem().string();
+    if (path.extension() != ".bin" || stem.size() <= 5 || stem.compare(0, 5, "dict-") != 0 ||
+        stem.find_first_not_of("0123456789", 5) != std::string::npos) {
+        return 0;
+    }
+    return static_cast<uint32_t>(std::stoul(stem.substr(5)));
+}
+
+uint32_t dictId(const std::string& data) {
+    return static_cast<uint32_t>(::adler32(::adler32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(data.data()),
+                                           static_cast<uInt>(data.size())));
+}
+
+} // anonymous namespace
+
+DictionaryStore::DictionaryStore(const fs::path& dir, std::shared_ptr<Logger> logger)
+    : dir_(dir)
+    , logger_(logger) {
+    fs::create_directories(dir_);
+    load();
+}
+
+fs::path DictionaryStore::dictPath(uint32_t version) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "dict-%08u.bin", version);
+    return dir_ / name;
+}
+
+void DictionaryStore::load() {
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir_, ec)) {
+        uint32_t version = dictVersion(entry.path());
+        if (version == 0) {
+            continue;
+        }
+        std::ifstream in(entry.path(), std::ios::binary);
+        auto dictionary = std::make_shared<Dictionary>();
+        dictionary->version = version;
+        dictionary->data.assign((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (dictionary->data.empty() || dictionary->data.size() > kMaxSize) {
+            logger_->warning("忽略无效的压缩字典: " + entry.path().string());
+            continue;
+        }
+        dictionary->id = dictId(dictionary->data);
+        versions_[version] = std::move(dictionary);
+    }
+    if (!versions_.empty()) {
+        logger_->info("压缩字典已加载: " + std::to_string(versions_.size()) + " 个版本，当前版本 " +
+                      std::to_string(versions_.rbegin()->first));
+    }
+}
+
+std::shared_ptr<const DictionaryStore::Dictionary> DictionaryStore::current() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return versions_.empty() ? nullptr : versions_.rbegin()->second;
+}
+
+std::shared_ptr<const DictionaryStore::Dictionary> DictionaryStore::byVersion(uint32_t version) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = versions_.find(version);
+    return it == versions_.end() ? nullptr : it->second;
+}
+
+std::string DictionaryStore::build(const std::vector<BeatmapList>& samples) {
+    // 只有出现在多个列表中的片段才能在用户之间共享。同一谱面在不同用户的列表中内容相同，
+    // 除单个字符串外，把整个条目在二进制编码与 JSON 中的形式也作为候选，一次匹配即可覆盖整条记录
+    std::unordered_map<std::string, uint32_t> lists;
+    std::unordered_set<std::string> seen;
+    std::string fragment;
+    for (const auto& list : samples) {
+        seen.clear();
+        for (const auto& entry : list.entries) {
+            for (const std::string* value : {&entry.title, &entry.artist, &entry.creator, &entry.version}) {
+                if (value->size() >= kMinStringLength && value->size() <= kMaxStringLength) {
+                    seen.insert(*value);
+                }
+            }
+            // 二进制编码：title 到 md5 的连续字符串
+            fragment.clear();
+            for (const std::string* value : {&entry.title, &entry.artist, &entry.creator, &entry.version, &entry.md5}) {
+                putVarint(fragment, value->size());
+                fragment += *value;
+            }
+            if (fragment.size() <= kMaxStringLength) {
+                seen.insert(fragment);
+            }
+            // JSON：从 {"id" 到 md5，之后的 localPath 与 downloaded 因人而异
+            fragment.clear();
+            BeatmapList::appendEntryJson(fragment, entry,
+                                         BeatmapList::kFieldId | BeatmapList::kFieldTitle | BeatmapList::kFieldArtist |
+                                             BeatmapList::kFieldCreator | BeatmapList::kFieldVersion |
+                                             BeatmapList::kFieldMd5);
+            fragment.pop_back();
+            if (fragment.size() <= kMaxStringLength) {
+                seen.insert(fragment);
+            }
+        }
+        for (const auto& value : seen) {
+            lists[value]++;
+        }
+    }
+
+    std::vector<std::pair<uint64_t, const std::string*>> candidates;
+    for (const auto& [value, count] : lists) {
+        if (count >= 2) {
+            candidates.emplace_back(static_cast<uint64_t>(count - 1) * value.size(), &value);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : *a.second < *b.second;
+    });
+
+    size_t budget = kMaxSize - (sizeof(kJsonSkeleton) - 1);
+    std::vector<const std::string*> chosen;
+    for (const auto& candidate : candidates) {
+        if (candidate.second->size() > budget) {
+            continue;
+        }
+        budget -= candidate.second->size();
+        chosen.push_back(candidate.second);
+    }
+
+    std::string dictionary;
+    for (auto it = chosen.rbegin(); it != chosen.rend(); ++it) {
+        dictionary += **it;
+    }
+    dictionary += kJsonSkeleton;
+    return dictionary;
+}
+
+uint32_t DictionaryStore::train(const std::vector<BeatmapList>& samples, std::string& errorMessage) {
+    std::string data = build(samples);
+    std::lock_guard<std::mutex> trainLock(trainMutex_);
+    auto latest = current();
+    if (latest && latest->data == data) {
+        return latest->version;
+    }
+
+    auto dictionary = std::make_shared<Dictionary>();
+    dictionary->version = latest ? latest->version + 1 : 1;
+    dictionary->id = dictId(data);
+    dictionary->data = std::move(data);
+
+    fs::path target = dictPath(dictionary->version);
+    fs::path temp = target;
+    temp += ".tmp";
+    std::ofstream ofs(temp, std::ios::binary | std::ios::trunc);
+    ofs.write(dictionary->data.data(), static_cast<std::streamsize>(dictionary->data.size()));
+    ofs.close();
+    std::error_code ec;
+    if (!ofs || (fs::rename(temp, target, ec), ec)) {
+        fs::remove(temp, ec);
+        errorMessage = "写入压缩字典失败: " + target.string();
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    versions_[dictionary->version] = dictionary;
+    logger_->info("压缩字典已训练: 版本 " + std::to_string(dictionary->version) + "，" +
+                  std::to_string(dictionary->data.size()) + " 字节，样本 " + std::to_string(samples.size()) + " 个列表");
+    return dictionary->version;
+}
+
+bool DictionaryStore::compress(const std::string& raw, const Dictionary* dictionary, int level, std::string& out) {
+    z_stream stream{};
+    if (deflateInit(&stream, level) != Z_OK) {
+        return false;
+    }
+    if (dictionary && deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(dictionary->data.data()),
+                                           static_cast<uInt>(dictionary->data.size())) != Z_OK) {
+        deflateEnd(&stream);
+        return false;
+    }
+    out.resize(deflateBound(&stream, static_cast<uLong>(raw.size())));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(raw.data()));
+    stream.avail_in = static_cast<uInt>(raw.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+    int rc = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return rc == Z_STREAM_END;
+}
+
+bool DictionaryStore::decompress(const char* data, size_t size, size_t expected, std::string& out) const {
+    z_stream stream{};
+    if (inflateInit(&stream) != Z_OK) {
+        return false;
+    }
+    // 多留一个字节，解压结果比记录的长时能够发现
+    std::string raw(expected + 1, '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = static_cast<uInt>(size);
+    stream.next_out = reinterpret_cast<Bytef*>(&raw[0]);
+    stream.avail_out = static_cast<uInt>(raw.size());
+    int rc = inflate(&stream, Z_FINISH);
+    if (rc == Z_NEED_DICT) {
+        std::shared_ptr<const Dictionary> dictionary;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& [version, candidate] : versions_) {
+                if (candidate->id == stream.adler) {
+                    dictionary = candidate;
+                }
+            }
+        }
+        if (!dictionary) {
+            logger_->error("缺少压缩字典，DICTID: " + std::to_string(stream.adler));
+            inflateEnd(&stream);
+            return false;
+        }
+        inflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(dictionary->data.data()),
+                             static_cast<uInt>(dictionary->data.size()));
+        rc = inflate(&stream, Z_FINISH);
+    }
+    bool ok = rc == Z_STREAM_END && stream.total_out == expected;
+    inflateEnd(&stream);
+    if (ok) {
+        raw.resize(expected);
+        out = std::move(raw);
+    }
+    return ok;
+}
+
+void DictionaryStore::handleGet(const std::string& version, httplib::Response& res) const {
+    std::shared_ptr<const Dictionary> dictionary;
+    if (version.empty()) {
+        dictionary = current();
+    } else {
+        try {
+            dictionary = byVersion(static_cast<uint32_t>(std::stoul(version)));
+        } catch (const std::exception&) {
+            res.status = 400;
+            res.set_content("无效的字典版本", "text/plain; charset=utf-8");
+            return;
+        }
+    }
+    if (!dictionary) {
+        res.status = 404;
+        res.set_content("压缩字典不存在", "text/plain; charset=utf-8");
+        return;
+    }
+    res.set_header("X-Dictionary-Version", std::to_string(dictionary->version));
+    // 同一版本的内容永不改变
+    if (!version.empty()) {
+        res.set_header("Cache-Control", "public, max-age=31536000, immutable");
+    }
+    res.set_content(dictionary->data, "application/octet-stream");
+}
+
+DeflateStream::DeflateStream(const DictionaryStore::Dictionary* dictionary) {
+    deflateInit2(&stream_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, dictionary ? 15 : 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    if (dictionary) {
+        deflateSetDictionary(&stream_, reinterpret_cast<const Bytef*>(dictionary->data.data()),
+                             static_cast<uInt>(dictionary->data.size()));
+    }
+}
+
+DeflateStream::~DeflateStream() {
+    deflateEnd(&stream_);
+}
+
+std::string DeflateStream::compress(const std::string& data, bool finish) {
+    std::string out;
+    char buffer[16 * 1024];
+    stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream_.avail_in = static_cast<uInt>(data.size());
+    do {
+        stream_.next_out = reinterpret_cast<Bytef*>(buffer);
+        stream_.avail_out = sizeof(buffer);
+        deflate(&stream_, finish ? Z_FINISH : Z_NO_FLUSH);
+        out.append(buffer, sizeof(buffer) - stream_.avail_out);
+    } while (stream_.avail_out == 0);
+    return out;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include "httplib.h"
+#include "beatmap_list.hpp"
+#include "logger.hpp"
+
+namespace fs = std::filesystem;
+
+// 跨用户共享的 deflate 预置字典
+// 不同用户的列表大量重复同样的曲名、艺术家与谱师，单独压缩每个文件时这些重复无从利用；
+// 从已存储的列表中抽样训练一份字典，冷层条目与网络传输都以它作为 deflate 的预置字典。
+//
+// 字典按版本保存为 dict-<版本>.bin，只增不删：重新训练产生新版本，旧版本继续用于解压已有数据。
+// 压缩结果为 zlib 格式，流头部的 DICTID（字典的 Adler-32）标明所用的字典，解压时据此查找。
+// 网络传输时客户端以 Accept-Encoding: x-deflate-dict 与 X-Dictionary-Version 声明自己持有的版本，
+// 字典本身通过 GET /dictionary[/<版本>] 获取。
+class DictionaryStore {
+public:
+    static constexpr size_t kMaxSize = 32 * 1024;   // deflate 的窗口大小，更长的字典没有意义
+    static constexpr const char* kContentEncoding = "x-deflate-dict";
+
+    struct Dictionary {
+        uint32_t version = 0;
+        uint32_t id = 0;        // zlib 的 DICTID
+        std::string data;
+    };
+
+    DictionaryStore(const fs::path& dir, std::shared_ptr<Logger> logger);
+
+    // 当前版本，尚未训练时返回 nullptr
+    std::shared_ptr<const Dictionary> current() const;
+    std::shared_ptr<const Dictionary> byVersion(uint32_t version) const;
+
+    // 从样本列表训练新字典并设为当前版本（与当前版本相同时不产生新版本），返回当前版本号，失败时返回 0
+    uint32_t train(const std::vector<BeatmapList>& samples, std::string& errorMessage);
+
+    // 在多个列表中重复出现的字符串按“节省的字节数”排序装入字典，最有价值的放在末尾（距数据最近）
+    static std::string build(const std::vector<BeatmapList>& samples);
+
+    // 压缩为 zlib 格式，dictionary 为空时不使用字典
+    static bool compress(const std::string& raw, const Dictionary* dictionary, int level, std::string& out);
+    // 解压 zlib 格式的数据，按流中的 DICTID 查找字典；expected 为原始大小
+    bool decompress(const char* data, size_t size, size_t expected, std::string& out) const;
+
+    // GET /dictionary[/<版本>]，version 为空时返回当前版本
+    void handleGet(const std::string& version, httplib::Response& res) const;
+
+private:
+    fs::path dictPath(uint32_t version) const;
+    void load();
+
+    fs::path dir_;
+    std::shared_ptr<Logger> logger_;
+
+    mutable std::mutex mutex_;
+    std::map<uint32_t, std::shared_ptr<const Dictionary>> versions_;
+    std::mutex trainMutex_;     // 从分配版本号到发布期间持有，避免并发训练写出同一版本的文件
+
+};
+
+// 分块响应的流式压缩：gzip，或以预置字典压缩的 zlib 格式
+class DeflateStream {
+public:
+    // dictionary 为空时输出 gzip
+    explicit DeflateStream(const DictionaryStore::Dictionary* dictionary = nullptr);
+    ~DeflateStream();
+
+    DeflateStream(const DeflateStream&) = delete;
+    DeflateStream& operator=(const DeflateStream&) = delete;
+
+    // 压缩一块数据，finish 为 true 时结束压缩流
+    std::string compress(const std::string& data, bool finish);
+
+private:
+    z_stream stream_{};
+};
@@ -0,0 +1,797 @@
+#include "event_frontend.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr size_t kReadChunk = 64 * 1024;
+
+bool iequals(const std::string& a, const char* b) {
+    size_t n = std::strlen(b);
+    if (a.size() != n) {
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool containsToken(const std::string& value, const char* token) {
+    std::string lower = value;
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return lower.find(token) != std::string::npos;
+}
+
+// 请求或响应头的一行
+struct HeaderLine {
+    std::string name;
+    std::string value;
+    std::string raw;    // 含结尾的 \r\n
+};
+
+// 把头部（不含结尾的空行）拆成首行与各个字段
+bool splitHead(const std::string& head, std::string& startLine, std::vector<HeaderLine>& lines) {
+    size_t pos = head.find("\r\n");
+    if (pos == std::string::npos) {
+        return false;
+    }
+    startLine = head.substr(0, pos);
+    pos += 2;
+    while (pos < head.size()) {
+        size_t end = head.find("\r\n", pos);
+        if (end == std::string::npos) {
+            end = head.size();
+        }
+        std::string line = head.substr(pos, end - pos);
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            return false;
+        }
+        HeaderLine header;
+        header.name = line.substr(0, colon);
+        size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+        header.value = valueStart == std::string::npos ? "" : line.substr(valueStart);
+        while (!header.value.empty() && (header.value.back() == ' ' || header.value.back() == '\t')) {
+            header.value.pop_back();
+        }
+        header.raw = head.substr(pos, std::min(end + 2, head.size()) - pos);
+        lines.push_back(std::move(header));
+        pos = end + 2;
+    }
+    return true;
+}
+
+// 待发送的数据：已发送的前缀只记偏移，积累到一半以上时才整体前移，避免每次发送都搬动整个缓冲
+class SendBuffer {
+public:
+    const char* data() const { return buffer_.data() + offset_; }
+    size_t size() const { return buffer_.size() - offset_; }
+    bool empty() const { return size() == 0; }
+
+    void append(const char* data, size_t size) { buffer_.append(data, size); }
+    void append(const std::string& data, size_t pos = 0, size_t size = std::string::npos) {
+        buffer_.append(data, pos, size);
+    }
+    SendBuffer& operator+=(const std::string& data) {
+        buffer_ += data;
+        return *this;
+    }
+
+    void consume(size_t size) {
+        offset_ += size;
+        if (offset_ == buffer_.size()) {
+            clear();
+        } else if (offset_ > buffer_.size() / 2) {
+            buffer_.erase(0, offset_);
+            offset_ = 0;
+        }
+    }
+
+    void clear() {
+        buffer_.clear();
+        offset_ = 0;
+    }
+
+private:
+    std::string buffer_;
+    size_t offset_ = 0;
+};
+
+}  // namespace
+
+struct EventFrontend::Connection {
+    enum class State {
+        Reading,        // 等待（或正在读取）下一个请求
+        Forwarding      // 请求已转交，等待并转发响应
+    };
+
+    int client = -1;
+    int upstream = -1;
+    Endpoint clientEndpoint{this, false};
+    Endpoint upstreamEndpoint{this, true};
+    bool clientRegistered = false;
+    uint32_t clientMask = 0;
+    uint32_t upstreamMask = 0;
+    std::string peer;
+
+    State state = State::Reading;
+    std::string in;             // 从客户端读到、尚未转发的数据
+    SendBuffer toUpstream;
+    SendBuffer out;             // 待写给客户端的数据
+    std::string responseHead;   // 尚未读完头部的响应
+    bool connecting = false;
+    bool pipe = false;          // 请求体边读边转发
+    bool chunkedBody = false;   // 请求体长度未知，转发到响应结束为止
+    uint64_t bodyRemaining = 0;
+    bool headRequest = false;
+    bool keepAlive = false;
+    bool responseHeadDone = false;
+    bool upstreamDone = false;
+    bool closing = false;       // 写完 out 后关闭
+    bool dead = false;
+    std::chrono::steady_clock::time_point lastActivity = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point requestStart;     // 当前请求的第一个字节到达的时间
+};
+
+EventFrontend::EventFrontend(const Options& options, std::shared_ptr<Metrics> metrics, std::shared_ptr<Logger> logger)
+    : options_(options)
+    , metrics_(metrics)
+    , logger_(logger) {
+    metrics_->registerGauge("osu_sync_frontend_connections", [this] {
+        return static_cast<double>(connectionCount_.load());
+    });
+    metrics_->registerGauge("osu_sync_frontend_parked_connections", [this] {
+        return static_cast<double>(parkedCount_.load());
+    });
+}
+
+EventFrontend::~EventFrontend() {
+    stop();
+}
+
+std::string EventFrontend::clientAddress(const httplib::Request& req) {
+    const std::string& remote = req.remote_addr;
+    bool loopback = remote == "::1" || remote.rfind("127.", 0) == 0 || remote.rfind("::ffff:127.", 0) == 0;
+    if (loopback && req.has_header("X-Forwarded-For")) {
+        return req.get_header_value("X-Forwarded-For");
+    }
+    return remote;
+}
+
+#ifndef __linux__
+
+bool EventFrontend::supported() { return false; }
+
+bool EventFrontend::start(const std::string&, int, int, std::string& errorMessage) {
+    errorMessage = "当前平台不支持 epoll 前端";
+    return false;
+}
+
+void EventFrontend::stop() {}
+
+#else
+
+bool EventFrontend::supported() { return true; }
+
+bool EventFrontend::start(const std::string& host, int port, int upstreamPort, std::string& errorMessage) {
+    upstreamPort_ = upstreamPort;
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* result = nullptr;
+    std::string service = std::to_string(port);
+    if (getaddrinfo(host.c_str(), service.c_str(), &hints, &result) != 0 || !result) {
+        errorMessage = "无法解析监听地址: " + host;
+        return false;
+    }
+    listenFd_ = socket(result->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int yes = 1;
+    bool ok = listenFd_ >= 0 &&
+              setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) == 0 &&
+              bind(listenFd_, result->ai_addr, result->ai_addrlen) == 0 &&
+              listen(listenFd_, SOMAXCONN) == 0;
+    freeaddrinfo(result);
+    if (!ok) {
+        errorMessage = "无法监听 " + host + ":" + service + ": " + std::strerror(errno);
+        if (listenFd_ >= 0) {
+            close(listenFd_);
+            listenFd_ = -1;
+        }
+        return false;
+    }
+
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;  // 监听套接字
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenFd_, &ev);
+    ev.data.ptr = &wakeFd_;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &ev);
+
+    running_ = true;
+    thread_ = std::thread(&EventFrontend::run, this);
+    logger_->info("事件前端已启动: " + host + ":" + service + " -> 127.0.0.1:" + std::to_string(upstreamPort));
+    return true;
+}
+
+void EventFrontend::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    uint64_t one = 1;
+    if (write(wakeFd_, &one, sizeof(one)) < 0) {
+        logger_->warning("唤醒事件前端失败");
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    for (auto& entry : connections_) {
+        closeUpstream(*entry.second);
+        close(entry.second->client);
+    }
+    connections_.clear();
+    graveyard_.clear();
+    close(listenFd_);
+    close(wakeFd_);
+    close(epollFd_);
+}
+
+void EventFrontend::run() {
+    std::vector<epoll_event> events(256);
+    auto lastSweep = std::chrono::steady_clock::now();
+    while (running_) {
+        int n = epoll_wait(epollFd_, events.data(), static_cast<int>(events.size()), 1000);
+        for (int i = 0; i < n; i++) {
+            void* ptr = events[i].data.ptr;
+            if (ptr == nullptr) {
+                acceptClients();
+            } else if (ptr == &wakeFd_) {
+                break;
+            } else {
+                Endpoint* endpoint = static_cast<Endpoint*>(ptr);
+                Connection& c = *endpoint->connection;
+                if (c.dead) {
+                    continue;
+                }
+                if (endpoint->upstream) {
+                    onUpstreamEvent(c, events[i].events);
+                } else {
+                    onClientEvent(c, events[i].events);
+                }
+            }
+        }
+        graveyard_.clear();
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastSweep >= std::chrono::seconds(1)) {
+            sweep();
+            graveyard_.clear();
+            lastSweep = now;
+        }
+    }
+}
+
+void EventFrontend::acceptClients() {
+    while (true) {
+        sockaddr_storage addr{};
+        socklen_t length = sizeof(addr);
+        int fd = accept4(listenFd_, reinterpret_cast<sockaddr*>(&addr), &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;  // EAGAIN：本轮已全部接受
+        }
+        if (connections_.size() >= options_.maxConnections) {
+            close(fd);
+            metrics_->addCounter("osu_sync_frontend_rejected_connections_total");
+            continue;
+        }
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+        auto connection = std::make_unique<Connection>();
+        connection->client = fd;
+        char host[INET6_ADDRSTRLEN] = "";
+        if (addr.ss_family == AF_INET) {
+            inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(&addr)->sin_addr, host, sizeof(host));
+        } else if (addr.ss_family == AF_INET6) {
+            inet_ntop(AF_INET6, &reinterpret_cast<sockaddr_in6*>(&addr)->sin6_addr, host, sizeof(host));
+        }
+        connection->peer = host;
+
+        Connection& c = *connection;
+        connections_[fd] = std::move(connection);
+        connectionCount_ = connections_.size();
+        updateInterest(c);
+    }
+}
+
+void EventFrontend::onClientEvent(Connection& c, uint32_t events) {
+    if (events & (EPOLLHUP | EPOLLERR)) {
+        closeConnection(c);
+        return;
+    }
+    if (events & EPOLLOUT) {
+        writeClient(c);
+    }
+    if (!c.dead && (events & (EPOLLIN | EPOLLRDHUP))) {
+        readClient(c);
+    }
+    if (!c.dead) {
+        updateInterest(c);
+    }
+}
+
+void EventFrontend::onUpstreamEvent(Connection& c, uint32_t events) {
+    if (c.connecting && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(c.upstream, SOL_SOCKET, SO_ERROR, &error, &length);
+        c.connecting = false;
+        if (error != 0) {
+            logger_->error("连接上游失败: " + std::string(std::strerror(error)));
+            closeUpstream(c);
+            respondAndClose(c, 502, "Bad Gateway", "服务器暂时不可用");
+            updateInterest(c);
+            return;
+        }
+    }
+    if (!c.connecting && (events & EPOLLOUT)) {
+        writeUpstream(c);
+    }
+    if (!c.dead && c.upstream >= 0 && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        readUpstream(c);
+    }
+    if (!c.dead) {
+        updateInterest(c);
+    }
+}
+
+void EventFrontend::readClient(Connection& c) {
+    char buffer[kReadChunk];
+    while (true) {
+        // 转发请求体时上游跟不上就暂停读取；请求转交后不再读取流水线中的后续请求
+        if (c.state == Connection::State::Forwarding &&
+            (!c.pipe || c.toUpstream.size() >= options_.bufferedBodyBytes)) {
+            return;
+        }
+        ssize_t n = recv(c.client, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            c.lastActivity = std::chrono::steady_clock::now();
+            if (c.state == Connection::State::Reading && c.in.empty()) {
+                c.requestStart = c.lastActivity;
+            }
+            if (c.state == Connection::State::Forwarding && c.pipe) {
+                size_t forward = c.chunkedBody ? static_cast<size_t>(n)
+                                               : static_cast<size_t>(std::min<uint64_t>(n, c.bodyRemaining));
+                c.toUpstream.append(buffer, forward);
+                c.bodyRemaining -= c.chunkedBody ? 0 : forward;
+                c.in.append(buffer + forward, n - forward);
+                if (!c.chunkedBody && c.bodyRemaining == 0) {
+                    c.pipe = false;
+                }
+            } else {
+                c.in.append(buffer, n);
+            }
+            if (c.state == Connection::State::Reading) {
+                processRequest(c);
+                if (c.dead || c.closing) {
+                    return;
+                }
+            }
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            // 客户端已关闭：正在转发的请求也不再需要
+            closeConnection(c);
+            return;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return;
+    }
+}
+
+void EventFrontend::writeClient(Connection& c) {
+    while (!c.out.empty()) {
+        ssize_t n = send(c.client, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+        if (n > 0) {
+            c.out.consume(n);
+            c.lastActivity = std::chrono::steady_clock::now();
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        closeConnection(c);
+        return;
+    }
+    if (c.closing) {
+        closeConnection(c);
+        return;
+    }
+    if (c.state == Connection::State::Forwarding && c.upstreamDone) {
+        finishExchange(c);
+    }
+}
+
+void EventFrontend::readUpstream(Connection& c) {
+    char buffer[kReadChunk];
+    while (c.out.size() < options_.maxPendingResponseBytes) {
+        ssize_t n = recv(c.upstream, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            if (c.responseHeadDone) {
+                c.out.append(buffer, n);
+            } else {
+                c.responseHead.append(buffer, n);
+                handleResponseHead(c);
+                if (c.dead || c.closing) {
+                    return;
+                }
+            }
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        // 上游关闭：响应结束（请求都带 Connection: close）
+        closeUpstream(c);
+        c.upstreamDone = true;
+        if (!c.responseHeadDone) {
+            if (c.responseHead.empty()) {
+                respondAndClose(c, 502, "Bad Gateway", "服务器未返回响应");
+                return;
+            }
+            c.out += c.responseHead;
+            c.responseHead.clear();
+            c.keepAlive = false;
+        }
+        if (c.out.empty()) {
+            finishExchange(c);
+        }
+        return;
+    }
+}
+
+void EventFrontend::writeUpstream(Connection& c) {
+    while (!c.toUpstream.empty()) {
+        ssize_t n = send(c.upstream, c.toUpstream.data(), c.toUpstream.size(), MSG_NOSIGNAL);
+        if (n > 0) {
+            c.toUpstream.consume(n);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        // 上游提前关闭了连接（例如上传被拒绝），剩余的请求体不再需要；响应仍可读取
+        c.toUpstream.clear();
+        c.pipe = false;
+        c.chunkedBody = false;
+        c.keepAlive = false;
+        return;
+    }
+}
+
+void EventFrontend::processRequest(Connection& c) {
+    size_t end = c.in.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        if (c.in.size() > options_.maxHeaderBytes) {
+            respondAndClose(c, 431, "Request Header Fields Too Large", "请求头过大");
+        }
+        return;
+    }
+    if (end > options_.maxHeaderBytes) {
+        respondAndClose(c, 431, "Request Header Fields Too Large", "请求头过大");
+        return;
+    }
+
+    std::string head = c.in.substr(0, end);
+    std::string requestLine;
+    std::vector<HeaderLine> lines;
+    if (!splitHead(head + "\r\n", requestLine, lines)) {
+        respondAndClose(c, 400, "Bad Request", "无效的请求");
+        return;
+    }
+
+    bool http11 = requestLine.size() >= 8 && requestLine.compare(requestLine.size() - 8, 8, "HTTP/1.1") == 0;
+    bool closeRequested = false;
+    bool keepAliveRequested = false;
+    bool expectContinue = false;
+    uint64_t contentLength = 0;
+    c.chunkedBody = false;
+    for (const auto& line : lines) {
+        if (iequals(line.name, "Connection")) {
+            closeRequested = closeRequested || containsToken(line.value, "close");
+            keepAliveRequested = keepAliveRequested || containsToken(line.value, "keep-alive");
+        } else if (iequals(line.name, "Content-Length")) {
+            try {
+                contentLength = std::stoull(line.value);
+            } catch (const std::exception&) {
+                respondAndClose(c, 400, "Bad Request", "无效的 Content-Length");
+                return;
+            }
+        } else if (iequals(line.name, "Transfer-Encoding")) {
+            c.chunkedBody = containsToken(line.value, "chunked");
+        } else if (iequals(line.name, "Expect")) {
+            expectContinue = containsToken(line.value, "100-continue");
+        }
+    }
+    c.keepAlive = http11 ? !closeRequested : keepAliveRequested;
+    c.headRequest = requestLine.compare(0, 5, "HEAD ") == 0;
+
+    size_t headerLength = end + 4;
+    size_t available = c.in.size() - headerLength;
+    if (c.chunkedBody) {
+        // 分块请求体的结尾需要解析才能确定，转发到响应结束后关闭连接
+        c.keepAlive = false;
+        dispatch(c, head, headerLength, available);
+        return;
+    }
+    if (expectContinue || contentLength > options_.bufferedBodyBytes) {
+        size_t now = static_cast<size_t>(std::min<uint64_t>(available, contentLength));
+        c.bodyRemaining = contentLength - now;
+        dispatch(c, head, headerLength, now);
+        return;
+    }
+    if (available >= contentLength) {
+        c.bodyRemaining = 0;
+        dispatch(c, head, headerLength, static_cast<size_t>(contentLength));
+    }
+    // 否则请求体尚未读完，连接继续停在 epoll 中
+}
+
+bool EventFrontend::dispatch(Connection& c, const std::string& head, size_t headerLength, size_t bodyBytes) {
+    // 改写逐跳头：每个请求使用独立的回环连接
+    std::string requestLine;
+    std::vector<HeaderLine> lines;
+    splitHead(head + "\r\n", requestLine, lines);
+    std::string rewritten = requestLine + "\r\n";
+    for (const auto& line : lines) {
+        if (iequals(line.name, "Connection") || iequals(line.name, "Keep-Alive") ||
+            iequals(line.name, "X-Forwarded-For")) {
+            continue;
+        }
+        rewritten += line.raw;
+    }
+    rewritten += "Connection: close\r\nX-Forwarded-For: " + c.peer + "\r\n\r\n";
+
+    c.toUpstream.clear();
+    c.toUpstream += rewritten;
+    c.toUpstream.append(c.in, headerLength, bodyBytes);
+    c.in.erase(0, headerLength + bodyBytes);
+    c.pipe = c.chunkedBody || c.bodyRemaining > 0;
+    if (c.chunkedBody) {
+        c.toUpstream += c.in;
+        c.in.clear();
+    }
+
+    c.upstream = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(upstreamPort_));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (c.upstream < 0 ||
+        (connect(c.upstream, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 && errno != EINPROGRESS)) {
+        logger_->error("连接上游失败: " + std::string(std::strerror(errno)));
+        closeUpstream(c);
+        respondAndClose(c, 502, "Bad Gateway", "服务器暂时不可用");
+        return false;
+    }
+    c.connecting = true;
+    c.state = Connection::State::Forwarding;
+    c.responseHeadDone = false;
+    c.upstreamDone = false;
+    c.responseHead.clear();
+    metrics_->addCounter("osu_sync_frontend_requests_total");
+    updateInterest(c);
+    return true;
+}
+
+void EventFrontend::handleResponseHead(Connection& c) {
+    while (true) {
+        size_t end = c.responseHead.find("\r\n\r\n");
+        if (end == std::string::npos) {
+            if (c.responseHead.size() > options_.maxHeaderBytes) {
+                // 不认识的响应：原样转发，之后关闭
+                c.out += c.responseHead;
+                c.responseHead.clear();
+                c.responseHeadDone = true;
+                c.keepAlive = false;
+            }
+            return;
+        }
+
+        std::string statusLine;
+        std::vector<HeaderLine> lines;
+        std::string head = c.responseHead.substr(0, end + 2);
+        splitHead(head, statusLine, lines);
+
+        // 100 Continue 等中间响应原样转发，继续等待最终响应
+        if (statusLine.size() > 9 && statusLine[9] == '1') {
+            c.out.append(c.responseHead, 0, end + 4);
+            c.responseHead.erase(0, end + 4);
+            continue;
+        }
+
+        int status = statusLine.size() > 12 ? std::atoi(statusLine.c_str() + 9) : 0;
+        bool framed = c.headRequest || status == 204 || status == 304;
+        std::string rewritten = statusLine + "\r\n";
+        for (const auto& line : lines) {
+            if (iequals(line.name, "Content-Length") ||
+                (iequals(line.name, "Transfer-Encoding") && containsToken(line.value, "chunked"))) {
+                framed = true;
+            }
+            if (iequals(line.name, "Connection") || iequals(line.name, "Keep-Alive")) {
+                continue;
+            }
+            rewritten += line.raw;
+        }
+        // 没有长度信息的响应只能以关闭连接结束
+        c.keepAlive = c.keepAlive && framed;
+        rewritten += c.keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+
+        c.out += rewritten;
+        c.out.append(c.responseHead, end + 4, std::string::npos);
+        c.responseHead.clear();
+        c.responseHeadDone = true;
+        return;
+    }
+}
+
+void EventFrontend::finishExchange(Connection& c) {
+    if (!c.keepAlive || c.pipe) {
+        closeConnection(c);
+        return;
+    }
+    c.state = Connection::State::Reading;
+    c.lastActivity = std::chrono::steady_clock::now();
+    c.requestStart = c.lastActivity;
+    // 客户端可能已经发来了下一个请求
+    if (!c.in.empty()) {
+        processRequest(c);
+    }
+    if (!c.dead) {
+        updateInterest(c);
+    }
+}
+
+void EventFrontend::respondAndClose(Connection& c, int status, const std::string& reason, const std::string& body) {
+    c.out += "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n"
+             "Content-Type: text/plain; charset=utf-8\r\n"
+             "Content-Length: " + std::to_string(body.size()) + "\r\n"
+             "Connection: close\r\n\r\n" + body;
+    c.closing = true;
+    updateInterest(c);
+}
+
+void EventFrontend::updateInterest(Connection& c) {
+    if (c.dead) {
+        return;
+    }
+
+    uint32_t clientMask = 0;
+    bool wantRead = !c.closing &&
+                    (c.state == Connection::State::Reading ||
+                     (c.pipe && c.toUpstream.size() < options_.bufferedBodyBytes));
+    if (wantRead) {
+        clientMask |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (!c.out.empty() || c.closing) {
+        clientMask |= EPOLLOUT;
+    }
+    if (!c.clientRegistered || clientMask != c.clientMask) {
+        epoll_event ev{};
+        ev.events = clientMask;
+        ev.data.ptr = &c.clientEndpoint;
+        epoll_ctl(epollFd_, c.clientRegistered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, c.client, &ev);
+        c.clientRegistered = true;
+        c.clientMask = clientMask;
+    }
+
+    if (c.upstream >= 0) {
+        uint32_t upstreamMask = 0;
+        if (c.connecting || !c.toUpstream.empty()) {
+            upstreamMask |= EPOLLOUT;
+        }
+        if (!c.connecting && c.out.size() < options_.maxPendingResponseBytes) {
+            upstreamMask |= EPOLLIN;
+        }
+        if (upstreamMask != c.upstreamMask) {
+            epoll_event ev{};
+            ev.events = upstreamMask;
+            ev.data.ptr = &c.upstreamEndpoint;
+            if (c.upstreamMask == 0 && upstreamMask != 0) {
+                epoll_ctl(epollFd_, EPOLL_CTL_ADD, c.upstream, &ev);
+            } else if (upstreamMask == 0) {
+                epoll_ctl(epollFd_, EPOLL_CTL_DEL, c.upstream, nullptr);
+            } else {
+                epoll_ctl(epollFd_, EPOLL_CTL_MOD, c.upstream, &ev);
+            }
+            c.upstreamMask = upstreamMask;
+        }
+    }
+}
+
+void EventFrontend::closeUpstream(Connection& c) {
+    if (c.upstream >= 0) {
+        close(c.upstream);  // 关闭后自动从 epoll 中移除
+        c.upstream = -1;
+        c.upstreamMask = 0;
+        c.connecting = false;
+    }
+}
+
+void EventFrontend::closeConnection(Connection& c) {
+    if (c.dead) {
+        return;
+    }
+    c.dead = true;
+    closeUpstream(c);
+    close(c.client);
+    auto it = connections_.find(c.client);
+    if (it != connections_.end()) {
+        graveyard_.push_back(std::move(it->second));
+        connections_.erase(it);
+    }
+    connectionCount_ = connections_.size();
+}
+
+void EventFrontend::sweep() {
+    auto now = std::chrono::steady_clock::now();
+    auto idle = std::chrono::seconds(options_.idleTimeoutSeconds);
+    auto request = std::chrono::seconds(options_.requestTimeoutSeconds);
+
+    size_t parked = 0;
+    std::vector<Connection*> expired;
+    for (auto& entry : connections_) {
+        Connection& c = *entry.second;
+        bool expiredNow = false;
+        if (c.state == Connection::State::Reading) {
+            parked++;
+            // 空闲连接按 keep-alive 上限；读到一半的请求从第一个字节起计时，逐字节慢发也无法续期
+            expiredNow = c.in.empty() ? now - c.lastActivity > idle : now - c.requestStart > request;
+        } else if (c.pipe || !c.out.empty() || c.closing) {
+            // 请求体或响应长时间没有任何进展
+            expiredNow = now - c.lastActivity > request;
+        }
+        if (expiredNow) {
+            expired.push_back(&c);
+        }
+    }
+    for (Connection* c : expired) {
+        metrics_->addCounter("osu_sync_frontend_timeouts_total");
+        closeConnection(*c);
+    }
+    parkedCount_ = parked;
+}
+
+#endif
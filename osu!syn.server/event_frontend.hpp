@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "httplib.h"
+#include "logger.hpp"
+#include "metrics.hpp"
+
+// 基于 epoll 的前端连接层（仅 Linux）
+// httplib 为每个打开的连接占用一个工作线程，空闲的 keep-alive 连接和慢速客户端会耗尽线程池。
+// 前端在对外端口上用单个事件线程持有所有客户端连接：
+//   - 空闲连接和尚未发完请求的慢速连接只停在 epoll 中，不占用线程；
+//   - 读到完整的请求（较大的请求体、Expect: 100-continue 与分块请求体在读完请求头后）
+//     才经回环连接转交给 httplib（监听在 127.0.0.1 的临时端口），每个请求一条回环连接；
+//   - 响应由事件线程尽快读入缓冲再按客户端的速度写出，工作线程不会被慢速读取的客户端阻塞。
+// 转交的请求带有 X-Forwarded-For 头，内容为客户端地址。
+class EventFrontend {
+public:
+    struct Options {
+        size_t maxConnections = 10000;
+        int idleTimeoutSeconds = 60;        // keep-alive 连接的空闲上限
+        int requestTimeoutSeconds = 30;     // 读取一个请求（或写出响应时无进展）的时间上限
+        size_t bufferedBodyBytes = 1024 * 1024;         // 不超过此大小的请求体读完后再转交
+        size_t maxHeaderBytes = 64 * 1024;
+        size_t maxPendingResponseBytes = 8 * 1024 * 1024;  // 超过后暂停读取上游（反压）
+    };
+
+    EventFrontend(const Options& options, std::shared_ptr<Metrics> metrics, std::shared_ptr<Logger> logger);
+    ~EventFrontend();
+
+    static bool supported();
+
+    // 请求的客户端地址。只有经回环连接到达的请求（即前端转交的请求）才采信 X-Forwarded-For，
+    // 直接连到 httplib 的客户端可以随意填写该头
+    static std::string clientAddress(const httplib::Request& req);
+
+    // 监听 host:port 并把请求转交给 127.0.0.1:upstreamPort
+    bool start(const std::string& host, int port, int upstreamPort, std::string& errorMessage);
+    void stop();
+
+private:
+    struct Connection;
+    struct Endpoint {
+        Connection* connection;
+        bool upstream;
+    };
+
+    void run();
+    void acceptClients();
+    void onClientEvent(Connection& c, uint32_t events);
+    void onUpstreamEvent(Connection& c, uint32_t events);
+    void readClient(Connection& c);
+    void writeClient(Connection& c);
+    void readUpstream(Connection& c);
+    void writeUpstream(Connection& c);
+
+    // 尝试从已读数据中解析出一个完整的请求并转交
+    void processRequest(Connection& c);
+    bool dispatch(Connection& c, const std::string& head, size_t headerLength, size_t bodyBytes);
+    void handleResponseHead(Connection& c);
+    void finishExchange(Connection& c);
+    void respondAndClose(Connection& c, int status, const std::string& reason, const std::string& body);
+
+    void updateInterest(Connection& c);
+    void closeUpstream(Connection& c);
+    void closeConnection(Connection& c);
+    void sweep();
+
+    Options options_;
+    std::shared_ptr<Metrics> metrics_;
+    std::shared_ptr<Logger> logger_;
+
+    int listenFd_ = -1;
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+    int upstreamPort_ = 0;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+
+    std::unordered_map<int, std::unique_ptr<Connection>> connections_;  // 以客户端 fd 为键
+    std::vector<std::unique_ptr<Connection>> graveyard_;                // 本轮事件处理完后释放
+    std::atomic<size_t> connectionCount_{0};
+    std::atomic<size_t> parkedCount_{0};
+};
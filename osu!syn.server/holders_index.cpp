@@ -0,0 +1,417 @@
+#include "holders_index.hpp"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include "3rdparty/nlohmann/json.hpp"
+#include "binary_io.hpp"
+
+using json = nlohmann::json;
+using binary_io::getU64;
+using binary_io::getVarint;
+using binary_io::putU64;
+using binary_io::putVarint;
+
+namespace {
+
+// 路径中的 setId 只接受规范的十进制表示，且须在位图的 32 位范围内
+bool parseSetIdParam(const std::string& text, uint32_t& setId) {
+    uint64_t value = BeatmapEntry::parseSetId(text);
+    if (value > std::numeric_limits<uint32_t>::max()) {
+        return false;
+    }
+    setId = static_cast<uint32_t>(value);
+    return true;
+}
+
+size_t paramOr(const httplib::Request& req, const char* name, size_t fallback, size_t maximum) {
+    if (!req.has_param(name)) {
+        return fallback;
+    }
+    try {
+        return std::min<size_t>(std::stoul(req.get_param_value(name)), maximum);
+    } catch (const std::exception&) {
+        return fallback;
+    }
+}
+
+}  // namespace
+
+HoldersIndex::HoldersIndex(std::shared_ptr<Storage> storage,
+                           std::shared_ptr<ListStore> lists,
+                           std::shared_ptr<ClusterManager> cluster,
+                           std::shared_ptr<Logger> logger,
+                           const IndexCheckpoint* checkpoint)
+    : storage_(storage)
+    , lists_(lists)
+    , cluster_(cluster)
+    , logger_(logger) {
+    storage_->addListener([this](const fs::path& relPath, const std::string*) {
+        markDirty(relPath);
+    });
+
+    if (checkpoint && restore(*checkpoint)) {
+        return;
+    }
+
+    // 没有可用的检查点：读取已有的全部列表
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(storage_->root(), ec)) {
+        if (entry.is_regular_file(ec)) {
+            markDirty(entry.path().filename());
+        }
+    }
+    for (const auto& relPath : storage_->coldFiles()) {
+        markDirty(relPath);
+    }
+    refresh();
+    logger_->info("持有者索引已建立: " + std::to_string(userIds_.size()) + " 个用户，" +
+                  std::to_string(holders_.size()) + " 个谱面集");
+}
+
+HoldersIndex::~HoldersIndex() {
+    stop();
+}
+
+void HoldersIndex::start() {
+    {
+        std::lock_guard<std::mutex> lock(dirtyMutex_);
+        if (running_) {
+            return;
+        }
+        running_ = true;
+    }
+    thread_ = std::thread([this] { run(); });
+}
+
+void HoldersIndex::stop() {
+    {
+        std::lock_guard<std::mutex> lock(dirtyMutex_);
+        running_ = false;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void HoldersIndex::run() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(dirtyMutex_);
+            wake_.wait(lock, [this] { return !running_ || !dirty_.empty(); });
+            if (!running_) {
+                break;
+            }
+        }
+        refresh();
+    }
+}
+
+std::string HoldersIndex::serialize() {
+    // 格式：u64 用户数，每个用户 varint 长度 + 用户名、varint setId 数、按差值编码的 varint setId
+    refresh();
+    std::string out;
+    std::lock_guard<std::mutex> lock(mutex_);
+    putU64(out, userIds_.size());
+    for (const auto& [username, id] : userIds_) {
+        const SetIdBitmap& sets = sets_[id];
+        putVarint(out, username.size());
+        out += username;
+        putVarint(out, sets.cardinality());
+        uint32_t previous = 0;
+        sets.forEach([&](uint32_t setId) {
+            putVarint(out, setId - previous);
+            previous = setId;
+        });
+    }
+    return out;
+}
+
+bool HoldersIndex::restore(const IndexCheckpoint& checkpoint) {
+    auto started = std::chrono::steady_clock::now();
+    const char* data;
+    size_t size;
+    std::vector<std::string> tail;
+    if (!checkpoint.section(IndexCheckpoint::kHolders, data, size) || size < 8 ||
+        !storage_->changeLog()->pathsAfter(checkpoint.seq(), tail)) {
+        return false;
+    }
+    const char* p = data + 8;
+    const char* end = data + size;
+    uint64_t count = getU64(data);
+    if (count > size) {
+        return false;
+    }
+
+    // 先解码全部用户的 setId，再把 (setId, 用户编号) 对排序得到倒排表，内存只随条目数增长而与 setId 的取值无关
+    std::vector<std::string> names;
+    std::vector<uint32_t> setIds;
+    std::vector<size_t> starts;
+    names.reserve(count);
+    starts.reserve(count + 1);
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t length;
+        uint64_t cardinality;
+        if (!getVarint(p, end, length) || length > static_cast<uint64_t>(end - p)) {
+            return false;
+        }
+        names.emplace_back(p, static_cast<size_t>(length));
+        p += length;
+        if (!getVarint(p, end, cardinality) || cardinality == 0 || cardinality > static_cast<uint64_t>(end - p)) {
+            return false;
+        }
+        starts.push_back(setIds.size());
+        uint64_t setId = 0;
+        for (uint64_t k = 0; k < cardinality; k++) {
+            uint64_t gap;
+            if (!getVarint(p, end, gap) || (k > 0 && gap == 0) ||
+                setId + gap > std::numeric_limits<uint32_t>::max()) {
+                return false;
+            }
+            setId += gap;
+            setIds.push_back(static_cast<uint32_t>(setId));
+        }
+    }
+    starts.push_back(setIds.size());
+    if (p != end) {
+        return false;
+    }
+
+    // 高 32 位为 setId、低 32 位为用户编号，排序后同一 setId 的用户编号连续且有序
+    std::vector<uint64_t> pairs;
+    pairs.reserve(setIds.size());
+    for (uint32_t id = 0; id < names.size(); id++) {
+        for (size_t k = starts[id]; k < starts[id + 1]; k++) {
+            pairs.push_back(static_cast<uint64_t>(setIds[k]) << 32 | id);
+        }
+    }
+    std::sort(pairs.begin(), pairs.end());
+    std::vector<uint32_t> postings(pairs.size());
+    for (size_t k = 0; k < pairs.size(); k++) {
+        postings[k] = static_cast<uint32_t>(pairs[k]);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (uint32_t id = 0; id < names.size(); id++) {
+            if (!userIds_.emplace(names[id], id).second) {
+                userIds_.clear();
+                return false;
+            }
+        }
+        sets_.reserve(names.size());
+        for (uint32_t id = 0; id < names.size(); id++) {
+            sets_.push_back(SetIdBitmap::fromSorted(setIds.data() + starts[id], setIds.data() + starts[id + 1]));
+        }
+        names_ = std::move(names);
+        for (size_t begin = 0; begin < pairs.size();) {
+            uint32_t setId = static_cast<uint32_t>(pairs[begin] >> 32);
+            size_t end = begin + 1;
+            while (end < pairs.size() && static_cast<uint32_t>(pairs[end] >> 32) == setId) {
+                end++;
+            }
+            holders_.emplace(setId, SetIdBitmap::fromSorted(postings.data() + begin, postings.data() + end));
+            begin = end;
+        }
+    }
+
+    // 检查点之后写入的列表重新读取
+    for (const auto& relPath : tail) {
+        markDirty(relPath);
+    }
+    refresh();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    logger_->info("持有者索引已从检查点恢复: " + std::to_string(userIds_.size()) + " 个用户，耗时 " +
+                  std::to_string(static_cast<int>(ms)) + " 毫秒");
+    return true;
+}
+
+void HoldersIndex::markDirty(const fs::path& relPath) {
+    // 只关心顶层的用户列表
+    if (relPath.has_parent_path() || (relPath.extension() != ".list" && relPath.extension() != ".json")) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(dirtyMutex_);
+    dirty_.insert(relPath.stem().string());
+    wake_.notify_one();
+}
+
+void HoldersIndex::refresh() {
+    std::lock_guard<std::mutex> refreshLock(refreshMutex_);
+    std::unordered_set<std::string> dirty;
+    {
+        std::lock_guard<std::mutex> lock(dirtyMutex_);
+        if (dirty_.empty()) {
+            return;
+        }
+        dirty.swap(dirty_);
+    }
+    for (const auto& username : dirty) {
+        std::vector<uint64_t> setIds;
+        std::string errorMessage;
+        if (!lists_->loadSetIds(username, setIds, errorMessage) && !errorMessage.empty()) {
+            logger_->warning("更新持有者索引失败: " + errorMessage);
+        }
+        SetIdBitmap sets = SetIdBitmap::fromSorted(setIds);
+        std::lock_guard<std::mutex> lock(mutex_);
+        replace(username, std::move(sets));
+    }
+}
+
+void HoldersIndex::replace(const std::string& username, SetIdBitmap sets) {
+    auto it = userIds_.find(username);
+    if (it == userIds_.end()) {
+        if (sets.empty()) {
+            return;
+        }
+        uint32_t id;
+        if (!freeIds_.empty()) {
+            id = freeIds_.back();
+            freeIds_.pop_back();
+            names_[id] = username;
+        } else {
+            id = static_cast<uint32_t>(names_.size());
+            names_.push_back(username);
+            sets_.emplace_back();
+        }
+        it = userIds_.emplace(username, id).first;
+    }
+    uint32_t id = it->second;
+
+    SetIdBitmap removed = sets_[id];
+    removed -= sets;
+    SetIdBitmap added = sets;
+    added -= sets_[id];
+    removed.forEach([&](uint32_t setId) {
+        auto holder = holders_.find(setId);
+        if (holder != holders_.end()) {
+            holder->second.remove(id);
+            if (holder->second.empty()) {
+                holders_.erase(holder);
+            }
+        }
+    });
+    added.forEach([&](uint32_t setId) {
+        holders_[setId].add(id);
+    });
+
+    if (sets.empty()) {
+        // 列表已删除或没有在线谱面，编号留给之后的新用户
+        sets_[id] = SetIdBitmap();
+        names_[id].clear();
+        freeIds_.push_back(id);
+        userIds_.erase(it);
+        return;
+    }
+    sets_[id] = std::move(sets);
+}
+
+uint64_t HoldersIndex::collect(uint32_t setId, size_t offset, size_t limit, json& users) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto holder = holders_.find(setId);
+    if (holder == holders_.end()) {
+        return 0;
+    }
+    size_t index = 0;
+    holder->second.forEach([&](uint32_t user) {
+        if (index >= offset && index - offset < limit) {
+            users.push_back(names_[user]);
+        }
+        index++;
+    });
+    return holder->second.cardinality();
+}
+
+bool HoldersIndex::fetchRemote(const std::string& node, uint32_t setId, size_t offset, size_t limit,
+                               uint64_t& count, json& users) {
+    httplib::Client client(node);
+    client.set_connection_timeout(3, 0);
+    client.set_read_timeout(10, 0);
+    httplib::Headers headers = {{"X-Cluster-Internal", "1"}};
+    auto result = client.Get("/holders/" + std::to_string(setId) + "?offset=" + std::to_string(offset) +
+                             "&limit=" + std::to_string(limit), headers);
+    if (!result || result->status != 200) {
+        return false;
+    }
+    try {
+        json body = json::parse(result->body);
+        count = body.at("count").get<uint64_t>();
+        for (const auto& user : body.at("users")) {
+            users.push_back(user.get<std::string>());
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+void HoldersIndex::handleHolders(const std::string& setId, const httplib::Request& req, httplib::Response& res) {
+    uint32_t id;
+    if (!parseSetIdParam(setId, id)) {
+        res.status = 400;
+        res.set_content("无效的 setId", "text/plain; charset=utf-8");
+        return;
+    }
+    size_t limit = paramOr(req, "limit", 1000, 10000);
+    size_t offset = paramOr(req, "offset", 0, std::numeric_limits<size_t>::max());
+
+    json users = json::array();
+    // 来自其他分片的汇总请求只回答本分片
+    std::vector<std::string> nodes;
+    if (!req.has_header("X-Cluster-Internal")) {
+        nodes = cluster_->nodes();
+    }
+    if (nodes.empty()) {
+        uint64_t count = collect(id, offset, limit, users);
+        json response = {{"setId", id}, {"count", count}, {"users", users}};
+        res.set_content(response.dump(), "application/json");
+        return;
+    }
+
+    // 各分片按拓扑顺序拼接：依次扣除前面分片的持有者数得到每个分片内的偏移
+    uint64_t count = 0;
+    json unreachable = json::array();
+    for (const auto& node : nodes) {
+        size_t remaining = limit - std::min(limit, users.size());
+        uint64_t shardCount = 0;
+        if (node == cluster_->selfUrl()) {
+            shardCount = collect(id, offset, remaining, users);
+        } else if (!fetchRemote(node, id, offset, remaining, shardCount, users)) {
+            unreachable.push_back(node);
+            continue;
+        }
+        count += shardCount;
+        offset -= static_cast<size_t>(std::min<uint64_t>(offset, shardCount));
+    }
+    json response = {{"setId", id}, {"count", count}, {"users", users}};
+    if (!unreachable.empty()) {
+        response["unreachable"] = unreachable;
+    }
+    res.set_content(response.dump(), "application/json");
+}
+
+void HoldersIndex::handleHas(const std::string& username, const std::string& setId, httplib::Response& res) {
+    uint32_t id;
+    if (!parseSetIdParam(setId, id)) {
+        res.status = 400;
+        res.set_content("无效的 setId", "text/plain; charset=utf-8");
+        return;
+    }
+
+    bool has = false;
+    bool known = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = userIds_.find(username);
+        known = it != userIds_.end();
+        has = known && sets_[it->second].contains(id);
+    }
+    // 没有在线谱面的用户不在索引中，仍需区分“列表不存在”
+    if (!known && !lists_->exists(username)) {
+        res.status = 404;
+        res.set_content("文件未找到", "text/plain; charset=utf-8");
+        return;
+    }
+    json response = {{"user", username}, {"setId", id}, {"has", has}};
+    res.set_content(response.dump(), "application/json");
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "httplib.h"
+#include "cluster.hpp"
+#include "index_checkpoint.hpp"
+#include "list_store.hpp"
+#include "logger.hpp"
+#include "set_id_bitmap.hpp"
+#include "storage.hpp"
+
+// 谱面集持有者的倒排索引：“谁有谱面集 X”与“用户 U 是否有谱面集 X”
+// 每个用户分配一个稠密的编号；正向为每个用户的 setId 位图，反向为每个 setId 的用户编号位图（压缩的倒排表）。
+// 与相似度索引一样，列表写入时只记下用户名，由后台线程按新旧位图的差异只修改变化的倒排表，
+// 查询只读取上一次更新后的状态。
+// 每个分片只索引自己负责的用户：/has 重定向到属主，/holders 由接收请求的节点向其余分片汇总。
+// 索引随检查点保存，启动时只重新读取检查点之后变更过的用户。
+class HoldersIndex {
+public:
+    HoldersIndex(std::shared_ptr<Storage> storage,
+                 std::shared_ptr<ListStore> lists,
+                 std::shared_ptr<ClusterManager> cluster,
+                 std::shared_ptr<Logger> logger,
+                 const IndexCheckpoint* checkpoint = nullptr);
+    ~HoldersIndex();
+
+    void start();
+    void stop();
+
+    // 更新待处理的用户后序列化每个用户的 setId，供索引检查点保存
+    std::string serialize();
+
+    // GET /holders/<setId>?limit=&offset=
+    // 分片时按拓扑中的节点顺序拼接各分片的结果再分页；无法连接的分片列在 unreachable 中
+    void handleHolders(const std::string& setId, const httplib::Request& req, httplib::Response& res);
+
+    // GET /has/<user>/<setId>
+    void handleHas(const std::string& username, const std::string& setId, httplib::Response& res);
+
+private:
+    void run();
+    void markDirty(const fs::path& relPath);
+    bool restore(const IndexCheckpoint& checkpoint);
+    // 本分片中持有 setId 的用户，从第 offset 个起最多 limit 个追加到 users；返回持有者总数
+    uint64_t collect(uint32_t setId, size_t offset, size_t limit, nlohmann::json& users);
+    // 向另一个分片查询，无法连接或响应无效时返回 false
+    bool fetchRemote(const std::string& node, uint32_t setId, size_t offset, size_t limit,
+                     uint64_t& count, nlohmann::json& users);
+    // 重新读取自上次以来有变化的用户
+    void refresh();
+    // 以新的位图替换用户原有的位图，只修改两者差异涉及的倒排表；须持有 mutex_
+    void replace(const std::string& username, SetIdBitmap sets);
+
+    std::shared_ptr<Storage> storage_;
+    std::shared_ptr<ListStore> lists_;
+    std::shared_ptr<ClusterManager> cluster_;
+    std::shared_ptr<Logger> logger_;
+
+    std::mutex dirtyMutex_;
+    std::unordered_set<std::string> dirty_;
+    std::condition_variable wake_;      // 有新的待处理用户或停止
+    bool running_ = false;
+    std::thread thread_;
+    std::mutex refreshMutex_;   // 保证同一用户的更新按读取顺序生效
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, uint32_t> userIds_;
+    std::vector<std::string> names_;        // 编号 -> 用户名，空串表示编号空闲
+    std::vector<uint32_t> freeIds_;
+    std::vector<SetIdBitmap> sets_;         // 编号 -> 该用户的 setId
+    std::unordered_map<uint32_t, SetIdBitmap> holders_;     // setId -> 用户编号
+};
@@ -0,0 +1,257 @@
+#include "index_checkpoint.hpp"
+#include <cstring>
+#include <fstream>
+#include <zlib.h>
+#include "binary_io.hpp"
+#include "checksum_index.hpp"
+#include "holders_index.hpp"
+#include "similarity_index.hpp"
+#include "storage.hpp"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using binary_io::getU32;
+using binary_io::getU64;
+using binary_io::putU32;
+using binary_io::putU64;
+
+namespace {
+
+constexpr char kMagic[] = "OSIDXCP1";
+constexpr char kEndMagic[] = "OSIDXEND";
+constexpr size_t kHeaderSize = 8 + 8 + 4 + 4;
+constexpr size_t kSectionEntrySize = 4 + 4 + 8 + 8;
+constexpr size_t kTrailerSize = 4 + 4 + 8;
+
+void pad(std::string& out) {
+    out.append((8 - out.size() % 8) % 8, '\0');
+}
+
+} // anonymous namespace
+
+bool IndexCheckpoint::Builder::write(const fs::path& file, uint64_t seq, std::string& errorMessage) const {
+    std::string out;
+    out.append(kMagic, 8);
+    putU64(out, seq);
+    putU32(out, static_cast<uint32_t>(sections_.size()));
+    putU32(out, 0);
+
+    uint64_t offset = kHeaderSize + sections_.size() * kSectionEntrySize;
+    offset += (8 - offset % 8) % 8;
+    for (const auto& [id, data] : sections_) {
+        putU32(out, id);
+        putU32(out, 0);
+        putU64(out, offset);
+        putU64(out, data.size());
+        offset += data.size() + (8 - data.size() % 8) % 8;
+    }
+    pad(out);
+    for (const auto& section : sections_) {
+        out += section.second;
+        pad(out);
+    }
+    putU32(out, ChecksumIndex::compute(out));
+    putU32(out, 0);
+    out.append(kEndMagic, 8);
+
+    fs::path temp = file;
+    temp += ".tmp";
+    std::ofstream ofs(temp, std::ios::binary | std::ios::trunc);
+    ofs.write(out.data(), static_cast<std::streamsize>(out.size()));
+    ofs.close();
+    std::error_code ec;
+    if (!ofs || (fs::rename(temp, file, ec), ec)) {
+        fs::remove(temp, ec);
+        errorMessage = "写入索引检查点失败: " + file.string();
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<IndexCheckpoint> IndexCheckpoint::open(const fs::path& file, std::string& errorMessage) {
+    std::unique_ptr<IndexCheckpoint> checkpoint(new IndexCheckpoint());
+#ifndef _WIN32
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;     // 还没有检查点
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* mapped = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            checkpoint->data_ = static_cast<const char*>(mapped);
+            checkpoint->size_ = static_cast<size_t>(st.st_size);
+        }
+    }
+    ::close(fd);
+    if (!checkpoint->data_) {
+        errorMessage = "无法映射索引检查点";
+        return nullptr;
+    }
+#else
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+        return nullptr;
+    }
+    checkpoint->buffer_.assign((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    checkpoint->data_ = checkpoint->buffer_.data();
+    checkpoint->size_ = checkpoint->buffer_.size();
+#endif
+
+    const char* data = checkpoint->data_;
+    size_t size = checkpoint->size_;
+    if (size < kHeaderSize + kTrailerSize || std::memcmp(data, kMagic, 8) != 0 ||
+        std::memcmp(data + size - 8, kEndMagic, 8) != 0) {
+        errorMessage = "索引检查点格式无效";
+        return nullptr;
+    }
+    size_t body = size - kTrailerSize;
+    uint32_t crc = static_cast<uint32_t>(::crc32(0L, reinterpret_cast<const Bytef*>(data), static_cast<uInt>(body)));
+    if (crc != getU32(data + body)) {
+        errorMessage = "索引检查点校验失败";
+        return nullptr;
+    }
+    uint32_t count = getU32(data + 16);
+    if (kHeaderSize + static_cast<uint64_t>(count) * kSectionEntrySize > body) {
+        errorMessage = "索引检查点段表损坏";
+        return nullptr;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        const char* entry = data + kHeaderSize + i * kSectionEntrySize;
+        uint64_t offset = getU64(entry + 8);
+        uint64_t length = getU64(entry + 16);
+        if (offset > body || length > body - offset) {
+            errorMessage = "索引检查点段表损坏";
+            return nullptr;
+        }
+    }
+    checkpoint->seq_ = getU64(data + 8);
+    return checkpoint;
+}
+
+IndexCheckpoint::~IndexCheckpoint() {
+#ifndef _WIN32
+    if (data_) {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+}
+
+bool IndexCheckpoint::section(uint32_t id, const char*& data, size_t& size) const {
+    uint32_t count = getU32(data_ + 16);
+    for (uint32_t i = 0; i < count; i++) {
+        const char* entry = data_ + kHeaderSize + i * kSectionEntrySize;
+        if (getU32(entry) == id) {
+            data = data_ + getU64(entry + 8);
+            size = static_cast<size_t>(getU64(entry + 16));
+            return true;
+        }
+    }
+    return false;
+}
+
+IndexCheckpointer::IndexCheckpointer(const fs::path& file,
+                                     std::shared_ptr<Storage> storage,
+                                     std::shared_ptr<SimilarityIndex> similarity,
+                                     std::shared_ptr<HoldersIndex> holders,
+                                     std::chrono::seconds interval,
+                                     std::shared_ptr<Metrics> metrics,
+                                     std::shared_ptr<Logger> logger)
+    : file_(file)
+    , storage_(storage)
+    , similarity_(similarity)
+    , holders_(holders)
+    , interval_(interval)
+    , metrics_(metrics)
+    , logger_(logger)
+    , hold_(storage_->changeLog()->hold(UINT64_MAX)) {}
+
+IndexCheckpointer::~IndexCheckpointer() {
+    stop();
+}
+
+void IndexCheckpointer::start() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_) {
+            return;
+        }
+        running_ = true;
+    }
+    // 不知道磁盘上已有的检查点需要从哪里回放，写出第一份检查点之前保留全部日志
+    hold_->update(storage_->changeLog()->baseSeq() + 1);
+    thread_ = std::thread([this] { run(); });
+}
+
+void IndexCheckpointer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void IndexCheckpointer::run() {
+    // 启动时先写一份，下次启动即可跳过完整重建
+    checkpoint();
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait_for(lock, interval_, [this] { return !running_; });
+            if (!running_) {
+                break;
+            }
+        }
+        checkpoint();
+    }
+}
+
+bool IndexCheckpointer::checkpoint() {
+    std::lock_guard<std::mutex> lock(checkpointMutex_);
+    auto started = std::chrono::steady_clock::now();
+    uint64_t generation = generation_;
+
+    uint64_t seq = 0;
+    IndexCheckpoint::Builder builder;
+    builder.add(IndexCheckpoint::kStorageIndex, storage_->serializeIndex(seq));
+    if (similarity_) {
+        builder.add(IndexCheckpoint::kSimilaritySignatures, similarity_->serialize());
+    }
+    if (holders_) {
+        builder.add(IndexCheckpoint::kHolders, holders_->serialize());
+    }
+
+    std::string errorMessage;
+    if (!builder.write(file_, seq, errorMessage)) {
+        logger_->error(errorMessage);
+        return false;
+    }
+    if (generation_ != generation) {
+        // 序列化时可能还没有看到那次改动
+        invalidate();
+        return false;
+    }
+    // 下次启动只回放 seq 之后的日志，更早的分段可以回收
+    hold_->update(seq + 1);
+    storage_->changeLog()->compact();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    metrics_->setGauge("osu_sync_index_checkpoint_seq", static_cast<double>(seq));
+    metrics_->setGauge("osu_sync_index_checkpoint_duration_seconds", seconds);
+    return true;
+}
+
+void IndexCheckpointer::invalidate() {
+    generation_++;
+    hold_->update(UINT64_MAX);
+    std::error_code ec;
+    if (fs::remove(file_, ec)) {
+        logger_->info("索引检查点已作废，下次启动将完整重建索引，直到写出新的检查点");
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "changelog.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+
+namespace fs = std::filesystem;
+
+// 内存索引的检查点文件
+// 启动时映射检查点并只回放其后的变更日志，而不必重新扫描全部文件。
+//
+// 格式（小端序，各段从 8 字节对齐处开始，映射后可直接按定长记录访问）：
+//   "OSIDXCP1" u64 变更日志序号 u32 段数 u32 保留
+//   段表:  {u32 段号 u32 保留 u64 偏移 u64 长度} * 段数
+//   段数据
+//   尾部:  u32 CRC32(之前的全部内容) u32 保留 "OSIDXEND"
+// 检查点中的索引至少反映了序号不大于记录值的全部变更（可能更多），回放是幂等的。
+class IndexCheckpoint {
+public:
+    enum Section : uint32_t {
+        kStorageIndex = 1,          // Storage 的文件大小索引
+        kSimilaritySignatures = 2,  // SimilarityIndex 的 MinHash 签名
+        kHolders = 3                // HoldersIndex 中每个用户的 setId
+    };
+
+    class Builder {
+    public:
+        void add(uint32_t id, std::string data) { sections_.emplace_back(id, std::move(data)); }
+        // 以“临时文件 + 重命名”的方式写入
+        bool write(const fs::path& file, uint64_t seq, std::string& errorMessage) const;
+
+    private:
+        std::vector<std::pair<uint32_t, std::string>> sections_;
+    };
+
+    // 映射并校验检查点文件，不存在或损坏时返回 nullptr
+    static std::unique_ptr<IndexCheckpoint> open(const fs::path& file, std::string& errorMessage);
+    ~IndexCheckpoint();
+
+    IndexCheckpoint(const IndexCheckpoint&) = delete;
+    IndexCheckpoint& operator=(const IndexCheckpoint&) = delete;
+
+    uint64_t seq() const { return seq_; }
+
+    // 取得段数据（指向映射的内存，在本对象销毁前有效），没有该段时返回 false
+    bool section(uint32_t id, const char*& data, size_t& size) const;
+
+private:
+    IndexCheckpoint() = default;
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    std::string buffer_;        // 不支持映射的平台上读入内存
+    uint64_t seq_ = 0;
+};
+
+class Storage;
+class SimilarityIndex;
+class HoldersIndex;
+
+// 定期写出检查点的后台任务
+// Storage 的索引在写锁内与变更日志序号一起序列化；相似度签名与持有者索引随后序列化，只会比该序号更新。
+class IndexCheckpointer {
+public:
+    IndexCheckpointer(const fs::path& file,
+                      std::shared_ptr<Storage> storage,
+                      std::shared_ptr<SimilarityIndex> similarity,
+                      std::shared_ptr<HoldersIndex> holders,
+                      std::chrono::seconds interval,
+                      std::shared_ptr<Metrics> metrics,
+                      std::shared_ptr<Logger> logger);
+    ~IndexCheckpointer();
+
+    void start();
+    void stop();
+
+    bool checkpoint();
+    // 删除检查点，下次启动时完整重建（发生了不记日志的写入时调用，可以在存储层的写锁内调用）
+    void invalidate();
+
+private:
+    void run();
+
+    fs::path file_;
+    std::shared_ptr<Storage> storage_;
+    std::shared_ptr<SimilarityIndex> similarity_;
+    std::shared_ptr<HoldersIndex> holders_;
+    std::chrono::seconds interval_;
+    std::shared_ptr<Metrics> metrics_;
+    std::shared_ptr<Logger> logger_;
+
+    std::mutex checkpointMutex_;
+    std::atomic<uint64_t> generation_{0};       // 每次作废加一；写出期间发生作废则删除刚写出的检查点
+    std::shared_ptr<ChangeLog::Hold> hold_;     // 启动时回放检查点之后的日志，这部分日志不能回收
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool running_ = false;
+};
@@ -0,0 +1,365 @@
+#include "json_stream.hpp"
+
+namespace {
+
+bool isWhitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+bool isValidNumber(const std::string& text) {
+    size_t i = 0;
+    size_t n = text.size();
+    if (i < n && text[i] == '-') ++i;
+    if (i >= n) return false;
+    if (text[i] == '0') {
+        ++i;
+    } else if (isDigit(text[i])) {
+        while (i < n && isDigit(text[i])) ++i;
+    } else {
+        return false;
+    }
+    if (i < n && text[i] == '.') {
+        size_t start = ++i;
+        while (i < n && isDigit(text[i])) ++i;
+        if (i == start) return false;
+    }
+    if (i < n && (text[i] == 'e' || text[i] == 'E')) {
+        ++i;
+        if (i < n && (text[i] == '+' || text[i] == '-')) ++i;
+        size_t start = i;
+        while (i < n && isDigit(text[i])) ++i;
+        if (i == start) return false;
+    }
+    return i == n;
+}
+
+} // anonymous namespace
+
+JsonPushParser::JsonPushParser(Handler& handler, size_t maxDepth, size_t maxStringLength)
+    : handler_(handler)
+    , maxDepth_(maxDepth)
+    , maxStringLength_(maxStringLength) {}
+
+bool JsonPushParser::feed(const char* data, size_t size) {
+    if (failed_) {
+        return false;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        if (!step(data[i])) {
+            failed_ = true;
+            return false;
+        }
+        ++offset_;
+    }
+    return true;
+}
+
+bool JsonPushParser::finish() {
+    if (failed_) {
+        return false;
+    }
+    if (state_ == State::Number && !finishNumber()) {
+        failed_ = true;
+        return false;
+    }
+    if (state_ != State::AfterValue || !stack_.empty()) {
+        failed_ = true;
+        return fail("JSON 文档不完整");
+    }
+    return true;
+}
+
+bool JsonPushParser::fail(const std::string& message) {
+    error_ = message + "（偏移 " + std::to_string(offset_) + "）";
+    return false;
+}
+
+bool JsonPushParser::step(char c) {
+    switch (state_) {
+        case State::Value:
+            return isWhitespace(c) || beginValue(c);
+
+        case State::FirstValue:
+            if (isWhitespace(c)) {
+                return true;
+            }
+            if (c == ']') {
+                stack_.pop_back();
+                return handler_.endArray() && endValue();
+            }
+            return beginValue(c);
+
+        case State::FirstKey:
+        case State::Key:
+            if (isWhitespace(c)) {
+                return true;
+            }
+            if (c == '}' && state_ == State::FirstKey) {
+                stack_.pop_back();
+                return handler_.endObject() && endValue();
+            }
+            if (c != '"') {
+                return fail("期望对象的键");
+            }
+            token_.clear();
+            tokenIsKey_ = true;
+            state_ = State::String;
+            return true;
+
+        case State::Colon:
+            if (isWhitespace(c)) {
+                return true;
+            }
+            if (c != ':') {
+                return fail("期望 ':'");
+            }
+            state_ = State::Value;
+            return true;
+
+        case State::AfterValue:
+            if (isWhitespace(c)) {
+                return true;
+            }
+            if (stack_.empty()) {
+                return fail("文档结束后存在多余内容");
+            }
+            if (c == ',') {
+                state_ = stack_.back() == '{' ? State::Key : State::Value;
+                return true;
+            }
+            if (c == '}' && stack_.back() == '{') {
+                stack_.pop_back();
+                return handler_.endObject() && endValue();
+            }
+            if (c == ']' && stack_.back() == '[') {
+                stack_.pop_back();
+                return handler_.endArray() && endValue();
+            }
+            return fail("期望 ',' 或闭合符号");
+
+        case State::String:
+            if (utf8Remaining_ > 0) {
+                return appendUtf8Byte(static_cast<unsigned char>(c));
+            }
+            if (c == '\\') {
+                state_ = State::Escape;
+                return true;
+            }
+            if (highSurrogate_ != 0) {
+                return fail("无效的 Unicode 转义");
+            }
+            if (c == '"') {
+                return finishString();
+            }
+            if (static_cast<unsigned char>(c) < 0x20) {
+                return fail("字符串中含有控制字符");
+            }
+            return appendUtf8Byte(static_cast<unsigned char>(c));
+
+        case State::Escape: {
+            if (c == 'u') {
+                unicode_ = 0;
+                unicodeDigits_ = 0;
+                state_ = State::Unicode;
+                return true;
+            }
+            if (highSurrogate_ != 0) {
+                return fail("无效的 Unicode 转义");
+            }
+            char decoded;
+            switch (c) {
+                case '"': decoded = '"'; break;
+                case '\\': decoded = '\\'; break;
+                case '/': decoded = '/'; break;
+                case 'b': decoded = '\b'; break;
+                case 'f': decoded = '\f'; break;
+                case 'n': decoded = '\n'; break;
+                case 'r': decoded = '\r'; break;
+                case 't': decoded = '\t'; break;
+                default: return fail("无效的转义字符");
+            }
+            state_ = State::String;
+            return appendUtf8Byte(static_cast<unsigned char>(decoded));
+        }
+
+        case State::Unicode: {
+            int value = hexValue(c);
+            if (value < 0) {
+                return fail("无效的 Unicode 转义");
+            }
+            unicode_ = (unicode_ << 4) | static_cast<uint32_t>(value);
+            if (++unicodeDigits_ < 4) {
+                return true;
+            }
+            state_ = State::String;
+            if (highSurrogate_ != 0) {
+                if (unicode_ < 0xDC00 || unicode_ > 0xDFFF) {
+                    return fail("无效的 Unicode 代理对");
+                }
+                uint32_t codePoint = 0x10000 + ((highSurrogate_ - 0xD800) << 10) + (unicode_ - 0xDC00);
+                highSurrogate_ = 0;
+                return appendCodePoint(codePoint);
+            }
+            if (unicode_ >= 0xD800 && unicode_ <= 0xDBFF) {
+                highSurrogate_ = unicode_;
+                return true;
+            }
+            if (unicode_ >= 0xDC00 && unicode_ <= 0xDFFF) {
+                return fail("无效的 Unicode 代理对");
+            }
+            return appendCodePoint(unicode_);
+        }
+
+        case State::Number:
+            if (isDigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+                if (token_.size() >= 64) {
+                    return fail("数字过长");
+                }
+                token_.push_back(c);
+                return true;
+            }
+            // 数字没有结束符，遇到其他字符时才能确定结束，该字符需要重新处理
+            return finishNumber() && step(c);
+
+        case State::Literal:
+            if (c != literal_[literalPos_]) {
+                return fail("无效的字面量");
+            }
+            if (literal_[++literalPos_] != '\0') {
+                return true;
+            }
+            if (literal_[0] == 'n') {
+                return handler_.null() && endValue();
+            }
+            return handler_.boolean(literal_[0] == 't') && endValue();
+    }
+    return false;
+}
+
+bool JsonPushParser::beginValue(char c) {
+    switch (c) {
+        case '{':
+        case '[':
+            if (stack_.size() >= maxDepth_) {
+                return fail("嵌套层数过深");
+            }
+            stack_.push_back(c);
+            if (c == '{') {
+                state_ = State::FirstKey;
+                return handler_.startObject();
+            }
+            state_ = State::FirstValue;
+            return handler_.startArray();
+        case '"':
+            token_.clear();
+            tokenIsKey_ = false;
+            state_ = State::String;
+            return true;
+        case 't':
+            literal_ = "true";
+            break;
+        case 'f':
+            literal_ = "false";
+            break;
+        case 'n':
+            literal_ = "null";
+            break;
+        default:
+            if (c == '-' || isDigit(c)) {
+                token_.assign(1, c);
+                state_ = State::Number;
+                return true;
+            }
+            return fail("意外的字符");
+    }
+    literalPos_ = 1;
+    state_ = State::Literal;
+    return true;
+}
+
+bool JsonPushParser::endValue() {
+    state_ = State::AfterValue;
+    return true;
+}
+
+bool JsonPushParser::finishString() {
+    if (tokenIsKey_) {
+        state_ = State::Colon;
+        return handler_.key(token_);
+    }
+    return handler_.string(token_) && endValue();
+}
+
+bool JsonPushParser::finishNumber() {
+    if (!isValidNumber(token_)) {
+        return fail("无效的数字");
+    }
+    return handler_.number(token_) && endValue();
+}
+
+bool JsonPushParser::appendCodePoint(uint32_t codePoint) {
+    if (codePoint < 0x80) {
+        token_.push_back(static_cast<char>(codePoint));
+    } else if (codePoint < 0x800) {
+        token_.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+        token_.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    } else if (codePoint < 0x10000) {
+        token_.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+        token_.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        token_.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    } else {
+        token_.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+        token_.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+        token_.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        token_.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+    if (token_.size() > maxStringLength_) {
+        return fail("字符串过长");
+    }
+    return true;
+}
+
+bool JsonPushParser::appendUtf8Byte(unsigned char byte) {
+    if (utf8Remaining_ > 0) {
+        if (byte < utf8Low_ || byte > utf8High_) {
+            return fail("无效的 UTF-8 编码");
+        }
+        --utf8Remaining_;
+        utf8Low_ = 0x80;
+        utf8High_ = 0xBF;
+    } else if (byte >= 0x80) {
+        // 按 RFC 3629 拒绝过长编码与代理区码点
+        utf8Low_ = 0x80;
+        utf8High_ = 0xBF;
+        if (byte >= 0xC2 && byte <= 0xDF) {
+            utf8Remaining_ = 1;
+        } else if (byte >= 0xE0 && byte <= 0xEF) {
+            utf8Remaining_ = 2;
+            if (byte == 0xE0) utf8Low_ = 0xA0;
+            if (byte == 0xED) utf8High_ = 0x9F;
+        } else if (byte >= 0xF0 && byte <= 0xF4) {
+            utf8Remaining_ = 3;
+            if (byte == 0xF0) utf8Low_ = 0x90;
+            if (byte == 0xF4) utf8High_ = 0x8F;
+        } else {
+            return fail("无效的 UTF-8 编码");
+        }
+    }
+    token_.push_back(static_cast<char>(byte));
+    if (token_.size() > maxStringLength_) {
+        return fail("字符串过长");
+    }
+    return true;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 推送式（增量）JSON 词法解析器
+// 数据可以按任意大小的块陆续送入，每识别出一个语法单元就回调 Handler，
+// 不构建 DOM，因此内存占用只与最长的单个字符串和嵌套深度有关。
+// 字符串在送出前已完成转义处理并校验为合法 UTF-8。
+class JsonPushParser {
+public:
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+        // 返回 false 表示中止解析（错误信息由 Handler 自行记录）
+        virtual bool startObject() = 0;
+        virtual bool endObject() = 0;
+        virtual bool startArray() = 0;
+        virtual bool endArray() = 0;
+        virtual bool key(std::string& name) = 0;
+        virtual bool string(std::string& value) = 0;
+        virtual bool number(const std::string& text) = 0;
+        virtual bool boolean(bool value) = 0;
+        virtual bool null() = 0;
+    };
+
+    explicit JsonPushParser(Handler& handler, size_t maxDepth = 64, size_t maxStringLength = 1024 * 1024);
+
+    // 送入一块数据；出现语法错误或 Handler 中止时返回 false，之后的调用都会失败
+    bool feed(const char* data, size_t size);
+
+    // 输入结束：检查文档是否完整
+    bool finish();
+
+    bool failed() const { return failed_; }
+    // 语法错误的描述；Handler 中止时为空
+    const std::string& error() const { return error_; }
+    // 已处理的字节数
+    uint64_t offset() const { return offset_; }
+
+private:
+    enum class State {
+        Value,          // 期待一个值
+        FirstValue,     // '[' 之后：值或 ']'
+        FirstKey,       // '{' 之后：键或 '}'
+        Key,            // ',' 之后：键
+        Colon,
+        AfterValue,     // 值之后：',' 或闭合符号；栈为空时表示文档已结束
+        String,
+        Escape,
+        Unicode,
+        Number,
+        Literal
+    };
+
+    bool step(char c);
+    bool beginValue(char c);
+    bool endValue();
+    bool finishString();
+    bool finishNumber();
+    bool appendCodePoint(uint32_t codePoint);
+    bool appendUtf8Byte(unsigned char byte);
+    bool fail(const std::string& message);
+
+    Handler& handler_;
+    size_t maxDepth_;
+    size_t maxStringLength_;
+
+    State state_ = State::Value;
+    std::vector<char> stack_;
+    std::string token_;
+    bool tokenIsKey_ = false;
+    const char* literal_ = nullptr;
+    size_t literalPos_ = 0;
+    uint32_t unicode_ = 0;
+    int unicodeDigits_ = 0;
+    uint32_t highSurrogate_ = 0;
+    int utf8Remaining_ = 0;
+    unsigned char utf8Low_ = 0x80;
+    unsigned char utf8High_ = 0xBF;
+
+    bool failed_ = false;
+    std::string error_;
+    uint64_t offset_ = 0;
+};
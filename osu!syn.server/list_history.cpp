@@ -0,0 +1,510 @@
+#include "list_history.hpp"
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <optional>
+#include "binary_io.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+constexpr uint32_t kDeltaMagic = 0x4442534F; // "OSBD"
+
+int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string versionName(uint64_t version) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%010llu", static_cast<unsigned long long>(version));
+    return buffer;
+}
+
+bool parseVersionParam(const httplib::Request& req, const std::string& name, uint64_t& value) {
+    if (!req.has_param(name)) {
+        return false;
+    }
+    try {
+        value = std::stoull(req.get_param_value(name));
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+// 在排序好的列表上回放一个反向增量：删除 removed 中的键，再并入 added（同键时以 added 为准）
+void applyDelta(BeatmapList& list, const std::vector<BeatmapEntry>& removed, const BeatmapList& added) {
+    std::vector<BeatmapEntry> kept;
+    kept.reserve(list.entries.size());
+    size_t r = 0;
+    for (auto& entry : list.entries) {
+        while (r < removed.size() && entryLess(removed[r], entry)) {
+            ++r;
+        }
+        if (r < removed.size() && !entryLess(entry, removed[r])) {
+            continue;
+        }
+        kept.push_back(std::move(entry));
+    }
+
+    std::vector<BeatmapEntry> merged;
+    merged.reserve(kept.size() + added.entries.size());
+    size_t a = 0;
+    for (auto& entry : kept) {
+        while (a < added.entries.size() && entryLess(added.entries[a], entry)) {
+            merged.push_back(added.entries[a++]);
+        }
+        if (a < added.entries.size() && !entryLess(entry, added.entries[a])) {
+            merged.push_back(added.entries[a++]);
+            continue;
+        }
+        merged.push_back(std::move(entry));
+    }
+    merged.insert(merged.end(), added.entries.begin() + a, added.entries.end());
+
+    list.entries = std::move(merged);
+    list.isCollection = added.isCollection;
+    list.name = added.name;
+    list.description = added.description;
+}
+
+} // anonymous namespace
+
+ListHistory::ListHistory(std::shared_ptr<Storage> storage, std::shared_ptr<ListStore> lists,
+                         size_t maxVersions, std::shared_ptr<Logger> logger)
+    : storage_(storage)
+    , lists_(lists)
+    , maxVersions_(maxVersions < 1 ? 1 : maxVersions)
+    , logger_(logger) {}
+
+bool ListHistory::isListPath(const fs::path& relPath, std::string& username) {
+    if (relPath.has_parent_path() || relPath.extension() != ".json") {
+        return false;
+    }
+    username = relPath.stem().string();
+    return !username.empty();
+}
+
+std::string ListHistory::encodeDelta(uint64_t version, const Delta& delta) {
+    std::string added = delta.added.encode();
+    std::string removed = delta.removed.encode();
+    std::string out;
+    binary_io::putU32(out, kDeltaMagic);
+    binary_io::putU64(out, version);
+    binary_io::putVarint(out, added.size());
+    out += added;
+    binary_io::putVarint(out, removed.size());
+    out += removed;
+    return out;
+}
+
+bool ListHistory::decodeDelta(const std::string& content, Delta& delta) {
+    std::string errorMessage;
+    if (content.size() >= 12 && binary_io::getU32(content.data()) == kDeltaMagic) {
+        const char* p = content.data() + 12;
+        const char* end = content.data() + content.size();
+        uint64_t length;
+        if (!binary_io::getVarint(p, end, length) || length > static_cast<uint64_t>(end - p) ||
+            !BeatmapList::decode(std::string(p, length), delta.added, errorMessage)) {
+            return false;
+        }
+        p += length;
+        return binary_io::getVarint(p, end, length) && length == static_cast<uint64_t>(end - p) &&
+               BeatmapList::decode(std::string(p, length), delta.removed, errorMessage);
+    }
+
+    // 引入二进制格式之前的 JSON 增量：{version, header, removed, added}
+    try {
+        json legacy = json::parse(content);
+        if (!BeatmapList::parse(legacy.at("added").dump(), delta.added, errorMessage) ||
+            !BeatmapList::parse(legacy.at("removed").dump(), delta.removed, errorMessage)) {
+            return false;
+        }
+        const json& header = legacy["header"];
+        delta.added.isCollection = header.is_object();
+        if (header.is_object()) {
+            delta.added.name = header.value("name", std::string());
+            delta.added.description = header.value("description", std::string());
+        }
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+fs::path ListHistory::historyDir(const std::string& username) const {
+    return fs::path(username) / ".history";
+}
+
+fs::path ListHistory::deltaPath(const std::string& username, uint64_t version) const {
+    return historyDir(username) / (versionName(version) + ".delta");
+}
+
+fs::path ListHistory::keyframePath(const std::string& username, uint64_t version) const {
+    return historyDir(username) / (versionName(version) + ".full");
+}
+
+fs::path ListHistory::manifestPath(const std::string& username) const {
+    return historyDir(username) / "manifest.json";
+}
+
+json ListHistory::loadManifest(const std::string& username) const {
+    std::string content;
+    if (storage_->read(manifestPath(username), content)) {
+        try {
+            return json::parse(content);
+        } catch (const std::exception& e) {
+            logger_->error("版本清单损坏 (" + username + "): " + e.what());
+        }
+    }
+    return json{{"head", 0}, {"versions", json::array()}};
+}
+
+bool ListHistory::loadDelta(const std::string& username, uint64_t version, Delta& delta) const {
+    std::string content;
+    return storage_->read(deltaPath(username, version), content) && decodeDelta(content, delta);
+}
+
+ListHistory::Delta ListHistory::reverseDelta(const BeatmapList& previous, const BeatmapList& next) {
+    // 反向增量：从新版本回到旧版本需要删除 removed、加回 added；两个列表都已排序，一次归并即可
+    Delta delta;
+    delta.added.isCollection = previous.isCollection;
+    delta.added.name = previous.name;
+    delta.added.description = previous.description;
+    const auto& before = previous.entries;
+    const auto& after = next.entries;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < before.size() || j < after.size()) {
+        if (j == after.size() || (i < before.size() && entryLess(before[i], after[j]))) {
+            delta.added.entries.push_back(before[i++]);
+        } else if (i == before.size() || entryLess(after[j], before[i])) {
+            delta.removed.entries.push_back(after[j++]);
+        } else {
+            if (before[i] != after[j]) {
+                delta.added.entries.push_back(before[i]);
+                delta.removed.entries.push_back(after[j]);
+            }
+            ++i;
+            ++j;
+        }
+    }
+    return delta;
+}
+
+bool ListHistory::commit(const std::string& username, const BeatmapList& next, std::string& errorMessage) {
+    std::unique_lock<std::shared_mutex> lock(commitMutex_);
+    json manifest = loadManifest(username);
+
+    BeatmapList previous;
+    bool hasCurrent = loadCurrent(username, manifest, previous);
+    Delta delta;
+    if (hasCurrent) {
+        delta = reverseDelta(previous, next);
+    }
+    return commitLocked(username, manifest, hasCurrent ? &previous : nullptr, delta, next, errorMessage);
+}
+
+bool ListHistory::loadCurrent(const std::string& username, json& manifest, BeatmapList& current) const {
+    std::string loadError;
+    bool hasCurrent = lists_->load(username, current, loadError);
+    if (!loadError.empty()) {
+        // 当前列表无法解析时无法生成增量，历史从新版本重新开始
+        logger_->warning("用户 " + username + " 的当前列表无法解析，丢弃历史: " + loadError);
+        manifest["versions"] = json::array();
+    }
+    if (hasCurrent && manifest.value("head", uint64_t{0}) == 0) {
+        // 启用版本功能之前上传的列表视为版本 1
+        manifest["head"] = 1;
+        manifest["versions"].push_back({{"version", 1}, {"timestamp", nowMs()}, {"entries", 0}});
+    }
+    return hasCurrent;
+}
+
+bool ListHistory::commitLocked(const std::string& username, json& manifest, const BeatmapList* previous,
+                               const Delta& delta, const BeatmapList& next, std::string& errorMessage) {
+    uint64_t head = manifest.value("head", uint64_t{0});
+    if (previous) {
+        if (!storage_->put(deltaPath(username, head), encodeDelta(head, delta), errorMessage)) {
+            return false;
+        }
+        bool keyframe = head % kKeyframeInterval == 0;
+        if (keyframe && !storage_->put(keyframePath(username, head), previous->encode(), errorMessage)) {
+            return false;
+        }
+
+        auto& versions = manifest["versions"];
+        if (!versions.empty() && versions.back().value("version", uint64_t{0}) == head) {
+            versions.back()["entries"] = previous->entries.size();
+            versions.back()["keyframe"] = keyframe;
+        }
+    }
+
+    uint64_t version = head + 1;
+    manifest["head"] = version;
+    manifest["versions"].push_back({
+        {"version", version},
+        {"timestamp", nowMs()},
+        {"entries", next.entries.size()}
+    });
+    prune(username, manifest);
+
+    if (!lists_->save(username, next, errorMessage)) {
+        return false;
+    }
+    if (!storage_->put(manifestPath(username), manifest.dump(), errorMessage)) {
+        return false;
+    }
+    logger_->info("用户 " + username + " 的列表已更新到版本 " + std::to_string(version));
+    return true;
+}
+
+ListHistory::PatchResult ListHistory::patch(const std::string& username, uint64_t base, const BeatmapList& add,
+                                            const std::vector<uint64_t>& removeSetIds, size_t maxEntries,
+                                            uint64_t& version, size_t& entries, std::string& errorMessage) {
+    std::unique_lock<std::shared_mutex> lock(commitMutex_);
+    json manifest = loadManifest(username);
+    BeatmapList previous;
+    bool hasCurrent = loadCurrent(username, manifest, previous);
+    version = manifest.value("head", uint64_t{0});
+    entries = previous.entries.size();
+    if (base != version) {
+        return PatchResult::Conflict;
+    }
+
+    BeatmapList next;
+    next.isCollection = previous.isCollection;
+    next.name = previous.name;
+    next.description = previous.description;
+    next.entries.reserve(previous.entries.size() + add.entries.size());
+    Delta delta;
+    delta.added.isCollection = previous.isCollection;
+    delta.added.name = previous.name;
+    delta.added.description = previous.description;
+
+    // 三路归并：旧列表、待删除的 setId、新增条目都已按规范顺序排列
+    const auto& adds = add.entries;
+    size_t a = 0;
+    size_t r = 0;
+    for (const auto& entry : previous.entries) {
+        while (a < adds.size() && entryLess(adds[a], entry)) {
+            next.entries.push_back(adds[a]);
+            delta.removed.entries.push_back(adds[a++]);
+        }
+        while (r < removeSetIds.size() && removeSetIds[r] < entry.setId) {
+            ++r;
+        }
+        if (a < adds.size() && !entryLess(entry, adds[a])) {
+            if (adds[a] != entry) {
+                delta.added.entries.push_back(entry);
+                delta.removed.entries.push_back(adds[a]);
+            }
+            next.entries.push_back(adds[a++]);
+        } else if (r < removeSetIds.size() && removeSetIds[r] == entry.setId) {
+            delta.added.entries.push_back(entry);
+        } else {
+            next.entries.push_back(entry);
+        }
+    }
+    for (; a < adds.size(); ++a) {
+        next.entries.push_back(adds[a]);
+        delta.removed.entries.push_back(adds[a]);
+    }
+
+    if (delta.added.entries.empty() && delta.removed.entries.empty()) {
+        return PatchResult::Applied;
+    }
+    if (next.entries.size() > maxEntries) {
+        errorMessage = "列表条目数超出上限: " + std::to_string(next.entries.size()) + " > " +
+                       std::to_string(maxEntries);
+        return PatchResult::Rejected;
+    }
+    if (!commitLocked(username, manifest, hasCurrent ? &previous : nullptr, delta, next, errorMessage)) {
+        return PatchResult::Failed;
+    }
+    version = manifest.value("head", uint64_t{0});
+    entries = next.entries.size();
+    return PatchResult::Applied;
+}
+
+void ListHistory::prune(const std::string& username, json& manifest) {
+    auto& versions = manifest["versions"];
+    while (versions.size() > maxVersions_) {
+        uint64_t oldest = versions.front().value("version", uint64_t{0});
+        std::string errorMessage;
+        storage_->remove(deltaPath(username, oldest), errorMessage);
+        if (versions.front().value("keyframe", false)) {
+            storage_->remove(keyframePath(username, oldest), errorMessage);
+        }
+        versions.erase(versions.begin());
+    }
+}
+
+bool ListHistory::loadVersion(const std::string& username, const json& manifest, uint64_t version,
+                              BeatmapList& list, std::string& errorMessage) const {
+    uint64_t head = manifest.value("head", uint64_t{0});
+    bool known = false;
+    uint64_t start = head;
+    for (const auto& info : manifest["versions"]) {
+        uint64_t v = info.value("version", uint64_t{0});
+        known = known || v == version;
+        // 选择不早于目标版本的最近一个完整快照作为起点
+        if (v >= version && v < start && info.value("keyframe", false)) {
+            start = v;
+        }
+    }
+    if (!known || version > head) {
+        errorMessage = "版本不存在或已被清理";
+        return false;
+    }
+
+    std::string content;
+    bool loaded = start == head ? lists_->load(username, list, errorMessage)
+                                : storage_->read(keyframePath(username, start), content) &&
+                                  BeatmapList::parse(content, list, errorMessage);
+    if (!loaded) {
+        errorMessage = "读取版本 " + std::to_string(start) + " 失败";
+        return false;
+    }
+
+    for (uint64_t v = start; v-- > version;) {
+        Delta delta;
+        if (!loadDelta(username, v, delta)) {
+            errorMessage = "缺少版本 " + std::to_string(v) + " 的增量";
+            return false;
+        }
+        applyDelta(list, delta.removed.entries, delta.added);
+    }
+    return true;
+}
+
+void ListHistory::handleListVersions(const std::string& username, httplib::Response& res) {
+    std::shared_lock<std::shared_mutex> lock(commitMutex_);
+    json manifest = loadManifest(username);
+    if (manifest.value("head", uint64_t{0}) == 0) {
+        res.status = 404;
+        res.set_content("该用户没有版本历史", "text/plain; charset=utf-8");
+        return;
+    }
+    res.set_content(manifest.dump(), "application/json");
+}
+
+void ListHistory::handleGetVersion(const std::string& username, uint64_t version, httplib::Response& res) {
+    BeatmapList list;
+    std::string errorMessage;
+    bool loaded;
+    {
+        std::shared_lock<std::shared_mutex> lock(commitMutex_);
+        json manifest = loadManifest(username);
+        loaded = loadVersion(username, manifest, version, list, errorMessage);
+    }
+    if (!loaded) {
+        res.status = 404;
+        res.set_content(errorMessage, "text/plain; charset=utf-8");
+        return;
+    }
+    res.set_header("X-List-Version", std::to_string(version));
+    res.set_content(list.renderJson(), "application/json");
+}
+
+void ListHistory::handleDiff(const std::string& username, const httplib::Request& req, httplib::Response& res) {
+    // 持有到增量读取完毕，期间的提交与清理不会改动这些文件
+    std::shared_lock<std::shared_mutex> lock(commitMutex_);
+    json manifest = loadManifest(username);
+    uint64_t head = manifest.value("head", uint64_t{0});
+    uint64_t from = 0;
+    uint64_t to = head;
+    if (!parseVersionParam(req, "from", from) || (req.has_param("to") && !parseVersionParam(req, "to", to))) {
+        res.status = 400;
+        res.set_content("需要有效的 from（以及可选的 to）参数", "text/plain; charset=utf-8");
+        return;
+    }
+
+    uint64_t oldest = manifest["versions"].empty() ? 0 : manifest["versions"].front().value("version", uint64_t{0});
+    uint64_t low = std::min(from, to);
+    uint64_t high = std::max(from, to);
+    if (low < oldest || high > head || low == 0) {
+        res.status = 404;
+        res.set_content("版本不存在或已被清理", "text/plain; charset=utf-8");
+        return;
+    }
+
+    // 只组合 [low, high) 区间内的增量：记录每个被触及条目在 high 与当前回放位置的状态
+    struct Touched {
+        std::optional<BeatmapEntry> atHigh;     // 为空表示在 high 版本中不存在
+        std::optional<BeatmapEntry> current;
+    };
+    std::map<std::pair<uint64_t, std::string>, Touched> touched;
+    for (uint64_t v = high; v-- > low;) {
+        Delta delta;
+        if (!loadDelta(username, v, delta)) {
+            res.status = 500;
+            res.set_content("缺少版本 " + std::to_string(v) + " 的增量", "text/plain; charset=utf-8");
+            return;
+        }
+        for (const auto& entry : delta.removed.entries) {
+            auto [it, inserted] = touched.try_emplace({entry.setId, entry.key()});
+            if (inserted) {
+                it->second.atHigh = entry;
+            }
+            it->second.current.reset();
+        }
+        for (const auto& entry : delta.added.entries) {
+            // 首次出现在 added 而不在 removed 中，说明在 high 版本中不存在
+            touched[{entry.setId, entry.key()}].current = entry;
+        }
+    }
+
+    std::vector<BeatmapEntry> added;
+    std::vector<BeatmapEntry> removed;
+    for (const auto& [key, state] : touched) {
+        if (state.atHigh == state.current) {
+            continue;
+        }
+        if (state.atHigh) {
+            added.push_back(*state.atHigh);
+        }
+        if (state.current) {
+            removed.push_back(*state.current);
+        }
+    }
+    if (from > to) {
+        std::swap(added, removed);
+    }
+
+    std::string result = "{\"from\":" + std::to_string(from) + ",\"to\":" + std::to_string(to) +
+                         ",\"added\":" + BeatmapList::renderEntries(added) +
+                         ",\"removed\":" + BeatmapList::renderEntries(removed) + "}";
+    res.set_content(result, "application/json");
+}
+
+void ListHistory::handleRollback(const std::string& username, const httplib::Request& req, httplib::Response& res) {
+    uint64_t version = 0;
+    if (!parseVersionParam(req, "version", version)) {
+        res.status = 400;
+        res.set_content("需要有效的 version 参数", "text/plain; charset=utf-8");
+        return;
+    }
+
+    BeatmapList list;
+    std::string errorMessage;
+    bool loaded;
+    {
+        std::shared_lock<std::shared_mutex> lock(commitMutex_);
+        json manifest = loadManifest(username);
+        loaded = loadVersion(username, manifest, version, list, errorMessage);
+    }
+    if (!loaded) {
+        res.status = 404;
+        res.set_content(errorMessage, "text/plain; charset=utf-8");
+        return;
+    }
+    if (!commit(username, list, errorMessage)) {
+        res.status = 500;
+        res.set_content(errorMessage, "text/plain; charset=utf-8");
+        return;
+    }
+    res.set_content("已回滚到版本 " + std::to_string(version), "text/plain; charset=utf-8");
+}
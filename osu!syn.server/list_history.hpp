@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include "httplib.h"
+#include "3rdparty/nlohmann/json.hpp"
+#include "beatmap_list.hpp"
+#include "list_store.hpp"
+#include "logger.hpp"
+#include "storage.hpp"
+
+// 用户谱面列表的版本历史
+// 最新版本由 ListStore 保存，旧版本以“反向增量”保存在 <user>/.history/<版本号>.delta，
+// 每 kKeyframeInterval 个版本额外保存一份完整快照，使读取任意版本最多回放固定数量的增量。
+// 增量与快照都使用规范二进制编码：增量由“加回的条目（携带旧版本的合集信息）”与“删除的条目”两个列表组成
+class ListHistory {
+public:
+    static constexpr uint64_t kKeyframeInterval = 16;
+
+    ListHistory(std::shared_ptr<Storage> storage, std::shared_ptr<ListStore> lists,
+                size_t maxVersions, std::shared_ptr<Logger> logger);
+
+    // 判断上传路径是否为用户谱面列表（顶层 <user>.json），是则返回用户名
+    static bool isListPath(const fs::path& relPath, std::string& username);
+
+    // 提交新版本：生成上一版本的反向增量后覆盖最新版本
+    bool commit(const std::string& username, const BeatmapList& next, std::string& errorMessage);
+
+    enum class PatchResult {
+        Applied,    // 已提交（或没有任何改动），version 为当前版本
+        Conflict,   // base 不是当前版本，version 为当前版本
+        Rejected,   // 结果超出条目数上限
+        Failed
+    };
+
+    // 增量提交：在 base 版本上删除 removeSetIds 中的谱面，再并入 add 中的条目（同键时替换）。
+    // 归并的同时得到反向增量，不必与旧列表整体比较；removeSetIds 须已排序。
+    // 结果仍作为完整的新版本写入存储，写入的开销与列表大小成正比
+    PatchResult patch(const std::string& username, uint64_t base, const BeatmapList& add,
+                      const std::vector<uint64_t>& removeSetIds, size_t maxEntries,
+                      uint64_t& version, size_t& entries, std::string& errorMessage);
+
+    // GET /versions/<user>
+    void handleListVersions(const std::string& username, httplib::Response& res);
+
+    // GET /download/<user>/<user>.json?version=N
+    void handleGetVersion(const std::string& username, uint64_t version, httplib::Response& res);
+
+    // GET /diff/<user>?from=A&to=B
+    void handleDiff(const std::string& username, const httplib::Request& req, httplib::Response& res);
+
+    // POST /rollback/<user>?version=N：以旧版本内容提交一个新版本
+    void handleRollback(const std::string& username, const httplib::Request& req, httplib::Response& res);
+
+private:
+    struct Delta {
+        BeatmapList added;      // 回到旧版本需要加回（或替换为）的条目，以及旧版本的合集信息
+        BeatmapList removed;    // 回到旧版本需要删除的条目
+    };
+
+    static Delta reverseDelta(const BeatmapList& previous, const BeatmapList& next);
+    static std::string encodeDelta(uint64_t version, const Delta& delta);
+    static bool decodeDelta(const std::string& content, Delta& delta);
+
+    fs::path historyDir(const std::string& username) const;
+    fs::path deltaPath(const std::string& username, uint64_t version) const;
+    fs::path keyframePath(const std::string& username, uint64_t version) const;
+    fs::path manifestPath(const std::string& username) const;
+
+    nlohmann::json loadManifest(const std::string& username) const;
+    bool loadVersion(const std::string& username, const nlohmann::json& manifest, uint64_t version,
+                     BeatmapList& list, std::string& errorMessage) const;
+    bool loadDelta(const std::string& username, uint64_t version, Delta& delta) const;
+    // 读取当前列表并修正清单，以下两个函数须在持有 commitMutex_ 时调用
+    bool loadCurrent(const std::string& username, nlohmann::json& manifest, BeatmapList& current) const;
+    // previous 为空表示此前没有列表，此时不写增量
+    bool commitLocked(const std::string& username, nlohmann::json& manifest, const BeatmapList* previous,
+                      const Delta& delta, const BeatmapList& next, std::string& errorMessage);
+    void prune(const std::string& username, nlohmann::json& manifest);
+
+    std::shared_ptr<Storage> storage_;
+    std::shared_ptr<ListStore> lists_;
+    size_t maxVersions_;
+    std::shared_ptr<Logger> logger_;
+    std::shared_mutex commitMutex_;     // 提交独占；读取清单、版本与增量时共享，读到的清单与文件一致
+};
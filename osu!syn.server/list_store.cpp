@@ -0,0 +1,162 @@
+#include "list_store.hpp"
+#include "binary_io.hpp"
+#include <cstdio>
+#include <fstream>
+#include <zlib.h>
+
+ListStore::ListStore(std::shared_ptr<Storage> storage, size_t cacheBytes, std::shared_ptr<Logger> logger)
+    : storage_(storage)
+    , cacheBytes_(cacheBytes)
+    , logger_(logger) {}
+
+fs::path ListStore::listPath(const std::string& username) {
+    return username + ".list";
+}
+
+fs::path ListStore::legacyPath(const std::string& username) {
+    return username + ".json";
+}
+
+bool ListStore::exists(const std::string& username) const {
+    return storage_->exists(listPath(username)) || storage_->exists(legacyPath(username));
+}
+
+bool ListStore::load(const std::string& username, BeatmapList& list, std::string& errorMessage) const {
+    std::string content;
+    errorMessage.clear();
+    if (storage_->read(listPath(username), content)) {
+        return BeatmapList::decode(content, list, errorMessage);
+    }
+    if (storage_->read(legacyPath(username), content)) {
+        return BeatmapList::parse(content, list, errorMessage);
+    }
+    return false;
+}
+
+bool ListStore::loadSetIds(const std::string& username, std::vector<uint64_t>& setIds,
+                           std::string& errorMessage) const {
+    std::string content;
+    errorMessage.clear();
+    if (storage_->read(listPath(username), content)) {
+        if (!BeatmapList::readSetIds(content, setIds)) {
+            errorMessage = "谱面列表编码损坏: " + username;
+            return false;
+        }
+        return true;
+    }
+
+    BeatmapList list;
+    if (!storage_->read(legacyPath(username), content)) {
+        return false;
+    }
+    if (!BeatmapList::parse(content, list, errorMessage)) {
+        return false;
+    }
+    setIds.clear();
+    for (const auto& entry : list.entries) {
+        setIds.push_back(entry.setId);
+    }
+    return true;
+}
+
+bool ListStore::fingerprint(const std::string& username, std::string& tag) const {
+    uint32_t crc = 0;
+    // 编码末尾的 CRC 覆盖整个列表，只需读取最后 4 个字节
+    // （不能用整个文件的 CRC：带 CRC 尾部的数据整体的 CRC 恒为同一个值）
+    std::ifstream file(storage_->root() / listPath(username), std::ios::binary | std::ios::ate);
+    char trailer[4];
+    std::string content;
+    if (file && file.tellg() >= 4 && file.seekg(-4, std::ios::end) && file.read(trailer, 4)) {
+        crc = binary_io::getU32(trailer);
+    } else if (storage_->read(listPath(username), content) && content.size() >= 4) {
+        // 冷层中的列表
+        crc = binary_io::getU32(content.data() + content.size() - 4);
+    } else {
+        if (!storage_->read(legacyPath(username), content)) {
+            return false;
+        }
+        crc = ChecksumIndex::compute(content);
+    }
+    char buffer[16];
+    std::snprintf(buffer, sizeof(buffer), "%08x", crc);
+    tag = buffer;
+    return true;
+}
+
+bool ListStore::save(const std::string& username, const BeatmapList& list, std::string& errorMessage) {
+    if (!storage_->put(listPath(username), list.encode(), errorMessage)) {
+        return false;
+    }
+    if (storage_->exists(legacyPath(username))) {
+        storage_->remove(legacyPath(username), errorMessage);
+    }
+    return true;
+}
+
+void ListStore::touch(const std::string& username) {
+    storage_->touch(listPath(username));
+    storage_->touch(legacyPath(username));
+}
+
+std::shared_ptr<const ListStore::Rendered> ListStore::render(const std::string& username, std::string& errorMessage) {
+    touch(username);
+
+    fs::path path = storage_->root() / listPath(username);
+    std::error_code ec;
+    uintmax_t size = fs::file_size(path, ec);
+    fs::file_time_type mtime = ec ? fs::file_time_type() : fs::last_write_time(path, ec);
+    bool legacy = static_cast<bool>(ec);
+
+    if (!legacy) {
+        std::lock_guard<std::mutex> lock(cacheMutex_);
+        auto it = cache_.find(username);
+        if (it != cache_.end() && it->second.size == size && it->second.mtime == mtime) {
+            lru_.splice(lru_.begin(), lru_, it->second.lru);
+            return it->second.rendered;
+        }
+    }
+
+    BeatmapList list;
+    if (!load(username, list, errorMessage)) {
+        return nullptr;
+    }
+
+    auto rendered = std::make_shared<Rendered>();
+    rendered->json = list.renderJson();
+    char etag[16];
+    std::snprintf(etag, sizeof(etag), "\"%08lx\"",
+                  ::crc32(0L, reinterpret_cast<const Bytef*>(rendered->json.data()),
+                          static_cast<uInt>(rendered->json.size())));
+    rendered->etag = etag;
+
+    // 旧格式的文件会在下次提交时迁移，不进入缓存
+    if (!legacy) {
+        insertCache(username, size, mtime, rendered);
+    }
+    return rendered;
+}
+
+void ListStore::insertCache(const std::string& username, uintmax_t size, fs::file_time_type mtime,
+                            std::shared_ptr<const Rendered> rendered) {
+    std::lock_guard<std::mutex> lock(cacheMutex_);
+    auto it = cache_.find(username);
+    if (it != cache_.end()) {
+        cachedBytes_ -= it->second.rendered->json.size();
+        lru_.erase(it->second.lru);
+        cache_.erase(it);
+    }
+    if (rendered->json.size() > cacheBytes_) {
+        return;
+    }
+
+    while (cachedBytes_ + rendered->json.size() > cacheBytes_ && !lru_.empty()) {
+        auto victim = cache_.find(lru_.back());
+        cachedBytes_ -= victim->second.rendered->json.size();
+        cache_.erase(victim);
+        lru_.pop_back();
+    }
+
+    lru_.push_front(username);
+    cachedBytes_ += rendered->json.size();
+    cache_[username] = CacheEntry{size, mtime, std::move(rendered), lru_.begin()};
+}
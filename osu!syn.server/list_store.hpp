@@ -0,0 +1,69 @@
+#pragma once
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "beatmap_list.hpp"
+#include "logger.hpp"
+#include "storage.hpp"
+
+namespace fs = std::filesystem;
+
+// 用户当前谱面列表的读写入口
+// 列表以规范二进制形式保存在 <user>.list；JSON 响应在首次请求时生成并缓存，
+// 以文件大小和修改时间判断缓存是否过期，因此复制等绕过本类的写入同样会使缓存失效。
+class ListStore {
+public:
+    struct Rendered {
+        std::string json;
+        std::string etag;
+    };
+
+    ListStore(std::shared_ptr<Storage> storage, size_t cacheBytes, std::shared_ptr<Logger> logger);
+
+    static fs::path listPath(const std::string& username);
+    // 引入二进制格式之前保存的 JSON 列表
+    static fs::path legacyPath(const std::string& username);
+
+    bool exists(const std::string& username) const;
+
+    // 读取当前列表，兼容旧的 JSON 文件；不存在时返回 false 且 errorMessage 为空
+    bool load(const std::string& username, BeatmapList& list, std::string& errorMessage) const;
+
+    // 保存新的当前列表，并删除可能残留的旧 JSON 文件
+    bool save(const std::string& username, const BeatmapList& list, std::string& errorMessage);
+
+    // 只读取列表中已排序的 setId，不解码字符串；不存在时返回 false 且 errorMessage 为空
+    bool loadSetIds(const std::string& username, std::vector<uint64_t>& setIds, std::string& errorMessage) const;
+
+    // 当前列表的版本标识（编码尾部的 CRC），列表不存在时返回 false
+    bool fingerprint(const std::string& username, std::string& tag) const;
+
+    // 记录一次来自用户的访问：列表在冷层中时提升回热层
+    void touch(const std::string& username);
+
+    // 取得渲染好的 JSON，列表不存在时返回 nullptr；视为一次访问
+    std::shared_ptr<const Rendered> render(const std::string& username, std::string& errorMessage);
+
+private:
+    struct CacheEntry {
+        uintmax_t size = 0;
+        fs::file_time_type mtime;
+        std::shared_ptr<const Rendered> rendered;
+        std::list<std::string>::iterator lru;
+    };
+
+    void insertCache(const std::string& username, uintmax_t size, fs::file_time_type mtime,
+                     std::shared_ptr<const Rendered> rendered);
+
+    std::shared_ptr<Storage> storage_;
+    size_t cacheBytes_;
+    std::shared_ptr<Logger> logger_;
+
+    std::mutex cacheMutex_;
+    std::unordered_map<std::string, CacheEntry> cache_;
+    std::list<std::string> lru_;    // 最近使用的在前
+    size_t cachedBytes_ = 0;
+};
@@ -1,17 +1,35 @@
+#include <algorithm>
 #include <iostream>
 #include <filesystem>
 #include <locale>
+#include <random>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include "3rdparty/httplib.h"
+#include "club.hpp"
+#include "cluster.hpp"
+#include "cold_tiering.hpp"
+#include "dictionary_store.hpp"
+#include "holders_index.hpp"
+#include "index_checkpoint.hpp"
 #include "logger.hpp"
+#include "metrics.hpp"
+#include "mirror_stats.hpp"
+#include "negative_cache.hpp"
+#include "replication.hpp"
+#include "scrubber.hpp"
 #include "server.hpp"
+#include "similarity_index.hpp"
+#include "snapshot.hpp"
+#include "storage.hpp"
+#include "user_directory.hpp"
 
 namespace fs = std::filesystem;
 
 class Server {
 public:
-    Server() {
+    explicit Server(const std::string& configFile) {
         // 设置UTF-8编码
         #ifdef _WIN32
             setlocale(LC_ALL, "zh_CN.UTF-8");
@@ -21,12 +39,102 @@ public:
         #endif
         
         // 加载配置
-        Config::load("config.json");
+        Config::load(configFile);
         
         // 初始化日志系统
         logger_ = std::make_shared<Logger>(Config::getLogDir());
-        uploadHandler_ = std::make_unique<FileUploadHandler>(Config::getUploadDir(), logger_);
-        downloadHandler_ = std::make_unique<FileDownloadHandler>(Config::getUploadDir(), logger_);
+        metrics_ = std::make_shared<Metrics>();
+
+        // 初始化存储层与变更日志
+        changeLog_ = std::make_shared<ChangeLog>(Config::getDataDir() / "changelog.bin", logger_,
+                                                 Config::getChangeLogSegmentBytes());
+        checksums_ = std::make_shared<ChecksumIndex>(Config::getDataDir() / "checksums.log", logger_);
+
+        // 有检查点时内存索引从检查点加载，只回放之后的变更日志
+        std::string errorMessage;
+        auto checkpoint = IndexCheckpoint::open(Config::getDataDir() / "index.ckpt", errorMessage);
+        if (!checkpoint && !errorMessage.empty()) {
+            logger_->warning("忽略索引检查点: " + errorMessage);
+        }
+        storage_ = std::make_shared<Storage>(Config::getUploadDir(), changeLog_, logger_, checksums_,
+                                             checkpoint.get());
+        if (Config::isDictionaryEnabled()) {
+            dictionaries_ = std::make_shared<DictionaryStore>(Config::getDataDir() / "dictionary", logger_);
+        }
+        if (Config::isColdTierEnabled()) {
+            storage_->attachColdStore(std::make_shared<ColdStore>(Config::getDataDir() / "cold", logger_, dictionaries_));
+            coldTiering_ = std::make_unique<ColdTiering>(storage_,
+                                                         std::chrono::hours(24 * Config::getColdAfterDays()),
+                                                         std::chrono::seconds(Config::getColdTierIntervalSeconds()),
+                                                         metrics_, logger_);
+        }
+        metrics_->registerGauge("osu_sync_changelog_head_seq", [this] {
+            return static_cast<double>(changeLog_->headSeq());
+        });
+        metrics_->registerGauge("osu_sync_changelog_base_seq", [this] {
+            return static_cast<double>(changeLog_->baseSeq());
+        });
+        metrics_->registerGauge("osu_sync_changelog_bytes", [this] {
+            return static_cast<double>(changeLog_->totalBytes());
+        });
+
+        // 持有者索引需要向其他分片汇总，集群管理先于索引创建，拓扑在下面载入
+        cluster_ = std::make_shared<ClusterManager>(Config::getClusterSelf(), storage_, metrics_, logger_);
+        lists_ = std::make_shared<ListStore>(storage_, Config::getListCacheBytes(), logger_);
+        history_ = std::make_shared<ListHistory>(storage_, lists_, Config::getMaxVersions(), logger_);
+        similarity_ = std::make_shared<SimilarityIndex>(storage_, lists_, logger_, checkpoint.get());
+        holders_ = std::make_shared<HoldersIndex>(storage_, lists_, cluster_, logger_, checkpoint.get());
+        users_ = std::make_shared<UserDirectory>(storage_, lists_, logger_);
+        deadSets_ = std::make_unique<NegativeCache>(Config::getDataDir() / "dead_sets.log",
+                                                    std::chrono::hours(Config::getDeadSetTtlHours()),
+                                                    Config::getDeadSetMinReporters(), logger_);
+        mirrorStats_ = std::make_unique<MirrorStats>(std::chrono::hours(Config::getMirrorStatsWindowHours()),
+                                                     Config::getMirrorStatsMirrors(), logger_);
+        metrics_->registerGauge("osu_sync_dead_sets", [this] {
+            return static_cast<double>(deadSets_->size());
+        });
+        metrics_->registerGauge("osu_sync_users", [this] {
+            return static_cast<double>(users_->size());
+        });
+        if (dictionaries_ && !dictionaries_->current()) {
+            // 首次启用时用已有的列表训练；还没有足够的列表时等管理员之后触发
+            if (trainDictionary(errorMessage) == 0) {
+                logger_->info("暂未训练压缩字典: " + errorMessage);
+            }
+        }
+        checkpoint.reset();
+        checkpointer_ = std::make_unique<IndexCheckpointer>(Config::getDataDir() / "index.ckpt", storage_, similarity_, holders_,
+                                                            std::chrono::seconds(Config::getIndexCheckpointIntervalSeconds()),
+                                                            metrics_, logger_);
+        storage_->setUnloggedHook([this] { checkpointer_->invalidate(); });
+        uploadHandler_ = std::make_unique<FileUploadHandler>(storage_, history_, logger_);
+        downloadHandler_ = std::make_unique<FileDownloadHandler>(lists_, logger_, dictionaries_);
+        replicationSource_ = std::make_unique<ReplicationSource>(changeLog_,
+                                                                 std::chrono::minutes(Config::getFollowerRetentionMinutes()),
+                                                                 logger_);
+        snapshotWriter_ = std::make_unique<SnapshotWriter>(storage_, logger_);
+        scrubber_ = std::make_unique<Scrubber>(storage_, Config::getDataDir() / "quarantine",
+                                               Config::isFollower() ? Config::getLeaderUrl() : "",
+                                               Config::getScrubPeers(),
+                                               Config::getScrubBytesPerSecond(),
+                                               std::chrono::seconds(Config::getScrubIntervalSeconds()),
+                                               metrics_, logger_);
+        if (Config::isFollower()) {
+            if (Config::getLeaderUrl().empty()) {
+                throw std::runtime_error("从节点模式需要配置 leaderUrl");
+            }
+            follower_ = std::make_unique<ReplicationFollower>(Config::getLeaderUrl(), storage_, metrics_, logger_);
+        }
+
+        // 分片集群：只有主节点参与路由与再平衡，从节点直接服务本地副本
+        if (!Config::isFollower() && !Config::getClusterSelf().empty()) {
+            ClusterMap map;
+            map.nodes = Config::getClusterNodes();
+            map.virtualNodes = Config::getClusterVirtualNodes();
+            cluster_->load(map, Config::getDataDir() / "cluster.json", true);
+        }
+        club_ = std::make_unique<ClubLists>(lists_, cluster_, Config::getClubMaxMembers(),
+                                            Config::getClubCachedResults(), metrics_, logger_);
         
         setupRoutes();
         setupErrorHandlers();
@@ -35,7 +143,38 @@ public:
     void run() {
         logger_->info("服务器启动中...");
         logger_->info("监听地址: " + Config::getHost() + ":" + std::to_string(Config::getPort()));
+        similarity_->start();
+        holders_->start();
+        if (follower_) {
+            follower_->start();
+        }
+        if (Config::getScrubIntervalSeconds() > 0) {
+            scrubber_->start();
+        }
+        if (coldTiering_) {
+            coldTiering_->start();
+        }
+        if (Config::getIndexCheckpointIntervalSeconds() > 0) {
+            checkpointer_->start();
+        }
         
+        // 启用前端时 httplib 只监听回环地址上的临时端口，对外端口由前端持有
+        if (Config::isFrontendEnabled() && EventFrontend::supported()) {
+            int upstreamPort = server_.bind_to_any_port("127.0.0.1");
+            if (upstreamPort < 0) {
+                throw std::runtime_error("服务器启动失败");
+            }
+            frontend_ = std::make_unique<EventFrontend>(Config::getFrontendOptions(), metrics_, logger_);
+            std::string errorMessage;
+            if (!frontend_->start(Config::getHost(), Config::getPort(), upstreamPort, errorMessage)) {
+                throw std::runtime_error(errorMessage);
+            }
+            if (!server_.listen_after_bind()) {
+                throw std::runtime_error("服务器启动失败");
+            }
+            return;
+        }
+
         if (!server_.listen(Config::getHost(), Config::getPort())) {
             throw std::runtime_error("服务器启动失败");
         }
@@ -43,20 +182,225 @@ public:
 
 private:
     void setupRoutes() {
-        // 文件上传路由
-        server_.Post("/upload", [this](const httplib::Request& req, httplib::Response& res) {
+        // 文件上传路由：请求体由上传处理器边接收边校验
+        server_.set_payload_max_length(Config::getMaxFileSize() + FileUploadHandler::kMultipartOverhead);
+        uploadHandler_->setAdmission([this](const fs::path& savePath, const httplib::Request& req, httplib::Response& res) {
+            std::string username = ClusterManager::usernameForPath(savePath);
+            if (cluster_->redirectIfRemote(username, req, res)) {
+                return false;
+            }
+            // 再平衡迁移不得覆盖属主上已有的（可能更新的）数据
+            bool existing = savePath.has_parent_path() || username.empty() ?
+                            fs::exists(Config::getUploadDir() / savePath) : lists_->exists(username);
+            if (req.has_header("X-Cluster-Transfer") && existing) {
+                res.set_content("属主已有该文件，跳过迁移", "text/plain; charset=utf-8");
+                return false;
+            }
+            return true;
+        });
+        server_.Post("/upload", [this](const httplib::Request& req, httplib::Response& res,
+                                       const httplib::ContentReader& reader) {
             logger_->info("收到上传请求");
-            uploadHandler_->handleUpload(req, res);
+            if (follower_) {
+                res.status = 403;
+                res.set_header("X-Leader-Url", Config::getLeaderUrl());
+                res.set_header("Connection", "close");
+                res.set_content("当前节点为只读从节点，请向主节点上传", "text/plain; charset=utf-8");
+                return;
+            }
+            uploadHandler_->handleUpload(req, res, reader);
             logger_->info("处理上传请求完成: " + std::to_string(res.status));
         });
 
         // 文件下载路由
         server_.Get(R"(/download/([^/]+)/([^/]+\.json))", [this](const httplib::Request& req, httplib::Response& res) {
             logger_->info("收到下载请求");
+            std::string username = req.matches[1];
+            if (!req.has_header("X-Cluster-Internal")) {
+                if (cluster_->redirectIfRemote(username, req, res)) {
+                    return;
+                }
+                if (!lists_->exists(username)) {
+                    cluster_->fetchFromPreviousOwner(username);
+                }
+            }
+            if (req.has_param("version")) {
+                uint64_t version = 0;
+                try {
+                    version = std::stoull(req.get_param_value("version"));
+                } catch (const std::exception&) {
+                    res.status = 400;
+                    res.set_content("无效的版本号", "text/plain; charset=utf-8");
+                    return;
+                }
+                history_->handleGetVersion(username, version, res);
+                return;
+            }
             downloadHandler_->handleDownload(req, res);
             logger_->info("处理下载请求完成: " + std::to_string(res.status));
         });
 
+        // 复制流路由（从节点也可作为下游从节点的数据源）
+        // 流中包含全部数据，且 X-Follower-Id 会保留日志段，因此只对持有管理令牌的从节点开放
+        server_.Get("/replication/stream", [this](const httplib::Request& req, httplib::Response& res) {
+            if (!AdminAuth::authorize(req, res)) {
+                return;
+            }
+            replicationSource_->handleStream(req, res);
+        });
+
+        // 快照路由：导出一致的时间点备份
+        server_.Get("/admin/snapshot", [this](const httplib::Request& req, httplib::Response& res) {
+            if (!AdminAuth::authorize(req, res)) {
+                return;
+            }
+            snapshotWriter_->handleSnapshot(req, res);
+        });
+
+        // 后台巡检路由
+        server_.Post("/admin/scrub", [this](const httplib::Request& req, httplib::Response& res) {
+            if (!AdminAuth::authorize(req, res)) {
+                return;
+            }
+            scrubber_->handleTrigger(req, res);
+        });
+        server_.Get("/admin/object", [this](const httplib::Request& req, httplib::Response& res) {
+            if (!AdminAuth::authorize(req, res)) {
+                return;
+            }
+            scrubber_->handleGetObject(req, res);
+        });
+
+        // 压缩字典路由：客户端缓存字典后以 x-deflate-dict 编码下载列表
+        server_.Get(R"(/dictionary(?:/(\d+))?)", [this](const httplib::Request& req, httplib::Response& res) {
+            if (!dictionaries_) {
+                res.status = 404;
+                res.set_content("压缩字典未启用", "text/plain; charset=utf-8");
+                return;
+            }
+            dictionaries_->handleGet(req.matches[1], res);
+        });
+        server_.Post("/admin/dictionary", [this](const httplib::Request& req, httplib::Response& res) {
+            if (!AdminAuth::authorize(req, res)) {
+                return;
+            }
+            if (!dictionaries_) {
+                res.status = 404;
+                res.set_content("压缩字典未启用", "text/plain; charset=utf-8");
+                return;
+            }
+            std::string errorMessage;
+            uint32_t version = trainDictionary(errorMessage);
+            if (version == 0) {
+                res.status = 409;
+                res.set_content(errorMessage, "text/plain; charset=utf-8");
+                return;
+            }
+            res.set_content("{\"version\":" + std::to_string(version) + ",\"size\":" +
+                                std::to_string(dictionaries_->byVersion(version)->data.size()) + "}",
+                            "application/json");
+        });
+
+        // 列表版本历史路由
+        server_.Get(R"(/versions/([^/]+))", [this](const httplib::Request& req, httplib::Response& res) {
+            if (cluster_->redirectIfRemote(req.matches[1], req, res)) {
+                return;
+            }
+            history_->handleListVersions(req.matches[1], res);
+        });
+        server_.Get(R"(/diff/([^/]+))", [this](const httplib::Request& req, httplib::Response& res) {
+            if (cluster_->redirectIfRemote(req.matches[1], req, res)) {
+                return;
+            }
+            history_->handleDiff(req.matches[1], req, res);
+        });
+        server_.Post(R"(/rollback/([^/]+))", [this](const httplib::Request& req, httplib::Response& res) {
+            if (follower_) {
+                res.status = 403;
+                res.set_header("X-Leader-Url", Config::getLeaderUrl());
+                res.set_content("当前节点为只读从节点，请向主节点提交", "text/plain; charset=utf-8");
+                return;
+            }
+            if (cluster_->redirectIfRemote(req.matches[1], req, res)) {
+                return;
+            }
+            history_->handleRollback(req.matches[1], req, res);
+        });
+
+        server_.Patch(R"(/list/([^/]+))", [this](const httplib::Request& req, httplib::Response& res) {
+            if (follower_) {
+                res.status = 403;
+                res.set_header("X-Leader-Url", Config::getLeaderUrl());
+                res.set_content("当前节点为只读从节点，请向主节点提交", "text/plain; charset=utf-8");
+                return;
+            }
+            if (cluster_->redirectIfRemote(req.matches[1], req, res)) {
+                return;
+            }
+            uploadHandler_->handlePatch(req.matches[1], req, res);
+        });
+
+        // 社团列表路由：成员可以分布在不同的分片上，由接收请求的节点汇总
+        server_.Get("/club", [this](const httplib::Request& req, httplib::Response& res) {
+            club_->handleClub(req, res);
+        });
+
+        // 相似曲库推荐路由：每个分片只索引自己负责的用户
+        server_.Get(R"(/recommend/([^/]+))", [this](const httplib::Request& req, httplib::Response& res) {
+            if (cluster_->redirectIfRemote(req.matches[1], req, res)) {
+                return;
+            }
+            similarity_->handleRecommend(req.matches[1], req, res);
+        });
+
+        // 谱面集持有者路由：/has 重定向到属主；/holders 由接收请求的节点向各分片汇总
+        server_.Get(R"(/holders/([^/]+))", [this](const httplib::Request& req, httplib::Response& res) {
+            holders_->handleHolders(req.matches[1], req, res);
+        });
+        server_.Get(R"(/has/([^/]+)/([^/]+))", [this](const httplib::Request& req, httplib::Response& res) {
+            if (cluster_->redirectIfRemote(req.matches[1], req, res)) {
+                return;
+            }
+            holders_->handleHas(req.matches[1], req.matches[2], res);
+        });
+
+        // 用户目录路由：按前缀查找用户名，每个分片只列出自己负责的用户
+        server_.Get("/users", [this](const httplib::Request& req, httplib::Response& res) {
+            users_->handleList(req, res);
+        });
+
+        // 失效谱面集路由：客户端上报镜像站上已不存在的谱面集，规划下载前获取失效集合
+        server_.Post("/dead-sets", [this](const httplib::Request& req, httplib::Response& res) {
+            deadSets_->handleReport(req, res);
+        });
+        server_.Get("/dead-sets", [this](const httplib::Request& req, httplib::Response& res) {
+            deadSets_->handleGet(req, res);
+        });
+
+        // 镜像站统计路由：客户端匿名提交每个镜像站的表现，服务器汇总成镜像站提示
+        server_.Post("/mirror-stats", [this](const httplib::Request& req, httplib::Response& res) {
+            mirrorStats_->handleReport(req, res);
+        });
+        server_.Get("/mirror-hints", [this](const httplib::Request& req, httplib::Response& res) {
+            mirrorStats_->handleHints(req, res);
+        });
+
+        // 集群拓扑路由
+        server_.Get("/cluster", [this](const httplib::Request& req, httplib::Response& res) {
+            cluster_->handleGetMap(req, res);
+        });
+        server_.Post("/cluster", [this](const httplib::Request& req, httplib::Response& res) {
+            if (!AdminAuth::authorize(req, res)) {
+                return;
+            }
+            cluster_->handleUpdateMap(req, res);
+        });
+
+        // 指标路由
+        server_.Get("/metrics", [this](const httplib::Request&, httplib::Response& res) {
+            res.set_content(metrics_->render(), "text/plain; version=0.0.4");
+        });
+
         // 健康检查路由
         server_.Get("/health", [](const httplib::Request&, httplib::Response& res) {
             res.set_content("OK", "text/plain");
@@ -66,7 +410,10 @@ private:
     void setupErrorHandlers() {
         server_.set_error_handler([this](const httplib::Request&, httplib::Response& res) {
             logger_->error("发生错误: " + std::to_string(res.status));
-            res.set_content("服务器错误", "text/plain; charset=utf-8");
+            // 保留处理函数给出的具体错误信息
+            if (res.body.empty()) {
+                res.set_content("服务器错误", "text/plain; charset=utf-8");
+            }
         });
 
         server_.set_exception_handler([this](const httplib::Request&, httplib::Response& res, std::exception_ptr ep) {
@@ -80,15 +427,103 @@ private:
         });
     }
 
+    // 从随机抽取的用户列表训练新的压缩字典，返回当前版本号，失败时返回 0
+    uint32_t trainDictionary(std::string& errorMessage) {
+        std::vector<std::string> users;
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator(storage_->root(), ec)) {
+            if (entry.is_regular_file(ec) && entry.path().extension() == ".list") {
+                users.push_back(entry.path().stem().string());
+            }
+        }
+        for (const auto& relPath : storage_->coldFiles()) {
+            if (!relPath.has_parent_path() && relPath.extension() == ".list") {
+                users.push_back(relPath.stem().string());
+            }
+        }
+        std::vector<std::string> picked;
+        std::sample(users.begin(), users.end(), std::back_inserter(picked), Config::getDictionarySampleLists(),
+                    std::mt19937(std::random_device{}()));
+
+        std::vector<BeatmapList> samples;
+        samples.reserve(picked.size());
+        for (const auto& username : picked) {
+            BeatmapList list;
+            if (lists_->load(username, list, errorMessage)) {
+                samples.push_back(std::move(list));
+            }
+        }
+        if (samples.size() < 2) {
+            errorMessage = "样本不足，至少需要两个用户列表";
+            return 0;
+        }
+        return dictionaries_->train(samples, errorMessage);
+    }
+
     httplib::Server server_;
+    std::unique_ptr<EventFrontend> frontend_;
     std::shared_ptr<Logger> logger_;
+    std::shared_ptr<Metrics> metrics_;
+    std::shared_ptr<ChangeLog> changeLog_;
+    std::shared_ptr<ChecksumIndex> checksums_;
+    std::shared_ptr<Storage> storage_;
+    std::shared_ptr<ListStore> lists_;
+    std::shared_ptr<ListHistory> history_;
     std::unique_ptr<FileUploadHandler> uploadHandler_;
     std::unique_ptr<FileDownloadHandler> downloadHandler_;
+    std::unique_ptr<ReplicationSource> replicationSource_;
+    std::unique_ptr<SnapshotWriter> snapshotWriter_;
+    std::unique_ptr<Scrubber> scrubber_;
+    std::unique_ptr<ColdTiering> coldTiering_;
+    std::unique_ptr<ReplicationFollower> follower_;
+    std::shared_ptr<ClusterManager> cluster_;
+    std::unique_ptr<ClubLists> club_;
+    std::shared_ptr<SimilarityIndex> similarity_;
+    std::shared_ptr<HoldersIndex> holders_;
+    std::shared_ptr<UserDirectory> users_;
+    std::unique_ptr<NegativeCache> deadSets_;
+    std::unique_ptr<MirrorStats> mirrorStats_;
+    std::unique_ptr<IndexCheckpointer> checkpointer_;
+    std::shared_ptr<DictionaryStore> dictionaries_;
 };
 
+// 从快照恢复到配置中的（空）数据目录后退出，不启动任何后台线程
+int restoreSnapshot(const std::string& configFile, const fs::path& archive, size_t threads) {
+    Config::load(configFile);
+    auto logger = std::make_shared<Logger>(Config::getLogDir());
+    auto changeLog = std::make_shared<ChangeLog>(Config::getDataDir() / "changelog.bin", logger,
+                                                 Config::getChangeLogSegmentBytes());
+    auto checksums = std::make_shared<ChecksumIndex>(Config::getDataDir() / "checksums.log", logger);
+    auto storage = std::make_shared<Storage>(Config::getUploadDir(), changeLog, logger, checksums);
+    // 旧的索引检查点与恢复后的数据无关
+    std::error_code ec;
+    fs::remove(Config::getDataDir() / "index.ckpt", ec);
+
+    std::string errorMessage;
+    SnapshotRestorer restorer(storage, logger);
+    if (!restorer.restore(archive, threads, errorMessage)) {
+        std::cerr << "恢复失败: " << errorMessage << std::endl;
+        return 1;
+    }
+    std::cout << "恢复完成，当前序号 " << changeLog->headSeq() << std::endl;
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
     try {
-        Server server;
+        // 可通过第一个参数指定配置文件，便于在同一台机器上运行多个节点
+        std::string configFile = argc > 1 ? argv[1] : "config.json";
+
+        // osu_sync_server <config> --restore <archive> [--threads N]
+        if (argc > 3 && std::string(argv[2]) == "--restore") {
+            size_t threads = std::max(1u, std::thread::hardware_concurrency());
+            if (argc > 5 && std::string(argv[4]) == "--threads") {
+                threads = std::stoul(argv[5]);
+            }
+            return restoreSnapshot(configFile, argv[3], threads);
+        }
+
+        Server server(configFile);
 
 	        server.run();
         return 0;
@@ -0,0 +1,33 @@
+#include "metrics.hpp"
+#include <sstream>
+
+void Metrics::setGauge(const std::string& name, double value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    gauges_[name] = value;
+}
+
+void Metrics::addCounter(const std::string& name, double delta) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    counters_[name] += delta;
+}
+
+void Metrics::registerGauge(const std::string& name, std::function<double()> provider) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    providers_[name] = std::move(provider);
+}
+
+std::string Metrics::render() const {
+    std::ostringstream out;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (const auto& [name, value] : counters_) {
+        out << "# TYPE " << name << " counter\n" << name << " " << value << "\n";
+    }
+    for (const auto& [name, value] : gauges_) {
+        out << "# TYPE " << name << " gauge\n" << name << " " << value << "\n";
+    }
+    for (const auto& [name, provider] : providers_) {
+        out << "# TYPE " << name << " gauge\n" << name << " " << provider() << "\n";
+    }
+    return out.str();
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+// 简单的指标注册表，以 Prometheus 文本格式输出到 /metrics
+class Metrics {
+public:
+    // 设置瞬时值
+    void setGauge(const std::string& name, double value);
+
+    // 累加计数器
+    void addCounter(const std::string& name, double delta = 1);
+
+    // 注册在输出时才求值的指标（例如复制延迟）
+    void registerGauge(const std::string& name, std::function<double()> provider);
+
+    std::string render() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::map<std::string, double> gauges_;
+    std::map<std::string, double> counters_;
+    std::map<std::string, std::function<double()>> providers_;
+};
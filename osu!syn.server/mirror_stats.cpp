@@ -0,0 +1,148 @@
+#include "mirror_stats.hpp"
+#include <algorithm>
+#include <cmath>
+#include "3rdparty/nlohmann/json.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+constexpr size_t kMaxReportsPerBucket = 1000;   // 每个镜像站每小时计入的报告数上限
+constexpr double kMaxReportSeconds = 7 * 24 * 3600.0;
+constexpr uint64_t kMaxReportCount = 1000000;
+
+int64_t currentHour() {
+    return std::chrono::duration_cast<std::chrono::hours>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// 会打乱 values 的顺序；空时为 0
+double median(std::vector<float>& values) {
+    if (values.empty()) {
+        return 0;
+    }
+    auto middle = values.begin() + values.size() / 2;
+    std::nth_element(values.begin(), middle, values.end());
+    return *middle;
+}
+
+}  // namespace
+
+MirrorStats::MirrorStats(std::chrono::hours window,
+                         const std::vector<std::string>& mirrors,
+                         std::shared_ptr<Logger> logger)
+    : window_(std::max(window, std::chrono::hours(1)))
+    , known_(mirrors.begin(), mirrors.end())
+    , logger_(logger) {}
+
+void MirrorStats::expire(int64_t hour) {
+    for (auto it = mirrors_.begin(); it != mirrors_.end();) {
+        auto& buckets = it->second;
+        while (!buckets.empty() && buckets.front().hour <= hour - window_.count()) {
+            buckets.pop_front();
+        }
+        it = buckets.empty() ? mirrors_.erase(it) : std::next(it);
+    }
+}
+
+void MirrorStats::handleReport(const httplib::Request& req, httplib::Response& res) {
+    std::string name;
+    double bytes;
+    double seconds;
+    uint64_t succeeded;
+    uint64_t failed;
+    try {
+        json body = json::parse(req.body);
+        name = body.at("mirror").get<std::string>();
+        bytes = body.at("bytes").get<double>();
+        seconds = body.at("seconds").get<double>();
+        succeeded = body.at("succeeded").get<uint64_t>();
+        failed = body.at("failed").get<uint64_t>();
+    } catch (const std::exception&) {
+        res.status = 400;
+        res.set_content("请求体须为 {\"mirror\", \"bytes\", \"seconds\", \"succeeded\", \"failed\"}",
+                        "text/plain; charset=utf-8");
+        return;
+    }
+    if (known_.count(name) == 0) {
+        res.status = 400;
+        res.set_content("未知的镜像站", "text/plain; charset=utf-8");
+        return;
+    }
+    // seconds 为 0 表示客户端的批次全部被限速，没有可用的吞吐测量，只计入成功率
+    if (!(bytes >= 0) || !(seconds >= 0) || seconds > kMaxReportSeconds || (seconds == 0 && bytes > 0) ||
+        succeeded > kMaxReportCount || failed > kMaxReportCount || succeeded + failed == 0) {
+        res.status = 400;
+        res.set_content("无效的统计数据", "text/plain; charset=utf-8");
+        return;
+    }
+
+    int64_t hour = currentHour();
+    bool accepted = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        expire(hour);
+        auto& buckets = mirrors_[name];
+        if (buckets.empty() || buckets.back().hour != hour) {
+            buckets.emplace_back();
+            buckets.back().hour = hour;
+        }
+        Bucket& bucket = buckets.back();
+        // 只有失败的报告同样占用名额
+        if (bucket.reports < kMaxReportsPerBucket) {
+            bucket.reports++;
+            // 没有成功的下载或没有测量耗时时吞吐没有意义，只计入成功率
+            if (succeeded > 0 && seconds > 0) {
+                bucket.throughputs.push_back(static_cast<float>(bytes / seconds));
+            }
+            bucket.successRates.push_back(static_cast<float>(
+                static_cast<double>(succeeded) / static_cast<double>(succeeded + failed)));
+            accepted = true;
+        }
+    }
+    json response = {{"accepted", accepted}};
+    res.set_content(response.dump(), "application/json");
+}
+
+void MirrorStats::handleHints(const httplib::Request&, httplib::Response& res) {
+    struct Hint {
+        std::string mirror;
+        size_t reports = 0;
+        double throughput = 0;
+        double successRate = 0;
+    };
+    std::vector<Hint> hints;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        expire(currentHour());
+        for (const auto& [name, buckets] : mirrors_) {
+            Hint hint;
+            hint.mirror = name;
+            std::vector<float> throughputs;
+            std::vector<float> successRates;
+            for (const auto& bucket : buckets) {
+                throughputs.insert(throughputs.end(), bucket.throughputs.begin(), bucket.throughputs.end());
+                successRates.insert(successRates.end(), bucket.successRates.begin(), bucket.successRates.end());
+            }
+            hint.reports = successRates.size();
+            hint.throughput = median(throughputs);
+            hint.successRate = median(successRates);
+            hints.push_back(std::move(hint));
+        }
+    }
+    // 期望的有效吞吐：吞吐的中位数乘以成功率
+    std::sort(hints.begin(), hints.end(), [](const Hint& a, const Hint& b) {
+        return a.throughput * a.successRate > b.throughput * b.successRate;
+    });
+
+    json mirrors = json::array();
+    for (const auto& hint : hints) {
+        mirrors.push_back({{"mirror", hint.mirror},
+                           {"reports", hint.reports},
+                           {"bytesPerSecond", static_cast<uint64_t>(hint.throughput)},
+                           {"successRate", std::round(hint.successRate * 1000) / 1000}});
+    }
+    json response = {{"windowHours", window_.count()}, {"mirrors", mirrors}};
+    res.set_header("Cache-Control", "public, max-age=300");
+    res.set_content(response.dump(), "application/json");
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "httplib.h"
+#include "logger.hpp"
+
+// 众包的镜像站表现统计与镜像站提示
+// 客户端可以在一次导入结束时匿名提交每个镜像站的吞吐与成败次数（不含用户名，也不记录来源地址），
+// 服务器按小时分桶，只保留最近 windowHours 小时；GET /mirror-hints 返回按表现排序的简短提示，
+// 客户端在自己还没有测量数据时据此选择镜像站。
+// 吞吐与成功率都取各次报告的中位数（成功率按每次报告各自的比例计算），
+// 单个客户端的异常报告——包括成败次数很大的报告——影响有限。
+// 只接受配置中已知的镜像站，每个镜像站每小时计入的报告数有上限。统计只在内存中保留，重启后重新积累。
+class MirrorStats {
+public:
+    MirrorStats(std::chrono::hours window, const std::vector<std::string>& mirrors, std::shared_ptr<Logger> logger);
+
+    // POST /mirror-stats，请求体 {"mirror", "bytes", "seconds", "succeeded", "failed"}
+    void handleReport(const httplib::Request& req, httplib::Response& res);
+
+    // GET /mirror-hints
+    void handleHints(const httplib::Request& req, httplib::Response& res);
+
+private:
+    struct Bucket {
+        int64_t hour = 0;                   // unix 时间 / 3600
+        size_t reports = 0;
+        std::vector<float> throughputs;     // 有成功下载的报告的字节每秒
+        std::vector<float> successRates;    // 每次报告的成功比例
+    };
+
+    // 丢弃窗口之外的桶；须持有 mutex_
+    void expire(int64_t hour);
+
+    std::chrono::hours window_;
+    std::set<std::string> known_;
+    std::shared_ptr<Logger> logger_;
+
+    std::mutex mutex_;
+    std::map<std::string, std::deque<Bucket>> mirrors_;     // 镜像站 -> 按时间排序的桶
+};
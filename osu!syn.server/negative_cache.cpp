@@ -0,0 +1,327 @@
+#include "negative_cache.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <sstream>
+#include "3rdparty/nlohmann/json.hpp"
+#include "binary_io.hpp"
+#include "checksum_index.hpp"
+#include "event_frontend.hpp"
+
+using json = nlohmann::json;
+using binary_io::putVarint;
+
+namespace {
+
+constexpr size_t kMaxReportSize = 1000;     // 单次上报的 setId 数上限
+constexpr size_t kMaxMirrors = 16;
+constexpr size_t kMaxEntriesPerMirror = 50000;
+constexpr int64_t kPruneIntervalSeconds = 60;
+constexpr size_t kMinRewriteLines = 100000; // 日志不足此行数时不重写
+
+int64_t unixSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+NegativeCache::NegativeCache(const fs::path& file,
+                             std::chrono::seconds ttl,
+                             size_t minReporters,
+                             std::shared_ptr<Logger> logger)
+    : file_(file)
+    , ttl_(ttl)
+    , minReporters_(std::max<size_t>(minReporters, 1))
+    , logger_(logger) {
+    load();
+}
+
+bool NegativeCache::isValidMirror(const std::string& mirror) {
+    return !mirror.empty() && mirror.size() <= 32 &&
+           std::all_of(mirror.begin(), mirror.end(), [](char c) {
+               return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '_';
+           });
+}
+
+bool NegativeCache::expired(const Entry& entry, int64_t now) const {
+    return now - entry.lastReport > ttl_.count();
+}
+
+void NegativeCache::load() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    {
+        std::ifstream in(file_);
+        int64_t seconds;
+        uint32_t reporter;
+        std::string name;
+        uint32_t setId;
+        std::string line;
+        while (std::getline(in, line)) {
+            // 崩溃时可能留下不完整的最后一行，格式不符的行直接忽略
+            std::istringstream fields(line);
+            if (fields >> seconds >> std::hex >> reporter >> name >> std::dec >> setId && isValidMirror(name)) {
+                Mirror* mirror = mirrorFor(name, seconds);
+                if (mirror != nullptr && admit(*mirror, setId, seconds)) {
+                    record(*mirror, setId, reporter, seconds);
+                }
+            }
+        }
+    }
+
+    // 重写日志，只保留未过期的记录
+    rewriteLog(unixSeconds());
+
+    size_t dead = 0;
+    for (const auto& [name, mirror] : mirrors_) {
+        for (const auto& [setId, entry] : mirror.entries) {
+            dead += entry.reporters.size() >= minReporters_;
+        }
+    }
+    if (dead > 0) {
+        logger_->info("失效谱面集缓存已加载: " + std::to_string(dead) + " 个谱面集");
+    }
+}
+
+void NegativeCache::rewriteLog(int64_t now) {
+    out_.close();
+    fs::path temp = file_;
+    temp += ".tmp";
+    size_t lines = 0;
+    {
+        std::ofstream ofs(temp, std::ios::trunc);
+        char reporter[9];
+        for (auto it = mirrors_.begin(); it != mirrors_.end();) {
+            prune(it->second, now);
+            if (it->second.entries.empty()) {
+                it = mirrors_.erase(it);
+                continue;
+            }
+            for (const auto& [setId, entry] : it->second.entries) {
+                for (uint32_t id : entry.reporters) {
+                    std::snprintf(reporter, sizeof(reporter), "%08x", id);
+                    ofs << entry.lastReport << ' ' << reporter << ' ' << it->first << ' ' << setId << '\n';
+                    lines++;
+                }
+            }
+            ++it;
+        }
+    }
+    std::error_code ec;
+    fs::rename(temp, file_, ec);
+    if (ec) {
+        logger_->warning("重写失效谱面集日志失败: " + ec.message());
+    }
+    out_.open(file_, std::ios::app);
+    logLines_ = lines;
+    rewriteAt_ = std::max(kMinRewriteLines, lines * 2);
+}
+
+NegativeCache::Mirror* NegativeCache::mirrorFor(const std::string& name, int64_t now) {
+    auto it = mirrors_.find(name);
+    if (it != mirrors_.end()) {
+        return &it->second;
+    }
+    if (mirrors_.size() >= kMaxMirrors) {
+        // 先丢弃条目已全部过期的镜像站；每个镜像站的清理仍受间隔限制
+        for (auto m = mirrors_.begin(); m != mirrors_.end();) {
+            if (now - m->second.lastPrune >= kPruneIntervalSeconds) {
+                prune(m->second, now);
+            }
+            m = m->second.entries.empty() ? mirrors_.erase(m) : std::next(m);
+        }
+        if (mirrors_.size() >= kMaxMirrors) {
+            return nullptr;
+        }
+    }
+    return &mirrors_[name];
+}
+
+bool NegativeCache::admit(Mirror& mirror, uint32_t setId, int64_t now) {
+    bool full = mirror.entries.size() >= kMaxEntriesPerMirror;
+    // 平时按间隔清理；条目已满时每秒最多清理一次，避免全是失效条目时每次上报都遍历
+    if (now - mirror.lastPrune >= kPruneIntervalSeconds || (full && now > mirror.lastPrune)) {
+        prune(mirror, now);
+    }
+    return mirror.entries.size() < kMaxEntriesPerMirror || mirror.entries.count(setId) > 0;
+}
+
+bool NegativeCache::record(Mirror& mirror, uint32_t setId, uint32_t reporter, int64_t seconds) {
+    Entry& entry = mirror.entries[setId];
+    if (expired(entry, seconds)) {
+        entry = Entry();
+    }
+    bool wasDead = entry.reporters.size() >= minReporters_;
+    entry.lastReport = std::max(entry.lastReport, seconds);
+    if (!wasDead && std::find(entry.reporters.begin(), entry.reporters.end(), reporter) == entry.reporters.end()) {
+        entry.reporters.push_back(reporter);
+    }
+    // 已失效的条目再次被上报时过期时间顺延，同样需要重新编码
+    bool changed = wasDead || entry.reporters.size() >= minReporters_;
+    if (changed) {
+        mirror.version++;
+    }
+    return changed;
+}
+
+void NegativeCache::prune(Mirror& mirror, int64_t now) {
+    mirror.lastPrune = now;
+    std::vector<std::pair<int64_t, uint32_t>> pending;
+    for (auto it = mirror.entries.begin(); it != mirror.entries.end();) {
+        bool dead = it->second.reporters.size() >= minReporters_;
+        if (expired(it->second, now)) {
+            mirror.version += dead;
+            it = mirror.entries.erase(it);
+            continue;
+        }
+        if (!dead) {
+            pending.emplace_back(it->second.lastReport, it->first);
+        }
+        ++it;
+    }
+    if (mirror.entries.size() < kMaxEntriesPerMirror) {
+        return;
+    }
+    // 仍然满：淘汰最早上报的一半未判定条目，给新的上报腾出位置
+    size_t evict = std::min(pending.size(), mirror.entries.size() - kMaxEntriesPerMirror / 2);
+    std::nth_element(pending.begin(), pending.begin() + evict, pending.end());
+    for (size_t i = 0; i < evict; i++) {
+        mirror.entries.erase(pending[i].second);
+    }
+}
+
+void NegativeCache::encode(Mirror& mirror, int64_t now) {
+    std::vector<uint32_t> dead;
+    int64_t expiry = std::numeric_limits<int64_t>::max();
+    for (auto it = mirror.entries.begin(); it != mirror.entries.end();) {
+        if (expired(it->second, now)) {
+            it = mirror.entries.erase(it);
+            continue;
+        }
+        if (it->second.reporters.size() >= minReporters_) {
+            dead.push_back(it->first);
+            expiry = std::min(expiry, it->second.lastReport + ttl_.count() + 1);
+        }
+        ++it;
+    }
+    std::sort(dead.begin(), dead.end());
+
+    mirror.encoded.clear();
+    putVarint(mirror.encoded, dead.size());
+    uint32_t previous = 0;
+    for (uint32_t setId : dead) {
+        putVarint(mirror.encoded, setId - previous);
+        previous = setId;
+    }
+    mirror.encodedVersion = mirror.version;
+    mirror.encodedExpiry = expiry;
+}
+
+void NegativeCache::handleReport(const httplib::Request& req, httplib::Response& res) {
+    std::string name;
+    std::vector<uint32_t> setIds;
+    try {
+        json body = json::parse(req.body);
+        name = body.at("mirror").get<std::string>();
+        const auto& ids = body.at("setIds");
+        if (!ids.is_array() || ids.size() > kMaxReportSize) {
+            throw std::runtime_error("setIds");
+        }
+        for (const auto& id : ids) {
+            if (!id.is_number_unsigned() || id.get<uint64_t>() == 0 ||
+                id.get<uint64_t>() > std::numeric_limits<uint32_t>::max()) {
+                throw std::runtime_error("setId");
+            }
+            setIds.push_back(id.get<uint32_t>());
+        }
+    } catch (const std::exception&) {
+        res.status = 400;
+        res.set_content("请求体须为 {\"mirror\": 镜像站, \"setIds\": [setId...]}，每次最多 " +
+                        std::to_string(kMaxReportSize) + " 个", "text/plain; charset=utf-8");
+        return;
+    }
+    if (!isValidMirror(name)) {
+        res.status = 400;
+        res.set_content("无效的镜像站名称", "text/plain; charset=utf-8");
+        return;
+    }
+
+    // 以来源地址区分上报者，同一地址的重复上报只算一次
+    uint32_t reporter = ChecksumIndex::compute(EventFrontend::clientAddress(req));
+    int64_t now = unixSeconds();
+    size_t accepted = 0;
+    size_t dead = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Mirror* mirror = mirrorFor(name, now);
+        if (mirror == nullptr) {
+            res.status = 503;
+            res.set_content("镜像站数量已达上限", "text/plain; charset=utf-8");
+            return;
+        }
+        char id[9];
+        std::snprintf(id, sizeof(id), "%08x", reporter);
+        for (uint32_t setId : setIds) {
+            if (!admit(*mirror, setId, now)) {
+                continue;
+            }
+            dead += record(*mirror, setId, reporter, now);
+            out_ << now << ' ' << id << ' ' << name << ' ' << setId << '\n';
+            logLines_++;
+            accepted++;
+        }
+        out_.flush();
+        if (logLines_ >= rewriteAt_) {
+            rewriteLog(now);
+        }
+    }
+    json response = {{"accepted", accepted}, {"dead", dead}};
+    res.set_content(response.dump(), "application/json");
+}
+
+void NegativeCache::handleGet(const httplib::Request& req, httplib::Response& res) {
+    std::string name = req.has_param("mirror") ? req.get_param_value("mirror") : "";
+    if (!isValidMirror(name)) {
+        res.status = 400;
+        res.set_content("需要有效的 mirror 参数", "text/plain; charset=utf-8");
+        return;
+    }
+
+    std::string encoded;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = mirrors_.find(name);
+        if (it != mirrors_.end()) {
+            Mirror& mirror = it->second;
+            int64_t now = unixSeconds();
+            if (mirror.encodedVersion != mirror.version || mirror.encoded.empty() || now >= mirror.encodedExpiry) {
+                encode(mirror, now);
+            }
+            encoded = mirror.encoded;
+        } else {
+            putVarint(encoded, 0);
+        }
+    }
+
+    // ETag 取内容的 CRC，重启后依然有效
+    char etag[11];
+    std::snprintf(etag, sizeof(etag), "\"%08x\"", ChecksumIndex::compute(encoded));
+    res.set_header("ETag", etag);
+    if (req.get_header_value("If-None-Match") == etag) {
+        res.status = 304;
+        return;
+    }
+    res.set_content(encoded, "application/octet-stream");
+}
+
+size_t NegativeCache::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t now = unixSeconds();
+    size_t dead = 0;
+    for (const auto& [name, mirror] : mirrors_) {
+        for (const auto& [setId, entry] : mirror.entries) {
+            dead += entry.reporters.size() >= minReporters_ && !expired(entry, now);
+        }
+    }
+    return dead;
+}
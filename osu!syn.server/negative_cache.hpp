@@ -0,0 +1,84 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "httplib.h"
+#include "logger.hpp"
+
+namespace fs = std::filesystem;
+
+// 镜像站上已不存在的谱面集的共享负缓存
+// 客户端下载时遇到永久性失败（镜像站返回“资源不存在”）后上报，服务器按镜像站汇总；
+// 来自足够多不同地址的上报才把谱面集判定为失效，在最后一次上报后的 TTL 内有效。
+// 客户端规划下载前获取失效集合，直接跳过这些谱面集，不再每次同步都耗尽重试与超时。
+// 失效的谱面集不再被尝试，也就不再有新的上报，TTL 过后自然重新尝试一次。
+//
+// 上报记录追加到文本日志，每行 "<unix 秒> <上报者> <镜像站> <setId>"，启动时回放并丢弃过期的记录，
+// 运行中日志增长到存活记录的数倍时同样重写。每个节点各自维护，不参与复制。
+//
+// 上报无需认证，镜像站数与每个镜像站的条目数都有上限；上报时定期清理过期条目，
+// 条目已满时先淘汰最早的一半尚未判定失效的条目，已判定失效的条目只随过期删除。
+class NegativeCache {
+public:
+    NegativeCache(const fs::path& file, std::chrono::seconds ttl, size_t minReporters, std::shared_ptr<Logger> logger);
+
+    // POST /dead-sets，请求体 {"mirror": 镜像站, "setIds": [setId...]}
+    void handleReport(const httplib::Request& req, httplib::Response& res);
+
+    // GET /dead-sets?mirror=
+    // 响应为二进制：varint 个数，之后是按差值编码的升序 varint setId；ETag 随内容变化
+    void handleGet(const httplib::Request& req, httplib::Response& res);
+
+    // 当前判定为失效的谱面集数
+    size_t size();
+
+    // 镜像站名称只接受小写字母、数字、'-' 与 '_'，同时保证日志中不含空白
+    static bool isValidMirror(const std::string& mirror);
+
+private:
+    struct Entry {
+        int64_t lastReport = 0;
+        std::vector<uint32_t> reporters;    // 不同上报者的标识，达到 minReporters_ 后不再增加
+    };
+    struct Mirror {
+        std::unordered_map<uint32_t, Entry> entries;
+        int64_t lastPrune = 0;      // 上一次清理过期条目的时间
+        uint64_t version = 0;       // 内容变化时递增
+        std::string encoded;        // 按 version 缓存的响应体
+        uint64_t encodedVersion = 0;
+        int64_t encodedExpiry = 0;  // 缓存中最早过期的条目的过期时间
+    };
+
+    void load();
+    // 以下须持有 mutex_
+    // 查找或创建镜像站，镜像站数已达上限时返回 nullptr
+    Mirror* mirrorFor(const std::string& name, int64_t now);
+    // 条目已满且无法腾出位置时返回 false，不记录
+    bool admit(Mirror& mirror, uint32_t setId, int64_t now);
+    // 记录一次上报，返回失效集合是否因此变化
+    bool record(Mirror& mirror, uint32_t setId, uint32_t reporter, int64_t seconds);
+    // 删除过期条目；仍然满时淘汰较早的一半未判定条目
+    void prune(Mirror& mirror, int64_t now);
+    // 重新编码失效集合，顺便删除过期条目
+    void encode(Mirror& mirror, int64_t now);
+    // 以存活的记录重写日志
+    void rewriteLog(int64_t now);
+    bool expired(const Entry& entry, int64_t now) const;
+
+    fs::path file_;
+    std::chrono::seconds ttl_;
+    size_t minReporters_;
+    std::shared_ptr<Logger> logger_;
+
+    std::mutex mutex_;
+    std::ofstream out_;
+    size_t logLines_ = 0;       // 日志当前的行数
+    size_t rewriteAt_ = 0;      // 行数达到此值时重写日志
+    std::unordered_map<std::string, Mirror> mirrors_;
+};
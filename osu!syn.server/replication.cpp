@@ -0,0 +1,282 @@
+#include "replication.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include "server.hpp"
+#include "snapshot.hpp"
+
+namespace {
+
+constexpr auto kHeartbeatInterval = std::chrono::milliseconds(1000);
+constexpr auto kReconnectDelay = std::chrono::seconds(2);
+constexpr size_t kBatchRecords = 256;
+constexpr size_t kBatchBytes = 4 * 1024 * 1024;
+
+int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void updateMax(std::atomic<uint64_t>& target, uint64_t value) {
+    uint64_t current = target.load();
+    while (current < value && !target.compare_exchange_weak(current, value)) {
+    }
+}
+
+} // anonymous namespace
+
+ReplicationSource::ReplicationSource(std::shared_ptr<ChangeLog> changeLog, std::chrono::minutes retention,
+                                     std::shared_ptr<Logger> logger)
+    : changeLog_(changeLog)
+    , retention_(retention)
+    , logger_(logger) {}
+
+std::shared_ptr<ChangeLog::Hold> ReplicationSource::holdFor(const std::string& follower, uint64_t from) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t now = nowMs();
+    for (auto it = followers_.begin(); it != followers_.end();) {
+        it = it->second->expired(now) ? followers_.erase(it) : std::next(it);
+    }
+    // 同一从节点重连时旧连接可能还没结束，每个连接各用一个保留点，表中记录最新的一个
+    auto hold = changeLog_->hold(from);
+    followers_[follower] = hold;
+    return hold;
+}
+
+void ReplicationSource::handleStream(const httplib::Request& req, httplib::Response& res) {
+    uint64_t from = 1;
+    if (req.has_param("from")) {
+        try {
+            from = std::stoull(req.get_param_value("from"));
+        } catch (const std::exception&) {
+            res.status = 400;
+            res.set_content("无效的起始序号", "text/plain; charset=utf-8");
+            return;
+        }
+    }
+
+    uint64_t head = changeLog_->headSeq();
+    if (from <= changeLog_->baseSeq()) {
+        res.status = 410;
+        res.set_content("请求的记录已不在日志中，请先从快照恢复", "text/plain; charset=utf-8");
+        return;
+    }
+    if (from == 0 || from > head + 1) {
+        res.status = 409;
+        res.set_content("起始序号超出主节点日志范围，当前末尾: " + std::to_string(head),
+                        "text/plain; charset=utf-8");
+        return;
+    }
+
+    std::string peer = EventFrontend::clientAddress(req);
+    logger_->info("从节点 " + peer + " 开始复制，起始序号: " + std::to_string(from));
+
+    auto hold = holdFor(req.has_header("X-Follower-Id") ? req.get_header_value("X-Follower-Id") : peer, from);
+    auto next = std::make_shared<uint64_t>(from);
+    res.set_chunked_content_provider("application/octet-stream",
+        [this, next, hold](size_t, httplib::DataSink& sink) {
+            // 上一批已经送出；这里起的记录在从节点确认之前都要保留
+            hold->update(*next);
+            if (*next <= changeLog_->baseSeq()) {
+                // 保留点过期后日志已被回收，断开后从节点会收到 410
+                return false;
+            }
+            auto records = changeLog_->readFrom(*next, kBatchRecords, kBatchBytes);
+            if (records.empty()) {
+                changeLog_->waitForNewer(*next - 1, kHeartbeatInterval);
+                records = changeLog_->readFrom(*next, kBatchRecords, kBatchBytes);
+            }
+
+            std::string out;
+            for (const auto& record : records) {
+                ChangeLog::encode(record, out);
+                *next = record.seq + 1;
+            }
+
+            // 每批数据后附带心跳，告知从节点主节点当前的末尾位置
+            LogRecord heartbeat;
+            heartbeat.op = LogRecord::Op::Heartbeat;
+            heartbeat.seq = changeLog_->headSeq();
+            heartbeat.timestampMs = changeLog_->headTimestamp();
+            ChangeLog::encode(heartbeat, out);
+
+            return sink.write(out.data(), out.size());
+        },
+        [this, hold](bool) {
+            hold->expireAt(nowMs() + std::chrono::duration_cast<std::chrono::milliseconds>(retention_).count());
+        });
+}
+
+ReplicationFollower::ReplicationFollower(const std::string& leaderUrl,
+                                         std::shared_ptr<Storage> storage,
+                                         std::shared_ptr<Metrics> metrics,
+                                         std::shared_ptr<Logger> logger)
+    : leaderUrl_(leaderUrl)
+    , storage_(storage)
+    , metrics_(metrics)
+    , logger_(logger) {
+    std::mt19937_64 random(std::random_device{}());
+    char id[17];
+    snprintf(id, sizeof(id), "%016llx", static_cast<unsigned long long>(random()));
+    id_ = id;
+    metrics_->registerGauge("osu_sync_replication_applied_seq", [this] { return static_cast<double>(appliedSeq()); });
+    metrics_->registerGauge("osu_sync_replication_leader_seq", [this] { return static_cast<double>(leaderSeq()); });
+    metrics_->registerGauge("osu_sync_replication_lag_records", [this] {
+        uint64_t applied = appliedSeq();
+        uint64_t leader = leaderSeq();
+        return leader > applied ? static_cast<double>(leader - applied) : 0.0;
+    });
+    metrics_->registerGauge("osu_sync_replication_lag_seconds", [this] { return lagSeconds(); });
+    metrics_->registerGauge("osu_sync_replication_connected", [this] { return connected() ? 1.0 : 0.0; });
+    metrics_->registerGauge("osu_sync_replication_last_contact_seconds", [this] {
+        int64_t last = lastContactMs_;
+        return last == 0 ? -1.0 : (nowMs() - last) / 1000.0;
+    });
+}
+
+ReplicationFollower::~ReplicationFollower() {
+    stop();
+}
+
+void ReplicationFollower::start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    thread_ = std::thread([this] { run(); });
+}
+
+void ReplicationFollower::stop() {
+    running_ = false;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+double ReplicationFollower::lagSeconds() const {
+    if (appliedSeq() >= leaderSeq()) {
+        return 0.0;
+    }
+    int64_t lag = leaderTimestampMs_ - appliedTimestampMs_;
+    return lag > 0 ? lag / 1000.0 : 0.0;
+}
+
+void ReplicationFollower::run() {
+    logger_->info("以从节点模式运行，主节点: " + leaderUrl_);
+    while (running_) {
+        streamOnce();
+        connected_ = false;
+        if (!running_) {
+            break;
+        }
+        if (reseedNeeded_) {
+            reseedNeeded_ = false;
+            if (reseed()) {
+                continue;
+            }
+        }
+        logger_->warning("与主节点的复制连接断开，稍后重连");
+        std::this_thread::sleep_for(kReconnectDelay);
+    }
+}
+
+bool ReplicationFollower::streamOnce() {
+    httplib::Client client(leaderUrl_);
+    client.set_connection_timeout(5, 0);
+    client.set_read_timeout(10, 0);
+
+    uint64_t from = appliedSeq() + 1;
+    ChangeLog::Decoder decoder;
+    bool applyFailed = false;
+
+    auto result = client.Get("/replication/stream?from=" + std::to_string(from), httplib::Headers{{"X-Follower-Id", id_}, {"X-Admin-Token", Config::getAdminToken()}},
+        [&](const httplib::Response& response) {
+            if (response.status == 410) {
+                logger_->warning("主节点的日志已不包含序号 " + std::to_string(from) + "，需要从快照重新初始化");
+                reseedNeeded_ = true;
+                return false;
+            }
+            if (response.status != 200) {
+                logger_->error("主节点拒绝复制请求: " + std::to_string(response.status));
+                return false;
+            }
+            connected_ = true;
+            logger_->info("已连接主节点，从序号 " + std::to_string(from) + " 开始复制");
+            return true;
+        },
+        [&](const char* data, size_t length) {
+            decoder.feed(data, length);
+            lastContactMs_ = nowMs();
+
+            LogRecord record;
+            while (decoder.next(record)) {
+                if (record.op == LogRecord::Op::Heartbeat) {
+                    updateMax(leaderSeq_, record.seq);
+                    leaderTimestampMs_ = record.timestampMs;
+                    continue;
+                }
+
+                std::string errorMessage;
+                if (!storage_->apply(record, errorMessage)) {
+                    logger_->error("应用复制记录失败: " + errorMessage);
+                    applyFailed = true;
+                    return false;
+                }
+                appliedTimestampMs_ = record.timestampMs;
+                updateMax(leaderSeq_, record.seq);
+                metrics_->addCounter("osu_sync_replication_applied_records_total");
+            }
+
+            if (decoder.corrupt()) {
+                logger_->error("复制流数据损坏");
+                return false;
+            }
+            return running_.load();
+        });
+
+    if (!result && running_ && !applyFailed) {
+        logger_->warning("复制流结束: " + httplib::to_string(result.error()));
+    }
+    return !applyFailed;
+}
+
+bool ReplicationFollower::reseed() {
+    fs::path archive = Config::getDataDir() / "reseed.ossnap";
+    {
+        httplib::Client client(leaderUrl_);
+        client.set_connection_timeout(5, 0);
+        client.set_read_timeout(60, 0);
+        std::ofstream out(archive, std::ios::binary | std::ios::trunc);
+        int status = 0;
+        auto result = client.Get("/admin/snapshot", httplib::Headers{{"X-Admin-Token", Config::getAdminToken()}},
+            [&](const httplib::Response& response) {
+                status = response.status;
+                return status == 200;
+            },
+            [&](const char* data, size_t length) {
+                out.write(data, static_cast<std::streamsize>(length));
+                return static_cast<bool>(out) && running_.load();
+            });
+        out.close();
+        if (!result || status != 200 || !out) {
+            logger_->error("下载主节点快照失败: " + (status != 0 ? std::to_string(status) : httplib::to_string(result.error())));
+            std::error_code ec;
+            fs::remove(archive, ec);
+            return false;
+        }
+    }
+
+    // 快照下载完整后才清空本地日志；恢复期间读请求看到的是新旧数据的混合，完成后与主节点一致
+    storage_->changeLog()->reset();
+    std::string errorMessage;
+    SnapshotRestorer restorer(storage_, logger_);
+    bool restored = restorer.restore(archive, std::max(1u, std::thread::hardware_concurrency()), errorMessage, true);
+    std::error_code ec;
+    fs::remove(archive, ec);
+    if (!restored) {
+        logger_->error("从快照重新初始化失败: " + errorMessage);
+        return false;
+    }
+    metrics_->addCounter("osu_sync_replication_reseeds_total");
+    return true;
+}
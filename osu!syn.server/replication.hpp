@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "httplib.h"
+#include "changelog.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "storage.hpp"
+
+// 主节点：通过长连接 HTTP 流向从节点推送变更日志
+// 每个从节点（按 X-Follower-Id 区分）持有一个日志保留点，跟随复制进度前移；
+// 连接断开后保留点继续有效 retention 时长，期间重连的从节点不会因日志回收而需要重新初始化
+class ReplicationSource {
+public:
+    ReplicationSource(std::shared_ptr<ChangeLog> changeLog, std::chrono::minutes retention,
+                      std::shared_ptr<Logger> logger);
+
+    // GET /replication/stream?from=<seq>，需要管理令牌（主从节点须配置相同的 adminToken）
+    void handleStream(const httplib::Request& req, httplib::Response& res);
+
+private:
+    // 为从节点登记新的保留点，顺便清理已过期的
+    std::shared_ptr<ChangeLog::Hold> holdFor(const std::string& follower, uint64_t from);
+
+    std::shared_ptr<ChangeLog> changeLog_;
+    std::chrono::minutes retention_;
+    std::shared_ptr<Logger> logger_;
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<ChangeLog::Hold>> followers_;
+};
+
+// 从节点：持续跟随主节点的变更日志并写入本地存储
+// 主节点已回收所需的日志（410）时，下载主节点的快照并从中重新初始化本地存储，之后继续跟随
+class ReplicationFollower {
+public:
+    ReplicationFollower(const std::string& leaderUrl,
+                        std::shared_ptr<Storage> storage,
+                        std::shared_ptr<Metrics> metrics,
+                        std::shared_ptr<Logger> logger);
+    ~ReplicationFollower();
+
+    void start();
+    void stop();
+
+    uint64_t appliedSeq() const { return storage_->changeLog()->headSeq(); }
+    uint64_t leaderSeq() const { return leaderSeq_; }
+    bool connected() const { return connected_; }
+
+    // 以主节点时钟计算的落后时间（秒），已追平时为 0
+    double lagSeconds() const;
+
+private:
+    void run();
+    bool streamOnce();
+    bool reseed();
+
+    std::string leaderUrl_;
+    std::string id_;            // 本进程的从节点标识，主节点据此保留日志
+    std::shared_ptr<Storage> storage_;
+    std::shared_ptr<Metrics> metrics_;
+    std::shared_ptr<Logger> logger_;
+
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> connected_{false};
+    bool reseedNeeded_ = false;
+    std::atomic<uint64_t> leaderSeq_{0};
+    std::atomic<int64_t> leaderTimestampMs_{0};
+    std::atomic<int64_t> appliedTimestampMs_{0};
+    std::atomic<int64_t> lastContactMs_{0};
+};
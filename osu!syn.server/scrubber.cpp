@@ -0,0 +1,491 @@
+#include "scrubber.hpp"
+#include <fstream>
+#include <vector>
+#include <zlib.h>
+#include "3rdparty/nlohmann/json.hpp"
+#include "beatmap_list.hpp"
+#include "binary_io.hpp"
+#include "server.hpp"
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using binary_io::getU16;
+using binary_io::getU32;
+
+namespace {
+
+constexpr size_t kReadChunk = 64 * 1024;
+constexpr uint32_t kLocalHeaderSig = 0x04034b50;
+constexpr uint32_t kCentralHeaderSig = 0x02014b50;
+constexpr uint32_t kEndOfCentralDirSig = 0x06054b50;
+constexpr size_t kEndOfCentralDirSize = 22;
+constexpr uint32_t kZip64Marker = 0xFFFFFFFF;
+
+int64_t nowSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool isZipPath(const fs::path& path) {
+    auto ext = path.extension();
+    return ext == ".zip" || ext == ".osz" || ext == ".osk";
+}
+
+bool isJsonPath(const fs::path& path) {
+    return path.extension() == ".json";
+}
+
+bool isListPath(const fs::path& path) {
+    // 当前列表与版本历史中的完整快照
+    auto ext = path.extension();
+    return ext == ".list" || ext == ".full";
+}
+
+// 解压（或直接读取）一个 ZIP 条目并计算 CRC32
+bool entryChecksum(const char* data, size_t size, uint16_t method, uint32_t& crc) {
+    crc = ::crc32(0L, Z_NULL, 0);
+    if (method == 0) {
+        crc = ::crc32(crc, reinterpret_cast<const Bytef*>(data), static_cast<uInt>(size));
+        return true;
+    }
+
+    z_stream stream{};
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        return false;
+    }
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = static_cast<uInt>(size);
+
+    unsigned char buffer[kReadChunk];
+    int rc;
+    do {
+        stream.next_out = buffer;
+        stream.avail_out = sizeof(buffer);
+        rc = inflate(&stream, Z_NO_FLUSH);
+        if (rc != Z_OK && rc != Z_STREAM_END) {
+            break;
+        }
+        crc = ::crc32(crc, buffer, static_cast<uInt>(sizeof(buffer) - stream.avail_out));
+    } while (rc != Z_STREAM_END && (stream.avail_in > 0 || stream.avail_out == 0));
+    inflateEnd(&stream);
+    return rc == Z_STREAM_END;
+}
+
+// 降低巡检线程的 CPU 与 I/O 优先级，避免与在线请求竞争
+void lowerThreadPriority() {
+#ifdef __linux__
+    pid_t tid = static_cast<pid_t>(::syscall(SYS_gettid));
+    ::setpriority(PRIO_PROCESS, tid, 19);
+#ifdef SYS_ioprio_set
+    constexpr int kIoprioWhoProcess = 1;
+    constexpr int kIoprioClassIdle = 3;
+    ::syscall(SYS_ioprio_set, kIoprioWhoProcess, tid, kIoprioClassIdle << 13);
+#endif
+#endif
+}
+
+} // anonymous namespace
+
+Scrubber::Scrubber(std::shared_ptr<Storage> storage,
+                   const fs::path& quarantineDir,
+                   const std::string& leaderUrl,
+                   const std::vector<std::string>& peers,
+                   size_t bytesPerSecond,
+                   std::chrono::seconds interval,
+                   std::shared_ptr<Metrics> metrics,
+                   std::shared_ptr<Logger> logger)
+    : storage_(storage)
+    , quarantineDir_(quarantineDir)
+    , leaderUrl_(leaderUrl)
+    , peers_(peers)
+    , bytesPerSecond_(bytesPerSecond)
+    , interval_(interval)
+    , metrics_(metrics)
+    , logger_(logger) {
+    metrics_->registerGauge("osu_sync_scrub_pass_progress", [this] { return progress_.load(); });
+}
+
+Scrubber::~Scrubber() {
+    stop();
+}
+
+void Scrubber::start() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_ || !storage_->checksums()) {
+            return;
+        }
+        running_ = true;
+    }
+    thread_ = std::thread([this] { run(); });
+}
+
+void Scrubber::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void Scrubber::requestPass() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        passRequested_ = true;
+    }
+    wake_.notify_all();
+}
+
+void Scrubber::run() {
+    lowerThreadPriority();
+    logger_->info("后台巡检已启动，限速 " + std::to_string(bytesPerSecond_ / 1024) + "KB/s，间隔 " +
+                  std::to_string(interval_.count()) + " 秒");
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            // 启动后先等待一个间隔，避开启动时的流量高峰
+            wake_.wait_for(lock, interval_, [this] { return !running_ || passRequested_; });
+            if (!running_) {
+                break;
+            }
+            passRequested_ = false;
+        }
+        scrubPass();
+    }
+}
+
+void Scrubber::scrubPass() {
+    auto started = std::chrono::steady_clock::now();
+    metrics_->setGauge("osu_sync_scrub_running", 1);
+    progress_ = 0;
+
+    std::vector<fs::path> files;
+    std::error_code ec;
+    const fs::path& root = storage_->root();
+    for (auto it = fs::recursive_directory_iterator(root, ec);
+         it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec) {
+            break;
+        }
+        if (it->is_regular_file() && it->path().extension() != ".tmp") {
+            files.push_back(fs::relative(it->path(), root));
+        }
+    }
+
+    size_t corrupt = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_) {
+                break;
+            }
+        }
+
+        std::string relPath = files[i].generic_string();
+        std::string content;
+        if (readThrottled(files[i], content)) {
+            metrics_->addCounter("osu_sync_scrub_files_checked_total");
+            metrics_->addCounter("osu_sync_scrub_bytes_checked_total", static_cast<double>(content.size()));
+
+            std::string reason;
+            if (!verify(relPath, content, reason)) {
+                ++corrupt;
+                handleCorrupt(relPath, reason);
+            } else {
+                uint32_t recorded;
+                if (!storage_->checksums()->lookup(relPath, recorded)) {
+                    storage_->adoptChecksum(files[i], ChecksumIndex::compute(content));
+                }
+            }
+        }
+        progress_ = static_cast<double>(i + 1) / files.size();
+    }
+
+    storage_->checksums()->compact();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    metrics_->setGauge("osu_sync_scrub_running", 0);
+    metrics_->setGauge("osu_sync_scrub_last_pass_timestamp_seconds", static_cast<double>(nowSeconds()));
+    metrics_->setGauge("osu_sync_scrub_last_pass_duration_seconds", seconds);
+    metrics_->addCounter("osu_sync_scrub_passes_total");
+    logger_->info("巡检完成: " + std::to_string(files.size()) + " 个文件，发现损坏 " +
+                  std::to_string(corrupt) + " 个，耗时 " + std::to_string(static_cast<int>(seconds)) + " 秒");
+}
+
+void Scrubber::throttle(size_t bytes) {
+    if (bytesPerSecond_ == 0) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    // 空闲期间不累积额度，避免之后突发读取
+    if (nextRead_ < now) {
+        nextRead_ = now;
+    }
+    nextRead_ += std::chrono::microseconds(bytes * 1000000 / bytesPerSecond_);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    wake_.wait_until(lock, nextRead_, [this] { return !running_; });
+}
+
+bool Scrubber::readThrottled(const fs::path& relPath, std::string& content) {
+    std::ifstream file(storage_->root() / relPath, std::ios::binary);
+    if (!file) {
+        return false;   // 文件在枚举后被删除
+    }
+
+    char buffer[kReadChunk];
+    while (file) {
+        file.read(buffer, sizeof(buffer));
+        content.append(buffer, static_cast<size_t>(file.gcount()));
+        throttle(static_cast<size_t>(file.gcount()));
+    }
+    return !file.bad();
+}
+
+bool Scrubber::verify(const std::string& relPath, const std::string& content, std::string& reason) const {
+    uint32_t recorded;
+    if (storage_->checksums()->lookup(relPath, recorded) && ChecksumIndex::compute(content) != recorded) {
+        reason = "校验和不匹配";
+        return false;
+    }
+    if (isJsonPath(relPath) && !nlohmann::json::accept(content)) {
+        reason = "JSON 结构损坏";
+        return false;
+    }
+    BeatmapList list;
+    if (isListPath(relPath) && !BeatmapList::parse(content, list, reason)) {
+        return false;
+    }
+    if (isZipPath(relPath) && !checkZip(content, reason)) {
+        return false;
+    }
+    return true;
+}
+
+void Scrubber::handleCorrupt(const std::string& relPath, const std::string& reason) {
+    metrics_->addCounter("osu_sync_scrub_corrupt_files_total");
+    if (leaderUrl_.empty()) {
+        repairOnLeader(relPath, reason);
+        return;
+    }
+    fs::path dest = quarantineDir_ / (relPath + "." + std::to_string(nowSeconds()));
+
+    // 在写锁内复查，避免把刚被正常写入替换的文件误判为损坏
+    std::string errorMessage;
+    bool quarantined = storage_->quarantine(relPath, dest, [&](const std::string& current) {
+        std::string ignored;
+        return !verify(relPath, current, ignored);
+    }, errorMessage);
+    if (!quarantined) {
+        if (!errorMessage.empty()) {
+            logger_->error(errorMessage + " (" + relPath + ")");
+        }
+        return;
+    }
+
+    metrics_->addCounter("osu_sync_scrub_quarantined_files_total");
+    logger_->warning("发现损坏文件 " + relPath + " (" + reason + ")，已隔离到 " + dest.string());
+
+    if (!leaderUrl_.empty() && refetch(relPath)) {
+        metrics_->addCounter("osu_sync_scrub_refetched_files_total");
+        logger_->info("已从主节点重新拉取: " + relPath);
+    }
+}
+
+void Scrubber::repairOnLeader(const std::string& relPath, const std::string& reason) {
+    // 损坏的文件仍在原处时向副本节点取回；校验和记录还在，取回的副本须与之相符
+    std::string replacement;
+    bool found = false;
+    bool unreachable = false;
+    for (const auto& peer : peers_) {
+        std::string content;
+        std::string ignored;
+        int status = fetch(peer, relPath, content);
+        if (status == 200 && verify(relPath, content, ignored)) {
+            replacement = std::move(content);
+            found = true;
+            break;
+        }
+        unreachable = unreachable || status == 0;
+    }
+    if (!found && unreachable) {
+        logger_->warning("发现损坏文件 " + relPath + " (" + reason + ")，部分副本节点无法访问，下一轮巡检重试");
+        return;
+    }
+
+    fs::path dest = quarantineDir_ / (relPath + "." + std::to_string(nowSeconds()));
+    std::string errorMessage;
+    bool repaired = storage_->repair(relPath, dest, [&](const std::string& current) {
+        std::string ignored;
+        return !verify(relPath, current, ignored);
+    }, found ? &replacement : nullptr, errorMessage);
+    if (!repaired) {
+        if (!errorMessage.empty()) {
+            logger_->error(errorMessage + " (" + relPath + ")");
+        }
+        return;
+    }
+
+    metrics_->addCounter("osu_sync_scrub_quarantined_files_total");
+    if (found) {
+        metrics_->addCounter("osu_sync_scrub_refetched_files_total");
+        logger_->warning("发现损坏文件 " + relPath + " (" + reason + ")，已隔离到 " + dest.string() +
+                         "，并以副本节点上的完好副本替换");
+    } else {
+        logger_->error("发现损坏文件 " + relPath + " (" + reason + ")，已隔离到 " + dest.string() +
+                       "，各副本节点都没有完好的副本，已删除");
+    }
+}
+
+int Scrubber::fetch(const std::string& url, const std::string& relPath, std::string& content) {
+    httplib::Client client(url);
+    client.set_connection_timeout(5, 0);
+    client.set_read_timeout(30, 0);
+
+    httplib::Headers headers = {{"X-Admin-Token", Config::getAdminToken()}};
+    auto result = client.Get("/admin/object", httplib::Params{{"path", relPath}}, headers);
+    if (!result) {
+        logger_->warning("从 " + url + " 拉取失败: " + relPath + " (" + httplib::to_string(result.error()) + ")");
+        return 0;
+    }
+    if (result->status == 200) {
+        content = std::move(result->body);
+    }
+    return result->status;
+}
+
+bool Scrubber::refetch(const std::string& relPath) {
+    std::string content;
+    int status = fetch(leaderUrl_, relPath, content);
+    if (status != 200) {
+        if (status != 0) {
+            logger_->warning("从主节点重新拉取失败: " + relPath + " (" + std::to_string(status) + ")");
+        }
+        return false;
+    }
+
+    // 隔离后已没有校验和记录，这里只检查结构
+    std::string reason;
+    if (!verify(relPath, content, reason)) {
+        logger_->error("主节点上的副本同样损坏: " + relPath + " (" + reason + ")");
+        return false;
+    }
+    std::string errorMessage;
+    return storage_->putUnlogged(relPath, content, errorMessage);
+}
+
+void Scrubber::handleTrigger(const httplib::Request&, httplib::Response& res) {
+    if (!storage_->checksums()) {
+        res.status = 409;
+        res.set_content("后台巡检未启用", "text/plain; charset=utf-8");
+        return;
+    }
+    requestPass();
+    res.status = 202;
+    res.set_content("已开始新一轮巡检", "text/plain; charset=utf-8");
+}
+
+void Scrubber::handleGetObject(const httplib::Request& req, httplib::Response& res) {
+    fs::path relPath = req.get_param_value("path");
+    bool valid = !relPath.empty() && !relPath.is_absolute();
+    for (const auto& component : relPath) {
+        valid = valid && component != ".." && component != ".";
+    }
+    if (!valid) {
+        res.status = 400;
+        res.set_content("无效的路径", "text/plain; charset=utf-8");
+        return;
+    }
+
+    std::string content;
+    if (!storage_->read(relPath, content)) {
+        res.status = 404;
+        res.set_content("文件未找到", "text/plain; charset=utf-8");
+        return;
+    }
+    res.set_content(content, "application/octet-stream");
+}
+
+bool Scrubber::checkZip(const std::string& content, std::string& reason) {
+    const char* data = content.data();
+    size_t size = content.size();
+
+    // 目录结尾记录位于文件末尾，之后最多跟 65535 字节的注释
+    size_t eocd = std::string::npos;
+    if (size >= kEndOfCentralDirSize) {
+        size_t lowest = size > kEndOfCentralDirSize + 0xFFFF ? size - kEndOfCentralDirSize - 0xFFFF : 0;
+        for (size_t pos = size - kEndOfCentralDirSize + 1; pos-- > lowest;) {
+            if (getU32(data + pos) == kEndOfCentralDirSig) {
+                eocd = pos;
+                break;
+            }
+        }
+    }
+    if (eocd == std::string::npos) {
+        reason = "ZIP 缺少目录结尾记录";
+        return false;
+    }
+
+    uint16_t entries = getU16(data + eocd + 10);
+    uint32_t directorySize = getU32(data + eocd + 12);
+    uint32_t directoryOffset = getU32(data + eocd + 16);
+    if (directoryOffset == kZip64Marker || directorySize == kZip64Marker) {
+        return true;    // ZIP64 归档只做最基本的检查
+    }
+    if (static_cast<uint64_t>(directoryOffset) + directorySize > eocd) {
+        reason = "ZIP 中央目录越界";
+        return false;
+    }
+
+    size_t pos = directoryOffset;
+    for (uint16_t i = 0; i < entries; ++i) {
+        if (pos + 46 > eocd || getU32(data + pos) != kCentralHeaderSig) {
+            reason = "ZIP 中央目录第 " + std::to_string(i) + " 项损坏";
+            return false;
+        }
+        uint16_t method = getU16(data + pos + 10);
+        uint32_t crc = getU32(data + pos + 16);
+        uint32_t compressedSize = getU32(data + pos + 20);
+        uint16_t nameLength = getU16(data + pos + 28);
+        uint16_t extraLength = getU16(data + pos + 30);
+        uint16_t commentLength = getU16(data + pos + 32);
+        uint32_t localOffset = getU32(data + pos + 42);
+        std::string name(data + pos + 46, std::min<size_t>(nameLength, eocd - pos - 46));
+        pos += 46 + nameLength + extraLength + commentLength;
+
+        if (compressedSize == kZip64Marker || localOffset == kZip64Marker) {
+            continue;
+        }
+        if (static_cast<uint64_t>(localOffset) + 30 > directoryOffset ||
+            getU32(data + localOffset) != kLocalHeaderSig) {
+            reason = "ZIP 条目头损坏: " + name;
+            return false;
+        }
+        uint64_t dataOffset = static_cast<uint64_t>(localOffset) + 30 +
+                              getU16(data + localOffset + 26) + getU16(data + localOffset + 28);
+        if (dataOffset + compressedSize > directoryOffset) {
+            reason = "ZIP 条目数据越界: " + name;
+            return false;
+        }
+
+        // 只校验存储与 deflate 两种常见压缩方式
+        if (method == 0 || method == 8) {
+            uint32_t actual;
+            if (!entryChecksum(data + dataOffset, compressedSize, method, actual) || actual != crc) {
+                reason = "ZIP 条目 CRC 不匹配: " + name;
+                return false;
+            }
+        }
+    }
+    if (pos > eocd) {
+        reason = "ZIP 中央目录越界";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "httplib.h"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "storage.hpp"
+
+// 后台数据巡检
+// 以低优先级、限速的方式逐个重读存储中的文件：校验记录的 CRC32，
+// 并检查 JSON 与谱面列表能否解析、ZIP 归档的目录结构与各条目的 CRC 是否完好。
+// 发现损坏的文件会被移动到隔离目录；从节点随后尝试从主节点重新拉取。
+// 主节点上的文件是各副本的来源，不能只在本地移走：先从配置的副本节点取回完好的副本，
+// 以记日志的写入替换损坏的文件；各副本都没有完好的副本时以记日志的删除移除它，使副本随复制流收敛。
+// 有副本节点暂时无法访问时保持原样，留到下一轮巡检。
+class Scrubber {
+public:
+    Scrubber(std::shared_ptr<Storage> storage,
+             const fs::path& quarantineDir,
+             const std::string& leaderUrl,
+             const std::vector<std::string>& peers,
+             size_t bytesPerSecond,
+             std::chrono::seconds interval,
+             std::shared_ptr<Metrics> metrics,
+             std::shared_ptr<Logger> logger);
+    ~Scrubber();
+
+    void start();
+    void stop();
+
+    // 立即开始一轮巡检（不等待间隔）
+    void requestPass();
+
+    // POST /admin/scrub
+    void handleTrigger(const httplib::Request& req, httplib::Response& res);
+
+    // GET /admin/object?path=<相对路径>，供从节点重新拉取损坏的文件
+    void handleGetObject(const httplib::Request& req, httplib::Response& res);
+
+    // 检查 ZIP 归档结构，损坏时返回 false 并给出原因
+    static bool checkZip(const std::string& content, std::string& reason);
+
+private:
+    void run();
+    void scrubPass();
+    bool readThrottled(const fs::path& relPath, std::string& content);
+    void throttle(size_t bytes);
+    bool verify(const std::string& relPath, const std::string& content, std::string& reason) const;
+    void handleCorrupt(const std::string& relPath, const std::string& reason);
+    void repairOnLeader(const std::string& relPath, const std::string& reason);
+    bool refetch(const std::string& relPath);
+    // 从 url 所指的节点读取文件：返回 HTTP 状态码，无法连接时返回 0
+    int fetch(const std::string& url, const std::string& relPath, std::string& content);
+
+    std::shared_ptr<Storage> storage_;
+    fs::path quarantineDir_;
+    std::string leaderUrl_;
+    std::vector<std::string> peers_;    // 主节点上用于取回完好副本的副本节点
+    size_t bytesPerSecond_;
+    std::chrono::seconds interval_;
+    std::shared_ptr<Metrics> metrics_;
+    std::shared_ptr<Logger> logger_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool running_ = false;
+    bool passRequested_ = false;
+    std::chrono::steady_clock::time_point nextRead_;
+    std::atomic<double> progress_{0};
+};
@@ -1,10 +1,49 @@
 #include "server.hpp"
 #include "logger.hpp"
+#include <algorithm>
+#include <cctype>
+#include <limits>
 #include <fstream>
+#include <zlib.h>
 #include "3rdparty/nlohmann/json.hpp"
 
 using json = nlohmann::json;
 
+namespace {
+
+constexpr size_t kChunkBytes = 64 * 1024;
+
+// 客户端以 Accept-Encoding: x-deflate-dict 与 X-Dictionary-Version 声明持有的字典版本，服务器仍保存该版本时使用；
+// 无论是否使用都告知当前版本，客户端据此决定是否获取新字典
+std::shared_ptr<const DictionaryStore::Dictionary> negotiateDictionary(const DictionaryStore* dictionaries,
+                                                                       const httplib::Request& req,
+                                                                       httplib::Response& res) {
+    if (!dictionaries) {
+        return nullptr;
+    }
+    if (auto latest = dictionaries->current()) {
+        res.set_header("X-Dictionary-Latest", std::to_string(latest->version));
+    }
+    res.set_header("Vary", "Accept-Encoding, X-Dictionary-Version");
+    if (req.get_header_value("Accept-Encoding").find(DictionaryStore::kContentEncoding) == std::string::npos ||
+        !req.has_header("X-Dictionary-Version")) {
+        return nullptr;
+    }
+    std::shared_ptr<const DictionaryStore::Dictionary> dictionary;
+    try {
+        dictionary = dictionaries->byVersion(static_cast<uint32_t>(std::stoul(req.get_header_value("X-Dictionary-Version"))));
+    } catch (const std::exception&) {
+        return nullptr;
+    }
+    if (dictionary) {
+        res.set_header("Content-Encoding", DictionaryStore::kContentEncoding);
+        res.set_header("X-Dictionary-Version", std::to_string(dictionary->version));
+    }
+    return dictionary;
+}
+
+} // anonymous namespace
+
 // 静态成员初始化
 std::string Config::configPath_;
 std::string Config::host_ = "0.0.0.0";
@@ -12,6 +51,37 @@ int Config::port_ = 8080;
 size_t Config::maxFileSize_ = 1024 * 1024 * 100; // 默认100MB
 fs::path Config::uploadDir_ = "uploads";
 fs::path Config::logDir_ = "logs";
+fs::path Config::dataDir_ = "data";
+std::string Config::role_ = "leader";
+std::string Config::leaderUrl_;
+std::string Config::adminToken_;
+std::string Config::clusterSelf_;
+std::vector<std::string> Config::clusterNodes_;
+int Config::clusterVirtualNodes_ = 128;
+size_t Config::maxVersions_ = 50;
+size_t Config::listCacheBytes_ = 64 * 1024 * 1024;
+size_t Config::scrubBytesPerSecond_ = 4 * 1024 * 1024;
+int Config::scrubIntervalSeconds_ = 24 * 3600;
+std::vector<std::string> Config::scrubPeers_;
+BeatmapListLimits Config::uploadLimits_;
+uint64_t Config::quotaBytes_ = 1024ull * 1024 * 1024;
+uint64_t Config::quotaObjects_ = 10000;
+size_t Config::clubMaxMembers_ = 1000;
+size_t Config::clubCachedResults_ = 256;
+bool Config::frontendEnabled_ = true;
+EventFrontend::Options Config::frontendOptions_;
+bool Config::coldTierEnabled_ = true;
+int Config::coldAfterDays_ = 7;
+int Config::coldTierIntervalSeconds_ = 3600;
+int Config::indexCheckpointIntervalSeconds_ = 300;
+bool Config::dictionaryEnabled_ = true;
+size_t Config::dictionarySampleLists_ = 500;
+int Config::deadSetTtlHours_ = 168;
+size_t Config::deadSetMinReporters_ = 2;
+int Config::mirrorStatsWindowHours_ = 24;
+std::vector<std::string> Config::mirrorStatsMirrors_ = {"sayobot", "catboy", "chimu", "nerinyan", "kitsu"};
+uint64_t Config::changeLogSegmentBytes_ = ChangeLog::kDefaultSegmentBytes;
+int Config::followerRetentionMinutes_ = 60;
 
 void Config::load(const std::string& configFile) {
     configPath_ = configFile;
@@ -28,6 +98,74 @@ void Config::load(const std::string& configFile) {
         if (config.contains("maxFileSize")) maxFileSize_ = config["maxFileSize"];
         if (config.contains("uploadDir")) uploadDir_ = config["uploadDir"].get<std::string>();
         if (config.contains("logDir")) logDir_ = config["logDir"].get<std::string>();
+        if (config.contains("dataDir")) dataDir_ = config["dataDir"].get<std::string>();
+        if (config.contains("role")) role_ = config["role"];
+        if (config.contains("leaderUrl")) leaderUrl_ = config["leaderUrl"];
+        if (config.contains("adminToken")) adminToken_ = config["adminToken"];
+        if (config.contains("maxVersions")) maxVersions_ = config["maxVersions"];
+        if (config.contains("listCacheBytes")) listCacheBytes_ = config["listCacheBytes"];
+        if (config.contains("indexCheckpointIntervalSeconds")) indexCheckpointIntervalSeconds_ = config["indexCheckpointIntervalSeconds"];
+        if (config.contains("cluster")) {
+            const auto& cluster = config["cluster"];
+            if (cluster.contains("self")) clusterSelf_ = cluster["self"];
+            if (cluster.contains("nodes")) clusterNodes_ = cluster["nodes"].get<std::vector<std::string>>();
+            if (cluster.contains("virtualNodes")) clusterVirtualNodes_ = cluster["virtualNodes"];
+        }
+        if (config.contains("quota")) {
+            const auto& quota = config["quota"];
+            if (quota.contains("maxBytesPerUser")) quotaBytes_ = quota["maxBytesPerUser"];
+            if (quota.contains("maxObjectsPerUser")) quotaObjects_ = quota["maxObjectsPerUser"];
+        }
+        if (config.contains("club")) {
+            const auto& club = config["club"];
+            if (club.contains("maxMembers")) clubMaxMembers_ = club["maxMembers"];
+            if (club.contains("cachedResults")) clubCachedResults_ = club["cachedResults"];
+        }
+        if (config.contains("frontend")) {
+            const auto& frontend = config["frontend"];
+            if (frontend.contains("enabled")) frontendEnabled_ = frontend["enabled"];
+            if (frontend.contains("maxConnections")) frontendOptions_.maxConnections = frontend["maxConnections"];
+            if (frontend.contains("idleTimeoutSeconds")) frontendOptions_.idleTimeoutSeconds = frontend["idleTimeoutSeconds"];
+            if (frontend.contains("requestTimeoutSeconds")) frontendOptions_.requestTimeoutSeconds = frontend["requestTimeoutSeconds"];
+        }
+        if (config.contains("coldTier")) {
+            const auto& coldTier = config["coldTier"];
+            if (coldTier.contains("enabled")) coldTierEnabled_ = coldTier["enabled"];
+            if (coldTier.contains("coldAfterDays")) coldAfterDays_ = coldTier["coldAfterDays"];
+            if (coldTier.contains("intervalSeconds")) coldTierIntervalSeconds_ = coldTier["intervalSeconds"];
+        }
+        if (config.contains("dictionary")) {
+            const auto& dictionary = config["dictionary"];
+            if (dictionary.contains("enabled")) dictionaryEnabled_ = dictionary["enabled"];
+            if (dictionary.contains("sampleLists")) dictionarySampleLists_ = dictionary["sampleLists"];
+        }
+        if (config.contains("deadSets")) {
+            const auto& deadSets = config["deadSets"];
+            if (deadSets.contains("ttlHours")) deadSetTtlHours_ = deadSets["ttlHours"];
+            if (deadSets.contains("minReporters")) deadSetMinReporters_ = deadSets["minReporters"];
+        }
+        if (config.contains("mirrorStats")) {
+            const auto& mirrorStats = config["mirrorStats"];
+            if (mirrorStats.contains("windowHours")) mirrorStatsWindowHours_ = mirrorStats["windowHours"];
+            if (mirrorStats.contains("mirrors")) mirrorStatsMirrors_ = mirrorStats["mirrors"].get<std::vector<std::string>>();
+        }
+        if (config.contains("changeLog")) {
+            const auto& changeLog = config["changeLog"];
+            if (changeLog.contains("segmentBytes")) changeLogSegmentBytes_ = changeLog["segmentBytes"];
+            if (changeLog.contains("followerRetentionMinutes")) followerRetentionMinutes_ = changeLog["followerRetentionMinutes"];
+        }
+        if (config.contains("scrub")) {
+            const auto& scrub = config["scrub"];
+            if (scrub.contains("bytesPerSecond")) scrubBytesPerSecond_ = scrub["bytesPerSecond"];
+            if (scrub.contains("intervalSeconds")) scrubIntervalSeconds_ = scrub["intervalSeconds"];
+            if (scrub.contains("peers")) scrubPeers_ = scrub["peers"].get<std::vector<std::string>>();
+        }
+        if (config.contains("uploadLimits")) {
+            const auto& limits = config["uploadLimits"];
+            if (limits.contains("maxEntries")) uploadLimits_.maxEntries = limits["maxEntries"];
+            if (limits.contains("maxStringLength")) uploadLimits_.maxStringLength = limits["maxStringLength"];
+            if (limits.contains("maxDepth")) uploadLimits_.maxDepth = limits["maxDepth"];
+        }
         
     } catch (const std::exception& e) {
         std::cerr << "加载配置文件失败: " << e.what() << std::endl;
@@ -43,7 +181,30 @@ bool Config::reload() {
     return true;
 }
 
-bool FileValidator::isSafePath(const fs::path& path, std::string& errorMessage) {
+bool AdminAuth::isAuthorized(const httplib::Request& req) {
+    return !Config::getAdminToken().empty() &&
+           req.get_header_value("X-Admin-Token") == Config::getAdminToken();
+}
+
+bool AdminAuth::authorize(const httplib::Request& req, httplib::Response& res) {
+    if (Config::getAdminToken().empty()) {
+        res.status = 403;
+        res.set_content("未配置 adminToken，管理接口已禁用", "text/plain; charset=utf-8");
+        return false;
+    }
+    if (req.get_header_value("X-Admin-Token") != Config::getAdminToken()) {
+        res.status = 401;
+        res.set_content("管理令牌无效", "text/plain; charset=utf-8");
+        return false;
+    }
+    return true;
+}
+
+bool FileValidator::isSafePath(const fs::path& path, std::string& errorMessage, bool allowInternal) {
+    if (path.empty()) {
+        errorMessage = "文件路径为空";
+        return false;
+    }
     if (path.is_absolute()) {
         errorMessage = "不允许使用绝对路径";
         return false;
@@ -54,14 +215,28 @@ bool FileValidator::isSafePath(const fs::path& path, std::string& errorMessage)
             errorMessage = "不允许使用相对路径导航";
             return false;
         }
+        // 以.开头的路径保留给服务器内部数据（如版本历史）
+        if (!allowInternal && !component.empty() && component.string()[0] == '.') {
+            errorMessage = "不允许使用以.开头的路径";
+            return false;
+        }
     }
 
     return true;
 }
 
 bool FileValidator::isAllowedFileType(const std::string& filename, std::string& errorMessage) {
-    // 允许所有文件类型
-    return true;
+    static const char* const allowed[] = {".json", ".list", ".osz", ".osk", ".osr", ".zip", ".db"};
+    std::string extension = fs::path(filename).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    for (const char* candidate : allowed) {
+        if (extension == candidate) {
+            return true;
+        }
+    }
+    errorMessage = "不支持的文件类型: " + (extension.empty() ? filename : extension);
+    return false;
 }
 
 bool FileValidator::isValidFileSize(size_t fileSize, std::string& errorMessage) {
@@ -85,100 +260,338 @@ bool FileValidator::validateChecksum(const std::string& content,
     return true;
 }
 
-FileUploadHandler::FileUploadHandler(const fs::path& baseUploadDir, std::shared_ptr<Logger> logger)
-    : baseUploadDir_(baseUploadDir)
+// 一次上传请求的接收状态
+struct FileUploadHandler::Upload {
+    enum class Kind {
+        List,       // 顶层 <用户名>.json：流式解析为规范列表
+        Encoded,    // 已编码的 .list
+        Archive,    // ZIP 类归档
+        Raw
+    };
+
+    fs::path savePath;
+    std::string username;
+    Kind kind = Kind::Raw;
+    bool internal = false;   // 经过鉴权的集群迁移
+    bool prepared = false;
+    bool sawFile = false;
+    bool inFile = false;     // 当前分段是 file 字段
+    bool discard = false;    // 准入检查未通过：读完请求体但不保存
+    bool rejected = false;
+    int status = 0;          // 拒绝时的状态码
+    uint64_t declared = 0;   // Content-Length，包含 multipart 开销
+    uint64_t quotaRemaining = std::numeric_limits<uint64_t>::max();
+    size_t received = 0;
+    std::string content;
+    std::unique_ptr<BeatmapListParser> parser;
+    std::unique_ptr<EncodedListValidator> validator;
+};
+
+FileUploadHandler::FileUploadHandler(std::shared_ptr<Storage> storage,
+                                     std::shared_ptr<ListHistory> history,
+                                     std::shared_ptr<Logger> logger)
+    : storage_(storage)
+    , history_(history)
     , logger_(logger) {}
 
-void FileUploadHandler::handleUpload(const httplib::Request& req, httplib::Response& res) {
+void FileUploadHandler::handleUpload(const httplib::Request& req, httplib::Response& res,
+                                     const httplib::ContentReader& reader) {
     logger_->info("收到新的上传请求");
 
-    if (!validateRequest(req, res)) {
+    Upload upload;
+    upload.internal = req.has_header("X-Cluster-Transfer") && AdminAuth::isAuthorized(req);
+
+    if (!req.is_multipart_form_data()) {
+        reject(upload, res, 400, "上传必须使用 multipart/form-data");
         return;
     }
 
-    auto file = req.get_file_value("file");
-    fs::path savePath = req.has_param("filepath") ? 
-                       req.get_param_value("filepath") : 
-                       file.filename;
-                       
-    logger_->info("文件名: " + file.filename + ", 大小: " + 
-                 std::to_string(file.content.size() / 1024) + "KB");
+    // 声明的长度超过上限时直接拒绝，一个字节都不读
+    if (req.has_header("Content-Length")) {
+        try {
+            upload.declared = std::stoull(req.get_header_value("Content-Length"));
+        } catch (const std::exception&) {
+            reject(upload, res, 400, "无效的 Content-Length");
+            return;
+        }
+        std::string errorMessage;
+        if (upload.declared > Config::getMaxFileSize() + kMultipartOverhead) {
+            FileValidator::isValidFileSize(upload.declared, errorMessage);
+            reject(upload, res, 413, errorMessage);
+            return;
+        }
+    }
 
-    std::string errorMessage;
-    if (!FileValidator::isSafePath(savePath, errorMessage)) {
-        res.status = 400;
-        res.set_content(errorMessage, "text/plain; charset=utf-8");
+    // 路径由参数给出时，在读取请求体之前完成全部检查
+    if (req.has_param("filepath") && !prepare(upload, req.get_param_value("filepath"), req, res)) {
         return;
     }
 
-    if (!FileValidator::isAllowedFileType(file.filename, errorMessage)) {
-        res.status = 400;
-        res.set_content(errorMessage, "text/plain; charset=utf-8");
+    bool completed = reader(
+        [&](const httplib::MultipartFormData& part) {
+            upload.inFile = part.name == "file" && !upload.sawFile;
+            if (!upload.inFile) {
+                return true;  // 忽略其他表单字段
+            }
+            upload.sawFile = true;
+            logger_->info("文件名: " + part.filename);
+            return upload.prepared || prepare(upload, part.filename, req, res);
+        },
+        [&](const char* data, size_t size) {
+            return !upload.inFile || receive(upload, data, size, res);
+        });
+
+    if (!completed) {
+        if (upload.rejected) {
+            res.status = upload.status;  // 读取失败时 httplib 会把状态改写为 400
+        } else {
+            reject(upload, res, 400, "上传数据不完整");
+        }
+        logger_->warning("上传在接收过程中被中止: " + upload.savePath.generic_string() +
+                         "，已读取 " + std::to_string(upload.received) + " 字节");
+        return;
+    }
+    if (upload.discard) {
+        return;
+    }
+    if (!upload.sawFile) {
+        reject(upload, res, 400, "未找到上传的文件");
         return;
     }
 
-    if (!FileValidator::isValidFileSize(file.content.size(), errorMessage)) {
-        res.status = 400;
-        res.set_content(errorMessage, "text/plain; charset=utf-8");
+    logger_->info("文件大小: " + std::to_string(upload.received / 1024) + "KB");
+    if (!saveUploadedFile(upload, res)) {
         return;
     }
 
-    fs::path targetPath = baseUploadDir_ / savePath;
+    res.set_content("文件上传成功: " + (storage_->root() / upload.savePath).string(), "text/plain; charset=utf-8");
+}
 
-    if (!prepareUploadDirectory(targetPath.parent_path(), res)) {
-        return;
+bool FileUploadHandler::prepare(Upload& upload, const fs::path& savePath,
+                                const httplib::Request& req, httplib::Response& res) {
+    upload.prepared = true;
+    upload.savePath = savePath;
+
+    std::string errorMessage;
+    if (!FileValidator::isSafePath(savePath, errorMessage, upload.internal)) {
+        reject(upload, res, 400, errorMessage);
+        return false;
     }
 
-    if (!saveUploadedFile(file, targetPath, res)) {
-        return;
+    // 集群迁移会搬运版本历史等内部文件，不受类型限制
+    if (!upload.internal && !FileValidator::isAllowedFileType(savePath.filename().string(), errorMessage)) {
+        reject(upload, res, 400, errorMessage);
+        return false;
     }
 
-    res.set_content("文件上传成功: " + targetPath.string(), "text/plain; charset=utf-8");
+    if (admission_ && !admission_(savePath, req, res)) {
+        upload.discard = true;
+        return true;
+    }
+
+    std::string extension = savePath.extension().string();
+    if (ListHistory::isListPath(savePath, upload.username)) {
+        upload.kind = Upload::Kind::List;
+        upload.parser = std::make_unique<BeatmapListParser>(Config::getUploadLimits());
+    } else if (!savePath.has_parent_path() && extension == ".list") {
+        upload.kind = Upload::Kind::Encoded;
+        upload.validator = std::make_unique<EncodedListValidator>(Config::getUploadLimits());
+    } else if (extension == ".osz" || extension == ".osk" || extension == ".zip") {
+        upload.kind = Upload::Kind::Archive;
+    }
+
+    // 集群迁移搬运的是已经计入配额的数据
+    return upload.internal || checkQuota(upload, res);
 }
 
-bool FileUploadHandler::validateRequest(const httplib::Request& req, httplib::Response& res) {
-    if (!req.has_file("file")) {
-        res.status = 400;
-        res.set_content("未找到上传的文件", "text/plain; charset=utf-8");
+bool FileUploadHandler::checkQuota(Upload& upload, httplib::Response& res) {
+    std::string owner = Storage::ownerOf(upload.savePath);
+    Storage::Usage usage = storage_->usage(owner);
+
+    // 覆盖已有文件时，旧文件的大小会被释放
+    uint64_t existing = 0;
+    fs::path target = upload.kind == Upload::Kind::List ? ListStore::listPath(upload.username) : upload.savePath;
+    bool replaces = storage_->stat(target, existing);
+
+    if (!replaces && Config::getQuotaObjects() > 0 && usage.objects >= Config::getQuotaObjects()) {
+        reject(upload, res, 507, "超出文件数配额: " + std::to_string(usage.objects) + " / " +
+                                 std::to_string(Config::getQuotaObjects()));
         return false;
     }
+
+    if (Config::getQuotaBytes() > 0) {
+        uint64_t used = usage.bytes - std::min(usage.bytes, existing);
+        upload.quotaRemaining = Config::getQuotaBytes() - std::min(used, Config::getQuotaBytes());
+        if (upload.declared > upload.quotaRemaining + kMultipartOverhead) {
+            reject(upload, res, 507, "超出存储配额: 剩余 " + std::to_string(upload.quotaRemaining / 1024) +
+                                     "KB，上传 " + std::to_string(upload.declared / 1024) + "KB");
+            return false;
+        }
+    }
     return true;
 }
 
-bool FileUploadHandler::prepareUploadDirectory(const fs::path& path, httplib::Response& res) {
-    try {
-        fs::create_directories(path);
+bool FileUploadHandler::receive(Upload& upload, const char* data, size_t size, httplib::Response& res) {
+    upload.received += size;
+    std::string errorMessage;
+    if (!FileValidator::isValidFileSize(upload.received, errorMessage)) {
+        reject(upload, res, 413, errorMessage);
+        return false;
+    }
+    if (upload.discard) {
         return true;
-    } catch (const fs::filesystem_error& e) {
-        res.status = 500;
-        res.set_content("创建目录失败: " + std::string(e.what()), "text/plain; charset=utf-8");
+    }
+    if (upload.received > upload.quotaRemaining) {
+        reject(upload, res, 507, "超出存储配额: 剩余 " + std::to_string(upload.quotaRemaining / 1024) + "KB");
         return false;
     }
+
+    // 列表只保留解析后的结构，原始字节不缓存
+    if (upload.kind == Upload::Kind::List) {
+        if (!upload.parser->feed(data, size)) {
+            reject(upload, res, 400, "谱面列表格式错误: " + upload.parser->error());
+            return false;
+        }
+        return true;
+    }
+
+    // 已编码的列表逐个字段校验，在第一处错误时拒绝
+    if (upload.kind == Upload::Kind::Encoded && !upload.validator->feed(data, size)) {
+        reject(upload, res, 400, upload.validator->error());
+        return false;
+    }
+
+    size_t before = upload.content.size();
+    upload.content.append(data, size);
+
+    // 读到文件头后立即检查魔数
+    if (before < 4 && upload.content.size() >= 4) {
+        if (upload.kind == Upload::Kind::Archive && upload.content.compare(0, 2, "PK") != 0) {
+            reject(upload, res, 400, "不是有效的 ZIP 归档");
+            return false;
+        }
+    }
+    return true;
 }
 
-bool FileUploadHandler::saveUploadedFile(const httplib::MultipartFormData& file, 
-                                       const fs::path& path, 
-                                       httplib::Response& res) {
-    try {
-        std::ofstream ofs(path, std::ios::binary);
-        if (!ofs) {
-            throw std::runtime_error("无法创建文件");
+bool FileUploadHandler::saveUploadedFile(Upload& upload, httplib::Response& res) {
+    std::string errorMessage;
+    if (upload.kind == Upload::Kind::List) {
+        // 用户谱面列表只在这里解析一次，之后以规范形式按版本保存
+        BeatmapList list;
+        if (!upload.parser->finish(list)) {
+            reject(upload, res, 400, "谱面列表格式错误: " + upload.parser->error());
+            return false;
+        }
+        if (!history_->commit(upload.username, list, errorMessage)) {
+            res.status = 500;
+            res.set_content(errorMessage, "text/plain; charset=utf-8");
+            return false;
         }
-        
-        ofs.write(file.content.data(), file.content.size());
-        ofs.close();
-        
         return true;
-    } catch (const std::exception& e) {
+    }
+
+    // 已编码的列表（例如集群再平衡迁移）必须完整，并且能够解码（检查条目的规范顺序）
+    if (upload.kind == Upload::Kind::Encoded && !upload.validator->finish()) {
+        reject(upload, res, 400, upload.validator->error());
+        return false;
+    }
+    BeatmapList decoded;
+    if (upload.kind == Upload::Kind::Encoded &&
+        !BeatmapList::decode(upload.content, decoded, errorMessage)) {
+        reject(upload, res, 400, errorMessage);
+        return false;
+    }
+
+    if (!storage_->put(upload.savePath, upload.content, errorMessage)) {
         res.status = 500;
-        res.set_content("保存文件失败: " + std::string(e.what()), "text/plain; charset=utf-8");
+        res.set_content(errorMessage, "text/plain; charset=utf-8");
         return false;
     }
+    return true;
 }
 
-FileDownloadHandler::FileDownloadHandler(const fs::path& baseUploadDir, std::shared_ptr<Logger> logger)
-    : baseUploadDir_(baseUploadDir)
-    , logger_(logger) {}
+void FileUploadHandler::handlePatch(const std::string& username, const httplib::Request& req,
+                                    httplib::Response& res) {
+    auto fail = [&](int status, const std::string& message) {
+        res.status = status;
+        res.set_content(message, "text/plain; charset=utf-8");
+        logger_->warning("拒绝增量上传 " + username + ": " + message);
+    };
+
+    std::string errorMessage;
+    if (!FileValidator::isSafePath(username, errorMessage)) {
+        fail(400, errorMessage);
+        return;
+    }
+
+    // 请求体在 httplib 中已受 payload 上限约束，这里与整份上传保持同样的大小限制
+    if (!FileValidator::isValidFileSize(req.body.size(), errorMessage)) {
+        fail(413, errorMessage);
+        return;
+    }
+
+    // 与整份上传一样流式解析，add 中的条目受同样的结构限制
+    BeatmapPatchParser parser(Config::getUploadLimits());
+    BeatmapPatch patch;
+    if (!parser.feed(req.body.data(), req.body.size()) || !parser.finish(patch)) {
+        fail(400, "增量请求格式错误: " + parser.error());
+        return;
+    }
+
+    // 列表的增长不会超过新增条目在请求中的大小
+    if (!patch.add.entries.empty() && Config::getQuotaBytes() > 0) {
+        Storage::Usage usage = storage_->usage(username);
+        if (usage.bytes + req.body.size() > Config::getQuotaBytes()) {
+            fail(507, "超出存储配额: 已用 " + std::to_string(usage.bytes / 1024) + "KB");
+            return;
+        }
+    }
+
+    uint64_t version = 0;
+    size_t entries = 0;
+    switch (history_->patch(username, patch.base, patch.add, patch.removeSetIds,
+                            Config::getUploadLimits().maxEntries, version, entries, errorMessage)) {
+        case ListHistory::PatchResult::Applied:
+            break;
+        case ListHistory::PatchResult::Conflict:
+            res.set_header("X-List-Version", std::to_string(version));
+            fail(412, "基准版本 " + std::to_string(patch.base) + " 不是当前版本 " + std::to_string(version) +
+                      "，请重新获取列表后再提交");
+            return;
+        case ListHistory::PatchResult::Rejected:
+            fail(413, errorMessage);
+            return;
+        case ListHistory::PatchResult::Failed:
+            logger_->error("增量上传失败: " + errorMessage);
+            res.status = 500;
+            res.set_content(errorMessage, "text/plain; charset=utf-8");
+            return;
+    }
+
+    logger_->info("增量上传 " + username + ": +" + std::to_string(patch.add.entries.size()) +
+                  " -" + std::to_string(patch.removeSetIds.size()) + "，版本 " + std::to_string(version) +
+                  "，共 " + std::to_string(entries) + " 条");
+    res.set_header("X-List-Version", std::to_string(version));
+    res.set_content(json{{"version", version}, {"entries", entries}}.dump(), "application/json");
+}
+
+void FileUploadHandler::reject(Upload& upload, httplib::Response& res, int status, const std::string& message) {
+    upload.rejected = true;
+    upload.status = status;
+    res.status = status;
+    res.set_content(message, "text/plain; charset=utf-8");
+    // 剩余的请求体不再读取，回复后断开连接
+    res.set_header("Connection", "close");
+    logger_->warning("拒绝上传 " + upload.savePath.generic_string() + ": " + message);
+}
+
+FileDownloadHandler::FileDownloadHandler(std::shared_ptr<ListStore> lists,
+                                         std::shared_ptr<Logger> logger,
+                                         std::shared_ptr<DictionaryStore> dictionaries)
+    : lists_(lists)
+    , logger_(logger)
+    , dictionaries_(dictionaries) {}
 
 void FileDownloadHandler::handleDownload(const httplib::Request& req, httplib::Response& res) {
     logger_->info("收到下载请求: " + req.path);
@@ -190,38 +603,163 @@ void FileDownloadHandler::handleDownload(const httplib::Request& req, httplib::R
         return;
     }
 
-    fs::path jsonPath = buildJsonPath(username);
-    
-    // 检查文件是否存在
-    if (!fs::exists(jsonPath)) {
-        res.status = 404;
-        res.set_content("文件未找到", "text/plain; charset=utf-8");
+    if (req.has_param("fields") || req.has_param("limit") || req.has_param("cursor") || req.has_param("format")) {
+        handleProjected(username, req, res);
         return;
     }
 
-    // 尝试读取文件
-    try {
-        std::ifstream file(jsonPath, std::ios::binary);
-        if (!file) {
-            throw std::runtime_error("无法打开文件");
+    // JSON 由规范列表按需生成并缓存
+    std::string errorMessage;
+    auto rendered = lists_->render(username, errorMessage);
+    if (!rendered) {
+        if (errorMessage.empty()) {
+            res.status = 404;
+            res.set_content("文件未找到", "text/plain; charset=utf-8");
+        } else {
+            logger_->error("文件下载失败: " + errorMessage);
+            res.status = 500;
+            res.set_content("服务器内部错误", "text/plain; charset=utf-8");
         }
+        return;
+    }
 
-        // 读取文件内容
-        std::string content((std::istreambuf_iterator<char>(file)),
-                          std::istreambuf_iterator<char>());
+    res.set_header("ETag", rendered->etag);
+    if (req.get_header_value("If-None-Match") == rendered->etag) {
+        res.status = 304;
+        return;
+    }
 
-        // 设置响应头
-        res.set_header("Content-Type", "application/json");
-        res.set_header("Content-Disposition", "attachment; filename=\"" + username + ".json\"");
-        res.set_content(content, "application/json");
-        
-        logger_->info("文件下载成功: " + jsonPath.string());
+    // 设置响应头
+    res.set_header("Content-Disposition", "attachment; filename=\"" + username + ".json\"");
+    auto dictionary = negotiateDictionary(dictionaries_.get(), req, res);
+    std::string compressed;
+    if (dictionary && DictionaryStore::compress(rendered->json, dictionary.get(), Z_DEFAULT_COMPRESSION, compressed)) {
+        res.set_content(compressed, "application/json");
+    } else {
+        res.headers.erase("Content-Encoding");
+        res.headers.erase("X-Dictionary-Version");
+        res.set_content(rendered->json, "application/json");
     }
-    catch (const std::exception& e) {
-        logger_->error("文件下载失败: " + std::string(e.what()));
-        res.status = 500;
-        res.set_content("服务器内部错误", "text/plain; charset=utf-8");
+    logger_->info("文件下载成功: " + username);
+}
+
+void FileDownloadHandler::handleProjected(const std::string& username, const httplib::Request& req,
+                                          httplib::Response& res) {
+    std::string errorMessage;
+    uint32_t fields = BeatmapList::kAllFields;
+    if (req.has_param("fields") && !BeatmapList::parseFields(req.get_param_value("fields"), fields, errorMessage)) {
+        res.status = 400;
+        res.set_content(errorMessage, "text/plain; charset=utf-8");
+        return;
+    }
+    std::string format = req.has_param("format") ? req.get_param_value("format") : "json";
+    if (format != "json" && format != "ndjson") {
+        res.status = 400;
+        res.set_content("format 必须是 json 或 ndjson", "text/plain; charset=utf-8");
+        return;
+    }
+    size_t limit = std::numeric_limits<size_t>::max();
+    if (req.has_param("limit")) {
+        try {
+            limit = std::stoul(req.get_param_value("limit"));
+        } catch (const std::exception&) {
+            limit = 0;
+        }
+        if (limit == 0) {
+            res.status = 400;
+            res.set_content("limit 必须是正整数", "text/plain; charset=utf-8");
+            return;
+        }
+    }
+    // 游标是上一页最后一项的键，本页从严格大于它的位置开始，期间列表被修改也不会重复或遗漏未改动的条目
+    BeatmapEntry cursor;
+    bool hasCursor = req.has_param("cursor");
+    if (hasCursor) {
+        cursor.id = req.get_param_value("cursor");
+        cursor.setId = BeatmapEntry::parseSetId(cursor.id);
+    }
+
+    lists_->touch(username);
+    auto page = std::make_shared<std::vector<BeatmapEntry>>();
+    size_t total = 0;
+    bool more = false;
+    std::vector<uint64_t> setIds;
+    if (fields == BeatmapList::kFieldId && lists_->loadSetIds(username, setIds, errorMessage) &&
+        (setIds.empty() || setIds.back() != BeatmapEntry::kNoSetId)) {
+        total = setIds.size();
+        auto begin = hasCursor ? std::upper_bound(setIds.begin(), setIds.end(), cursor.setId) : setIds.begin();
+        size_t count = std::min<size_t>(limit, setIds.end() - begin);
+        more = count < static_cast<size_t>(setIds.end() - begin);
+        page->resize(count);
+        for (size_t i = 0; i < count; i++) {
+            (*page)[i].setId = begin[i];
+            (*page)[i].id = std::to_string(begin[i]);
+        }
+    } else {
+        BeatmapList list;
+        if (!lists_->load(username, list, errorMessage)) {
+            if (errorMessage.empty()) {
+                res.status = 404;
+                res.set_content("文件未找到", "text/plain; charset=utf-8");
+            } else {
+                logger_->error("文件下载失败: " + errorMessage);
+                res.status = 500;
+                res.set_content("服务器内部错误", "text/plain; charset=utf-8");
+            }
+            return;
+        }
+        auto& entries = list.entries;
+        total = entries.size();
+        auto begin = hasCursor ? std::upper_bound(entries.begin(), entries.end(), cursor, entryLess) : entries.begin();
+        size_t count = std::min<size_t>(limit, entries.end() - begin);
+        more = count < static_cast<size_t>(entries.end() - begin);
+        page->assign(std::make_move_iterator(begin), std::make_move_iterator(begin + count));
+    }
+
+    res.set_header("X-List-Entries", std::to_string(total));
+    if (more) {
+        res.set_header("X-Next-Cursor", httplib::detail::encode_query_param(page->back().key()));
+    }
+    bool ndjson = format == "ndjson";
+    auto dictionary = negotiateDictionary(dictionaries_.get(), req, res);
+    bool gzip = !dictionary && req.get_header_value("Accept-Encoding").find("gzip") != std::string::npos;
+    if (gzip) {
+        res.set_header("Content-Encoding", "gzip");
     }
+
+    // 分块生成，不拼接完整的响应体
+    res.set_chunked_content_provider(
+        ndjson ? "application/x-ndjson" : "application/json",
+        [page, fields, ndjson, gzip, dictionary](size_t, httplib::DataSink& sink) {
+            std::unique_ptr<DeflateStream> compressor =
+                dictionary || gzip ? std::make_unique<DeflateStream>(dictionary.get()) : nullptr;
+            auto flush = [&](std::string& buffer, bool finish) {
+                std::string out = compressor ? compressor->compress(buffer, finish) : std::move(buffer);
+                buffer.clear();
+                return out.empty() || sink.write(out.data(), out.size());
+            };
+            std::string buffer = ndjson ? "" : "[";
+            for (size_t i = 0; i < page->size(); i++) {
+                if (!ndjson && i > 0) {
+                    buffer += ',';
+                }
+                BeatmapList::appendEntryJson(buffer, (*page)[i], fields);
+                if (ndjson) {
+                    buffer += '\n';
+                }
+                if (buffer.size() >= kChunkBytes && !flush(buffer, false)) {
+                    return false;
+                }
+            }
+            if (!ndjson) {
+                buffer += ']';
+            }
+            if (!flush(buffer, true)) {
+                return false;
+            }
+            sink.done();
+            return true;
+        });
 }
 
 std::string FileDownloadHandler::extractUsername(const std::string& path) {
@@ -250,9 +788,3 @@ std::string FileDownloadHandler::extractUsername(const std::string& path) {
 
     return username;
 }
-
-fs::path FileDownloadHandler::buildJsonPath(const std::string& username) {
-    return baseUploadDir_ / (username + ".json");
-}
-
-
@@ -1,19 +1,35 @@
 #pragma once
 #include <string>
 #include <filesystem>
+#include <functional>
+#include <vector>
 #include "httplib.h"
+#include "dictionary_store.hpp"
+#include "event_frontend.hpp"
+#include "list_history.hpp"
+#include "list_store.hpp"
 #include "logger.hpp"
+#include "storage.hpp"
 
 namespace fs = std::filesystem;
 
 class FileValidator {
 public:
-    static bool isSafePath(const fs::path& path, std::string& errorMessage);
+    // allowInternal 为 true 时允许以.开头的内部路径（仅限经过鉴权的集群迁移）
+    static bool isSafePath(const fs::path& path, std::string& errorMessage, bool allowInternal = false);
     static bool isAllowedFileType(const std::string& filename, std::string& errorMessage);
     static bool isValidFileSize(size_t fileSize, std::string& errorMessage);
     static bool validateChecksum(const std::string& content, const std::string& expectedHash, std::string& errorMessage);
 };  // 添加缺失的闭合大括号
 
+// 管理接口鉴权：要求请求头 X-Admin-Token 与配置中的 adminToken 一致
+class AdminAuth {
+public:
+    static bool authorize(const httplib::Request& req, httplib::Response& res);
+    // 只检查令牌，不填写响应
+    static bool isAuthorized(const httplib::Request& req);
+};
+
 class Config {
 public:
     static void load(const std::string& configFile);
@@ -24,6 +40,38 @@ public:
     static size_t getMaxFileSize() { return maxFileSize_; }
     static const fs::path& getUploadDir() { return uploadDir_; }
     static const fs::path& getLogDir() { return logDir_; }
+    static const fs::path& getDataDir() { return dataDir_; }
+    static const std::string& getRole() { return role_; }
+    static const std::string& getLeaderUrl() { return leaderUrl_; }
+    static bool isFollower() { return role_ == "follower"; }
+    static const std::string& getAdminToken() { return adminToken_; }
+    static const std::string& getClusterSelf() { return clusterSelf_; }
+    static const std::vector<std::string>& getClusterNodes() { return clusterNodes_; }
+    static int getClusterVirtualNodes() { return clusterVirtualNodes_; }
+    static size_t getMaxVersions() { return maxVersions_; }
+    static size_t getListCacheBytes() { return listCacheBytes_; }
+    static size_t getScrubBytesPerSecond() { return scrubBytesPerSecond_; }
+    static int getScrubIntervalSeconds() { return scrubIntervalSeconds_; }
+    static const std::vector<std::string>& getScrubPeers() { return scrubPeers_; }
+    static const BeatmapListLimits& getUploadLimits() { return uploadLimits_; }
+    static uint64_t getQuotaBytes() { return quotaBytes_; }
+    static uint64_t getQuotaObjects() { return quotaObjects_; }
+    static size_t getClubMaxMembers() { return clubMaxMembers_; }
+    static size_t getClubCachedResults() { return clubCachedResults_; }
+    static bool isFrontendEnabled() { return frontendEnabled_; }
+    static const EventFrontend::Options& getFrontendOptions() { return frontendOptions_; }
+    static bool isColdTierEnabled() { return coldTierEnabled_; }
+    static int getColdAfterDays() { return coldAfterDays_; }
+    static int getColdTierIntervalSeconds() { return coldTierIntervalSeconds_; }
+    static int getIndexCheckpointIntervalSeconds() { return indexCheckpointIntervalSeconds_; }
+    static bool isDictionaryEnabled() { return dictionaryEnabled_; }
+    static size_t getDictionarySampleLists() { return dictionarySampleLists_; }
+    static int getDeadSetTtlHours() { return deadSetTtlHours_; }
+    static size_t getDeadSetMinReporters() { return deadSetMinReporters_; }
+    static int getMirrorStatsWindowHours() { return mirrorStatsWindowHours_; }
+    static const std::vector<std::string>& getMirrorStatsMirrors() { return mirrorStatsMirrors_; }
+    static uint64_t getChangeLogSegmentBytes() { return changeLogSegmentBytes_; }
+    static int getFollowerRetentionMinutes() { return followerRetentionMinutes_; }
     
 private:
     static std::string configPath_;
@@ -32,39 +80,101 @@ private:
     static size_t maxFileSize_;
     static fs::path uploadDir_;
     static fs::path logDir_;
+    static fs::path dataDir_;       // 服务器内部数据（变更日志等）
+    static std::string role_;       // "leader" 或 "follower"
+    static std::string leaderUrl_;  // 从节点模式下主节点的地址
+    static std::string adminToken_; // 为空时禁用管理接口
+    static std::string clusterSelf_;                // 本节点在集群中的地址
+    static std::vector<std::string> clusterNodes_;  // 初始集群节点列表，为空时不分片
+    static int clusterVirtualNodes_;
+    static size_t maxVersions_;     // 每个用户保留的列表版本数
+    static size_t listCacheBytes_;  // 渲染后的 JSON 列表缓存上限
+    static size_t scrubBytesPerSecond_; // 后台巡检的读取限速
+    static int scrubIntervalSeconds_;   // 两轮巡检之间的间隔，0 表示关闭
+    static std::vector<std::string> scrubPeers_;    // 主节点修复损坏文件时取回副本的节点
+    static BeatmapListLimits uploadLimits_; // 上传列表的条目数、字符串长度与嵌套深度上限
+    static uint64_t quotaBytes_;    // 每个用户的存储字节数上限，0 表示不限
+    static uint64_t quotaObjects_;  // 每个用户的文件数上限，0 表示不限
+    static size_t clubMaxMembers_;      // 单次社团列表请求的成员数上限
+    static size_t clubCachedResults_;   // 缓存的社团列表结果数
+    static bool frontendEnabled_;       // 由 epoll 前端持有客户端连接（仅 Linux）
+    static EventFrontend::Options frontendOptions_;
+    static bool coldTierEnabled_;       // 把长期无人访问的列表压缩进冷层
+    static int coldAfterDays_;          // 超过多少天未被请求或改写的列表视为冷数据
+    static int coldTierIntervalSeconds_;
+    static int indexCheckpointIntervalSeconds_; // 内存索引检查点的写出间隔，0 表示关闭
+    static bool dictionaryEnabled_;         // 冷层与下载使用共享的 deflate 预置字典
+    static size_t dictionarySampleLists_;   // 训练字典时抽取的列表数
+    static int deadSetTtlHours_;            // 失效谱面集在最后一次上报后保留的时间
+    static size_t deadSetMinReporters_;     // 判定失效所需的不同上报者数
+    static int mirrorStatsWindowHours_;     // 镜像站统计的滚动窗口
+    static std::vector<std::string> mirrorStatsMirrors_;   // 接受统计的镜像站，与客户端内置的镜像站一致
+    static uint64_t changeLogSegmentBytes_; // 变更日志分段的大小上限
+    static int followerRetentionMinutes_;   // 从节点断开后为它保留日志的时长
 };
 
+// 上传处理：请求体边接收边校验
+// 列表在流入时由 BeatmapListParser 逐块校验，二进制文件先检查魔数，
+// 一旦违反格式或限制就停止读取并关闭连接，不会先把整个请求体读入内存。
 class FileUploadHandler {
 public:
-    explicit FileUploadHandler(const fs::path& baseUploadDir, std::shared_ptr<Logger> logger);
-    
-    void handleUpload(const httplib::Request& req, httplib::Response& res);
-    
+    // 开始接收文件内容前的准入检查（例如集群路由）；
+    // 返回 false 时响应已填写，请求体会被读取并丢弃
+    using Admission = std::function<bool(const fs::path& savePath,
+                                         const httplib::Request& req,
+                                         httplib::Response& res)>;
+
+    FileUploadHandler(std::shared_ptr<Storage> storage,
+                      std::shared_ptr<ListHistory> history,
+                      std::shared_ptr<Logger> logger);
+
+    void setAdmission(Admission admission) { admission_ = std::move(admission); }
+
+    void handleUpload(const httplib::Request& req, httplib::Response& res,
+                      const httplib::ContentReader& reader);
+
+    // PATCH /list/<user>：只携带改动的增量上传
+    // 请求体 {"base": 版本号, "add": [BeatmapInfo...], "remove": [setId...]}；
+    // base 不是当前版本时返回 412 与当前版本号，由客户端重新获取后再提交
+    void handlePatch(const std::string& username, const httplib::Request& req, httplib::Response& res);
+
+    // multipart 编码本身的额外开销（边界与分段头）
+    static constexpr size_t kMultipartOverhead = 64 * 1024;
+
 private:
-    fs::path baseUploadDir_;
+    struct Upload;
+
+    std::shared_ptr<Storage> storage_;
+    std::shared_ptr<ListHistory> history_;
     std::shared_ptr<Logger> logger_;
-    
-    bool validateRequest(const httplib::Request& req, httplib::Response& res);
-    bool prepareUploadDirectory(const fs::path& path, httplib::Response& res);
-    bool saveUploadedFile(const httplib::MultipartFormData& file,
-                         const fs::path& path,
-                         httplib::Response& res);
+    Admission admission_;
+
+    bool prepare(Upload& upload, const fs::path& savePath,
+                 const httplib::Request& req, httplib::Response& res);
+    bool checkQuota(Upload& upload, httplib::Response& res);
+    bool receive(Upload& upload, const char* data, size_t size, httplib::Response& res);
+    bool saveUploadedFile(Upload& upload, httplib::Response& res);
+    void reject(Upload& upload, httplib::Response& res, int status, const std::string& message);
 };
 
 class FileDownloadHandler {
 public:
-    explicit FileDownloadHandler(const fs::path& baseUploadDir, std::shared_ptr<Logger> logger);
+    FileDownloadHandler(std::shared_ptr<ListStore> lists,
+                        std::shared_ptr<Logger> logger,
+                        std::shared_ptr<DictionaryStore> dictionaries = nullptr);
     
-    // 处理下载请求
+    // 处理下载请求（客户端持有压缩字典时以 x-deflate-dict 编码响应）
     void handleDownload(const httplib::Request& req, httplib::Response& res);
     
 private:
-    fs::path baseUploadDir_;
+    // 带 fields / limit / cursor / format 参数的下载：直接从规范列表投影、分页，以 JSON 数组或 NDJSON 分块输出
+    // 只要 id 且列表全部为数字ID时只读取 setId 数组；下一页的游标（本页最后一项的键）放在 X-Next-Cursor 中
+    void handleProjected(const std::string& username, const httplib::Request& req, httplib::Response& res);
+
+    std::shared_ptr<ListStore> lists_;
     std::shared_ptr<Logger> logger_;
+    std::shared_ptr<DictionaryStore> dictionaries_;
     
     // 从请求路径中提取用户名
     std::string extractUsername(const std::string& path);
-    
-    // 验证并构建JSON文件路径
-    fs::path buildJsonPath(const std::string& username);
 };
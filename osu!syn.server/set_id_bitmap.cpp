@@ -0,0 +1,296 @@
+#include "set_id_bitmap.hpp"
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+uint32_t popcount(const std::vector<uint64_t>& bits) {
+    uint32_t count = 0;
+    for (uint64_t word : bits) {
+        count += static_cast<uint32_t>(__builtin_popcountll(word));
+    }
+    return count;
+}
+
+}  // namespace
+
+bool SetIdBitmap::Container::contains(uint16_t low) const {
+    if (dense()) {
+        return (bits[low >> 6] >> (low & 63)) & 1;
+    }
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+void SetIdBitmap::Container::add(uint16_t low) {
+    if (dense()) {
+        uint64_t mask = uint64_t(1) << (low & 63);
+        if (!(bits[low >> 6] & mask)) {
+            bits[low >> 6] |= mask;
+            count++;
+        }
+        return;
+    }
+    auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it == array.end() || *it != low) {
+        array.insert(it, low);
+        count++;
+        normalize();
+    }
+}
+
+void SetIdBitmap::Container::remove(uint16_t low) {
+    if (dense()) {
+        uint64_t mask = uint64_t(1) << (low & 63);
+        if (bits[low >> 6] & mask) {
+            bits[low >> 6] &= ~mask;
+            count--;
+            normalize();
+        }
+        return;
+    }
+    auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it != array.end() && *it == low) {
+        array.erase(it);
+        count--;
+    }
+}
+
+void SetIdBitmap::Container::normalize() {
+    if (dense() && count <= kMaxArray) {
+        std::vector<uint16_t> values;
+        values.reserve(count);
+        for (size_t w = 0; w < bits.size(); w++) {
+            uint64_t word = bits[w];
+            while (word) {
+                values.push_back(static_cast<uint16_t>(w * 64 + __builtin_ctzll(word)));
+                word &= word - 1;
+            }
+        }
+        array = std::move(values);
+        bits.clear();
+        bits.shrink_to_fit();
+    } else if (!dense() && count > kMaxArray) {
+        bits = toBits();
+        array.clear();
+        array.shrink_to_fit();
+    }
+}
+
+std::vector<uint64_t> SetIdBitmap::Container::toBits() const {
+    if (dense()) {
+        return bits;
+    }
+    std::vector<uint64_t> result(kWords, 0);
+    for (uint16_t low : array) {
+        result[low >> 6] |= uint64_t(1) << (low & 63);
+    }
+    return result;
+}
+
+SetIdBitmap::Container SetIdBitmap::unite(const Container& a, const Container& b) {
+    Container result;
+    if (!a.dense() && !b.dense()) {
+        result.array.reserve(a.array.size() + b.array.size());
+        std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                       std::back_inserter(result.array));
+        result.count = static_cast<uint32_t>(result.array.size());
+    } else {
+        result.bits = a.toBits();
+        if (b.dense()) {
+            for (size_t w = 0; w < Container::kWords; w++) {
+                result.bits[w] |= b.bits[w];
+            }
+        } else {
+            for (uint16_t low : b.array) {
+                result.bits[low >> 6] |= uint64_t(1) << (low & 63);
+            }
+        }
+        result.count = popcount(result.bits);
+    }
+    result.normalize();
+    return result;
+}
+
+SetIdBitmap::Container SetIdBitmap::intersect(const Container& a, const Container& b) {
+    Container result;
+    if (a.dense() && b.dense()) {
+        result.bits.resize(Container::kWords);
+        for (size_t w = 0; w < Container::kWords; w++) {
+            result.bits[w] = a.bits[w] & b.bits[w];
+        }
+        result.count = popcount(result.bits);
+    } else if (!a.dense() && !b.dense()) {
+        std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                              std::back_inserter(result.array));
+        result.count = static_cast<uint32_t>(result.array.size());
+    } else {
+        const Container& sparse = a.dense() ? b : a;
+        const Container& other = a.dense() ? a : b;
+        for (uint16_t low : sparse.array) {
+            if (other.contains(low)) {
+                result.array.push_back(low);
+            }
+        }
+        result.count = static_cast<uint32_t>(result.array.size());
+    }
+    result.normalize();
+    return result;
+}
+
+SetIdBitmap::Container SetIdBitmap::subtract(const Container& a, const Container& b) {
+    Container result;
+    if (!a.dense()) {
+        for (uint16_t low : a.array) {
+            if (!b.contains(low)) {
+                result.array.push_back(low);
+            }
+        }
+        result.count = static_cast<uint32_t>(result.array.size());
+    } else {
+        result.bits = a.bits;
+        if (b.dense()) {
+            for (size_t w = 0; w < Container::kWords; w++) {
+                result.bits[w] &= ~b.bits[w];
+            }
+        } else {
+            for (uint16_t low : b.array) {
+                result.bits[low >> 6] &= ~(uint64_t(1) << (low & 63));
+            }
+        }
+        result.count = popcount(result.bits);
+    }
+    result.normalize();
+    return result;
+}
+
+SetIdBitmap SetIdBitmap::fromSorted(const std::vector<uint64_t>& setIds) {
+    return build(setIds.data(), setIds.data() + setIds.size());
+}
+
+SetIdBitmap SetIdBitmap::fromSorted(const uint32_t* begin, const uint32_t* end) {
+    return build(begin, end);
+}
+
+template <typename T>
+SetIdBitmap SetIdBitmap::build(const T* begin, const T* end) {
+    SetIdBitmap bitmap;
+    for (const T* it = begin; it != end; ++it) {
+        uint64_t setId = *it;
+        if (setId > 0xFFFFFFFFull) {
+            break;  // 升序，之后只剩超出范围的ID
+        }
+        uint16_t high = static_cast<uint16_t>(setId >> 16);
+        if (bitmap.chunks_.empty() || bitmap.chunks_.back().first != high) {
+            bitmap.chunks_.emplace_back(high, Container());
+        }
+        Container& c = bitmap.chunks_.back().second;
+        uint16_t low = static_cast<uint16_t>(setId);
+        if (c.array.empty() || c.array.back() != low) {
+            c.array.push_back(low);
+            c.count++;
+        }
+    }
+    for (auto& chunk : bitmap.chunks_) {
+        chunk.second.normalize();
+    }
+    return bitmap;
+}
+
+SetIdBitmap::Container* SetIdBitmap::find(uint16_t high) {
+    auto it = std::lower_bound(chunks_.begin(), chunks_.end(), high,
+                               [](const std::pair<uint16_t, Container>& c, uint16_t h) { return c.first < h; });
+    return it != chunks_.end() && it->first == high ? &it->second : nullptr;
+}
+
+const SetIdBitmap::Container* SetIdBitmap::find(uint16_t high) const {
+    return const_cast<SetIdBitmap*>(this)->find(high);
+}
+
+bool SetIdBitmap::contains(uint32_t id) const {
+    const Container* c = find(static_cast<uint16_t>(id >> 16));
+    return c && c->contains(static_cast<uint16_t>(id));
+}
+
+void SetIdBitmap::add(uint32_t id) {
+    uint16_t high = static_cast<uint16_t>(id >> 16);
+    auto it = std::lower_bound(chunks_.begin(), chunks_.end(), high,
+                               [](const std::pair<uint16_t, Container>& c, uint16_t h) { return c.first < h; });
+    if (it == chunks_.end() || it->first != high) {
+        it = chunks_.emplace(it, high, Container());
+    }
+    it->second.add(static_cast<uint16_t>(id));
+}
+
+void SetIdBitmap::remove(uint32_t id) {
+    uint16_t high = static_cast<uint16_t>(id >> 16);
+    auto it = std::lower_bound(chunks_.begin(), chunks_.end(), high,
+                               [](const std::pair<uint16_t, Container>& c, uint16_t h) { return c.first < h; });
+    if (it == chunks_.end() || it->first != high) {
+        return;
+    }
+    it->second.remove(static_cast<uint16_t>(id));
+    if (it->second.count == 0) {
+        chunks_.erase(it);
+    }
+}
+
+uint64_t SetIdBitmap::cardinality() const {
+    uint64_t total = 0;
+    for (const auto& chunk : chunks_) {
+        total += chunk.second.count;
+    }
+    return total;
+}
+
+SetIdBitmap& SetIdBitmap::operator|=(const SetIdBitmap& other) {
+    std::vector<std::pair<uint16_t, Container>> merged;
+    merged.reserve(chunks_.size() + other.chunks_.size());
+    auto a = chunks_.begin();
+    auto b = other.chunks_.begin();
+    while (a != chunks_.end() || b != other.chunks_.end()) {
+        if (b == other.chunks_.end() || (a != chunks_.end() && a->first < b->first)) {
+            merged.push_back(std::move(*a++));
+        } else if (a == chunks_.end() || b->first < a->first) {
+            merged.push_back(*b++);
+        } else {
+            merged.emplace_back(a->first, unite(a->second, b->second));
+            ++a;
+            ++b;
+        }
+    }
+    chunks_ = std::move(merged);
+    return *this;
+}
+
+SetIdBitmap& SetIdBitmap::operator&=(const SetIdBitmap& other) {
+    std::vector<std::pair<uint16_t, Container>> kept;
+    for (auto& chunk : chunks_) {
+        const Container* c = other.find(chunk.first);
+        if (!c) {
+            continue;
+        }
+        Container result = intersect(chunk.second, *c);
+        if (result.count > 0) {
+            kept.emplace_back(chunk.first, std::move(result));
+        }
+    }
+    chunks_ = std::move(kept);
+    return *this;
+}
+
+SetIdBitmap& SetIdBitmap::operator-=(const SetIdBitmap& other) {
+    std::vector<std::pair<uint16_t, Container>> kept;
+    for (auto& chunk : chunks_) {
+        const Container* c = other.find(chunk.first);
+        if (!c) {
+            kept.push_back(std::move(chunk));
+            continue;
+        }
+        Container result = subtract(chunk.second, *c);
+        if (result.count > 0) {
+            kept.emplace_back(chunk.first, std::move(result));
+        }
+    }
+    chunks_ = std::move(kept);
+    return *this;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// 谱面集ID的压缩位图（Roaring 风格）
+// 按高 16 位分块：块内元素不超过 4096 个时存为有序的低 16 位数组，
+// 否则存为 65536 位的位图。稀疏的个人列表和稠密的合并结果都只占用与元素数相称的内存。
+class SetIdBitmap {
+public:
+    // 由升序的 setId 构造，超出 32 位的ID（以及 BeatmapEntry::kNoSetId）被忽略
+    static SetIdBitmap fromSorted(const std::vector<uint64_t>& setIds);
+    static SetIdBitmap fromSorted(const uint32_t* begin, const uint32_t* end);
+
+    bool contains(uint32_t id) const;
+    void add(uint32_t id);
+    void remove(uint32_t id);
+
+    uint64_t cardinality() const;
+    bool empty() const { return chunks_.empty(); }
+
+    SetIdBitmap& operator|=(const SetIdBitmap& other);
+    SetIdBitmap& operator&=(const SetIdBitmap& other);
+    // 去掉 other 中的元素
+    SetIdBitmap& operator-=(const SetIdBitmap& other);
+
+    // 按升序访问每个元素
+    template <typename F>
+    void forEach(F&& f) const {
+        for (const auto& chunk : chunks_) {
+            uint32_t high = static_cast<uint32_t>(chunk.first) << 16;
+            const Container& c = chunk.second;
+            if (c.dense()) {
+                for (size_t w = 0; w < c.bits.size(); w++) {
+                    uint64_t word = c.bits[w];
+                    while (word) {
+                        f(high | static_cast<uint32_t>(w * 64 + __builtin_ctzll(word)));
+                        word &= word - 1;
+                    }
+                }
+            } else {
+                for (uint16_t low : c.array) {
+                    f(high | low);
+                }
+            }
+        }
+    }
+
+private:
+    struct Container {
+        static constexpr size_t kMaxArray = 4096;
+        static constexpr size_t kWords = 65536 / 64;
+
+        std::vector<uint16_t> array;    // 稀疏：有序的低 16 位
+        std::vector<uint64_t> bits;     // 稠密：kWords 个字
+        uint32_t count = 0;
+
+        bool dense() const { return !bits.empty(); }
+        bool contains(uint16_t low) const;
+        void add(uint16_t low);
+        void remove(uint16_t low);
+        // 按元素数在两种表示之间转换
+        void normalize();
+        std::vector<uint64_t> toBits() const;
+    };
+
+    template <typename T>
+    static SetIdBitmap build(const T* begin, const T* end);
+
+    static Container unite(const Container& a, const Container& b);
+    static Container intersect(const Container& a, const Container& b);
+    static Container subtract(const Container& a, const Container& b);
+
+    Container* find(uint16_t high);
+    const Container* find(uint16_t high) const;
+
+    std::vector<std::pair<uint16_t, Container>> chunks_;   // 按高 16 位排序，不含空块
+};
@@ -0,0 +1,417 @@
+#include "similarity_index.hpp"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include "3rdparty/nlohmann/json.hpp"
+#include "binary_io.hpp"
+
+using json = nlohmann::json;
+using binary_io::getU32;
+using binary_io::getU64;
+using binary_io::putU32;
+using binary_io::putU64;
+
+namespace {
+
+uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// 第 i 个哈希函数为 (a_i * x + b_i) 的高 32 位，a_i 为奇数
+struct HashFamily {
+    std::array<uint64_t, SimilarityIndex::kHashes> a;
+    std::array<uint64_t, SimilarityIndex::kHashes> b;
+
+    HashFamily() {
+        for (size_t i = 0; i < SimilarityIndex::kHashes; i++) {
+            a[i] = splitmix64(2 * i) | 1;
+            b[i] = splitmix64(2 * i + 1);
+        }
+    }
+};
+
+const HashFamily& hashFamily() {
+    static const HashFamily family;
+    return family;
+}
+
+// 检查点中的一条签名：u32 用户名偏移 u32 用户名长度 u32 签名[kHashes]，用户名集中存放在记录之后
+constexpr size_t kRecordSize = 4 + 4 + 4 * SimilarityIndex::kHashes;
+
+size_t paramOr(const httplib::Request& req, const char* name, size_t fallback, size_t maximum) {
+    if (!req.has_param(name)) {
+        return fallback;
+    }
+    try {
+        return std::min<size_t>(std::stoul(req.get_param_value(name)), maximum);
+    } catch (const std::exception&) {
+        return fallback;
+    }
+}
+
+}  // namespace
+
+SimilarityIndex::SimilarityIndex(std::shared_ptr<Storage> storage,
+                                 std::shared_ptr<ListStore> lists,
+                                 std::shared_ptr<Logger> logger,
+                                 const IndexCheckpoint* checkpoint)
+    : storage_(storage)
+    , lists_(lists)
+    , logger_(logger) {
+    storage_->addListener([this](const fs::path& relPath, const std::string*) {
+        markDirty(relPath);
+    });
+
+    if (checkpoint && restore(*checkpoint)) {
+        return;
+    }
+
+    // 没有可用的检查点：为已有的全部列表建立签名
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(storage_->root(), ec)) {
+        if (entry.is_regular_file(ec)) {
+            markDirty(entry.path().filename());
+        }
+    }
+    for (const auto& relPath : storage_->coldFiles()) {
+        markDirty(relPath);
+    }
+    refresh();
+    logger_->info("相似度索引已建立: " + std::to_string(signatures_.size()) + " 个用户");
+}
+
+SimilarityIndex::~SimilarityIndex() {
+    stop();
+}
+
+void SimilarityIndex::start() {
+    {
+        std::lock_guard<std::mutex> lock(dirtyMutex_);
+        if (running_) {
+            return;
+        }
+        running_ = true;
+    }
+    thread_ = std::thread([this] { run(); });
+}
+
+void SimilarityIndex::stop() {
+    {
+        std::lock_guard<std::mutex> lock(dirtyMutex_);
+        running_ = false;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void SimilarityIndex::run() {
+    // 从检查点恢复时分段索引推迟到这里建立
+    buildBuckets();
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(dirtyMutex_);
+            wake_.wait(lock, [this] { return !running_ || !dirty_.empty(); });
+            if (!running_) {
+                break;
+            }
+        }
+        refresh();
+    }
+}
+
+SimilarityIndex::Signature SimilarityIndex::sign(const std::vector<uint64_t>& setIds) {
+    const HashFamily& family = hashFamily();
+    Signature signature;
+    signature.fill(std::numeric_limits<uint32_t>::max());
+    for (uint64_t setId : setIds) {
+        if (setId == BeatmapEntry::kNoSetId) {
+            continue;
+        }
+        uint64_t x = splitmix64(setId);
+        for (size_t i = 0; i < kHashes; i++) {
+            uint32_t h = static_cast<uint32_t>((family.a[i] * x + family.b[i]) >> 32);
+            signature[i] = std::min(signature[i], h);
+        }
+    }
+    return signature;
+}
+
+double SimilarityIndex::similarity(const Signature& a, const Signature& b) {
+    size_t same = 0;
+    for (size_t i = 0; i < kHashes; i++) {
+        same += a[i] == b[i];
+    }
+    return static_cast<double>(same) / kHashes;
+}
+
+uint64_t SimilarityIndex::bandKey(const Signature& signature, size_t band) {
+    uint64_t key = band;
+    for (size_t r = 0; r < kRows; r++) {
+        key = splitmix64(key ^ signature[band * kRows + r]);
+    }
+    return key;
+}
+
+std::string SimilarityIndex::serialize() {
+    refresh();
+    std::string out;
+    std::string records;
+    std::string names;
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    for (const auto& [username, signature] : signatures_) {
+        putU32(records, static_cast<uint32_t>(names.size()));
+        putU32(records, static_cast<uint32_t>(username.size()));
+        for (uint32_t value : signature) {
+            putU32(records, value);
+        }
+        names += username;
+    }
+    putU64(out, signatures_.size());
+    putU64(out, names.size());
+    out += records;
+    out += names;
+    return out;
+}
+
+bool SimilarityIndex::restore(const IndexCheckpoint& checkpoint) {
+    auto started = std::chrono::steady_clock::now();
+    const char* data;
+    size_t size;
+    std::vector<std::string> tail;
+    if (!checkpoint.section(IndexCheckpoint::kSimilaritySignatures, data, size) || size < 16 ||
+        !storage_->changeLog()->pathsAfter(checkpoint.seq(), tail)) {
+        return false;
+    }
+    uint64_t count = getU64(data);
+    uint64_t nameBytes = getU64(data + 8);
+    if (count > (size - 16) / kRecordSize || nameBytes > size - 16 - count * kRecordSize) {
+        return false;
+    }
+    const char* names = data + 16 + count * kRecordSize;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        bucketsReady_ = false;
+        for (uint64_t i = 0; i < count; i++) {
+            const char* record = data + 16 + i * kRecordSize;
+            uint32_t offset = getU32(record);
+            uint32_t length = getU32(record + 4);
+            if (static_cast<uint64_t>(offset) + length > nameBytes) {
+                signatures_.clear();
+                bucketsReady_ = true;
+                return false;
+            }
+            Signature& signature = signatures_[std::string(names + offset, length)];
+            for (size_t h = 0; h < kHashes; h++) {
+                signature[h] = getU32(record + 8 + 4 * h);
+            }
+        }
+    }
+
+    // 检查点之后写入的列表重新计算
+    for (const auto& relPath : tail) {
+        markDirty(relPath);
+    }
+    refresh();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    logger_->info("相似度索引已从检查点恢复: " + std::to_string(signatures_.size()) + " 个用户，耗时 " +
+                  std::to_string(static_cast<int>(ms)) + " 毫秒");
+    return true;
+}
+
+void SimilarityIndex::markDirty(const fs::path& relPath) {
+    // 只关心顶层的用户列表
+    if (relPath.has_parent_path() || (relPath.extension() != ".list" && relPath.extension() != ".json")) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(dirtyMutex_);
+    dirty_.insert(relPath.stem().string());
+    wake_.notify_one();
+}
+
+void SimilarityIndex::refresh() {
+    std::lock_guard<std::mutex> refreshLock(refreshMutex_);
+    std::unordered_set<std::string> dirty;
+    {
+        std::lock_guard<std::mutex> lock(dirtyMutex_);
+        dirty.swap(dirty_);
+    }
+    for (const auto& username : dirty) {
+        update(username);
+    }
+}
+
+void SimilarityIndex::update(const std::string& username) {
+    std::vector<uint64_t> setIds;
+    std::string errorMessage;
+    bool loaded = lists_->loadSetIds(username, setIds, errorMessage);
+    if (!loaded && !errorMessage.empty()) {
+        logger_->warning("更新相似度签名失败: " + errorMessage);
+    }
+    bool hasSets = loaded && !setIds.empty() && setIds.front() != BeatmapEntry::kNoSetId;
+    Signature signature;
+    if (hasSets) {
+        signature = sign(setIds);
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    unindex(username);
+    if (!hasSets) {
+        return;  // 列表已删除或没有在线谱面
+    }
+    insert(username, signature);
+}
+
+void SimilarityIndex::insert(const std::string& username, const Signature& signature) {
+    signatures_[username] = signature;
+    if (!bucketsReady_) {
+        return;
+    }
+    for (size_t band = 0; band < kBands; band++) {
+        buckets_[band][bandKey(signature, band)].push_back(username);
+    }
+}
+
+void SimilarityIndex::buildBuckets() {
+    std::lock_guard<std::mutex> refreshLock(refreshMutex_);
+    std::array<std::unordered_map<uint64_t, std::vector<std::string>>, kBands> buckets;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        if (bucketsReady_) {
+            return;
+        }
+        for (const auto& [username, signature] : signatures_) {
+            for (size_t band = 0; band < kBands; band++) {
+                buckets[band][bandKey(signature, band)].push_back(username);
+            }
+        }
+    }
+    // 持有 refreshMutex_，签名在建立期间不会变化
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    buckets_.swap(buckets);
+    bucketsReady_ = true;
+}
+
+void SimilarityIndex::unindex(const std::string& username) {
+    auto it = signatures_.find(username);
+    if (it == signatures_.end()) {
+        return;
+    }
+    for (size_t band = 0; band < kBands && bucketsReady_; band++) {
+        auto bucket = buckets_[band].find(bandKey(it->second, band));
+        if (bucket == buckets_[band].end()) {
+            continue;
+        }
+        auto& users = bucket->second;
+        auto pos = std::find(users.begin(), users.end(), username);
+        if (pos != users.end()) {
+            *pos = std::move(users.back());
+            users.pop_back();
+        }
+        if (users.empty()) {
+            buckets_[band].erase(bucket);
+        }
+    }
+    signatures_.erase(it);
+}
+
+bool SimilarityIndex::nearest(const std::string& username, size_t count, std::vector<Neighbour>& neighbours) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (!bucketsReady_) {
+        return false;
+    }
+    auto self = signatures_.find(username);
+    if (self == signatures_.end()) {
+        return true;
+    }
+
+    // 只有至少一段签名完全相同的用户才是候选者
+    std::unordered_set<std::string> candidates;
+    for (size_t band = 0; band < kBands; band++) {
+        auto bucket = buckets_[band].find(bandKey(self->second, band));
+        if (bucket != buckets_[band].end()) {
+            candidates.insert(bucket->second.begin(), bucket->second.end());
+        }
+    }
+    candidates.erase(username);
+
+    for (const auto& candidate : candidates) {
+        neighbours.push_back({candidate, similarity(self->second, signatures_.at(candidate))});
+    }
+    std::sort(neighbours.begin(), neighbours.end(), [](const Neighbour& a, const Neighbour& b) {
+        return a.similarity != b.similarity ? a.similarity > b.similarity : a.username < b.username;
+    });
+    if (neighbours.size() > count) {
+        neighbours.resize(count);
+    }
+    return true;
+}
+
+void SimilarityIndex::handleRecommend(const std::string& username, const httplib::Request& req,
+                                      httplib::Response& res) {
+    if (!lists_->exists(username)) {
+        res.status = 404;
+        res.set_content("文件未找到", "text/plain; charset=utf-8");
+        return;
+    }
+    size_t limit = paramOr(req, "limit", 50, 500);
+    size_t neighbourCount = paramOr(req, "neighbours", 20, 100);
+
+    std::vector<Neighbour> neighbours;
+    if (!nearest(username, neighbourCount, neighbours)) {
+        res.status = 503;
+        res.set_header("Retry-After", "5");
+        res.set_content("相似度索引正在建立，请稍后重试", "text/plain; charset=utf-8");
+        return;
+    }
+
+    std::vector<uint64_t> own;
+    std::string errorMessage;
+    if (!lists_->loadSetIds(username, own, errorMessage)) {
+        res.status = 500;
+        res.set_content(errorMessage, "text/plain; charset=utf-8");
+        return;
+    }
+
+    // 候选谱面集：邻居拥有而本人没有的，按邻居相似度加权计分
+    struct Candidate {
+        double score = 0;
+        size_t holders = 0;
+    };
+    std::unordered_map<uint64_t, Candidate> candidates;
+    json neighboursJson = json::array();
+    for (const auto& neighbour : neighbours) {
+        neighboursJson.push_back({{"user", neighbour.username}, {"similarity", neighbour.similarity}});
+        std::vector<uint64_t> theirs;
+        if (!lists_->loadSetIds(neighbour.username, theirs, errorMessage)) {
+            continue;
+        }
+        for (uint64_t setId : theirs) {
+            if (setId == BeatmapEntry::kNoSetId || std::binary_search(own.begin(), own.end(), setId)) {
+                continue;
+            }
+            Candidate& candidate = candidates[setId];
+            candidate.score += neighbour.similarity;
+            candidate.holders++;
+        }
+    }
+
+    std::vector<std::pair<uint64_t, Candidate>> ranked(candidates.begin(), candidates.end());
+    size_t top = std::min(limit, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + top, ranked.end(), [](const auto& a, const auto& b) {
+        return a.second.score != b.second.score ? a.second.score > b.second.score : a.first < b.first;
+    });
+    ranked.resize(top);
+
+    json setsJson = json::array();
+    for (const auto& entry : ranked) {
+        setsJson.push_back({{"setId", entry.first}, {"score", entry.second.score}, {"holders", entry.second.holders}});
+    }
+
+    json response = {{"user", username}, {"neighbours", neighboursJson}, {"sets", setsJson}};
+    res.set_content(response.dump(), "application/json");
+}
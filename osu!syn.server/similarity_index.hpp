@@ -0,0 +1,91 @@
+#pragma once
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "httplib.h"
+#include "index_checkpoint.hpp"
+#include "list_store.hpp"
+#include "logger.hpp"
+#include "storage.hpp"
+
+// “相似曲库”推荐：为每个用户的谱面集维护 MinHash 签名，并建立 LSH 分段索引
+// 签名由 kHashes 个独立哈希函数下的最小值组成，两份签名相同位置相等的比例是 Jaccard 相似度的估计；
+// 签名被切成 kBands 段，任一段完全相同的用户落在同一个桶里，查询只比较同桶的候选者。
+// 列表写入时（包括复制与迁移）只记下用户名，由后台线程批量更新签名；
+// 查询只读取后台线程上一次更新后的状态，请求线程上不做任何计算。
+// 签名随索引检查点保存；启动时给出检查点则只重新计算检查点之后变更过的用户，
+// LSH 分段索引推迟到后台线程启动后再建立，建立期间查询返回 503。
+class SimilarityIndex {
+public:
+    static constexpr size_t kHashes = 128;
+    static constexpr size_t kBands = 32;
+    static constexpr size_t kRows = kHashes / kBands;
+
+    using Signature = std::array<uint32_t, kHashes>;
+
+    SimilarityIndex(std::shared_ptr<Storage> storage,
+                    std::shared_ptr<ListStore> lists,
+                    std::shared_ptr<Logger> logger,
+                    const IndexCheckpoint* checkpoint = nullptr);
+    ~SimilarityIndex();
+
+    void start();
+    void stop();
+
+    // 更新待处理的签名后序列化全部签名，供索引检查点保存
+    std::string serialize();
+
+    // GET /recommend/<user>?limit=&neighbours=
+    void handleRecommend(const std::string& username, const httplib::Request& req, httplib::Response& res);
+
+    static Signature sign(const std::vector<uint64_t>& setIds);
+    static double similarity(const Signature& a, const Signature& b);
+
+private:
+    struct Neighbour {
+        std::string username;
+        double similarity;
+    };
+
+    void markDirty(const fs::path& relPath);
+    bool restore(const IndexCheckpoint& checkpoint);
+    void run();
+    void insert(const std::string& username, const Signature& signature);
+    // 在共享锁下建立分段索引，完成后再换入，建立期间查询不被阻塞
+    void buildBuckets();
+    // 重新计算自上次以来有变化的用户的签名
+    void refresh();
+    void update(const std::string& username);
+    void unindex(const std::string& username);
+
+    // 分段索引尚未建立时返回 false
+    bool nearest(const std::string& username, size_t count, std::vector<Neighbour>& neighbours);
+
+    static uint64_t bandKey(const Signature& signature, size_t band);
+
+    std::shared_ptr<Storage> storage_;
+    std::shared_ptr<ListStore> lists_;
+    std::shared_ptr<Logger> logger_;
+
+    std::mutex dirtyMutex_;
+    std::unordered_set<std::string> dirty_;
+    std::condition_variable wake_;      // 有新的待处理用户或停止
+    bool running_ = false;
+    std::thread thread_;
+
+    // 签名与分段索引只在持有 refreshMutex_ 时修改（后台线程与检查点线程）
+    std::mutex refreshMutex_;
+    std::shared_mutex mutex_;
+    std::unordered_map<std::string, Signature> signatures_;
+    // 每一段：段哈希 -> 该段签名相同的用户
+    std::array<std::unordered_map<uint64_t, std::vector<std::string>>, kBands> buckets_;
+    bool bucketsReady_ = true;
+};
@@ -0,0 +1,351 @@
+#include "snapshot.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <unordered_set>
+#include <zlib.h>
+#include "3rdparty/nlohmann/json.hpp"
+#include "binary_io.hpp"
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+using json = nlohmann::json;
+using binary_io::getU32;
+using binary_io::getU64;
+using binary_io::putU32;
+using binary_io::putU64;
+
+namespace {
+
+constexpr char kArchiveMagic[] = "OSSNAP01";
+constexpr char kIndexMagic[] = "OSSNAPIX";
+constexpr uint32_t kEntryMagic = 0x454E534F; // "OSNE"
+constexpr size_t kEntryHeaderSize = 4 + 1 + 4 + 8 + 8 + 4;
+constexpr size_t kTrailerSize = 8 + 8 + 8;
+constexpr size_t kBatchBytes = 1024 * 1024;
+
+enum EntryKind : uint8_t {
+    kFileEntry = 1,
+    kLogEntry = 2
+};
+
+uint32_t checksum(const std::string& data) {
+    return static_cast<uint32_t>(::crc32(0L, reinterpret_cast<const Bytef*>(data.data()),
+                                         static_cast<uInt>(data.size())));
+}
+
+// 生成一个独立压缩的条目，并把它在归档中的位置记入索引
+void appendEntry(std::string& out, uint64_t archiveOffset, EntryKind kind,
+                 const std::string& path, const std::string& raw, json& index) {
+    uLongf compressedSize = compressBound(static_cast<uLong>(raw.size()));
+    std::string compressed(compressedSize, '\0');
+    // 快照需要跟上磁盘顺序读的速度，使用最快的压缩级别
+    if (compress2(reinterpret_cast<Bytef*>(&compressed[0]), &compressedSize,
+                  reinterpret_cast<const Bytef*>(raw.data()), static_cast<uLong>(raw.size()),
+                  Z_BEST_SPEED) != Z_OK) {
+        throw std::runtime_error("压缩失败: " + path);
+    }
+    compressed.resize(compressedSize);
+
+    uint32_t crc = checksum(raw);
+    index["entries"].push_back({
+        {"path", path},
+        {"kind", kind},
+        {"offset", archiveOffset + out.size()},
+        {"size", raw.size()},
+        {"compressed", compressed.size()},
+        {"crc", crc}
+    });
+
+    putU32(out, kEntryMagic);
+    out.push_back(static_cast<char>(kind));
+    putU32(out, static_cast<uint32_t>(path.size()));
+    putU64(out, raw.size());
+    putU64(out, compressed.size());
+    putU32(out, crc);
+    out += path;
+    out += compressed;
+}
+
+// 列出存储目录中的全部文件，按 inode 排序以尽量接近磁盘上的物理顺序
+std::vector<fs::path> listFiles(const fs::path& root) {
+    std::vector<std::pair<uint64_t, fs::path>> files;
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(root, ec);
+         it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec) {
+            break;
+        }
+        if (!it->is_regular_file() || it->path().extension() == ".tmp") {
+            continue;
+        }
+        uint64_t order = 0;
+#ifndef _WIN32
+        struct stat st;
+        if (::stat(it->path().c_str(), &st) == 0) {
+            order = static_cast<uint64_t>(st.st_ino);
+        }
+#endif
+        files.emplace_back(order, fs::relative(it->path(), root));
+    }
+    std::sort(files.begin(), files.end());
+
+    std::vector<fs::path> result;
+    result.reserve(files.size());
+    for (auto& [order, path] : files) {
+        result.push_back(std::move(path));
+    }
+    return result;
+}
+
+struct SnapshotState {
+    uint64_t startSeq = 0;
+    uint64_t endSeq = 0;
+    uint64_t nextLogSeq = 0;
+    std::vector<fs::path> files;
+    size_t nextFile = 0;
+    uint64_t offset = 0;
+    bool headerWritten = false;
+    bool logCaptured = false;
+    json index = {{"entries", json::array()}};
+    std::shared_ptr<ChangeLog::Hold> hold;  // 快照结束前阻止回收 startSeq 之后的日志
+};
+
+bool readExact(std::ifstream& in, uint64_t offset, char* buffer, size_t size) {
+    in.seekg(static_cast<std::streamoff>(offset));
+    return static_cast<bool>(in.read(buffer, static_cast<std::streamsize>(size)));
+}
+
+// 读取并解压索引中的一个条目
+bool readEntry(std::ifstream& in, const json& entry, std::string& raw, std::string& errorMessage) {
+    uint64_t offset = entry.at("offset");
+    std::string path = entry.at("path");
+    size_t size = entry.at("size");
+    size_t compressedSize = entry.at("compressed");
+
+    std::string buffer(kEntryHeaderSize + path.size() + compressedSize, '\0');
+    if (!readExact(in, offset, &buffer[0], buffer.size()) || getU32(buffer.data()) != kEntryMagic) {
+        errorMessage = "归档条目损坏: " + path;
+        return false;
+    }
+
+    raw.assign(size, '\0');
+    uLongf rawSize = static_cast<uLongf>(size);
+    const char* compressed = buffer.data() + kEntryHeaderSize + path.size();
+    int rc = uncompress(reinterpret_cast<Bytef*>(size ? &raw[0] : nullptr), &rawSize,
+                        reinterpret_cast<const Bytef*>(compressed), static_cast<uLong>(compressedSize));
+    if (rc != Z_OK || rawSize != size || checksum(raw) != entry.at("crc").get<uint32_t>()) {
+        errorMessage = "归档条目校验失败: " + path;
+        return false;
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+SnapshotWriter::SnapshotWriter(std::shared_ptr<Storage> storage, std::shared_ptr<Logger> logger)
+    : storage_(storage)
+    , logger_(logger) {}
+
+void SnapshotWriter::handleSnapshot(const httplib::Request&, httplib::Response& res) {
+    auto state = std::make_shared<SnapshotState>();
+    state->startSeq = storage_->changeLog()->headSeq();
+    state->hold = storage_->changeLog()->hold(state->startSeq + 1);
+    state->files = listFiles(storage_->root());
+    // 冷层中的文件不在目录里，同样经 Storage::read 读出
+    for (auto& path : storage_->coldFiles()) {
+        state->files.push_back(std::move(path));
+    }
+    logger_->info("开始生成快照，起始序号 " + std::to_string(state->startSeq) +
+                  "，文件数 " + std::to_string(state->files.size()));
+
+    res.set_header("Content-Disposition", "attachment; filename=\"snapshot-" +
+                   std::to_string(state->startSeq) + ".ossnap\"");
+    res.set_chunked_content_provider("application/octet-stream",
+        [this, state](size_t, httplib::DataSink& sink) {
+            std::string out;
+            if (!state->headerWritten) {
+                out.append(kArchiveMagic, 8);
+                putU64(out, state->startSeq);
+                state->headerWritten = true;
+            }
+
+            try {
+                // 1. 文件条目
+                while (state->nextFile < state->files.size() && out.size() < kBatchBytes) {
+                    const fs::path& path = state->files[state->nextFile++];
+                    std::string content;
+                    if (storage_->read(path, content)) {
+                        appendEntry(out, state->offset, kFileEntry, path.generic_string(), content, state->index);
+                    }
+                }
+
+                // 2. 快照期间产生的日志记录
+                if (state->nextFile == state->files.size() && !state->logCaptured && out.size() < kBatchBytes) {
+                    if (state->endSeq == 0) {
+                        state->endSeq = storage_->changeLog()->headSeq();
+                        state->nextLogSeq = state->startSeq + 1;
+                    }
+                    while (state->nextLogSeq <= state->endSeq && out.size() < kBatchBytes) {
+                        auto records = storage_->changeLog()->readFrom(state->nextLogSeq, 64, kBatchBytes);
+                        if (records.empty()) {
+                            throw std::runtime_error("读取变更日志失败");
+                        }
+                        for (const auto& record : records) {
+                            if (record.seq > state->endSeq) {
+                                break;
+                            }
+                            std::string encoded;
+                            ChangeLog::encode(record, encoded);
+                            appendEntry(out, state->offset, kLogEntry, "", encoded, state->index);
+                            state->nextLogSeq = record.seq + 1;
+                        }
+                    }
+                    state->logCaptured = state->nextLogSeq > state->endSeq;
+                }
+            } catch (const std::exception& e) {
+                logger_->error("生成快照失败: " + std::string(e.what()));
+                return false;
+            }
+
+            // 3. 索引与尾部
+            bool finished = state->logCaptured;
+            if (finished) {
+                state->index["startSeq"] = state->startSeq;
+                state->index["endSeq"] = state->endSeq;
+                std::string indexData = state->index.dump();
+                uint64_t indexOffset = state->offset + out.size();
+                out += indexData;
+                putU64(out, indexOffset);
+                putU64(out, indexData.size());
+                out.append(kIndexMagic, 8);
+            }
+
+            state->offset += out.size();
+            if (!sink.write(out.data(), out.size())) {
+                return false;
+            }
+            if (finished) {
+                logger_->info("快照完成，一致序号 " + std::to_string(state->endSeq) +
+                              "，大小 " + std::to_string(state->offset / 1024) + "KB");
+                sink.done();
+            }
+            return true;
+        });
+}
+
+SnapshotRestorer::SnapshotRestorer(std::shared_ptr<Storage> storage, std::shared_ptr<Logger> logger)
+    : storage_(storage)
+    , logger_(logger) {}
+
+bool SnapshotRestorer::restore(const fs::path& archive, size_t threads, std::string& errorMessage,
+                               bool pruneExisting) {
+    if (storage_->changeLog()->headSeq() != 0) {
+        errorMessage = "只能恢复到空的节点（变更日志非空）";
+        return false;
+    }
+
+    std::ifstream in(archive, std::ios::binary);
+    char magic[8];
+    if (!in || !in.read(magic, 8) || std::string(magic, 8) != kArchiveMagic) {
+        errorMessage = "不是有效的快照归档: " + archive.string();
+        return false;
+    }
+
+    uint64_t archiveSize = fs::file_size(archive);
+    char trailer[kTrailerSize];
+    if (archiveSize < 16 + kTrailerSize ||
+        !readExact(in, archiveSize - kTrailerSize, trailer, kTrailerSize) ||
+        std::string(trailer + 16, 8) != kIndexMagic) {
+        errorMessage = "快照归档不完整（缺少索引）";
+        return false;
+    }
+
+    json index;
+    try {
+        std::string indexData(getU64(trailer + 8), '\0');
+        if (!readExact(in, getU64(trailer), &indexData[0], indexData.size())) {
+            throw std::runtime_error("读取失败");
+        }
+        index = json::parse(indexData);
+    } catch (const std::exception& e) {
+        errorMessage = "快照索引损坏: " + std::string(e.what());
+        return false;
+    }
+
+    std::vector<const json*> fileEntries;
+    std::vector<const json*> logEntries;
+    for (const auto& entry : index["entries"]) {
+        (entry.at("kind") == kFileEntry ? fileEntries : logEntries).push_back(&entry);
+    }
+    logger_->info("开始恢复快照: " + std::to_string(fileEntries.size()) + " 个文件，" +
+                  std::to_string(logEntries.size()) + " 条日志记录");
+
+    // 1. 并行写入文件
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::mutex errorMutex;
+    std::vector<std::thread> workers;
+    threads = std::max<size_t>(1, threads);
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            std::ifstream input(archive, std::ios::binary);
+            std::string raw;
+            std::string error;
+            for (size_t i = next++; i < fileEntries.size() && !failed; i = next++) {
+                const json& entry = *fileEntries[i];
+                if (!readEntry(input, entry, raw, error) ||
+                    !storage_->putUnlogged(entry.at("path").get<std::string>(), raw, error)) {
+                    failed = true;
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    errorMessage = error;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    if (failed) {
+        return false;
+    }
+    if (pruneExisting) {
+        std::unordered_set<std::string> archived;
+        for (const json* entry : fileEntries) {
+            archived.insert(entry->at("path").get<std::string>());
+        }
+        size_t pruned = 0;
+        for (const auto& relPath : storage_->paths()) {
+            if (!archived.count(relPath) && storage_->removeUnlogged(relPath, errorMessage)) {
+                pruned++;
+            }
+        }
+        logger_->info("删除快照中没有的本地文件 " + std::to_string(pruned) + " 个");
+    }
+
+    // 2. 按顺序回放快照期间的日志，得到 endSeq 时刻的一致状态
+    uint64_t startSeq = index.value("startSeq", uint64_t{0});
+    if (startSeq > 0) {
+        storage_->changeLog()->markBase(startSeq);
+    }
+    for (const json* entry : logEntries) {
+        std::string raw;
+        if (!readEntry(in, *entry, raw, errorMessage)) {
+            return false;
+        }
+        ChangeLog::Decoder decoder;
+        decoder.feed(raw.data(), raw.size());
+        LogRecord record;
+        if (!decoder.next(record) || !storage_->apply(record, errorMessage)) {
+            if (errorMessage.empty()) {
+                errorMessage = "快照中的日志记录损坏";
+            }
+            return false;
+        }
+    }
+
+    logger_->info("快照恢复完成，当前序号 " + std::to_string(storage_->changeLog()->headSeq()));
+    return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "httplib.h"
+#include "logger.hpp"
+#include "storage.hpp"
+
+// 存储层的时间点快照
+//
+// 归档格式：
+//   "OSSNAP01" u64 startSeq
+//   条目*:  u32 魔数 u8 类型 u32 pathLen u64 原始大小 u64 压缩大小 u32 CRC32(原始数据) path 压缩数据
+//           类型 1 为文件，类型 2 为快照期间产生的变更日志记录
+//   索引:   JSON {startSeq, endSeq, entries: [{path, kind, offset, size, compressed, crc}]}
+//   尾部:   u64 索引偏移 u64 索引长度 "OSSNAPIX"
+//
+// 文件逐个读取时可能已被新的写入覆盖；由于存储层先记日志再落盘，把 [startSeq, endSeq]
+// 之间的日志记录附在文件之后，恢复时回放即可得到 endSeq 时刻一致的数据。
+// 每个条目独立压缩，恢复时可根据索引并行解压写入。
+class SnapshotWriter {
+public:
+    SnapshotWriter(std::shared_ptr<Storage> storage, std::shared_ptr<Logger> logger);
+
+    // GET /admin/snapshot
+    void handleSnapshot(const httplib::Request& req, httplib::Response& res);
+
+private:
+    std::shared_ptr<Storage> storage_;
+    std::shared_ptr<Logger> logger_;
+};
+
+class SnapshotRestorer {
+public:
+    SnapshotRestorer(std::shared_ptr<Storage> storage, std::shared_ptr<Logger> logger);
+
+    // 把归档恢复到变更日志为空的存储中，文件条目由 threads 个线程并行写入
+    // pruneExisting 为 true 时删除存储中归档里没有的文件（从节点在已有数据之上重新初始化）
+    bool restore(const fs::path& archive, size_t threads, std::string& errorMessage, bool pruneExisting = false);
+
+private:
+    std::shared_ptr<Storage> storage_;
+    std::shared_ptr<Logger> logger_;
+};
@@ -0,0 +1,525 @@
+#include "storage.hpp"
+#include <chrono>
+#include <fstream>
+#include <unordered_set>
+#include "binary_io.hpp"
+
+using binary_io::getU32;
+using binary_io::getU64;
+using binary_io::putU32;
+using binary_io::putU64;
+
+namespace {
+
+// 检查点中的一条记录：u64 数值 u64 数值 u32 字符串偏移 u32 字符串长度，字符串集中存放在记录之后
+constexpr size_t kRecordSize = 8 + 8 + 4 + 4;
+
+void putRecord(std::string& records, std::string& strings, const std::string& key, uint64_t a, uint64_t b) {
+    putU64(records, a);
+    putU64(records, b);
+    putU32(records, static_cast<uint32_t>(strings.size()));
+    putU32(records, static_cast<uint32_t>(key.size()));
+    strings += key;
+}
+
+// 解析一组记录，越界时返回 false
+template <typename Visit>
+bool readRecords(const char*& p, const char* end, Visit visit) {
+    if (end - p < 16) {
+        return false;
+    }
+    uint64_t count = getU64(p);
+    uint64_t stringBytes = getU64(p + 8);
+    p += 16;
+    if (count > static_cast<uint64_t>(end - p) / kRecordSize ||
+        stringBytes > static_cast<uint64_t>(end - p) - count * kRecordSize) {
+        return false;
+    }
+    const char* strings = p + count * kRecordSize;
+    for (uint64_t i = 0; i < count; i++) {
+        const char* record = p + i * kRecordSize;
+        uint32_t offset = getU32(record + 16);
+        uint32_t length = getU32(record + 20);
+        if (static_cast<uint64_t>(offset) + length > stringBytes) {
+            return false;
+        }
+        visit(std::string(strings + offset, length), getU64(record), getU64(record + 8));
+    }
+    p = strings + stringBytes;
+    return true;
+}
+
+} // anonymous namespace
+
+Storage::Storage(const fs::path& root, std::shared_ptr<ChangeLog> changeLog, std::shared_ptr<Logger> logger,
+                 std::shared_ptr<ChecksumIndex> checksums, const IndexCheckpoint* checkpoint)
+    : root_(root)
+    , changeLog_(changeLog)
+    , logger_(logger)
+    , checksums_(checksums) {
+    fs::create_directories(root_);
+    if (!checkpoint || !restoreIndex(*checkpoint)) {
+        buildIndex();
+    }
+}
+
+std::string Storage::serializeIndex(uint64_t& seq) {
+    std::string records;
+    std::string strings;
+    std::string out;
+    std::lock_guard<std::mutex> writeLock(writeMutex_);
+    std::lock_guard<std::mutex> lock(indexMutex_);
+    seq = changeLog_->headSeq();
+
+    for (const auto& [relPath, size] : sizes_) {
+        putRecord(records, strings, relPath, size, 0);
+    }
+    putU64(out, sizes_.size());
+    putU64(out, strings.size());
+    out += records;
+    out += strings;
+
+    records.clear();
+    strings.clear();
+    for (const auto& [owner, usage] : usage_) {
+        putRecord(records, strings, owner, usage.bytes, usage.objects);
+    }
+    putU64(out, usage_.size());
+    putU64(out, strings.size());
+    out += records;
+    out += strings;
+    return out;
+}
+
+bool Storage::restoreIndex(const IndexCheckpoint& checkpoint) {
+    auto started = std::chrono::steady_clock::now();
+    const char* data;
+    size_t size;
+    std::vector<std::string> tail;
+    if (!checkpoint.section(IndexCheckpoint::kStorageIndex, data, size) ||
+        !changeLog_->pathsAfter(checkpoint.seq(), tail)) {
+        return false;
+    }
+
+    const char* p = data;
+    const char* end = data + size;
+    bool parsed = readRecords(p, end, [this](std::string relPath, uint64_t size, uint64_t) {
+        sizes_.emplace(std::move(relPath), size);
+    }) && readRecords(p, end, [this](std::string owner, uint64_t bytes, uint64_t objects) {
+        usage_[std::move(owner)] = Usage{bytes, objects};
+    });
+    if (!parsed) {
+        logger_->warning("索引检查点中的存储索引损坏，改为扫描目录");
+        sizes_.clear();
+        usage_.clear();
+        return false;
+    }
+
+    // 回放检查点之后改动过的路径：以磁盘上的现状为准，回放多少次结果都相同
+    std::unordered_set<std::string> replayed;
+    for (const auto& relPath : tail) {
+        if (!replayed.insert(relPath).second) {
+            continue;
+        }
+        std::error_code ec;
+        uint64_t fileSize = fs::file_size(root_ / relPath, ec);
+        account(relPath, !ec, ec ? 0 : fileSize);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    logger_->info("存储索引已从检查点恢复: " + std::to_string(sizes_.size()) + " 个文件，回放 " +
+                  std::to_string(tail.size()) + " 条记录，耗时 " + std::to_string(static_cast<int>(ms)) + " 毫秒");
+    return true;
+}
+
+void Storage::buildIndex() {
+    size_t files = 0;
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(root_, ec); !ec && it != fs::recursive_directory_iterator();
+         it.increment(ec)) {
+        if (!it->is_regular_file(ec) || it->path().extension() == ".tmp") {
+            continue;
+        }
+        account(it->path().lexically_relative(root_), true, it->file_size(ec));
+        files++;
+    }
+    logger_->info("存储索引已建立: " + std::to_string(files) + " 个文件");
+}
+
+void Storage::attachColdStore(std::shared_ptr<ColdStore> cold) {
+    cold_ = cold;
+    for (const auto& [relPath, size] : cold_->entries()) {
+        // 已在索引中的（从检查点恢复，或下沉、提升中途崩溃后热层副本仍在）不重复计入
+        if (!exists(relPath)) {
+            account(relPath, true, size);
+        }
+    }
+}
+
+std::string Storage::ownerOf(const fs::path& relPath) {
+    if (relPath.empty()) {
+        return "";
+    }
+    if (!relPath.has_parent_path()) {
+        return relPath.stem().string();
+    }
+    return relPath.begin()->string();
+}
+
+void Storage::notify(const fs::path& relPath, const std::string* content) {
+    for (const auto& listener : listeners_) {
+        listener(relPath, content);
+    }
+}
+
+Storage::Usage Storage::usage(const std::string& owner) const {
+    std::lock_guard<std::mutex> lock(indexMutex_);
+    auto it = usage_.find(owner);
+    return it == usage_.end() ? Usage() : it->second;
+}
+
+bool Storage::exists(const fs::path& relPath) const {
+    std::lock_guard<std::mutex> lock(indexMutex_);
+    return sizes_.count(relPath.generic_string()) > 0;
+}
+
+bool Storage::stat(const fs::path& relPath, uint64_t& size) const {
+    std::lock_guard<std::mutex> lock(indexMutex_);
+    auto it = sizes_.find(relPath.generic_string());
+    if (it == sizes_.end()) {
+        return false;
+    }
+    size = it->second;
+    return true;
+}
+
+void Storage::account(const fs::path& relPath, bool present, uint64_t size) {
+    std::string key = relPath.generic_string();
+    std::lock_guard<std::mutex> lock(indexMutex_);
+    Usage& usage = usage_[ownerOf(relPath)];
+    auto it = sizes_.find(key);
+    if (it != sizes_.end()) {
+        usage.bytes -= it->second;
+        usage.objects--;
+        if (!present) {
+            sizes_.erase(it);
+        }
+    }
+    if (present) {
+        sizes_[key] = size;
+        usage.bytes += size;
+        usage.objects++;
+    }
+}
+
+// 先写文件、成功后再追加日志：写入失败的变更不会进入日志并被复制到从节点
+bool Storage::put(const fs::path& relPath, const std::string& content, std::string& errorMessage) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    if (!writeFile(relPath, content, errorMessage)) {
+        return false;
+    }
+    changeLog_->append(LogRecord::Op::Put, relPath.generic_string(), content);
+    return true;
+}
+
+bool Storage::remove(const fs::path& relPath, std::string& errorMessage) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    if (!removeFile(relPath, errorMessage)) {
+        return false;
+    }
+    changeLog_->append(LogRecord::Op::Remove, relPath.generic_string(), "");
+    return true;
+}
+
+bool Storage::apply(const LogRecord& record, std::string& errorMessage) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    // 日志只经由 writeMutex_ 追加，此处检查过的序号在追加时仍然连续
+    uint64_t head = changeLog_->headSeq();
+    if (head != 0 && record.seq != head + 1) {
+        errorMessage = "复制序号不连续: 期望 " + std::to_string(head + 1) +
+                       ", 收到 " + std::to_string(record.seq);
+        return false;
+    }
+
+    // 应用失败时不追加，从节点重连后从同一序号重试
+    bool applied = true;
+    switch (record.op) {
+        case LogRecord::Op::Put:
+            applied = writeFile(record.path, record.data, errorMessage);
+            break;
+        case LogRecord::Op::Remove:
+            applied = removeFile(record.path, errorMessage);
+            break;
+        default:
+            break;
+    }
+    if (!applied) {
+        return false;
+    }
+    changeLog_->appendReplicated(record);
+    return true;
+}
+
+bool Storage::putUnlogged(const fs::path& relPath, const std::string& content, std::string& errorMessage) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    if (!writeFile(relPath, content, errorMessage)) {
+        return false;
+    }
+    if (unloggedHook_) {
+        unloggedHook_();
+    }
+    return true;
+}
+
+bool Storage::removeUnlogged(const fs::path& relPath, std::string& errorMessage) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    if (!removeFile(relPath, errorMessage)) {
+        return false;
+    }
+    if (unloggedHook_) {
+        unloggedHook_();
+    }
+    return true;
+}
+
+bool Storage::read(const fs::path& relPath, std::string& content) const {
+    std::ifstream file(root_ / relPath, std::ios::binary);
+    if (!file) {
+        return cold_ && cold_->read(relPath.generic_string(), content);
+    }
+    content.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return !file.bad();
+}
+
+void Storage::writeAtomically(const fs::path& relPath, const std::string& content) {
+    fs::path target = root_ / relPath;
+    fs::path temp = target;
+    temp += ".tmp";
+
+    try {
+        fs::create_directories(target.parent_path());
+
+        std::ofstream ofs(temp, std::ios::binary | std::ios::trunc);
+        if (!ofs) {
+            throw std::runtime_error("无法创建文件");
+        }
+        ofs.write(content.data(), content.size());
+        ofs.close();
+        if (!ofs) {
+            throw std::runtime_error("写入文件失败");
+        }
+
+        fs::rename(temp, target);
+    } catch (const std::exception&) {
+        std::error_code ec;
+        fs::remove(temp, ec);
+        throw;
+    }
+}
+
+bool Storage::writeFile(const fs::path& relPath, const std::string& content, std::string& errorMessage) {
+    try {
+        writeAtomically(relPath, content);
+        if (cold_) {
+            cold_->forget(relPath.generic_string());
+        }
+        account(relPath, true, content.size());
+        if (checksums_) {
+            checksums_->record(relPath.generic_string(), ChecksumIndex::compute(content));
+        }
+        notify(relPath, &content);
+        return true;
+    } catch (const std::exception& e) {
+        errorMessage = "保存文件失败: " + std::string(e.what());
+        logger_->error(errorMessage + " (" + (root_ / relPath).string() + ")");
+        return false;
+    }
+}
+
+bool Storage::removeFile(const fs::path& relPath, std::string& errorMessage) {
+    std::error_code ec;
+    fs::remove(root_ / relPath, ec);
+    if (ec) {
+        errorMessage = "删除文件失败: " + ec.message();
+        return false;
+    }
+    if (cold_) {
+        cold_->forget(relPath.generic_string());
+        cold_->forgetAccess(relPath.generic_string());
+    }
+    account(relPath, false, 0);
+    if (checksums_) {
+        checksums_->forget(relPath.generic_string());
+    }
+    notify(relPath, nullptr);
+    return true;
+}
+
+void Storage::touch(const fs::path& relPath) {
+    if (!cold_ || !exists(relPath)) {
+        return;
+    }
+    std::string key = relPath.generic_string();
+    cold_->recordAccess(key, std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    if (cold_->contains(key)) {
+        promote(relPath);
+    }
+}
+
+bool Storage::promote(const fs::path& relPath) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    std::string key = relPath.generic_string();
+    std::string content;
+    std::error_code ec;
+    if (fs::exists(root_ / relPath, ec)) {
+        cold_->forget(key);
+        return true;
+    }
+    if (!cold_->read(key, content)) {
+        return false;
+    }
+    // 内容没有变化，不记日志也不通知
+    try {
+        writeAtomically(relPath, content);
+    } catch (const std::exception& e) {
+        logger_->error("提升冷层文件失败: " + key + " (" + e.what() + ")");
+        return false;
+    }
+    cold_->forget(key);
+    logger_->info("冷层文件已提升回热层: " + key);
+    return true;
+}
+
+size_t Storage::demote(const std::vector<fs::path>& relPaths, std::string& errorMessage) {
+    if (!cold_) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    std::vector<std::pair<std::string, std::string>> files;
+    for (const auto& relPath : relPaths) {
+        std::ifstream file(root_ / relPath, std::ios::binary);
+        if (!file) {
+            continue;   // 已被删除
+        }
+        std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (!file.bad()) {
+            files.emplace_back(relPath.generic_string(), std::move(content));
+        }
+    }
+    if (files.empty() || !cold_->add(files, errorMessage)) {
+        return 0;
+    }
+
+    // 冷层已登记，之后才删除热层文件
+    std::error_code ec;
+    for (const auto& file : files) {
+        fs::remove(root_ / file.first, ec);
+    }
+    return files.size();
+}
+
+std::vector<fs::path> Storage::coldFiles() const {
+    std::vector<fs::path> result;
+    if (!cold_) {
+        return result;
+    }
+    std::error_code ec;
+    for (const auto& entry : cold_->entries()) {
+        if (!fs::exists(root_ / entry.first, ec)) {
+            result.emplace_back(entry.first);
+        }
+    }
+    return result;
+}
+
+std::vector<std::string> Storage::paths() const {
+    std::lock_guard<std::mutex> lock(indexMutex_);
+    std::vector<std::string> result;
+    result.reserve(sizes_.size());
+    for (const auto& entry : sizes_) {
+        result.push_back(entry.first);
+    }
+    return result;
+}
+
+void Storage::adoptChecksum(const fs::path& relPath, uint32_t crc) {
+    if (!checksums_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    uint32_t existing;
+    std::string content;
+    // 读取与记录之间文件可能已被改写，只有内容未变时才采纳
+    if (!checksums_->lookup(relPath.generic_string(), existing) &&
+        read(relPath, content) && ChecksumIndex::compute(content) == crc) {
+        checksums_->record(relPath.generic_string(), crc);
+    }
+}
+
+bool Storage::quarantine(const fs::path& relPath, const fs::path& dest,
+                         const std::function<bool(const std::string&)>& stillBad, std::string& errorMessage) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    std::string content;
+    if (!read(relPath, content) || !stillBad(content)) {
+        return false;
+    }
+
+    std::error_code ec;
+    fs::create_directories(dest.parent_path(), ec);
+    fs::rename(root_ / relPath, dest, ec);
+    if (ec) {
+        // 隔离目录可能位于另一个文件系统上
+        ec.clear();
+        fs::copy_file(root_ / relPath, dest, fs::copy_options::overwrite_existing, ec);
+        if (!ec) {
+            fs::remove(root_ / relPath, ec);
+        }
+    }
+    if (ec) {
+        errorMessage = "隔离文件失败: " + ec.message();
+        return false;
+    }
+    account(relPath, false, 0);
+    if (checksums_) {
+        checksums_->forget(relPath.generic_string());
+    }
+    notify(relPath, nullptr);
+    if (unloggedHook_) {
+        unloggedHook_();
+    }
+    return true;
+}
+
+bool Storage::repair(const fs::path& relPath, const fs::path& dest,
+                     const std::function<bool(const std::string&)>& stillBad,
+                     const std::string* replacement, std::string& errorMessage) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    std::string content;
+    if (!read(relPath, content) || !stillBad(content)) {
+        return false;
+    }
+
+    // 损坏的内容留一份在隔离目录中备查，原文件由随后的写入或删除替换
+    std::error_code ec;
+    fs::create_directories(dest.parent_path(), ec);
+    std::ofstream out(dest, std::ios::binary | std::ios::trunc);
+    out.write(content.data(), static_cast<std::streamsize>(content.size()));
+    out.close();
+    if (!out) {
+        errorMessage = "隔离文件失败: " + dest.string();
+        return false;
+    }
+
+    if (replacement) {
+        if (!writeFile(relPath, *replacement, errorMessage)) {
+            return false;
+        }
+        changeLog_->append(LogRecord::Op::Put, relPath.generic_string(), *replacement);
+        return true;
+    }
+    if (!removeFile(relPath, errorMessage)) {
+        return false;
+    }
+    changeLog_->append(LogRecord::Op::Remove, relPath.generic_string(), "");
+    return true;
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "changelog.hpp"
+#include "checksum_index.hpp"
+#include "cold_store.hpp"
+#include "index_checkpoint.hpp"
+#include "logger.hpp"
+
+namespace fs = std::filesystem;
+
+// 上传目录之上的存储层
+// 所有写入都以“临时文件 + 重命名”的方式原子地落盘，成功后再记入变更日志
+// 配置了校验和索引时，每次落盘同时记录文件的 CRC32
+// 内存中的索引记录每个文件的大小与每个用户的用量，随每次写入和删除同步更新，
+// 只在启动时遍历一次目录；给出有效的检查点时改为加载检查点并按变更日志回放之后的路径
+// 启用冷层后，文件可能只存在于冷层的打包文件中：读取透明地解压，索引中照常计入，
+// 目录中看不到它们，需要枚举全部文件的地方须同时使用 coldFiles()
+class Storage {
+public:
+    struct Usage {
+        uint64_t bytes = 0;
+        uint64_t objects = 0;
+    };
+
+    // 文件落盘或删除后的通知（content 为 nullptr 表示删除），在写锁内调用，必须足够轻量
+    using Listener = std::function<void(const fs::path& relPath, const std::string* content)>;
+
+    Storage(const fs::path& root, std::shared_ptr<ChangeLog> changeLog, std::shared_ptr<Logger> logger,
+            std::shared_ptr<ChecksumIndex> checksums = nullptr, const IndexCheckpoint* checkpoint = nullptr);
+
+    // 写入文件（relPath 必须已通过 FileValidator::isSafePath 校验）
+    bool put(const fs::path& relPath, const std::string& content, std::string& errorMessage);
+
+    // 删除文件
+    bool remove(const fs::path& relPath, std::string& errorMessage);
+
+    // 应用从主节点复制来的记录
+    bool apply(const LogRecord& record, std::string& errorMessage);
+
+    // 直接写入或删除文件而不记日志，仅用于从快照恢复（此时日志稍后以基准标记接续）
+    bool putUnlogged(const fs::path& relPath, const std::string& content, std::string& errorMessage);
+    bool removeUnlogged(const fs::path& relPath, std::string& errorMessage);
+
+    // 读取文件内容（热层或冷层），文件不存在或读取失败时返回 false
+    bool read(const fs::path& relPath, std::string& content) const;
+
+    // 文件是否存在（热层或冷层），O(1)
+    bool exists(const fs::path& relPath) const;
+
+    // 为没有校验和记录的文件（例如索引启用前写入的文件）补记校验和
+    void adoptChecksum(const fs::path& relPath, uint32_t crc);
+
+    // 在写锁内重新读取文件，若 stillBad 仍判定其损坏则移动到 dest 并删除校验和记录
+    // 返回 false 表示文件已被新的写入替换或不存在，无需隔离
+    bool quarantine(const fs::path& relPath, const fs::path& dest,
+                    const std::function<bool(const std::string&)>& stillBad, std::string& errorMessage);
+
+    // 主节点上的损坏文件：在写锁内复查后把损坏的内容复制到 dest，再以记日志的写入替换为 replacement
+    // （为 nullptr 时以记日志的删除移除），从节点随复制流得到同样的结果
+    bool repair(const fs::path& relPath, const fs::path& dest,
+                const std::function<bool(const std::string&)>& stillBad,
+                const std::string* replacement, std::string& errorMessage);
+
+    // 注册写入通知，须在开始服务之前调用
+    void addListener(Listener listener) { listeners_.push_back(std::move(listener)); }
+
+    // 发生不记日志的改动（快照恢复、巡检隔离与重新拉取）后调用，用于作废索引检查点
+    void setUnloggedHook(std::function<void()> hook) { unloggedHook_ = std::move(hook); }
+
+    // 在写锁内序列化大小与用量索引，seq 为与之一致的变更日志序号
+    std::string serializeIndex(uint64_t& seq);
+
+    // 启用冷层：把索引中还没有的冷层文件计入索引，须在开始服务之前调用
+    void attachColdStore(std::shared_ptr<ColdStore> cold);
+
+    // 记录一次来自请求的访问；文件在冷层中时提升回热层
+    void touch(const fs::path& relPath);
+
+    // 把一批热层文件压缩进冷层的一个打包文件，返回下沉的文件数
+    size_t demote(const std::vector<fs::path>& relPaths, std::string& errorMessage);
+
+    // 只存在于冷层中的文件
+    std::vector<fs::path> coldFiles() const;
+
+    // 索引中的全部文件（热层与冷层，generic 形式的相对路径），不遍历目录
+    std::vector<std::string> paths() const;
+
+    // 文件所属的用户：第一级目录名，顶层文件取去掉扩展名后的文件名
+    static std::string ownerOf(const fs::path& relPath);
+
+    // 用户当前的用量，O(1)
+    Usage usage(const std::string& owner) const;
+
+    // 索引中记录的文件大小，文件不存在时返回 false
+    bool stat(const fs::path& relPath, uint64_t& size) const;
+
+    const fs::path& root() const { return root_; }
+    const std::shared_ptr<ChangeLog>& changeLog() const { return changeLog_; }
+    const std::shared_ptr<ChecksumIndex>& checksums() const { return checksums_; }
+    const std::shared_ptr<ColdStore>& coldStore() const { return cold_; }
+
+private:
+    bool writeFile(const fs::path& relPath, const std::string& content, std::string& errorMessage);
+    bool removeFile(const fs::path& relPath, std::string& errorMessage);
+    // 以“临时文件 + 重命名”的方式写入热层，失败时抛出异常
+    void writeAtomically(const fs::path& relPath, const std::string& content);
+    bool promote(const fs::path& relPath);
+    void buildIndex();
+    bool restoreIndex(const IndexCheckpoint& checkpoint);
+    // 更新索引：present 为 false 表示文件已删除
+    void account(const fs::path& relPath, bool present, uint64_t size);
+    void notify(const fs::path& relPath, const std::string* content);
+
+    fs::path root_;
+    std::shared_ptr<ChangeLog> changeLog_;
+    std::shared_ptr<Logger> logger_;
+    std::shared_ptr<ChecksumIndex> checksums_;
+    std::shared_ptr<ColdStore> cold_;
+    std::vector<Listener> listeners_;
+    std::function<void()> unloggedHook_;
+    std::mutex writeMutex_;     // 保证日志顺序与落盘顺序一致
+
+    mutable std::mutex indexMutex_;
+    std::unordered_map<std::string, uint64_t> sizes_;
+    std::unordered_map<std::string, Usage> usage_;
+};
@@ -0,0 +1,157 @@
+#include "user_directory.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include "3rdparty/nlohmann/json.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+// 一次刷新中改动不超过这个数目时原地插入删除，否则整体归并
+constexpr size_t kInPlaceChanges = 64;
+
+// 顶层用户列表（.list 或旧格式的 .json）对应的用户名，其他文件返回空串
+std::string listOwner(const fs::path& relPath) {
+    if (relPath.has_parent_path() || (relPath.extension() != ".list" && relPath.extension() != ".json")) {
+        return "";
+    }
+    return relPath.stem().string();
+}
+
+}  // namespace
+
+UserDirectory::UserDirectory(std::shared_ptr<Storage> storage,
+                             std::shared_ptr<ListStore> lists,
+                             std::shared_ptr<Logger> logger)
+    : storage_(storage)
+    , lists_(lists)
+    , logger_(logger) {
+    storage_->addListener([this](const fs::path& relPath, const std::string*) {
+        markDirty(relPath);
+    });
+
+    auto started = std::chrono::steady_clock::now();
+    for (auto& relPath : storage_->paths()) {
+        // 与 listOwner 相同的判断，直接作用于字符串，避免为每个文件构造 fs::path
+        if (relPath.size() > 5 && relPath.find('/') == std::string::npos &&
+            (relPath.compare(relPath.size() - 5, 5, ".list") == 0 ||
+             relPath.compare(relPath.size() - 5, 5, ".json") == 0)) {
+            relPath.resize(relPath.size() - 5);
+            names_.push_back(std::move(relPath));
+        }
+    }
+    std::sort(names_.begin(), names_.end());
+    names_.erase(std::unique(names_.begin(), names_.end()), names_.end());
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    logger_->info("用户目录已建立: " + std::to_string(names_.size()) + " 个用户，耗时 " +
+                  std::to_string(static_cast<int>(ms)) + " 毫秒");
+}
+
+void UserDirectory::markDirty(const fs::path& relPath) {
+    std::string username = listOwner(relPath);
+    if (username.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(dirtyMutex_);
+    dirty_.insert(std::move(username));
+}
+
+void UserDirectory::refresh() {
+    std::unordered_set<std::string> dirty;
+    {
+        std::lock_guard<std::mutex> lock(dirtyMutex_);
+        if (dirty_.empty()) {
+            return;
+        }
+        dirty.swap(dirty_);
+    }
+
+    // 持有 mutex_ 直到更新完成，同一用户的先后两次刷新不会乱序
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+    for (const auto& username : dirty) {
+        bool present = lists_->exists(username);
+        auto it = std::lower_bound(names_.begin(), names_.end(), username);
+        bool known = it != names_.end() && *it == username;
+        if (present && !known) {
+            added.push_back(username);
+        } else if (!present && known) {
+            removed.push_back(username);
+        }
+    }
+
+    if (added.size() + removed.size() <= kInPlaceChanges) {
+        for (auto& username : added) {
+            names_.insert(std::lower_bound(names_.begin(), names_.end(), username), std::move(username));
+        }
+        for (const auto& username : removed) {
+            names_.erase(std::lower_bound(names_.begin(), names_.end(), username));
+        }
+        return;
+    }
+
+    std::sort(added.begin(), added.end());
+    std::sort(removed.begin(), removed.end());
+    std::vector<std::string> kept;
+    kept.reserve(names_.size() - removed.size());
+    std::set_difference(std::make_move_iterator(names_.begin()), std::make_move_iterator(names_.end()),
+                        removed.begin(), removed.end(), std::back_inserter(kept));
+    names_.clear();
+    names_.reserve(kept.size() + added.size());
+    std::merge(std::make_move_iterator(kept.begin()), std::make_move_iterator(kept.end()),
+               std::make_move_iterator(added.begin()), std::make_move_iterator(added.end()),
+               std::back_inserter(names_));
+}
+
+size_t UserDirectory::size() {
+    refresh();
+    std::lock_guard<std::mutex> lock(mutex_);
+    return names_.size();
+}
+
+void UserDirectory::handleList(const httplib::Request& req, httplib::Response& res) {
+    std::string prefix = req.has_param("prefix") ? req.get_param_value("prefix") : "";
+    size_t limit = 100;
+    if (req.has_param("limit")) {
+        try {
+            limit = std::min<size_t>(std::stoul(req.get_param_value("limit")), 10000);
+        } catch (const std::exception&) {
+            limit = 0;
+        }
+        if (limit == 0) {
+            res.status = 400;
+            res.set_content("limit 必须是正整数", "text/plain; charset=utf-8");
+            return;
+        }
+    }
+
+    refresh();
+    json users = json::array();
+    size_t total;
+    bool more;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // 以 prefix 开头的用户名在排序后连续排列
+        auto first = std::lower_bound(names_.begin(), names_.end(), prefix);
+        auto last = std::partition_point(first, names_.end(), [&](const std::string& name) {
+            return name.compare(0, prefix.size(), prefix) == 0;
+        });
+        total = static_cast<size_t>(last - first);
+        auto begin = first;
+        if (req.has_param("cursor")) {
+            begin = std::max(begin, std::upper_bound(first, last, req.get_param_value("cursor")));
+        }
+        size_t count = std::min<size_t>(limit, last - begin);
+        more = count < static_cast<size_t>(last - begin);
+        for (auto it = begin; it != begin + count; ++it) {
+            users.push_back(*it);
+        }
+    }
+    if (more) {
+        res.set_header("X-Next-Cursor", httplib::detail::encode_query_param(users.back().get<std::string>()));
+    }
+    json response = {{"prefix", prefix}, {"total", total}, {"users", users}};
+    res.set_content(response.dump(), "application/json");
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "httplib.h"
+#include "list_store.hpp"
+#include "logger.hpp"
+#include "storage.hpp"
+
+// 用户目录：按用户名排序的数组，支持前缀查找与按用户名翻页
+// 启动时从存储层的内存索引建立，不遍历上传目录；列表写入或删除时只记下用户名，
+// 下一次查询前再确认这些用户的列表是否存在并更新数组（少量改动原地插入删除，大批改动归并）。
+// 每个分片只列出自己负责的用户。
+class UserDirectory {
+public:
+    UserDirectory(std::shared_ptr<Storage> storage, std::shared_ptr<ListStore> lists, std::shared_ptr<Logger> logger);
+
+    size_t size();
+
+    // GET /users?prefix=&limit=&cursor=
+    // 按用户名升序返回以 prefix 开头的用户；还有更多时 X-Next-Cursor 为本页最后一个用户名，作为下一页的 cursor
+    void handleList(const httplib::Request& req, httplib::Response& res);
+
+private:
+    void markDirty(const fs::path& relPath);
+    // 处理自上次以来有变化的用户
+    void refresh();
+
+    std::shared_ptr<Storage> storage_;
+    std::shared_ptr<ListStore> lists_;
+    std::shared_ptr<Logger> logger_;
+
+    std::mutex dirtyMutex_;
+    std::unordered_set<std::string> dirty_;
+
+    std::mutex mutex_;
+    std::vector<std::string> names_;    // 已排序，无重复
+};
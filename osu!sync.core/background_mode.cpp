@@ -0,0 +1,250 @@
+#include "background_mode.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cwctype>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <tlhelp32.h>
+#else
+#include <filesystem>
+#include <fstream>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace osu {
+
+namespace {
+
+constexpr auto kPollInterval = std::chrono::seconds(2);
+constexpr size_t kBackgroundConcurrency = 2;    // 游戏运行期间的并发下载数上限
+
+#ifdef _WIN32
+
+// 项目以 Unicode 字符集编译，进程名为宽字符；游戏进程名只含 ASCII 字符，逐字符比较即可
+bool sameName(const wchar_t* exeFile, const std::string& name) {
+    std::wstring exe(exeFile);
+    return exe.size() == name.size() && std::equal(exe.begin(), exe.end(), name.begin(), [](wchar_t x, char y) {
+        return std::towlower(x) == static_cast<wchar_t>(std::tolower(static_cast<unsigned char>(y)));
+    });
+}
+
+// 遍历系统中的所有进程
+template <typename Callback>
+void forEachProcess(Callback callback) {
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    if (snapshot == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    PROCESSENTRY32W entry;
+    entry.dwSize = sizeof(entry);
+    for (BOOL ok = Process32FirstW(snapshot, &entry); ok; ok = Process32NextW(snapshot, &entry)) {
+        callback(entry);
+    }
+    CloseHandle(snapshot);
+}
+
+#else
+
+// Linux 的 ioprio_set 没有 glibc 封装，常量取自 linux/ioprio.h
+constexpr int kIoprioWhoProcess = 1;
+constexpr int kIoprioClassShift = 13;
+constexpr int kIoprioClassBestEffort = 2;
+constexpr int kIoprioClassIdle = 3;
+
+void setIoPriority(long id, bool idle) {
+    int ioprio = idle ? (kIoprioClassIdle << kIoprioClassShift)
+                      : (kIoprioClassBestEffort << kIoprioClassShift) | 4;
+    syscall(SYS_ioprio_set, kIoprioWhoProcess, static_cast<int>(id), ioprio);
+}
+
+// 从 /proc/<pid>/stat 读取父进程ID；进程名可能含空格与括号，从最后一个 ')' 之后解析
+long parentOf(const std::filesystem::path& statFile) {
+    std::ifstream in(statFile);
+    std::string stat;
+    std::getline(in, stat);
+    size_t pos = stat.rfind(')');
+    if (pos == std::string::npos || pos + 4 >= stat.size()) {
+        return -1;
+    }
+    // ") S <ppid>"
+    try {
+        return std::stol(stat.substr(pos + 4));
+    } catch (const std::exception&) {
+        return -1;
+    }
+}
+
+template <typename Callback>
+void forEachProcess(Callback callback) {
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator("/proc", ec)) {
+        const std::string name = entry.path().filename().string();
+        if (!name.empty() && std::all_of(name.begin(), name.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            callback(std::stol(name), entry.path());
+        }
+    }
+}
+
+#endif
+
+} // namespace
+
+BackgroundMode::BackgroundMode(std::string gameProcess, uint64_t bytesPerSecond)
+    : gameProcess_(std::move(gameProcess))
+    , bytesPerSecond_(bytesPerSecond) {
+#ifndef _WIN32
+    mainThread_ = syscall(SYS_gettid);
+#endif
+}
+
+BackgroundMode::~BackgroundMode() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (watcher_.joinable()) {
+        watcher_.join();
+    }
+    if (gameRunning_) {
+        applyPriority(false);
+    }
+}
+
+std::string BackgroundMode::defaultGameProcess() {
+    // Linux 下 osu! 通过 Wine 运行，进程名同样是 osu!.exe
+    return "osu!.exe";
+}
+
+void BackgroundMode::start() {
+    check();
+    watcher_ = std::thread([this] { watch(); });
+}
+
+size_t BackgroundMode::concurrency(size_t normal) const {
+    return gameRunning_ ? std::min(normal, kBackgroundConcurrency) : normal;
+}
+
+void BackgroundMode::run(const std::function<void()>& task) const {
+    if (!gameRunning_) {
+        task();
+        return;
+    }
+    std::exception_ptr error;
+    std::thread worker([&] {
+#ifdef _WIN32
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#else
+        long thread = syscall(SYS_gettid);
+        setIoPriority(thread, true);
+        setpriority(PRIO_PROCESS, static_cast<id_t>(thread), 19);
+#endif
+        try {
+            task();
+        } catch (...) {
+            error = std::current_exception();
+        }
+    });
+    worker.join();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void BackgroundMode::watch() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!wake_.wait_for(lock, kPollInterval, [this] { return stopping_; })) {
+        lock.unlock();
+        check();
+        lock.lock();
+    }
+}
+
+void BackgroundMode::check() {
+    bool running = isProcessRunning(gameProcess_);
+    if (running != gameRunning_) {
+        gameRunning_ = running;
+        std::cout << (running ? "\n检测到游戏正在运行，切换到后台速度" : "\n游戏已退出，恢复全速") << std::endl;
+        applyPriority(running);
+    }
+}
+
+bool BackgroundMode::isProcessRunning(const std::string& name) {
+    bool found = false;
+#ifdef _WIN32
+    forEachProcess([&](const PROCESSENTRY32W& entry) {
+        found = found || sameName(entry.szExeFile, name);
+    });
+#else
+    // comm 最多保留进程名的前 15 个字符
+    const std::string comm = name.substr(0, 15);
+    forEachProcess([&](long, const std::filesystem::path& dir) {
+        if (found) {
+            return;
+        }
+        std::ifstream in(dir / "comm");
+        std::string value;
+        found = std::getline(in, value) && value == comm;
+    });
+#endif
+    return found;
+}
+
+void BackgroundMode::applyPriority(bool low) {
+#ifdef _WIN32
+    // 后台处理模式同时降低本进程的 CPU、I/O 与内存优先级
+    SetPriorityClass(GetCurrentProcess(), low ? PROCESS_MODE_BACKGROUND_BEGIN : PROCESS_MODE_BACKGROUND_END);
+
+    // 下载子进程（及其子进程）降到空闲优先级类
+    std::map<DWORD, DWORD> parents;
+    forEachProcess([&](const PROCESSENTRY32W& entry) {
+        parents[entry.th32ProcessID] = entry.th32ParentProcessID;
+    });
+    const DWORD self = GetCurrentProcessId();
+    for (const auto& [pid, parent] : parents) {
+        DWORD ancestor = parent;
+        for (int depth = 0; depth < 8 && ancestor != self && parents.count(ancestor) > 0; ++depth) {
+            ancestor = parents[ancestor];
+        }
+        if (ancestor != self || pid == self) {
+            continue;
+        }
+        HANDLE process = OpenProcess(PROCESS_SET_INFORMATION, FALSE, pid);
+        if (process != nullptr) {
+            SetPriorityClass(process, low ? IDLE_PRIORITY_CLASS : NORMAL_PRIORITY_CLASS);
+            CloseHandle(process);
+        }
+    }
+#else
+    // I/O 优先级按线程设置，降低执行导入的主线程
+    setIoPriority(mainThread_, low);
+
+    std::map<long, long> parents;
+    forEachProcess([&](long pid, const std::filesystem::path& dir) {
+        parents[pid] = parentOf(dir / "stat");
+    });
+    const long self = getpid();
+    for (const auto& [pid, parent] : parents) {
+        long ancestor = parent;
+        for (int depth = 0; depth < 8 && ancestor != self && parents.count(ancestor) > 0; ++depth) {
+            ancestor = parents[ancestor];
+        }
+        if (ancestor != self) {
+            continue;
+        }
+        setIoPriority(pid, low);
+        // 普通用户无法把 nice 值调回去，恢复时忽略失败；下一批会以正常优先级启动新的下载进程
+        setpriority(PRIO_PROCESS, static_cast<id_t>(pid), low ? 19 : 0);
+    }
+#endif
+}
+
+} // namespace osu
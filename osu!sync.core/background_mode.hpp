@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace osu {
+
+// 后台模式：游戏运行时为游戏让路
+// 后台线程定期检查游戏进程是否在运行。游戏运行期间：
+//   - 本进程的 I/O 降为空闲优先级（Windows 下进入后台处理模式，同时降低 CPU 优先级），
+//     下载子进程（aria2c）的 I/O 与 CPU 优先级也一并降低；
+//   - 之后开始的下载批次限制总带宽与并发数，从而限制写盘速度。
+// 游戏退出后恢复正常优先级，之后的批次恢复全速。
+// 已在运行的 aria2c 无法在中途调整限速，导入器在后台模式下用较小的批次让切换尽快生效。
+class BackgroundMode {
+public:
+    // gameProcess 为游戏的进程名，bytesPerSecond 为游戏运行期间的下载限速
+    BackgroundMode(std::string gameProcess, uint64_t bytesPerSecond);
+    ~BackgroundMode();
+
+    BackgroundMode(const BackgroundMode&) = delete;
+    BackgroundMode& operator=(const BackgroundMode&) = delete;
+
+    // 开始监视游戏进程；会立即检查一次
+    void start();
+
+    bool gameRunning() const { return gameRunning_; }
+
+    // 当前批次应使用的下载限速（字节每秒），0 表示不限速
+    uint64_t downloadLimit() const { return gameRunning_ ? bytesPerSecond_ : 0; }
+
+    // 当前批次应使用的并发下载数
+    size_t concurrency(size_t normal) const;
+
+    // 执行一个下载批次：游戏运行时在一个降低了 CPU 与 I/O 优先级的临时线程中执行，
+    // 其中启动的下载进程一开始就继承低优先级；线程随批次结束，不需要恢复
+    void run(const std::function<void()>& task) const;
+
+    // 是否有名为 name 的进程在运行
+    static bool isProcessRunning(const std::string& name);
+
+    // 默认的游戏进程名
+    static std::string defaultGameProcess();
+
+private:
+    void watch();
+    void check();
+    // 调整本进程与下载子进程的优先级
+    void applyPriority(bool low);
+
+    std::string gameProcess_;
+    uint64_t bytesPerSecond_;
+    std::atomic<bool> gameRunning_{false};
+    long mainThread_ = 0;       // 执行下载与导入的线程，Linux 下 I/O 优先级按线程设置
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread watcher_;
+};
+
+} // namespace osu
@@ -1,9 +1,21 @@
 #include "beatmap_importer.hpp"
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include "collection_downloader.hpp"
+#include "external_sort.hpp"
+#include "list_diff.hpp"
 
 namespace osu {
 
+namespace {
+
+constexpr size_t kMaxErrors = 1000;     // 状态中保留的错误信息条数上限
+constexpr size_t kBackgroundBatchSize = 50;     // 后台模式下每批下载的谱面数，游戏启动或退出后下一批即按新状态下载
+
+} // namespace
+
 BeatmapImporter::BeatmapImporter(const fs::path& savePath, size_t maxConcurrent)
     : savePath_(savePath)
     , currentMirror_("sayobot")
@@ -13,6 +25,10 @@ BeatmapImporter::BeatmapImporter(const fs::path& savePath, size_t maxConcurrent)
 }
 
 ImportStatus BeatmapImporter::importFromJson(const std::string& jsonPath) {
+    if (memoryBudget_ > 0) {
+        return importStreaming(jsonPath);
+    }
+
     std::ifstream file(jsonPath);
     if (!file.is_open()) {
         status_.errors.push_back("无法打开谱面列表文件: " + jsonPath);
@@ -28,6 +44,7 @@ ImportStatus BeatmapImporter::importFromJsonString(const std::string& jsonConten
     try {
         // 重置状态
         status_ = ImportStatus{};
+        suppressedErrors_ = 0;
         
         // 解析JSON
         nlohmann::json j = nlohmann::json::parse(jsonContent);
@@ -57,8 +74,9 @@ ImportStatus BeatmapImporter::importFromJsonString(const std::string& jsonConten
             throw std::runtime_error("保存目录无效或无法创建");
         }
 
-        // 收集需要下载的谱面ID
-        std::vector<std::string> toDownload;
+        auto deadSets = prepareServer();
+
+        // 收集需要下载的谱面
         std::vector<BeatmapInfo*> beatmapRefs;
         
         for (auto& beatmap : beatmaps) {
@@ -74,51 +92,30 @@ ImportStatus BeatmapImporter::importFromJsonString(const std::string& jsonConten
                 status_.downloadedMaps++;
                 continue;
             }
+
+            if (deadSets.count(beatmap.id) > 0) {
+                status_.failedMaps++;
+                addError("镜像站上已不存在，跳过: " + beatmap.title + " (ID: " + beatmap.id + ")");
+                continue;
+            }
             
-            toDownload.push_back(beatmap.id);
             beatmapRefs.push_back(&beatmap);
         }
         
         // 如果有需要下载的谱面
-        if (!toDownload.empty()) {
-            std::cout << "\n开始下载 " << toDownload.size() << " 个谱面..." << std::endl;
-            
-            // 配置下载选项
-            DownloadOptions options;
-            options.mirror = currentMirror_;
-            options.concurrent = maxConcurrent_;
-            
-            // 批量下载所有谱面
-            if (NetworkUtils::downloadFile(toDownload, savePath_, options)) {
-                // 更新下载成功的谱面状态
-                for (size_t i = 0; i < toDownload.size(); ++i) {
-                    auto& beatmap = *beatmapRefs[i];
-                    fs::path beatmapPath = savePath_ / (beatmap.id + ".osz");
-                    
-                    if (fs::exists(beatmapPath) && fs::file_size(beatmapPath) > 0) {
-                        beatmap.localPath = beatmapPath.string();
-                        beatmap.downloaded = true;
-                        status_.downloadedMaps++;
-                        
-                        // 如果设置了osu安装目录，尝试导入
-                        if (!osuPath_.empty()) {
-                            if (importToOsuFolder(beatmap)) {
-                                std::cout << "谱面已成功导入到osu!: " << beatmap.title << std::endl;
-                            }
-                        }
-                    } else {
-                        status_.failedMaps++;
-                        status_.errors.push_back("下载失败: " + beatmap.title + " (ID: " + beatmap.id + ")");
-                    }
+        MirrorTally tally;
+        if (!beatmapRefs.empty()) {
+            std::cout << "\n开始下载 " << beatmapRefs.size() << " 个谱面..." << std::endl;
+            if (background_) {
+                for (size_t begin = 0; begin < beatmapRefs.size(); begin += kBackgroundBatchSize) {
+                    auto end = beatmapRefs.begin() + std::min(beatmapRefs.size(), begin + kBackgroundBatchSize);
+                    downloadBatch(std::vector<BeatmapInfo*>(beatmapRefs.begin() + begin, end), tally);
                 }
             } else {
-                // 批量下载失败
-                for (auto& beatmap : beatmapRefs) {
-                    status_.failedMaps++;
-                    status_.errors.push_back("下载失败: " + beatmap->title + " (ID: " + beatmap->id + ")");
-                }
+                downloadBatch(beatmapRefs, tally);
             }
         }
+        reportTally(tally);
         
         // 更新总进度
         status_.currentProgress = 1.0;
@@ -126,10 +123,207 @@ ImportStatus BeatmapImporter::importFromJsonString(const std::string& jsonConten
     } catch (const std::exception& e) {
         status_.errors.push_back(std::string("解析谱面列表失败: ") + e.what());
     }
+    finishErrors();
     
     return status_;
 }
 
+ImportStatus BeatmapImporter::importStreaming(const std::string& jsonPath) {
+    status_ = ImportStatus{};
+    suppressedErrors_ = 0;
+    try {
+        if (!validateSavePath()) {
+            throw std::runtime_error("保存目录无效或无法创建");
+        }
+
+        // 预算的一半给列表排序，四分之一给保存目录的文件名排序，其余留给下载批次
+        ExternalSorter listSorter(memoryBudget_ / 2);
+        auto list = readBeatmapList(jsonPath, listSorter);
+        if (list.collection) {
+            std::cout << "开始导入谱面合集: " << list.name << std::endl;
+            if (!list.description.empty()) {
+                std::cout << "描述: " << list.description << std::endl;
+            }
+        } else {
+            std::cout << "开始导入谱面列表" << std::endl;
+        }
+        std::cout << "列表条目数: " << list.entries << "，排序段数: " << listSorter.runs() << std::endl;
+        if (list.invalidEntries > 0) {
+            status_.failedMaps += static_cast<int>(list.invalidEntries);
+            addError("跳过缺少ID的条目: " + std::to_string(list.invalidEntries) + " 个");
+        }
+
+        // 保存目录中已下载的谱面，同样排序后与列表归并比对
+        ExternalSorter localSorter(memoryBudget_ / 4);
+        readBeatmapDirectory(savePath_, localSorter);
+
+        auto deadSets = prepareServer();
+
+        // 每批下载的谱面数随预算变化，批次本身与 aria2c 的输入文件都不会随列表增长
+        size_t batchSize = std::clamp<size_t>(memoryBudget_ / (64 * 1024), 100, 5000);
+        if (background_) {
+            batchSize = kBackgroundBatchSize;
+        }
+        std::vector<BeatmapInfo> batch;
+        batch.reserve(batchSize);
+        MirrorTally tally;
+        auto flush = [&] {
+            std::cout << "\n开始下载一批 " << batch.size() << " 个谱面..." << std::endl;
+            std::vector<BeatmapInfo*> refs;
+            for (auto& beatmap : batch) {
+                refs.push_back(&beatmap);
+            }
+            downloadBatch(refs, tally);
+            batch.clear();
+        };
+
+        auto listStream = listSorter.finish();
+        auto localStream = localSorter.finish();
+        auto counts = diffSorted(*listStream, *localStream, [&](DiffKind kind, SortRecord& entry) {
+            if (kind == DiffKind::Extra) {
+                return;
+            }
+            status_.totalMaps++;
+            if (kind == DiffKind::Common) {
+                status_.downloadedMaps++;
+                return;
+            }
+            if (deadSets.count(entry.key) > 0) {
+                status_.failedMaps++;
+                addError("镜像站上已不存在，跳过: " + entry.value + " (ID: " + entry.key + ")");
+                return;
+            }
+            BeatmapInfo beatmap;
+            beatmap.id = std::move(entry.key);
+            beatmap.title = std::move(entry.value);
+            batch.push_back(std::move(beatmap));
+            if (batch.size() >= batchSize) {
+                flush();
+            }
+        });
+        if (!batch.empty()) {
+            flush();
+        }
+        std::cout << "去重后谱面数: " << status_.totalMaps << "，已存在: " << counts.common << std::endl;
+        reportTally(tally);
+
+        status_.currentProgress = 1.0;
+    } catch (const std::exception& e) {
+        status_.errors.push_back(std::string("解析谱面列表失败: ") + e.what());
+    }
+    finishErrors();
+
+    return status_;
+}
+
+std::unordered_set<std::string> BeatmapImporter::prepareServer() {
+    std::unordered_set<std::string> deadSets;
+    if (serverUrl_.empty()) {
+        return deadSets;
+    }
+
+    // 用户没有指定镜像站时，按其他客户端近期的表现选择
+    if (!mirrorPinned_) {
+        auto mirrors = NetworkUtils::getMirrors();
+        for (const auto& hinted : CollectionDownloader::fetchMirrorHints(serverUrl_)) {
+            if (mirrors.count(hinted) > 0) {
+                if (hinted != currentMirror_) {
+                    currentMirror_ = hinted;
+                    std::cout << "根据服务器的镜像站提示使用镜像站: " << currentMirror_ << std::endl;
+                }
+                break;
+            }
+        }
+    }
+
+    // 服务器记录的、在当前镜像站上已不存在的谱面集
+    return CollectionDownloader::fetchDeadSets(serverUrl_, currentMirror_);
+}
+
+void BeatmapImporter::downloadBatch(const std::vector<BeatmapInfo*>& batch, MirrorTally& tally) {
+    std::vector<std::string> toDownload;
+    for (const auto* beatmap : batch) {
+        toDownload.push_back(beatmap->id);
+    }
+
+    // 配置下载选项
+    DownloadOptions options;
+    options.mirror = currentMirror_;
+    options.concurrent = maxConcurrent_;
+    options.stripVideo = stripVideo_;
+    if (background_) {
+        options.concurrent = background_->concurrency(maxConcurrent_);
+        options.maxBytesPerSecond = background_->downloadLimit();
+    }
+
+    // 游戏运行期间的批次被限速、降低并发与优先级，耗时反映的不是镜像站的速度，不计入吞吐
+    bool throttled = background_ && background_->gameRunning();
+    std::vector<std::string> notFound;
+    uint64_t receivedBytes = 0;
+    auto started = std::chrono::steady_clock::now();
+    // 返回值只表示是否全部成功，部分失败时其余谱面仍已下载，逐个以文件为准
+    auto download = [&] { NetworkUtils::downloadFile(toDownload, savePath_, options, &notFound, &receivedBytes); };
+    if (background_) {
+        background_->run(download);
+    } else {
+        download();
+    }
+    if (!throttled) {
+        // 字节数取去除视频之前的大小，与耗时对应的是实际下载量
+        tally.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        tally.bytes += receivedBytes;
+    }
+    if (!notFound.empty() && !serverUrl_.empty()) {
+        CollectionDownloader::reportDeadSets(serverUrl_, currentMirror_, notFound);
+    }
+
+    // 更新下载成功的谱面状态
+    for (auto* beatmap : batch) {
+        fs::path beatmapPath = savePath_ / (beatmap->id + ".osz");
+        std::error_code ec;
+        uintmax_t size = fs::exists(beatmapPath, ec) ? fs::file_size(beatmapPath, ec) : 0;
+        if (ec || size == 0) {
+            status_.failedMaps++;
+            tally.failed++;
+            addError("下载失败: " + beatmap->title + " (ID: " + beatmap->id + ")");
+            continue;
+        }
+        beatmap->localPath = beatmapPath.string();
+        beatmap->downloaded = true;
+        status_.downloadedMaps++;
+        tally.succeeded++;
+
+        // 如果设置了osu安装目录，尝试导入
+        if (!osuPath_.empty()) {
+            if (importToOsuFolder(*beatmap)) {
+                std::cout << "谱面已成功导入到osu!: " << beatmap->title << std::endl;
+            }
+        }
+    }
+}
+
+void BeatmapImporter::reportTally(const MirrorTally& tally) {
+    if (shareStats_ && !serverUrl_.empty() && tally.succeeded + tally.failed > 0) {
+        CollectionDownloader::reportMirrorStats(serverUrl_, currentMirror_, tally.bytes, tally.seconds,
+                                                tally.succeeded, tally.failed);
+    }
+}
+
+void BeatmapImporter::addError(std::string message) {
+    if (status_.errors.size() < kMaxErrors) {
+        status_.errors.push_back(std::move(message));
+    } else {
+        suppressedErrors_++;
+    }
+}
+
+void BeatmapImporter::finishErrors() {
+    if (suppressedErrors_ > 0) {
+        status_.errors.push_back("另有 " + std::to_string(suppressedErrors_) + " 条错误未列出");
+        suppressedErrors_ = 0;
+    }
+}
+
 bool BeatmapImporter::validateSavePath() {
     try {
         if (!fs::exists(savePath_)) {
@@ -4,6 +4,8 @@
 #include <memory>
 #include <future>
 #include <mutex>
+#include <unordered_set>
+#include "background_mode.hpp"
 #include "network.utils.hpp"
 
 namespace fs = std::filesystem;
@@ -22,11 +24,28 @@ public:
     ImportStatus importFromJsonString(const std::string& jsonContent);
     
     // 设置下载镜像
-    void setMirror(const std::string& mirrorName) { currentMirror_ = mirrorName; }
+    void setMirror(const std::string& mirrorName) { currentMirror_ = mirrorName; mirrorPinned_ = true; }
     
     // 设置osu!安装目录
     void setOsuPath(const fs::path& osuPath) { osuPath_ = osuPath; }
+
+    // 设置同步服务器：下载前跳过服务器记录的失效谱面集，下载后上报新发现的失效谱面集
+    // 未通过 setMirror 指定镜像站时，改用服务器镜像站提示中表现最好的镜像站
+    void setServer(const std::string& serverUrl) { serverUrl_ = serverUrl; }
+
+    // 导入结束时向服务器匿名提交本次所用镜像站的吞吐与成败次数，默认关闭
+    void setShareStats(bool shareStats) { shareStats_ = shareStats; }
     
+    // 设置内存预算（字节），非零时 importFromJson 改为流式导入：列表经外部排序去重，
+    // 与保存目录中已有的文件归并比对后分批下载，峰值内存与列表大小无关
+    void setMemoryBudget(size_t bytes) { memoryBudget_ = bytes; }
+
+    // 设置后台模式：游戏运行期间降低优先级、限速并缩小下载批次
+    void setBackgroundMode(std::shared_ptr<BackgroundMode> background) { background_ = std::move(background); }
+
+    // 设置是否在下载后从谱面中去除视频
+    void setStripVideo(bool stripVideo) { stripVideo_ = stripVideo; }
+
     // 设置最大并发下载数
     void setMaxConcurrent(size_t maxConcurrent) { maxConcurrent_ = maxConcurrent; }
     
@@ -37,9 +56,40 @@ private:
     fs::path savePath_;         // 谱面保存路径
     fs::path osuPath_;          // osu!安装目录
     std::string currentMirror_; // 当前使用的下载镜像
+    bool mirrorPinned_ = false; // 镜像站是否由用户指定
+    std::string serverUrl_;     // 同步服务器地址，为空时不使用失效谱面集缓存
+    bool shareStats_ = false;   // 是否提交镜像站统计
     ImportStatus status_;       // 导入状态
     size_t maxConcurrent_;     // 最大并发下载数
     std::mutex statusMutex_;   // 用于保护状态更新
+    size_t memoryBudget_ = 0;  // 流式导入的内存预算，0 表示整个列表读入内存
+    size_t suppressedErrors_ = 0;  // 超出上限未记录的错误数
+    std::shared_ptr<BackgroundMode> background_;   // 为空时不检测游戏
+    bool stripVideo_ = false;  // 是否去除视频
+
+    // 一次导入中当前镜像站的累计表现
+    struct MirrorTally {
+        uint64_t bytes = 0;     // 只统计未限速的批次，全部批次都被限速时两者均为 0
+        double seconds = 0;
+        size_t succeeded = 0;
+        size_t failed = 0;
+    };
+
+    // 按内存预算流式导入
+    ImportStatus importStreaming(const std::string& jsonPath);
+
+    // 按服务器的镜像站提示选择镜像站，返回当前镜像站上的失效谱面集
+    std::unordered_set<std::string> prepareServer();
+
+    // 下载一批谱面，更新状态并导入到osu!
+    void downloadBatch(const std::vector<BeatmapInfo*>& batch, MirrorTally& tally);
+
+    // 开启统计提交时向服务器提交本次导入的镜像站表现
+    void reportTally(const MirrorTally& tally);
+
+    // 记录错误信息，超出上限后只计数
+    void addError(std::string message);
+    void finishErrors();
     
     // 验证并确保保存路径存在
     bool validateSavePath();
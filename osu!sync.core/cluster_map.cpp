@@ -0,0 +1,121 @@
+#include "cluster_map.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "3rdpartyInclude/httplib.h"
+#include "3rdpartyInclude/nlohmann/json.hpp"
+
+namespace osu {
+
+ClusterRing::ClusterRing(const std::vector<std::string>& nodes, int virtualNodes)
+    : nodes_(nodes) {
+    points_.reserve(nodes.size() * virtualNodes);
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        for (int v = 0; v < virtualNodes; ++v) {
+            points_.emplace_back(hash(nodes[i] + "#" + std::to_string(v)), i);
+        }
+    }
+    std::sort(points_.begin(), points_.end());
+}
+
+std::string ClusterRing::ownerOf(const std::string& key) const {
+    if (points_.empty()) {
+        return "";
+    }
+    auto it = std::lower_bound(points_.begin(), points_.end(), std::make_pair(hash(key), size_t{0}));
+    if (it == points_.end()) {
+        it = points_.begin();
+    }
+    return nodes_[it->second];
+}
+
+uint64_t ClusterRing::hash(const std::string& key) {
+    // FNV-1a + splitmix64 混合
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    h += 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+ClusterRouter::ClusterRouter(const std::string& seedUrl)
+    : seedUrl_(seedUrl) {
+    std::ostringstream name;
+    name << "osu-sync-cluster-" << std::hex << ClusterRing::hash(seedUrl) << ".json";
+    cacheFile_ = fs::temp_directory_path() / name.str();
+}
+
+std::string ClusterRouter::ownerOf(const std::string& username) {
+    if (!loaded_) {
+        loaded_ = loadCache() || refresh(seedUrl_);
+    }
+    std::string owner = ring_.ownerOf(username);
+    return owner.empty() ? seedUrl_ : owner;
+}
+
+bool ClusterRouter::refresh(const std::string& nodeUrl) {
+    try {
+        httplib::Client client(nodeUrl);
+        client.set_connection_timeout(5, 0);
+        auto result = client.Get("/cluster");
+        if (!result) {
+            return false;
+        }
+        if (result->status == 404) {
+            // 服务器未启用集群，所有请求直接发往种子地址
+            ring_ = ClusterRing();
+            nodes_.clear();
+            return true;
+        }
+        if (result->status != 200 || !apply(result->body)) {
+            return false;
+        }
+        saveCache();
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "获取集群拓扑失败: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool ClusterRouter::loadCache() {
+    std::ifstream file(cacheFile_);
+    if (!file) {
+        return false;
+    }
+    std::string body((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return apply(body);
+}
+
+void ClusterRouter::saveCache() const {
+    nlohmann::json j = {
+        {"epoch", epoch_},
+        {"virtualNodes", virtualNodes_},
+        {"nodes", nodes_}
+    };
+    std::ofstream(cacheFile_) << j.dump();
+}
+
+bool ClusterRouter::apply(const std::string& body) {
+    try {
+        auto j = nlohmann::json::parse(body);
+        uint64_t epoch = j.value("epoch", uint64_t{0});
+        if (!nodes_.empty() && epoch < epoch_) {
+            return false;  // 不接受比缓存更旧的拓扑
+        }
+        epoch_ = epoch;
+        virtualNodes_ = j.value("virtualNodes", 128);
+        nodes_ = j.at("nodes").get<std::vector<std::string>>();
+        ring_ = ClusterRing(nodes_, virtualNodes_);
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+} // namespace osu
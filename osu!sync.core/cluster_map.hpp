@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace osu {
+
+// 带虚拟节点的一致性哈希环，必须与服务器端（osu!syn.server/cluster.cpp）的实现保持一致
+class ClusterRing {
+public:
+    ClusterRing() = default;
+    ClusterRing(const std::vector<std::string>& nodes, int virtualNodes);
+
+    // 返回 key 所属节点，环为空时返回空字符串
+    std::string ownerOf(const std::string& key) const;
+    bool empty() const { return points_.empty(); }
+
+    static uint64_t hash(const std::string& key);
+
+private:
+    std::vector<std::pair<uint64_t, size_t>> points_;
+    std::vector<std::string> nodes_;
+};
+
+// 客户端缓存的集群拓扑，用于把请求直接发往负责该用户的分片
+class ClusterRouter {
+public:
+    explicit ClusterRouter(const std::string& seedUrl);
+
+    // 返回负责该用户的节点地址；服务器未启用集群时返回种子地址
+    std::string ownerOf(const std::string& username);
+
+    // 从指定节点重新拉取拓扑（在收到带有更新版本号的重定向时调用）
+    bool refresh(const std::string& nodeUrl);
+
+    uint64_t epoch() const { return epoch_; }
+
+private:
+    bool loadCache();
+    void saveCache() const;
+    bool apply(const std::string& body);
+
+    std::string seedUrl_;
+    fs::path cacheFile_;
+    bool loaded_ = false;
+    uint64_t epoch_ = 0;
+    int virtualNodes_ = 128;
+    std::vector<std::string> nodes_;
+    ClusterRing ring_;
+};
+
+} // namespace osu
@@ -0,0 +1,258 @@
+#include "collection_downloader.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <zlib.h>
+#include "3rdpartyInclude/httplib.h"
+#include "cluster_map.hpp"
+
+namespace fs = std::filesystem;
+
+namespace osu {
+
+namespace {
+
+// 服务器的 deflate 预置字典（见 osu!syn.server/dictionary_store.hpp），按节点缓存在临时目录，
+// 持有字典时下载请求声明 Accept-Encoding: x-deflate-dict，响应以该字典压缩
+struct CachedDictionary {
+    uint32_t version = 0;
+    std::string data;
+};
+
+fs::path dictionaryCachePath(const std::string& node) {
+    std::ostringstream name;
+    name << "osu-sync-dict-" << std::hex << ClusterRing::hash(node) << ".bin";
+    return fs::temp_directory_path() / name.str();
+}
+
+// 缓存文件格式："<版本>\n" + 字典内容
+CachedDictionary loadDictionary(const std::string& node) {
+    CachedDictionary dictionary;
+    std::ifstream file(dictionaryCachePath(node), std::ios::binary);
+    if (file && file >> dictionary.version && file.get() == '\n') {
+        dictionary.data.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    }
+    if (dictionary.data.empty()) {
+        dictionary.version = 0;
+    }
+    return dictionary;
+}
+
+// 服务器有更新的字典时获取并缓存，供下一次下载使用；失败时不影响本次下载
+void refreshDictionary(httplib::Client& client, const std::string& node, const httplib::Result& result,
+                       const CachedDictionary& cached) {
+    if (!result->has_header("X-Dictionary-Latest")) {
+        return;
+    }
+    std::string latest = result->get_header_value("X-Dictionary-Latest");
+    if (cached.version != 0 && latest == std::to_string(cached.version)) {
+        return;
+    }
+    auto dictionary = client.Get("/dictionary/" + latest);
+    if (dictionary && dictionary->status == 200 && !dictionary->body.empty()) {
+        std::ofstream file(dictionaryCachePath(node), std::ios::binary | std::ios::trunc);
+        file << latest << '\n' << dictionary->body;
+    }
+}
+
+// 解压以预置字典压缩的 zlib 数据
+bool inflateWithDictionary(const std::string& body, const std::string& dictionary, std::string& out) {
+    z_stream stream{};
+    if (inflateInit(&stream) != Z_OK) {
+        return false;
+    }
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(body.data()));
+    stream.avail_in = static_cast<uInt>(body.size());
+    char buffer[64 * 1024];
+    int rc;
+    do {
+        stream.next_out = reinterpret_cast<Bytef*>(buffer);
+        stream.avail_out = sizeof(buffer);
+        rc = inflate(&stream, Z_NO_FLUSH);
+        if (rc == Z_NEED_DICT) {
+            // DICTID 不符（例如服务器换了字典）时返回 Z_DATA_ERROR
+            rc = inflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(dictionary.data()),
+                                      static_cast<uInt>(dictionary.size()));
+            if (rc == Z_OK) {
+                continue;
+            }
+        }
+        out.append(buffer, sizeof(buffer) - stream.avail_out);
+    } while (rc == Z_OK);
+    inflateEnd(&stream);
+    return rc == Z_STREAM_END;
+}
+
+} // anonymous namespace
+
+nlohmann::json CollectionDownloader::downloadBeatmapList(const std::string& username, const std::string& serverUrl) {
+    ClusterRouter router(serverUrl);
+    std::string node = router.ownerOf(username);
+    const std::string path = "/download/" + username + "/" + username + ".json";
+
+    // 拓扑过期时服务器返回 307，最多重试几次
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        httplib::Client client(node);
+        client.set_connection_timeout(5, 0);
+        client.set_read_timeout(30, 0);
+
+        CachedDictionary dictionary = loadDictionary(node);
+        httplib::Headers headers;
+        if (dictionary.version != 0) {
+            headers.emplace("Accept-Encoding", "x-deflate-dict");
+            headers.emplace("X-Dictionary-Version", std::to_string(dictionary.version));
+        }
+        auto result = client.Get(path, headers);
+        if (!result) {
+            throw std::runtime_error("连接服务器失败: " + node + " (" + httplib::to_string(result.error()) + ")");
+        }
+
+        switch (result->status) {
+            case 200: {
+                refreshDictionary(client, node, result, dictionary);
+                if (result->get_header_value("Content-Encoding") != "x-deflate-dict") {
+                    return nlohmann::json::parse(result->body);
+                }
+                std::string body;
+                if (inflateWithDictionary(result->body, dictionary.data, body)) {
+                    return nlohmann::json::parse(body);
+                }
+                // 缓存的字典与服务器的不一致：丢弃缓存，不带字典重新下载
+                std::error_code ec;
+                fs::remove(dictionaryCachePath(node), ec);
+                std::cout << "压缩字典已失效，重新下载" << std::endl;
+                break;
+            }
+            case 404:
+                throw std::runtime_error("服务器上没有用户 " + username + " 的谱面列表");
+            case 307: {
+                uint64_t epoch = 0;
+                if (result->has_header("X-Cluster-Epoch")) {
+                    epoch = std::stoull(result->get_header_value("X-Cluster-Epoch"));
+                }
+                if (epoch > router.epoch() && router.refresh(node)) {
+                    node = router.ownerOf(username);
+                } else {
+                    // 拓扑无法刷新时直接跟随重定向
+                    std::string location = result->get_header_value("Location");
+                    node = location.substr(0, location.size() - path.size());
+                }
+                std::cout << "集群拓扑已变化，改为访问节点: " << node << std::endl;
+                break;
+            }
+            default:
+                throw std::runtime_error("服务器返回错误 " + std::to_string(result->status) + ": " + result->body);
+        }
+    }
+    throw std::runtime_error("重定向次数过多");
+}
+
+std::unordered_set<std::string> CollectionDownloader::fetchDeadSets(const std::string& serverUrl,
+                                                                    const std::string& mirror) {
+    std::unordered_set<std::string> dead;
+    httplib::Client client(serverUrl);
+    client.set_connection_timeout(5, 0);
+    auto result = client.Get("/dead-sets?mirror=" + httplib::detail::encode_query_param(mirror));
+    if (!result || result->status != 200) {
+        return dead;
+    }
+
+    // varint 个数，之后是按差值编码的升序 varint setId
+    const std::string& body = result->body;
+    size_t pos = 0;
+    auto readVarint = [&](uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && pos < body.size(); shift += 7) {
+            uint8_t byte = static_cast<uint8_t>(body[pos++]);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    };
+    uint64_t count;
+    uint64_t setId = 0;
+    if (!readVarint(count)) {
+        return dead;
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t gap;
+        if (!readVarint(gap)) {
+            dead.clear();
+            break;
+        }
+        setId += gap;
+        dead.insert(std::to_string(setId));
+    }
+    return dead;
+}
+
+void CollectionDownloader::reportDeadSets(const std::string& serverUrl, const std::string& mirror,
+                                          const std::vector<std::string>& beatmapIds) {
+    nlohmann::json setIds = nlohmann::json::array();
+    for (const auto& id : beatmapIds) {
+        try {
+            setIds.push_back(std::stoul(id));
+        } catch (const std::exception&) {
+            // 非数字ID不是谱面集，不上报
+        }
+    }
+    httplib::Client client(serverUrl);
+    client.set_connection_timeout(5, 0);
+    // 服务器每次最多接受 1000 个
+    for (size_t begin = 0; begin < setIds.size(); begin += 1000) {
+        nlohmann::json body = {
+            {"mirror", mirror},
+            {"setIds", nlohmann::json(setIds.begin() + begin, setIds.begin() + std::min(setIds.size(), begin + 1000))}
+        };
+        auto result = client.Post("/dead-sets", body.dump(), "application/json");
+        if (!result || result->status != 200) {
+            std::cerr << "上报失效谱面集失败" << std::endl;
+            return;
+        }
+    }
+}
+
+std::vector<std::string> CollectionDownloader::fetchMirrorHints(const std::string& serverUrl) {
+    std::vector<std::string> ranked;
+    httplib::Client client(serverUrl);
+    client.set_connection_timeout(5, 0);
+    auto result = client.Get("/mirror-hints");
+    if (!result || result->status != 200) {
+        return ranked;
+    }
+    try {
+        // 服务器已按表现排序，这里只取名称
+        auto hints = nlohmann::json::parse(result->body);
+        for (const auto& hint : hints.at("mirrors")) {
+            ranked.push_back(hint.at("mirror").get<std::string>());
+        }
+    } catch (const std::exception&) {
+        ranked.clear();
+    }
+    return ranked;
+}
+
+void CollectionDownloader::reportMirrorStats(const std::string& serverUrl, const std::string& mirror,
+                                             uint64_t bytes, double seconds, size_t succeeded, size_t failed) {
+    // 只包含镜像站与汇总数字，不含用户名与谱面信息
+    nlohmann::json body = {
+        {"mirror", mirror},
+        {"bytes", bytes},
+        {"seconds", seconds},
+        {"succeeded", succeeded},
+        {"failed", failed}
+    };
+    httplib::Client client(serverUrl);
+    client.set_connection_timeout(5, 0);
+    auto result = client.Post("/mirror-stats", body.dump(), "application/json");
+    if (!result || result->status != 200) {
+        std::cerr << "提交镜像站统计失败" << std::endl;
+    }
+}
+
+} // namespace osu
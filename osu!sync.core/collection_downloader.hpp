@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "3rdpartyInclude/nlohmann/json.hpp"
+
+namespace osu {
+
+class CollectionDownloader {
+public:
+    // 从服务器下载指定用户的谱面列表
+    // 服务器为分片集群时，根据缓存的集群拓扑直接访问负责该用户的节点
+    static nlohmann::json downloadBeatmapList(const std::string& username, const std::string& serverUrl);
+
+    // 获取服务器汇总的、在指定镜像站上已不存在的谱面集ID，失败时返回空集合
+    static std::unordered_set<std::string> fetchDeadSets(const std::string& serverUrl, const std::string& mirror);
+
+    // 向服务器上报在指定镜像站上已不存在的谱面集ID，失败时忽略
+    static void reportDeadSets(const std::string& serverUrl, const std::string& mirror,
+                               const std::vector<std::string>& beatmapIds);
+
+    // 获取服务器汇总的镜像站提示，按近期表现从好到差排列的镜像站名称，失败时返回空列表
+    static std::vector<std::string> fetchMirrorHints(const std::string& serverUrl);
+
+    // 向服务器匿名提交一次导入中某个镜像站的表现：下载字节数、耗时与成败次数，失败时忽略
+    static void reportMirrorStats(const std::string& serverUrl, const std::string& mirror,
+                                  uint64_t bytes, double seconds, size_t succeeded, size_t failed);
+};
+
+} // namespace osu
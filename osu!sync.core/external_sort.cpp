@@ -0,0 +1,363 @@
+#include "external_sort.hpp"
+#include <algorithm>
+#include <fstream>
+#include <future>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace osu {
+
+namespace {
+
+constexpr size_t kBlockSize = 64 * 1024;       // 段文件中每个压缩块解压后的大小
+constexpr size_t kReaderMemory = 3 * kBlockSize;    // 每一路读取占用：当前块、预取块与压缩数据
+constexpr size_t kMaxFanIn = 64;                // 一次归并的最多段数
+constexpr size_t kMinMemoryBudget = 1024 * 1024;
+
+void putVarint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+bool getVarint(const char*& p, const char* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char byte = static_cast<unsigned char>(*p++);
+        v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void putU32(std::string& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (i * 8)) & 0xFF));
+}
+
+uint32_t getU32(const char* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v |= static_cast<uint32_t>(static_cast<unsigned char>(p[i])) << (i * 8);
+    return v;
+}
+
+// 段文件由压缩块组成，每块为 u32 解压后长度、u32 压缩后长度与 zlib 数据；
+// 块内每条记录为 varint key 长度、key、varint value 长度、value，记录不跨块。
+// 排序键多为递增的数字ID，标题等文本重复度高，快速压缩级别即可把临时文件缩小数倍。
+class RunWriter {
+public:
+    explicit RunWriter(const fs::path& path) : out_(path, std::ios::binary | std::ios::trunc) {
+        if (!out_) {
+            throw std::runtime_error("无法创建排序临时文件: " + path.string());
+        }
+        block_.reserve(kBlockSize + 1024);
+    }
+
+    void write(const SortRecord& record) {
+        putVarint(block_, record.key.size());
+        block_ += record.key;
+        putVarint(block_, record.value.size());
+        block_ += record.value;
+        if (block_.size() >= kBlockSize) {
+            flush();
+        }
+    }
+
+    void close() {
+        flush();
+        out_.close();
+        if (!out_) {
+            throw std::runtime_error("写入排序临时文件失败，磁盘空间可能不足");
+        }
+    }
+
+private:
+    void flush() {
+        if (block_.empty()) {
+            return;
+        }
+        uLongf size = compressBound(static_cast<uLong>(block_.size()));
+        compressed_.resize(size);
+        if (compress2(reinterpret_cast<Bytef*>(&compressed_[0]), &size,
+                      reinterpret_cast<const Bytef*>(block_.data()), static_cast<uLong>(block_.size()),
+                      Z_BEST_SPEED) != Z_OK) {
+            throw std::runtime_error("压缩排序临时文件失败");
+        }
+        std::string header;
+        putU32(header, static_cast<uint32_t>(block_.size()));
+        putU32(header, static_cast<uint32_t>(size));
+        out_.write(header.data(), static_cast<std::streamsize>(header.size()));
+        out_.write(compressed_.data(), static_cast<std::streamsize>(size));
+        block_.clear();
+    }
+
+    std::ofstream out_;
+    std::string block_;
+    std::string compressed_;
+};
+
+// 读取段文件：解码当前块的同时，后台线程已在读取并解压下一块，
+// 多路归并时各路的磁盘读取与解压相互重叠，吞吐接近顺序读盘的速度
+class RunReader : public RecordStream {
+public:
+    explicit RunReader(const fs::path& path) : path_(path), in_(path, std::ios::binary) {
+        if (!in_) {
+            throw std::runtime_error("无法打开排序临时文件: " + path.string());
+        }
+        prefetch();
+    }
+
+    ~RunReader() override {
+        // 后台读取引用着 in_，须等它结束
+        if (pending_.valid()) {
+            pending_.wait();
+        }
+    }
+
+    bool next(SortRecord& record) override {
+        while (pos_ == end_) {
+            if (!pending_.valid()) {
+                return false;
+            }
+            block_ = pending_.get();
+            if (block_.empty()) {
+                return false;
+            }
+            pos_ = block_.data();
+            end_ = pos_ + block_.size();
+            prefetch();
+        }
+        if (!readString(record.key) || !readString(record.value)) {
+            throw std::runtime_error("排序临时文件已损坏: " + path_.string());
+        }
+        return true;
+    }
+
+private:
+    void prefetch() {
+        pending_ = std::async(std::launch::async, [this] { return readBlock(); });
+    }
+
+    // 读取并解压下一块，文件结束时返回空串
+    std::string readBlock() {
+        char header[8];
+        if (!in_.read(header, sizeof(header))) {
+            return "";
+        }
+        uLongf rawSize = getU32(header);
+        uint32_t compressedSize = getU32(header + 4);
+        std::string compressed(compressedSize, '\0');
+        std::string block(rawSize, '\0');
+        if (!in_.read(&compressed[0], compressedSize) ||
+            uncompress(reinterpret_cast<Bytef*>(&block[0]), &rawSize,
+                       reinterpret_cast<const Bytef*>(compressed.data()), compressedSize) != Z_OK ||
+            rawSize != block.size()) {
+            throw std::runtime_error("排序临时文件已损坏: " + path_.string());
+        }
+        return block;
+    }
+
+    bool readString(std::string& out) {
+        uint64_t size;
+        if (!getVarint(pos_, end_, size) || size > static_cast<uint64_t>(end_ - pos_)) {
+            return false;
+        }
+        out.assign(pos_, static_cast<size_t>(size));
+        pos_ += size;
+        return true;
+    }
+
+    fs::path path_;
+    std::ifstream in_;
+    std::future<std::string> pending_;
+    std::string block_;
+    const char* pos_ = nullptr;
+    const char* end_ = nullptr;
+};
+
+// 内存中已排序的记录
+class VectorStream : public RecordStream {
+public:
+    explicit VectorStream(std::vector<SortRecord> records) : records_(std::move(records)) {}
+
+    bool next(SortRecord& record) override {
+        if (pos_ >= records_.size()) {
+            return false;
+        }
+        record = std::move(records_[pos_++]);
+        return true;
+    }
+
+private:
+    std::vector<SortRecord> records_;
+    size_t pos_ = 0;
+};
+
+// 多路归并的败者树：内部结点记录比赛的败者，tree_[0] 为当前的胜者（最小的首条记录）。
+// 胜者所在的路前进一条后只需沿它到根的路径重赛，每条记录 log2(k) 次比较，约为二叉堆的一半。
+// 已读完的路视为无穷大；key 相同时编号小的路胜出，相同 key 的记录按路的顺序输出。
+class MergeStream : public RecordStream {
+public:
+    explicit MergeStream(std::vector<std::unique_ptr<RecordStream>> sources)
+        : sources_(std::move(sources))
+        , heads_(sources_.size())
+        , alive_(sources_.size())
+        , tree_(sources_.size()) {
+        for (size_t i = 0; i < sources_.size(); ++i) {
+            alive_[i] = sources_[i]->next(heads_[i]);
+        }
+        if (!sources_.empty()) {
+            tree_[0] = build(1);
+        }
+    }
+
+    bool next(SortRecord& record) override {
+        if (sources_.empty() || !alive_[tree_[0]]) {
+            return false;
+        }
+        size_t winner = tree_[0];
+        record = std::move(heads_[winner]);
+        alive_[winner] = sources_[winner]->next(heads_[winner]);
+        for (size_t node = (winner + sources_.size()) / 2; node > 0; node /= 2) {
+            if (wins(tree_[node], winner)) {
+                std::swap(tree_[node], winner);
+            }
+        }
+        tree_[0] = winner;
+        return true;
+    }
+
+private:
+    bool wins(size_t a, size_t b) const {
+        if (!alive_[a] || !alive_[b]) {
+            return alive_[a];
+        }
+        int order = heads_[a].key.compare(heads_[b].key);
+        return order < 0 || (order == 0 && a < b);
+    }
+
+    // 完全二叉树中结点 node 的子树的胜者；叶结点 k + i 对应第 i 路
+    size_t build(size_t node) {
+        if (node >= sources_.size()) {
+            return node - sources_.size();
+        }
+        size_t left = build(2 * node);
+        size_t right = build(2 * node + 1);
+        if (wins(left, right)) {
+            tree_[node] = right;
+            return left;
+        }
+        tree_[node] = left;
+        return right;
+    }
+
+    std::vector<std::unique_ptr<RecordStream>> sources_;
+    std::vector<SortRecord> heads_;
+    std::vector<bool> alive_;
+    std::vector<size_t> tree_;
+};
+
+size_t recordBytes(const SortRecord& record) {
+    return record.key.capacity() + record.value.capacity();
+}
+
+} // namespace
+
+ExternalSorter::ExternalSorter(size_t memoryBudget, const fs::path& tempDir)
+    : memoryBudget_(std::max(memoryBudget, kMinMemoryBudget)) {
+    std::random_device random;
+    std::ostringstream name;
+    name << "osu-sync-sort-" << std::hex << random() << random();
+    dir_ = tempDir / name.str();
+}
+
+ExternalSorter::~ExternalSorter() {
+    std::error_code ec;
+    fs::remove_all(dir_, ec);
+}
+
+fs::path ExternalSorter::nextRunPath() {
+    if (runCounter_ == 0) {
+        fs::create_directories(dir_);
+    }
+    return dir_ / ("run-" + std::to_string(runCounter_++) + ".bin");
+}
+
+void ExternalSorter::add(std::string key, std::string value) {
+    buffer_.push_back(SortRecord{std::move(key), std::move(value)});
+    bufferedBytes_ += recordBytes(buffer_.back());
+    count_++;
+    if (bufferedBytes_ + buffer_.capacity() * sizeof(SortRecord) >= memoryBudget_) {
+        spill();
+    }
+}
+
+void ExternalSorter::spill() {
+    if (buffer_.empty()) {
+        return;
+    }
+    std::stable_sort(buffer_.begin(), buffer_.end(), [](const SortRecord& a, const SortRecord& b) {
+        return a.key < b.key;
+    });
+    fs::path path = nextRunPath();
+    RunWriter writer(path);
+    for (const auto& record : buffer_) {
+        writer.write(record);
+    }
+    writer.close();
+    runs_.push_back(path);
+    // 释放而不只是清空，归并阶段不再占用排序缓冲
+    std::vector<SortRecord>().swap(buffer_);
+    bufferedBytes_ = 0;
+}
+
+std::unique_ptr<RecordStream> ExternalSorter::finish() {
+    if (runs_.empty()) {
+        std::stable_sort(buffer_.begin(), buffer_.end(), [](const SortRecord& a, const SortRecord& b) {
+            return a.key < b.key;
+        });
+        std::vector<SortRecord> records;
+        records.swap(buffer_);
+        bufferedBytes_ = 0;
+        return std::make_unique<VectorStream>(std::move(records));
+    }
+    spill();
+
+    // 归并路数受预算限制：每一路占用当前块与预取块
+    size_t fanIn = std::clamp<size_t>(memoryBudget_ / kReaderMemory, 2, kMaxFanIn);
+    size_t first = 0;
+    while (runs_.size() - first > fanIn) {
+        std::vector<std::unique_ptr<RecordStream>> sources;
+        for (size_t i = first; i < first + fanIn; ++i) {
+            sources.push_back(std::make_unique<RunReader>(runs_[i]));
+        }
+        MergeStream merged(std::move(sources));
+        fs::path path = nextRunPath();
+        RunWriter writer(path);
+        SortRecord record;
+        while (merged.next(record)) {
+            writer.write(record);
+        }
+        writer.close();
+        std::error_code ec;
+        for (size_t i = first; i < first + fanIn; ++i) {
+            fs::remove(runs_[i], ec);
+        }
+        first += fanIn;
+        runs_.push_back(path);
+    }
+    runs_.erase(runs_.begin(), runs_.begin() + static_cast<std::ptrdiff_t>(first));
+
+    std::vector<std::unique_ptr<RecordStream>> sources;
+    for (const auto& run : runs_) {
+        sources.push_back(std::make_unique<RunReader>(run));
+    }
+    return std::make_unique<MergeStream>(std::move(sources));
+}
+
+} // namespace osu
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace osu {
+
+// 外部排序的一条记录：按 key 排序，value 随记录携带
+struct SortRecord {
+    std::string key;
+    std::string value;
+};
+
+// 按 key 升序读出的记录流
+class RecordStream {
+public:
+    virtual ~RecordStream() = default;
+
+    // 读出下一条记录，没有更多记录时返回 false
+    virtual bool next(SortRecord& record) = 0;
+};
+
+// 内存受限的外部排序
+// 记录先在内存中累积，超出预算后排序并写成一个有序段（run）文件；输入结束后对所有段做多路归并。
+// 段数超过归并路数上限时先分批归并成更大的段，内存占用只取决于预算，与记录总数无关。
+// 所有记录都能放进预算时不落盘，直接在内存中排序。段文件在析构时删除。
+class ExternalSorter {
+public:
+    explicit ExternalSorter(size_t memoryBudget, const fs::path& tempDir = fs::temp_directory_path());
+    ~ExternalSorter();
+
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    void add(std::string key, std::string value = "");
+
+    // 结束输入，返回全部记录的有序流（key 相同的记录相邻，不去重）；返回的流须先于排序器销毁
+    std::unique_ptr<RecordStream> finish();
+
+    // 已加入的记录数
+    size_t size() const { return count_; }
+
+    // 已写出的段数
+    size_t runs() const { return runs_.size(); }
+
+private:
+    // 排序内存中的记录并写成一个段
+    void spill();
+    fs::path nextRunPath();
+
+    size_t memoryBudget_;
+    fs::path dir_;
+    std::vector<SortRecord> buffer_;
+    size_t bufferedBytes_ = 0;      // buffer_ 中字符串占用的堆内存估计
+    std::vector<fs::path> runs_;
+    size_t runCounter_ = 0;
+    size_t count_ = 0;
+};
+
+} // namespace osu
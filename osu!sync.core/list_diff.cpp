@@ -0,0 +1,203 @@
+#include "list_diff.hpp"
+#include <fstream>
+#include <stdexcept>
+#include "3rdpartyInclude/nlohmann/json.hpp"
+
+namespace osu {
+
+namespace {
+
+// 只取出每个谱面的 id 与 title；支持与 BeatmapImporter::importFromJsonString 相同的两种格式
+class BeatmapListReader : public nlohmann::json_sax<nlohmann::json> {
+public:
+    BeatmapListReader(ExternalSorter& sorter, BeatmapListInfo& info) : sorter_(sorter), info_(info) {}
+
+    bool null() override { return true; }
+    bool boolean(bool) override { return true; }
+    bool binary(binary_t&) override { return true; }
+    bool number_float(number_float_t, const string_t&) override { return true; }
+
+    bool number_integer(number_integer_t value) override {
+        if (inEntryField("id")) {
+            id_ = std::to_string(value);
+        }
+        return true;
+    }
+
+    bool number_unsigned(number_unsigned_t value) override {
+        if (inEntryField("id")) {
+            id_ = std::to_string(value);
+        }
+        return true;
+    }
+
+    bool string(string_t& value) override {
+        if (inEntryField("id")) {
+            id_ = value;
+        } else if (inEntryField("title")) {
+            title_ = value;
+        } else if (depth_ == 1 && topObject_ && key_ == "name") {
+            info_.name = value;
+        } else if (depth_ == 1 && topObject_ && key_ == "description") {
+            info_.description = value;
+        }
+        return true;
+    }
+
+    bool start_object(std::size_t) override {
+        depth_++;
+        if (depth_ == 1) {
+            topObject_ = true;
+        } else if (listDepth_ > 0 && depth_ == listDepth_ + 1) {
+            inEntry_ = true;
+            id_.clear();
+            title_.clear();
+        }
+        key_.clear();
+        return true;
+    }
+
+    bool end_object() override {
+        if (inEntry_ && depth_ == listDepth_ + 1) {
+            inEntry_ = false;
+            if (id_.empty()) {
+                info_.invalidEntries++;
+            } else {
+                sorter_.add(std::move(id_), std::move(title_));
+                info_.entries++;
+            }
+        }
+        depth_--;
+        key_.clear();
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        depth_++;
+        sawArray_ = sawArray_ || depth_ == 1;
+        if (depth_ == 1 || (depth_ == 2 && topObject_ && key_ == "beatmaps")) {
+            listDepth_ = depth_;
+        }
+        key_.clear();
+        return true;
+    }
+
+    bool end_array() override {
+        if (depth_ == listDepth_) {
+            listDepth_ = 0;
+        }
+        depth_--;
+        key_.clear();
+        return true;
+    }
+
+    bool key(string_t& key) override {
+        key_ = key;
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override {
+        throw std::runtime_error(ex.what());
+    }
+
+    bool isCollection() const { return topObject_; }
+    bool isList() const { return depth_ == 0 && (topObject_ || sawArray_); }
+
+private:
+    bool inEntryField(const char* field) const {
+        return inEntry_ && depth_ == listDepth_ + 1 && key_ == field;
+    }
+
+    ExternalSorter& sorter_;
+    BeatmapListInfo& info_;
+    int depth_ = 0;
+    int listDepth_ = 0;         // 谱面数组所在的深度，0 表示当前不在谱面数组中
+    bool topObject_ = false;
+    bool sawArray_ = false;
+    bool inEntry_ = false;
+    std::string key_;
+    std::string id_;
+    std::string title_;
+};
+
+// 跳过 key 与上一条相同的记录
+class DistinctReader {
+public:
+    explicit DistinctReader(RecordStream& stream) : stream_(stream) {}
+
+    bool next(SortRecord& record) {
+        while (stream_.next(record)) {
+            if (first_ || record.key != previous_) {
+                first_ = false;
+                previous_ = record.key;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    RecordStream& stream_;
+    std::string previous_;
+    bool first_ = true;
+};
+
+} // namespace
+
+BeatmapListInfo readBeatmapList(const fs::path& path, ExternalSorter& sorter) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("无法打开谱面列表文件: " + path.string());
+    }
+    BeatmapListInfo info;
+    BeatmapListReader reader(sorter, info);
+    nlohmann::json::sax_parse(file, &reader);
+    if (!reader.isList()) {
+        throw std::runtime_error("无效的JSON格式：必须是数组或对象");
+    }
+    info.collection = reader.isCollection();
+    return info;
+}
+
+size_t readBeatmapDirectory(const fs::path& dir, ExternalSorter& sorter) {
+    size_t count = 0;
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        std::error_code ec;
+        if (entry.path().extension() == ".osz" && entry.is_regular_file(ec) && entry.file_size(ec) > 0) {
+            sorter.add(entry.path().stem().string());
+            count++;
+        }
+    }
+    return count;
+}
+
+DiffCounts diffSorted(RecordStream& expected, RecordStream& actual,
+                      const std::function<void(DiffKind, SortRecord&)>& emit) {
+    DiffCounts counts;
+    DistinctReader left(expected);
+    DistinctReader right(actual);
+    SortRecord a;
+    SortRecord b;
+    bool haveA = left.next(a);
+    bool haveB = right.next(b);
+    while (haveA || haveB) {
+        int order = !haveA ? 1 : !haveB ? -1 : a.key.compare(b.key);
+        if (order < 0) {
+            counts.missing++;
+            emit(DiffKind::Missing, a);
+            haveA = left.next(a);
+        } else if (order > 0) {
+            counts.extra++;
+            emit(DiffKind::Extra, b);
+            haveB = right.next(b);
+        } else {
+            counts.common++;
+            emit(DiffKind::Common, a);
+            haveA = left.next(a);
+            haveB = right.next(b);
+        }
+    }
+    return counts;
+}
+
+} // namespace osu
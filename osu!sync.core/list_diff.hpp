@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include "external_sort.hpp"
+
+namespace fs = std::filesystem;
+
+namespace osu {
+
+// 流式读取的谱面列表概况
+struct BeatmapListInfo {
+    bool collection = false;    // 是否为带 beatmaps 数组的合集对象
+    std::string name;
+    std::string description;
+    size_t entries = 0;         // 加入排序器的条目数（未去重）
+    size_t invalidEntries = 0;  // 缺少 id 的条目数
+};
+
+// 以 SAX 方式流式读取谱面列表文件（谱面数组或合集对象），不构建整个 JSON 文档；
+// 每个谱面以 id 为 key、title 为 value 加入排序器。无法打开或格式无效时抛出异常
+BeatmapListInfo readBeatmapList(const fs::path& path, ExternalSorter& sorter);
+
+// 把目录中非空的 .osz 文件以文件名（谱面ID）为 key 加入排序器，返回文件数
+size_t readBeatmapDirectory(const fs::path& dir, ExternalSorter& sorter);
+
+enum class DiffKind {
+    Missing,    // 只在 expected 中
+    Extra,      // 只在 actual 中
+    Common      // 两边都有
+};
+
+struct DiffCounts {
+    size_t missing = 0;
+    size_t extra = 0;
+    size_t common = 0;
+};
+
+// 归并两个按 key 升序的记录流，逐条输出差异，两边都不需要放进内存。
+// 每一边 key 重复的记录只取第一条；Common 输出 expected 一侧的记录
+DiffCounts diffSorted(RecordStream& expected, RecordStream& actual,
+                      const std::function<void(DiffKind, SortRecord&)>& emit);
+
+} // namespace osu
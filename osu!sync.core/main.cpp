@@ -6,9 +6,13 @@
 #include <functional>
 #include <locale>
 #include <codecvt>
+#include <cstdio>
 #include "stableExporter.hpp"
 #include "beatmap_types.hpp"
 #include "beatmap_importer.hpp"
+#include "collection_downloader.hpp"
+#include "list_diff.hpp"
+#include "songs_dedupe.hpp"
 #include "3rdpartyInclude/nlohmann/json.hpp"
 #include "network.utils.hpp"
 
@@ -55,13 +59,27 @@ void printUsage()
     UTF8Console::println("可用命令:");
     UTF8Console::println("  export <osu路径> <输出文件>     从osu!导出谱面列表到JSON文件");
     UTF8Console::println("  download <用户名> <服务器地址>  从服务器下载谱面列表");    
-    UTF8Console::println("  import <谱面列表> <保存路径> [osu路径] [并发数] [--mirror <镜像站>]");
+    UTF8Console::println("  import <谱面列表> <保存路径> [osu路径] [并发数] [--mirror <镜像站>] [--server <服务器地址>] [--share-stats]");
+    UTF8Console::println("                                 [--memory-budget <MB>] [--no-video]");
+    UTF8Console::println("                                 [--background [--game-process <进程名>] [--background-limit <KB/s>]]");
     UTF8Console::println("                                 下载并导入谱面列表中的谱面");
+    UTF8Console::println("  diff <列表A> <列表B或谱面目录> [--memory-budget <MB>] [--missing <文件>] [--extra <文件>]");
+    UTF8Console::println("                                 比较两个谱面列表，--missing/--extra 保存只在A/只在B中的谱面");
+    UTF8Console::println("  dedupe <osu路径> [--dry-run] [--reflink] [--threads <N>]");
+    UTF8Console::println("                                 把Songs中内容相同的文件替换为硬链接，--dry-run 只统计可节省的空间");
     UTF8Console::println("  mirrors                        列出所有可用的镜像站");
     UTF8Console::println("");
     UTF8Console::println("镜像站选项:");
     UTF8Console::println("  --mirror <镜像站>              指定下载使用的镜像站");
     UTF8Console::println("                                可选值: sayobot, catboy, chimu, nerinyan, kitsu");
+    UTF8Console::println("  --server <服务器地址>          跳过服务器记录的失效谱面集，并上报新发现的失效谱面集");
+    UTF8Console::println("                                未指定 --mirror 时使用服务器提示的表现最好的镜像站");
+    UTF8Console::println("  --share-stats                  导入结束时向服务器匿名提交镜像站的吞吐与成败次数");
+    UTF8Console::println("  --memory-budget <MB>           流式导入超大列表：借助磁盘临时文件排序去重，分批下载");
+    UTF8Console::println("  --no-video                     下载后从谱面中去除视频，不保存视频数据");
+    UTF8Console::println("  --background                   游戏运行时降低CPU与磁盘优先级并限速，游戏退出后恢复全速");
+    UTF8Console::println("  --game-process <进程名>        后台模式检测的游戏进程，默认 osu!.exe");
+    UTF8Console::println("  --background-limit <KB/s>      游戏运行时的下载限速，默认 2048");
     UTF8Console::println("");
     UTF8Console::println("示例:");
     UTF8Console::println("  osu!sync export \"C:/Games/osu!\" beatmaps.json");
@@ -118,32 +136,31 @@ bool exportBeatmaps(const std::vector<std::string> &args)
 }
 
 bool downloadCollection(const std::vector<std::string> &args)
-{    
-    // if (args.size() != 2)
-    // {
-    //     UTF8Console::error("错误: download命令需要用户名和服务器地址参数");
-    //     return false;
-    // }
-
-    // const auto &[username, serverUrl] = std::tie(args[0], args[1]);
-
-    // try
-    // {
-    //     UTF8Console::print("正在从服务器下载谱面列表...");
-    //     auto beatmaps = osu::CollectionDownloader::downloadBeatmapList(username, serverUrl);
-
-    //     std::string outputFile = username + "_collection.json";
-    //     saveToJson(beatmaps, outputFile);
-
-    //     UTF8Console::print("谱面列表已保存到: " + outputFile);
-    //     return true;
-    // }    
-    // catch (const std::exception &e)
-    // {
-    //     UTF8Console::error("下载谱面列表时发生错误: " + std::string(e.what()));
-    //     return false;
-    // }
-    return true;
+{
+    if (args.size() != 2)
+    {
+        UTF8Console::error("错误: download命令需要用户名和服务器地址参数");
+        return false;
+    }
+
+    const auto &[username, serverUrl] = std::tie(args[0], args[1]);
+
+    try
+    {
+        UTF8Console::println("正在从服务器下载谱面列表...");
+        auto beatmaps = osu::CollectionDownloader::downloadBeatmapList(username, serverUrl);
+
+        std::string outputFile = username + "_collection.json";
+        saveToJson(beatmaps, outputFile);
+
+        UTF8Console::println("谱面列表已保存到: " + outputFile);
+        return true;
+    }
+    catch (const std::exception &e)
+    {
+        UTF8Console::error("下载谱面列表时发生错误: " + std::string(e.what()));
+        return false;
+    }
 }
 
 bool importBeatmaps(const std::vector<std::string> &args)
@@ -160,6 +177,13 @@ bool importBeatmaps(const std::vector<std::string> &args)
         std::string savePath;
         std::string osuPath;
         std::string mirror;
+        std::string serverUrl;
+        bool shareStats = false;
+        size_t memoryBudgetMB = 0;
+        bool background = false;
+        bool noVideo = false;
+        std::string gameProcess = osu::BackgroundMode::defaultGameProcess();
+        size_t backgroundLimitKB = 2048;
         size_t concurrent = 25;
 
         // 解析参数
@@ -172,6 +196,66 @@ bool importBeatmaps(const std::vector<std::string> &args)
                 mirror = args[++i];
                 continue;
             }
+            if (args[i] == "--server") {
+                if (i + 1 >= args.size()) {
+                    UTF8Console::error("错误: --server 选项需要指定服务器地址");
+                    return false;
+                }
+                serverUrl = args[++i];
+                continue;
+            }
+            if (args[i] == "--memory-budget") {
+                if (i + 1 >= args.size()) {
+                    UTF8Console::error("错误: --memory-budget 选项需要指定内存预算（MB）");
+                    return false;
+                }
+                try {
+                    memoryBudgetMB = std::stoul(args[++i]);
+                } catch (const std::exception&) {
+                    memoryBudgetMB = 0;
+                }
+                if (memoryBudgetMB < 1) {
+                    UTF8Console::error("错误: 内存预算必须是正整数（MB）");
+                    return false;
+                }
+                continue;
+            }
+            if (args[i] == "--no-video") {
+                noVideo = true;
+                continue;
+            }
+            if (args[i] == "--background") {
+                background = true;
+                continue;
+            }
+            if (args[i] == "--game-process") {
+                if (i + 1 >= args.size()) {
+                    UTF8Console::error("错误: --game-process 选项需要指定进程名");
+                    return false;
+                }
+                gameProcess = args[++i];
+                continue;
+            }
+            if (args[i] == "--background-limit") {
+                if (i + 1 >= args.size()) {
+                    UTF8Console::error("错误: --background-limit 选项需要指定限速（KB/s）");
+                    return false;
+                }
+                try {
+                    backgroundLimitKB = std::stoul(args[++i]);
+                } catch (const std::exception&) {
+                    backgroundLimitKB = 0;
+                }
+                if (backgroundLimitKB < 1) {
+                    UTF8Console::error("错误: 限速必须是正整数（KB/s）");
+                    return false;
+                }
+                continue;
+            }
+            if (args[i] == "--share-stats") {
+                shareStats = true;
+                continue;
+            }
             
             // 处理位置参数
             if (jsonPath.empty()) {
@@ -209,10 +293,32 @@ bool importBeatmaps(const std::vector<std::string> &args)
             UTF8Console::println("使用镜像站: " + mirror);
         }
         
+        if (memoryBudgetMB > 0) {
+            importer.setMemoryBudget(memoryBudgetMB * 1024 * 1024);
+            UTF8Console::println("内存预算: " + std::to_string(memoryBudgetMB) + " MB");
+        }
+
+        importer.setStripVideo(noVideo);
+
+        if (background) {
+            auto mode = std::make_shared<osu::BackgroundMode>(gameProcess, backgroundLimitKB * 1024);
+            mode->start();
+            importer.setBackgroundMode(mode);
+            UTF8Console::println("后台模式: 检测进程 " + gameProcess + "，游戏运行时限速 " +
+                                 std::to_string(backgroundLimitKB) + " KB/s");
+        }
+
         // 设置osu路径
         if (!osuPath.empty()) {
             importer.setOsuPath(osuPath);
         }
+
+        if (!serverUrl.empty()) {
+            importer.setServer(serverUrl);
+            importer.setShareStats(shareStats);
+        } else if (shareStats) {
+            UTF8Console::error("警告: --share-stats 需要同时指定 --server，将被忽略");
+        }
         
         UTF8Console::println("开始导入谱面... (并发数: " + std::to_string(concurrent) + ")");
         auto status = importer.importFromJson(jsonPath);
@@ -238,6 +344,188 @@ bool importBeatmaps(const std::vector<std::string> &args)
     }
 }
 
+// 逐条写出谱面列表，输出格式可直接用于 import
+class BeatmapListWriter {
+public:
+    explicit BeatmapListWriter(const std::string& path) : out_(path) {
+        if (!out_) {
+            throw std::runtime_error("无法创建输出文件：" + path);
+        }
+        out_ << "[";
+    }
+
+    void write(const osu::SortRecord& record) {
+        osu::BeatmapInfo beatmap;
+        beatmap.id = record.key;
+        beatmap.title = record.value;
+        out_ << (first_ ? "\n" : ",\n") << json(beatmap).dump();
+        first_ = false;
+    }
+
+    void close() {
+        out_ << "\n]" << std::endl;
+    }
+
+private:
+    std::ofstream out_;
+    bool first_ = true;
+};
+
+bool diffLists(const std::vector<std::string> &args)
+{
+    try
+    {
+        std::vector<std::string> inputs;
+        std::string missingPath;
+        std::string extraPath;
+        size_t memoryBudgetMB = 64;
+
+        for (size_t i = 0; i < args.size(); i++) {
+            if (args[i] == "--memory-budget" || args[i] == "--missing" || args[i] == "--extra") {
+                if (i + 1 >= args.size()) {
+                    UTF8Console::error("错误: " + args[i] + " 选项需要一个参数");
+                    return false;
+                }
+                const std::string& option = args[i];
+                const std::string& value = args[++i];
+                if (option == "--missing") {
+                    missingPath = value;
+                } else if (option == "--extra") {
+                    extraPath = value;
+                } else {
+                    try {
+                        memoryBudgetMB = std::stoul(value);
+                    } catch (const std::exception&) {
+                        memoryBudgetMB = 0;
+                    }
+                    if (memoryBudgetMB < 1) {
+                        UTF8Console::error("错误: 内存预算必须是正整数（MB）");
+                        return false;
+                    }
+                }
+                continue;
+            }
+            inputs.push_back(args[i]);
+        }
+        if (inputs.size() != 2) {
+            UTF8Console::error("错误: diff命令需要两个谱面列表（第二个也可以是谱面目录）");
+            return false;
+        }
+
+        // 两边各用一半预算，排序段压缩后写入临时目录
+        size_t budget = memoryBudgetMB * 1024 * 1024 / 2;
+        std::vector<std::unique_ptr<osu::ExternalSorter>> sorters;
+        for (const auto& input : inputs) {
+            sorters.push_back(std::make_unique<osu::ExternalSorter>(budget));
+            if (fs::is_directory(input)) {
+                size_t files = osu::readBeatmapDirectory(input, *sorters.back());
+                UTF8Console::println(input + ": " + std::to_string(files) + " 个谱面文件");
+            } else {
+                auto info = osu::readBeatmapList(input, *sorters.back());
+                UTF8Console::println(input + ": " + std::to_string(info.entries) + " 个条目");
+            }
+        }
+
+        std::unique_ptr<BeatmapListWriter> missing;
+        std::unique_ptr<BeatmapListWriter> extra;
+        if (!missingPath.empty()) {
+            missing = std::make_unique<BeatmapListWriter>(missingPath);
+        }
+        if (!extraPath.empty()) {
+            extra = std::make_unique<BeatmapListWriter>(extraPath);
+        }
+
+        auto expected = sorters[0]->finish();
+        auto actual = sorters[1]->finish();
+        auto counts = osu::diffSorted(*expected, *actual, [&](osu::DiffKind kind, osu::SortRecord& record) {
+            if (kind == osu::DiffKind::Missing && missing) {
+                missing->write(record);
+            } else if (kind == osu::DiffKind::Extra && extra) {
+                extra->write(record);
+            }
+        });
+        if (missing) {
+            missing->close();
+        }
+        if (extra) {
+            extra->close();
+        }
+
+        UTF8Console::println("只在A中: " + std::to_string(counts.missing));
+        UTF8Console::println("只在B中: " + std::to_string(counts.extra));
+        UTF8Console::println("两边都有: " + std::to_string(counts.common));
+        return true;
+    }
+    catch (const std::exception &e)
+    {
+        UTF8Console::error("比较谱面列表时发生错误: " + std::string(e.what()));
+        return false;
+    }
+}
+
+bool dedupeSongs(const std::vector<std::string> &args)
+{
+    try
+    {
+        std::string osuPath;
+        osu::SongsDeduplicator::Options options;
+        for (size_t i = 0; i < args.size(); i++) {
+            if (args[i] == "--dry-run") {
+                options.dryRun = true;
+            } else if (args[i] == "--reflink") {
+                options.reflink = true;
+            } else if (args[i] == "--threads") {
+                if (i + 1 >= args.size()) {
+                    UTF8Console::error("错误: --threads 选项需要一个参数");
+                    return false;
+                }
+                try {
+                    options.threads = std::stoul(args[++i]);
+                } catch (const std::exception&) {
+                    options.threads = 0;
+                }
+                if (options.threads < 1) {
+                    UTF8Console::error("错误: 线程数必须是正整数");
+                    return false;
+                }
+            } else if (osuPath.empty()) {
+                osuPath = args[i];
+            } else {
+                UTF8Console::error("错误: 未知参数 '" + args[i] + "'");
+                return false;
+            }
+        }
+        if (osuPath.empty()) {
+            UTF8Console::error("错误: dedupe命令需要osu路径参数");
+            return false;
+        }
+
+        UTF8Console::println(options.dryRun ? "正在统计重复文件..." : "正在合并重复文件...");
+        auto result = osu::SongsDeduplicator(osuPath, options).run();
+        auto megabytes = [](uint64_t bytes) { return std::to_string(bytes / (1024 * 1024)) + " MB"; };
+        double percent = result.totalBytes ? 100.0 * result.savedBytes / result.totalBytes : 0.0;
+        char percentText[16];
+        snprintf(percentText, sizeof(percentText), "%.1f%%", percent);
+
+        UTF8Console::println("扫描文件: " + std::to_string(result.files) + " 个，共 " + megabytes(result.totalBytes));
+        UTF8Console::println("计算哈希: " + std::to_string(result.hashed) + " 个（其余沿用上次的记录）");
+        UTF8Console::println("重复文件组: " + std::to_string(result.duplicateGroups));
+        UTF8Console::println(std::string(options.dryRun ? "可替换: " : "已替换: ") + std::to_string(result.linked) +
+                             " 个，此前已共享: " + std::to_string(result.alreadyLinked) + " 个");
+        UTF8Console::println(std::string(options.dryRun ? "可节省: " : "节省: ") + megabytes(result.savedBytes) +
+                             " (" + percentText + ")");
+        if (result.failed > 0) {
+            UTF8Console::error("替换失败: " + std::to_string(result.failed) + " 个（文件可能正被游戏占用）");
+        }
+        return result.failed == 0;
+    }
+    catch (const std::exception &e)
+    {
+        UTF8Console::error("合并重复文件时发生错误: " + std::string(e.what()));
+        return false;
+    }
+}
+
 bool listMirrors()
 {
     try {
@@ -299,6 +587,10 @@ int main(int argc, char *argv[])
         return downloadCollection(args) ? 0 : 1;
     } else if (command == "import") {
         return importBeatmaps(args) ? 0 : 1;
+    } else if (command == "diff") {
+        return diffLists(args) ? 0 : 1;
+    } else if (command == "dedupe") {
+        return dedupeSongs(args) ? 0 : 1;
     } else {
         UTF8Console::error("错误: 未知命令 '" + command + "'");
         printUsage();
@@ -4,6 +4,7 @@
  */
 #pragma warning(disable : 4996)
 #include "network.utils.hpp"
+#include "osz_rewriter.hpp"
 #include<fstream>
 #include <cstdlib>
 #include <array>
@@ -14,12 +15,25 @@
 #include <thread>
 #include <chrono>
 #include <filesystem>
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
 
 namespace osu {
 
 std::string NetworkUtils::executeCommand(const std::string& command, bool showOutput) {
-    std::array<char, 1024> buffer;
     std::string result;
+    int exitCode = executeCommand(command, result, showOutput);
+    if (exitCode != 0) {
+        throw std::runtime_error("命令执行失败，退出码: " + std::to_string(exitCode));
+    }
+
+    return result;
+}
+
+int NetworkUtils::executeCommand(const std::string& command, std::string& result, bool showOutput) {
+    std::array<char, 1024> buffer;
+    result.clear();
     
     #ifdef _WIN32
     FILE* pipe = _popen(command.c_str(), "r");
@@ -42,19 +56,19 @@ std::string NetworkUtils::executeCommand(const std::string& command, bool showOu
     #ifdef _WIN32
     int exitCode = _pclose(pipe);
     #else
-    int exitCode = pclose(pipe);
+    int status = pclose(pipe);
+    // pclose 返回的是等待状态，取出命令本身的退出码
+    int exitCode = (status != -1 && WIFEXITED(status)) ? WEXITSTATUS(status) : status;
     #endif
     
-    if (exitCode != 0) {
-        throw std::runtime_error("命令执行失败，退出码: " + std::to_string(exitCode));
-    }
-    
-    return result;
+    return exitCode;
 }
 
 bool NetworkUtils::downloadFile(const std::vector<std::string>& beatmapIds,
                               const fs::path& savePath,
-                              const DownloadOptions& options) {
+                              const DownloadOptions& options,
+                              std::vector<std::string>* notFound,
+                              uint64_t* receivedBytes) {
     try {
         // 构建aria2c路径
         fs::path aria2Path = "aria2c";
@@ -83,19 +97,28 @@ bool NetworkUtils::downloadFile(const std::vector<std::string>& beatmapIds,
         for (size_t i = 0; i < beatmapIds.size(); ++i) {
             if (i > 0) combinedIds += ",";
             combinedIds += beatmapIds[i];
-        }        // 创建输入文件以存储下载URL
+        }
+        // 先为每个谱面ID生成下载URL，镜像站无效时在创建临时文件之前失败
+        std::vector<std::string> urls;
+        std::unordered_map<std::string, std::string> idByUrl;
+        for (const auto& id : beatmapIds) {
+            urls.push_back(getMirrorURL(id, options.mirror));
+            idByUrl[urls.back()] = id;
+        }
+
+        // 创建输入文件以存储下载URL
         fs::path inputFile = fs::temp_directory_path() / "aria2_input.txt";
         std::ofstream urlFile(inputFile);
         if (!urlFile) {
             throw std::runtime_error("无法创建下载输入文件");
         }
-
-        // 为每个谱面ID生成下载URL并写入文件
-        for (const auto& id : beatmapIds) {
-            std::string url = getMirrorURL(id, options.mirror);
-            urlFile << url << "\n\tout=" << id << ".osz\n";
+        for (size_t i = 0; i < beatmapIds.size(); ++i) {
+            urlFile << urls[i] << "\n\tout=" << beatmapIds[i] << ".osz\n";
         }
         urlFile.close();
+        // aria2c 的日志中记录每个失败下载的错误码，用于区分永久性失败
+        fs::path logFile = fs::temp_directory_path() / "aria2_log.txt";
+        fs::remove(logFile);
 
         // 构建aria2c命令
         std::stringstream cmd;
@@ -114,20 +137,85 @@ bool NetworkUtils::downloadFile(const std::vector<std::string>& beatmapIds,
             << " --continue=true"                 // 支持断点续传
             << " --console-log-level=notice"      // 日志级别
             << " --summary-interval=1"            // 进度更新间隔
-            << " --download-result=full";         // 显示详细的下载结果        // 执行下载命令并显示输出
+            << " --download-result=full"          // 显示详细的下载结果
+            << " --log=\"" << logFile.string() << "\""
+            << " --log-level=error";
+        if (options.maxBytesPerSecond > 0) {
+            cmd << " --max-overall-download-limit=" << options.maxBytesPerSecond;
+        }
+
+        // 执行下载命令并显示输出
         std::cout << "开始下载 " << beatmapIds.size() << " 个谱面...\n";
-        std::string output = executeCommand(cmd.str(), true);
+        // 批次中任一谱面下载失败时 aria2c 都以非零码退出（如 404 时为 3），其余谱面仍已下载完成，
+        // 因此不在此处返回，下面照常清理临时文件、解析日志并逐个验证、去除视频
+        std::string output;
+        int exitCode = -1;
+        try {
+            exitCode = executeCommand(cmd.str(), output, true);
+        } catch (const std::exception& e) {
+            std::cerr << "下载错误: " << e.what() << std::endl;
+        }
+        bool commandOk = exitCode == 0;
+        if (exitCode > 0) {
+            std::cerr << "部分谱面下载失败，aria2c 退出码: " << exitCode << std::endl;
+        }
 
         // 下载完成后删除临时文件
-        fs::remove(inputFile);
+        std::error_code ec;
+        fs::remove(inputFile, ec);
+
+        // errorCode=3 即“资源不存在”（HTTP 404），重试也不会成功
+        if (notFound) {
+            std::ifstream log(logFile);
+            std::string line;
+            const std::string marker = "errorCode=3 URI=";
+            while (std::getline(log, line)) {
+                size_t pos = line.find(marker);
+                if (pos == std::string::npos) {
+                    continue;
+                }
+                std::string url = line.substr(pos + marker.size());
+                url = url.substr(0, url.find_first_of(" \r\t"));
+                auto it = idByUrl.find(url);
+                if (it != idByUrl.end()) {
+                    notFound->push_back(it->second);
+                    idByUrl.erase(it);  // 同一下载的日志可能有多行
+                }
+            }
+        }
+        fs::remove(logFile, ec);
         
         // 验证每个谱面文件
-        bool allSuccess = true;
+        bool allSuccess = commandOk;
+        size_t stripped = 0;
+        uint64_t strippedBytes = 0;
         for (const auto& id : beatmapIds) {
             fs::path beatmapPath = savePath / (id + ".osz");
             if (!validateFile(beatmapPath)) {
                 allSuccess = false;
+                continue;
+            }
+            if (receivedBytes) {
+                std::error_code sizeError;
+                auto size = fs::file_size(beatmapPath, sizeError);
+                if (!sizeError) {
+                    *receivedBytes += size;
+                }
             }
+            // 在谱面被导入或解压之前去除视频，之后不再读写这部分数据
+            if (options.stripVideo) {
+                auto result = OszRewriter::stripVideo(beatmapPath);
+                if (!result.ok) {
+                    std::cerr << "去除视频失败，保留原文件: " << beatmapPath << " (" << result.error << ")" << std::endl;
+                } else if (result.removedEntries > 0) {
+                    stripped++;
+                    strippedBytes += result.removedBytes;
+                }
+            }
+        }
+        if (stripped > 0) {
+            std::cout << "已从 " << stripped << " 个谱面中去除视频，节省 "
+                      << strippedBytes / (1024 * 1024) << " MB" << std::endl;
         }
         
         return allSuccess;
@@ -4,8 +4,10 @@
  */
 
 #pragma once
+#include <cstdint>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include <filesystem>
 
 namespace fs = std::filesystem;
@@ -23,16 +25,25 @@ struct Mirror {
 struct DownloadOptions {
     std::string mirror;     // 要使用的镜像站名称
     size_t concurrent = 25; // 并发下载数量
+    uint64_t maxBytesPerSecond = 0; // 总下载限速（字节每秒），0 表示不限速
+    bool stripVideo = false;    // 下载完成后从 .osz 中去除视频
 };
 
 class NetworkUtils {
 public:    // 执行系统命令并返回输出
     static std::string executeCommand(const std::string& command, bool showOutput = false);
+
+    // 执行系统命令并返回退出码，退出码非零时不抛出异常；命令无法启动时仍抛出
+    static int executeCommand(const std::string& command, std::string& output, bool showOutput = false);
     
     // 批量下载谱面
+    // notFound 不为空时填入镜像站明确返回“资源不存在”（永久性失败）的谱面ID
+    // receivedBytes 不为空时累加通过验证的文件在去除视频之前的大小，即实际下载的字节数
     static bool downloadFile(const std::vector<std::string>& beatmapIds,
                            const fs::path& savePath,
-                           const DownloadOptions& options = DownloadOptions());
+                           const DownloadOptions& options = DownloadOptions(),
+                           std::vector<std::string>* notFound = nullptr,
+                           uint64_t* receivedBytes = nullptr);
                            
     // 单个谱面下载（向后兼容）
     static bool downloadFile(const std::string& beatmapId,
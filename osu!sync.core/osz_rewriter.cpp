@@ -0,0 +1,348 @@
+#include "osz_rewriter.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <deque>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include <zlib.h>
+
+namespace osu {
+
+namespace {
+
+constexpr uint32_t kLocalHeader = 0x04034b50;
+constexpr uint32_t kCentralHeader = 0x02014b50;
+constexpr uint32_t kEndOfCentralDirectory = 0x06054b50;
+constexpr uint32_t kDataDescriptor = 0x08074b50;
+constexpr size_t kBufferSize = 64 * 1024;
+
+uint16_t get16(const char* p) {
+    return static_cast<uint16_t>(static_cast<unsigned char>(p[0]) | (static_cast<unsigned char>(p[1]) << 8));
+}
+
+uint32_t get32(const char* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v |= static_cast<uint32_t>(static_cast<unsigned char>(p[i])) << (i * 8);
+    return v;
+}
+
+void put16(char* p, uint16_t v) {
+    p[0] = static_cast<char>(v & 0xFF);
+    p[1] = static_cast<char>(v >> 8);
+}
+
+void put32(char* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<char>((v >> (i * 8)) & 0xFF);
+}
+
+// 带缓冲的顺序读取，解压时可以直接访问缓冲区
+class Reader {
+public:
+    explicit Reader(std::istream& in) : in_(in), buffer_(kBufferSize) {}
+
+    // 缓冲区中可用的字节数，缓冲区已空时先读入；返回 0 表示输入结束
+    size_t available() {
+        if (pos_ == end_) {
+            in_.read(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+            end_ = static_cast<size_t>(in_.gcount());
+            pos_ = 0;
+        }
+        return end_ - pos_;
+    }
+
+    const char* data() const { return buffer_.data() + pos_; }
+    void consume(size_t n) { pos_ += n; }
+
+    bool read(char* out, size_t n) {
+        while (n > 0) {
+            size_t chunk = std::min(n, available());
+            if (chunk == 0) {
+                return false;
+            }
+            std::copy(data(), data() + chunk, out);
+            consume(chunk);
+            out += chunk;
+            n -= chunk;
+        }
+        return true;
+    }
+
+    bool read(std::string& out, size_t n) {
+        out.resize(n);
+        return n == 0 || read(&out[0], n);
+    }
+
+private:
+    std::istream& in_;
+    std::vector<char> buffer_;
+    size_t pos_ = 0;
+    size_t end_ = 0;
+};
+
+// 顺序写出并记录已写出的字节数（输出流不一定支持 tellp）
+class Writer {
+public:
+    explicit Writer(std::ostream& out) : out_(out) {}
+
+    void write(const char* data, size_t n) {
+        out_.write(data, static_cast<std::streamsize>(n));
+        written_ += n;
+    }
+
+    void write(const std::string& data) { write(data.data(), data.size()); }
+
+    uint64_t written() const { return written_; }
+
+private:
+    std::ostream& out_;
+    uint64_t written_ = 0;
+};
+
+// 把 n 字节从 reader 复制到 writer；writer 为空时只跳过
+bool copyBytes(Reader& reader, Writer* writer, uint64_t n) {
+    while (n > 0) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(n, reader.available()));
+        if (chunk == 0) {
+            return false;
+        }
+        if (writer) {
+            writer->write(reader.data(), chunk);
+        }
+        reader.consume(chunk);
+        n -= chunk;
+    }
+    return true;
+}
+
+// 大小未知的 deflate 数据：解压一遍找到压缩流的结尾，返回压缩数据的字节数，失败时返回 -1
+int64_t copyDeflateStream(Reader& reader, Writer* writer) {
+    z_stream stream{};
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        return -1;
+    }
+    std::array<Bytef, kBufferSize> sink;
+    int64_t total = 0;
+    int ret = Z_OK;
+    while (ret != Z_STREAM_END) {
+        size_t available = reader.available();
+        if (available == 0) {
+            break;
+        }
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(reader.data()));
+        stream.avail_in = static_cast<uInt>(available);
+        do {
+            stream.next_out = sink.data();
+            stream.avail_out = static_cast<uInt>(sink.size());
+            ret = inflate(&stream, Z_NO_FLUSH);
+        } while (ret == Z_OK && stream.avail_in > 0);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            break;
+        }
+        size_t used = available - stream.avail_in;
+        if (writer) {
+            writer->write(reader.data(), used);
+        }
+        reader.consume(used);
+        total += static_cast<int64_t>(used);
+    }
+    inflateEnd(&stream);
+    return ret == Z_STREAM_END ? total : -1;
+}
+
+OszRewriter::Result failure(OszRewriter::Result result, const std::string& error) {
+    result.ok = false;
+    result.error = error;
+    return result;
+}
+
+} // namespace
+
+bool OszRewriter::isVideo(const std::string& name) {
+    static const char* const kExtensions[] = {
+        ".avi", ".flv", ".m4v", ".mkv", ".mov", ".mp4", ".mpeg", ".mpg", ".ogv", ".webm", ".wmv"
+    };
+    std::string lower(name);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+    for (const char* extension : kExtensions) {
+        size_t length = std::char_traits<char>::length(extension);
+        if (lower.size() > length && lower.compare(lower.size() - length, length, extension) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+OszRewriter::Result OszRewriter::stripVideo(std::istream& in, std::ostream& out) {
+    Result result;
+    Reader reader(in);
+    Writer writer(out);
+    // 文件名 -> 各同名条目在输出中的偏移（按出现顺序），-1 表示已去除
+    std::unordered_map<std::string, std::deque<int64_t>> entries;
+    uint64_t centralStart = 0;
+    uint16_t centralCount = 0;
+    bool inCentral = false;
+
+    char signature[4];
+    while (reader.read(signature, sizeof(signature))) {
+        uint32_t type = get32(signature);
+
+        if (type == kLocalHeader && !inCentral) {
+            char header[26];
+            std::string name;
+            std::string extra;
+            if (!reader.read(header, sizeof(header)) || !reader.read(name, get16(header + 22)) ||
+                !reader.read(extra, get16(header + 24))) {
+                return failure(result, "文件头不完整");
+            }
+            uint16_t flags = get16(header + 2);
+            uint16_t method = get16(header + 4);
+            uint32_t compressedSize = get32(header + 14);
+            if (compressedSize == 0xFFFFFFFF) {
+                return failure(result, "不支持 ZIP64");
+            }
+            bool keep = !isVideo(name);
+            int64_t offset = static_cast<int64_t>(writer.written());
+            Writer* target = keep ? &writer : nullptr;
+            if (keep) {
+                writer.write(signature, sizeof(signature));
+                writer.write(header, sizeof(header));
+                writer.write(name);
+                writer.write(extra);
+            }
+
+            if (flags & 0x08) {
+                // 大小写在数据之后的数据描述符里
+                if (method != 8) {
+                    return failure(result, "不支持未记录大小的非 deflate 条目: " + name);
+                }
+                int64_t size = copyDeflateStream(reader, target);
+                if (size < 0) {
+                    return failure(result, "条目数据已损坏: " + name);
+                }
+                char descriptor[16];
+                if (!reader.read(descriptor, 12)) {
+                    return failure(result, "数据描述符不完整");
+                }
+                size_t descriptorSize = 12;
+                if (get32(descriptor) == kDataDescriptor) {
+                    // 带签名的数据描述符多 4 字节
+                    if (!reader.read(descriptor + 12, 4)) {
+                        return failure(result, "数据描述符不完整");
+                    }
+                    descriptorSize = 16;
+                }
+                if (keep) {
+                    writer.write(descriptor, descriptorSize);
+                }
+                compressedSize = static_cast<uint32_t>(size);
+            } else if (!copyBytes(reader, target, compressedSize)) {
+                return failure(result, "条目数据不完整: " + name);
+            }
+
+            if (!keep) {
+                result.removedEntries++;
+                result.removedBytes += compressedSize;
+            }
+            entries[name].push_back(keep ? offset : -1);
+            continue;
+        }
+
+        if (type == kCentralHeader) {
+            if (!inCentral) {
+                inCentral = true;
+                centralStart = writer.written();
+            }
+            char header[42];
+            std::string name;
+            std::string rest;
+            if (!reader.read(header, sizeof(header)) || !reader.read(name, get16(header + 24)) ||
+                !reader.read(rest, get16(header + 26) + get16(header + 28))) {
+                return failure(result, "中央目录不完整");
+            }
+            auto it = entries.find(name);
+            if (it == entries.end() || it->second.empty()) {
+                return failure(result, "中央目录与文件头不一致: " + name);
+            }
+            int64_t offset = it->second.front();
+            it->second.pop_front();
+            if (offset < 0) {
+                continue;
+            }
+            if (get32(header + 38) == 0xFFFFFFFF || offset > 0xFFFFFFFE) {
+                return failure(result, "不支持 ZIP64");
+            }
+            put32(header + 38, static_cast<uint32_t>(offset));
+            writer.write(signature, sizeof(signature));
+            writer.write(header, sizeof(header));
+            writer.write(name);
+            writer.write(rest);
+            centralCount++;
+            continue;
+        }
+
+        if (type == kEndOfCentralDirectory) {
+            char header[18];
+            std::string comment;
+            if (!reader.read(header, sizeof(header)) || !reader.read(comment, get16(header + 16))) {
+                return failure(result, "目录结束记录不完整");
+            }
+            if (get16(header) != 0 || get16(header + 6) == 0xFFFF) {
+                return failure(result, "不支持分卷或 ZIP64");
+            }
+            if (!inCentral) {
+                centralStart = writer.written();
+            }
+            put16(header + 4, centralCount);
+            put16(header + 6, centralCount);
+            put32(header + 8, static_cast<uint32_t>(writer.written() - centralStart));
+            put32(header + 12, static_cast<uint32_t>(centralStart));
+            writer.write(signature, sizeof(signature));
+            writer.write(header, sizeof(header));
+            writer.write(comment);
+            result.ok = static_cast<bool>(out);
+            if (!result.ok) {
+                result.error = "写入失败";
+            }
+            return result;
+        }
+
+        return failure(result, "无法识别的记录");
+    }
+    return failure(result, "缺少目录结束记录");
+}
+
+OszRewriter::Result OszRewriter::stripVideo(const fs::path& file) {
+    fs::path temp = file;
+    temp += ".strip";
+    Result result;
+    {
+        std::ifstream in(file, std::ios::binary);
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!in || !out) {
+            result.error = "无法打开文件";
+            return result;
+        }
+        result = stripVideo(in, out);
+        out.close();
+        if (result.ok && !out) {
+            result = failure(result, "写入失败");
+        }
+    }
+    std::error_code ec;
+    if (result.ok && result.removedEntries > 0) {
+        fs::rename(temp, file, ec);
+        if (ec) {
+            result = failure(result, "替换原文件失败: " + ec.message());
+        }
+    }
+    fs::remove(temp, ec);
+    return result;
+}
+
+} // namespace osu
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <iosfwd>
+#include <string>
+
+namespace fs = std::filesystem;
+
+namespace osu {
+
+// 从 .osz（ZIP）中去除视频
+// 按顺序流式读取本地文件头与数据，视频条目（按扩展名判断）直接跳过，其余条目原样写出；
+// 读到中央目录时只保留写出的条目并修正它们的偏移，最后重写目录结束记录。
+// 只向前读取，不需要随机访问，内存占用与压缩包大小无关。
+// 不支持 ZIP64 与分卷；大小写在数据描述符中的条目只支持 deflate 压缩（通过解压找到数据的结尾）。
+class OszRewriter {
+public:
+    struct Result {
+        bool ok = false;            // 为 false 时输出不可用，应保留原文件
+        size_t removedEntries = 0;
+        uint64_t removedBytes = 0;  // 去除的压缩数据字节数
+        std::string error;
+    };
+
+    // 从 in 读取压缩包，把去除视频后的压缩包写到 out
+    static Result stripVideo(std::istream& in, std::ostream& out);
+
+    // 原地处理一个 .osz 文件：没有视频或处理失败时文件保持不变
+    static Result stripVideo(const fs::path& file);
+
+    // 文件名是否为视频
+    static bool isVideo(const std::string& name);
+};
+
+} // namespace osu
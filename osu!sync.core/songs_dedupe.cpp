@@ -0,0 +1,393 @@
+#include "songs_dedupe.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <zlib.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+namespace osu {
+
+namespace {
+
+constexpr size_t kChunkSize = 64 * 1024;    // 快速哈希读取文件头尾各这么多字节，也是读取的缓冲大小
+constexpr const char* kTempSuffix = ".dedupe-tmp";
+
+struct FileEntry {
+    fs::path path;
+    std::string key;        // 相对于 Songs 的路径（UTF-8），记录中的键
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t fast = 0;
+    uint64_t full = 0;
+    bool hasFast = false;
+    bool hasFull = false;
+};
+
+// 64 位内容哈希：CRC32 与 Adler-32 拼接，两者都由 zlib 提供且足够快；
+// 哈希只用于分组，替换前仍会逐字节比较
+class ContentHash {
+public:
+    void update(const char* data, size_t size) {
+        crc_ = crc32(crc_, reinterpret_cast<const Bytef*>(data), static_cast<uInt>(size));
+        adler_ = adler32(adler_, reinterpret_cast<const Bytef*>(data), static_cast<uInt>(size));
+    }
+
+    uint64_t value() const { return (static_cast<uint64_t>(crc_) << 32) | adler_; }
+
+private:
+    uLong crc_ = crc32(0, Z_NULL, 0);
+    uLong adler_ = adler32(0, Z_NULL, 0);
+};
+
+bool fastHash(const FileEntry& entry, uint64_t& hash) {
+    std::ifstream in(entry.path, std::ios::binary);
+    std::vector<char> buffer(kChunkSize);
+    ContentHash content;
+    auto readAt = [&](uint64_t offset) {
+        in.seekg(static_cast<std::streamoff>(offset));
+        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        content.update(buffer.data(), static_cast<size_t>(in.gcount()));
+        return in.gcount() > 0;
+    };
+    if (!in || !readAt(0)) {
+        return false;
+    }
+    if (entry.size > kChunkSize) {
+        in.clear();
+        if (!readAt(entry.size - std::min<uint64_t>(entry.size - kChunkSize, kChunkSize))) {
+            return false;
+        }
+    }
+    hash = content.value();
+    return true;
+}
+
+bool fullHash(const FileEntry& entry, uint64_t& hash) {
+    std::ifstream in(entry.path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::vector<char> buffer(kChunkSize);
+    ContentHash content;
+    uint64_t total = 0;
+    while (in.read(buffer.data(), static_cast<std::streamsize>(buffer.size())) || in.gcount() > 0) {
+        content.update(buffer.data(), static_cast<size_t>(in.gcount()));
+        total += static_cast<uint64_t>(in.gcount());
+    }
+    hash = content.value();
+    return total == entry.size;
+}
+
+bool sameContent(const fs::path& a, const fs::path& b) {
+    std::ifstream left(a, std::ios::binary);
+    std::ifstream right(b, std::ios::binary);
+    if (!left || !right) {
+        return false;
+    }
+    std::vector<char> x(kChunkSize);
+    std::vector<char> y(kChunkSize);
+    while (true) {
+        left.read(x.data(), static_cast<std::streamsize>(x.size()));
+        right.read(y.data(), static_cast<std::streamsize>(y.size()));
+        if (left.gcount() != right.gcount() || !std::equal(x.begin(), x.begin() + left.gcount(), y.begin())) {
+            return false;
+        }
+        if (left.gcount() == 0) {
+            return true;
+        }
+    }
+}
+
+// 在 threads 个线程中对 [0, count) 执行 task
+template <typename Task>
+void parallelFor(size_t count, size_t threads, Task task) {
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < std::min(threads, count); ++t) {
+        workers.emplace_back([&] {
+            for (size_t i; (i = next++) < count;) {
+                task(i);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// 把 entries 中 key 相同且至少有两个成员的连续区间交给 callback；entries 须已按 key 排序
+template <typename Key, typename Callback>
+void forEachGroup(const std::vector<FileEntry*>& entries, Key key, Callback callback) {
+    for (size_t begin = 0; begin < entries.size();) {
+        size_t end = begin + 1;
+        while (end < entries.size() && key(*entries[end]) == key(*entries[begin])) {
+            end++;
+        }
+        if (end - begin > 1) {
+            callback(std::vector<FileEntry*>(entries.begin() + begin, entries.begin() + end));
+        }
+        begin = end;
+    }
+}
+
+bool isEditable(const fs::path& path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+    return extension == ".osu" || extension == ".osb";
+}
+
+int64_t modifiedTime(const fs::path& path, std::error_code& ec) {
+    return static_cast<int64_t>(fs::last_write_time(path, ec).time_since_epoch().count());
+}
+
+bool reflinkSupported() {
+#if defined(__linux__) && defined(FICLONE)
+    return true;
+#else
+    return false;
+#endif
+}
+
+// 在 target 处创建与 source 共享数据的文件
+bool shareData(const fs::path& source, const fs::path& target, bool reflink, std::error_code& ec) {
+    if (!reflink) {
+        fs::create_hard_link(source, target, ec);
+        return !ec;
+    }
+#if defined(__linux__) && defined(FICLONE)
+    int from = open(source.c_str(), O_RDONLY);
+    int to = open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = from >= 0 && to >= 0 && ioctl(to, FICLONE, from) == 0;
+    if (!ok) {
+        ec = std::error_code(errno, std::generic_category());
+    }
+    if (from >= 0) {
+        close(from);
+    }
+    if (to >= 0) {
+        close(to);
+    }
+    return ok;
+#else
+    ec = std::make_error_code(std::errc::operation_not_supported);
+    return false;
+#endif
+}
+
+} // namespace
+
+SongsDeduplicator::SongsDeduplicator(const fs::path& osuPath, Options options)
+    : songsPath_(osuPath / "Songs")
+    , recordPath_(osuPath / "osu!sync.dedupe")
+    , options_(options) {
+    if (options_.threads == 0) {
+        options_.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+SongsDeduplicator::Result SongsDeduplicator::run() {
+    if (!fs::is_directory(songsPath_)) {
+        throw std::runtime_error("Songs文件夹不存在: " + songsPath_.string());
+    }
+    if (options_.reflink && !reflinkSupported()) {
+        throw std::runtime_error("当前平台不支持 reflink");
+    }
+    Result result;
+
+    // 上次运行的记录：每行为 大小、修改时间、快速哈希、完整哈希（- 表示未计算）与相对路径
+    std::unordered_map<std::string, FileEntry> recorded;
+    {
+        std::ifstream in(recordPath_);
+        std::string line;
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            FileEntry entry;
+            std::string full;
+            if (fields >> entry.size >> entry.mtime >> std::hex >> entry.fast >> full && fields.get() == '\t' &&
+                std::getline(fields, entry.key)) {
+                entry.hasFast = true;
+                entry.hasFull = full != "-";
+                if (entry.hasFull) {
+                    entry.full = std::stoull(full, nullptr, 16);
+                }
+                recorded.emplace(entry.key, std::move(entry));
+            }
+        }
+    }
+
+    std::vector<FileEntry> files;
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(songsPath_, fs::directory_options::skip_permission_denied, ec), end;
+         it != end; it.increment(ec)) {
+        if (ec) {
+            break;
+        }
+        const auto& entry = *it;
+        if (entry.is_symlink(ec) || !entry.is_regular_file(ec) || isEditable(entry.path())) {
+            continue;
+        }
+        FileEntry file;
+        file.path = entry.path();
+        file.size = entry.file_size(ec);
+        if (ec || file.size < options_.minSize) {
+            continue;
+        }
+        std::string name = file.path.filename().string();
+        if (name.size() > std::char_traits<char>::length(kTempSuffix) &&
+            name.compare(name.size() - std::char_traits<char>::length(kTempSuffix), std::string::npos, kTempSuffix) == 0) {
+            // 上次中断留下的临时文件
+            fs::remove(file.path, ec);
+            continue;
+        }
+        file.mtime = modifiedTime(file.path, ec);
+        file.key = file.path.lexically_relative(songsPath_).generic_u8string();
+        auto cached = recorded.find(file.key);
+        if (cached != recorded.end() && cached->second.size == file.size && cached->second.mtime == file.mtime) {
+            file.fast = cached->second.fast;
+            file.full = cached->second.full;
+            file.hasFast = true;
+            file.hasFull = cached->second.hasFull;
+        }
+        result.totalBytes += file.size;
+        files.push_back(std::move(file));
+    }
+    recorded.clear();
+    result.files = files.size();
+
+    std::vector<FileEntry*> entries;
+    for (auto& file : files) {
+        entries.push_back(&file);
+    }
+
+    // 第一步：大小相同的文件计算快速哈希
+    std::sort(entries.begin(), entries.end(), [](const FileEntry* a, const FileEntry* b) {
+        return a->size < b->size;
+    });
+    std::vector<FileEntry*> pending;
+    forEachGroup(entries, [](const FileEntry& f) { return f.size; }, [&](const std::vector<FileEntry*>& group) {
+        for (auto* file : group) {
+            if (!file->hasFast) {
+                pending.push_back(file);
+            }
+        }
+    });
+    std::atomic<size_t> hashed{0};
+    parallelFor(pending.size(), options_.threads, [&](size_t i) {
+        pending[i]->hasFast = fastHash(*pending[i], pending[i]->fast);
+        hashed++;
+    });
+
+    // 第二步：快速哈希也相同的文件计算完整哈希
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [](const FileEntry* f) { return !f->hasFast; }),
+                  entries.end());
+    std::sort(entries.begin(), entries.end(), [](const FileEntry* a, const FileEntry* b) {
+        return std::tie(a->size, a->fast) < std::tie(b->size, b->fast);
+    });
+    pending.clear();
+    forEachGroup(entries, [](const FileEntry& f) { return std::make_pair(f.size, f.fast); },
+                 [&](const std::vector<FileEntry*>& group) {
+        for (auto* file : group) {
+            if (!file->hasFull) {
+                pending.push_back(file);
+            }
+        }
+    });
+    parallelFor(pending.size(), options_.threads, [&](size_t i) {
+        pending[i]->hasFull = fullHash(*pending[i], pending[i]->full);
+    });
+    result.hashed = hashed;
+
+    // 第三步：完整哈希相同的文件逐字节确认后共享数据
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [](const FileEntry* f) { return !f->hasFull; }),
+                  entries.end());
+    std::sort(entries.begin(), entries.end(), [](const FileEntry* a, const FileEntry* b) {
+        return std::tie(a->size, a->full, a->key) < std::tie(b->size, b->full, b->key);
+    });
+    forEachGroup(entries, [](const FileEntry& f) { return std::make_pair(f.size, f.full); },
+                 [&](const std::vector<FileEntry*>& group) {
+        result.duplicateGroups++;
+        // 以硬链接数最多的文件为源，已有的共享关系得以保留
+        std::error_code linkError;
+        FileEntry* source = *std::max_element(group.begin(), group.end(), [&](FileEntry* a, FileEntry* b) {
+            return fs::hard_link_count(a->path, linkError) < fs::hard_link_count(b->path, linkError);
+        });
+        for (auto* file : group) {
+            std::error_code error;
+            if (file == source) {
+                continue;
+            }
+            if (fs::equivalent(source->path, file->path, error)) {
+                result.alreadyLinked++;
+                continue;
+            }
+            // 还有其他硬链接指向的文件，替换它不会释放空间
+            bool frees = fs::hard_link_count(file->path, error) == 1;
+            if (options_.dryRun) {
+                result.linked++;
+                result.savedBytes += frees ? file->size : 0;
+                continue;
+            }
+            if (!sameContent(source->path, file->path)) {
+                continue;
+            }
+            fs::path temp = file->path;
+            temp += kTempSuffix;
+            fs::remove(temp, error);
+            error.clear();
+            if (shareData(source->path, temp, options_.reflink, error)) {
+                fs::rename(temp, file->path, error);
+            }
+            if (error) {
+                std::cerr << "替换失败: " << file->path.string() << ": " << error.message() << std::endl;
+                fs::remove(temp, error);
+                result.failed++;
+                continue;
+            }
+            result.linked++;
+            result.savedBytes += frees ? file->size : 0;
+            file->mtime = modifiedTime(file->path, error);
+        }
+    });
+
+    if (!options_.dryRun) {
+        // 写入新的记录，只保留计算过哈希的文件
+        fs::path temp = recordPath_;
+        temp += ".tmp";
+        {
+            std::ofstream out(temp, std::ios::trunc);
+            for (const auto& file : files) {
+                if (!file.hasFast) {
+                    continue;
+                }
+                out << file.size << '\t' << file.mtime << '\t' << std::hex << file.fast << '\t';
+                if (file.hasFull) {
+                    out << file.full;
+                } else {
+                    out << '-';
+                }
+                out << std::dec << '\t' << file.key << '\n';
+            }
+        }
+        fs::rename(temp, recordPath_, ec);
+    }
+    return result;
+}
+
+} // namespace osu
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace fs = std::filesystem;
+
+namespace osu {
+
+// Songs 文件夹中跨谱面集的重复文件去重
+// 同一首歌的不同谱面集、音效包等常常带着完全相同的音频与背景图。去重分三步，逐步缩小需要读取的范围：
+//   1. 按文件大小分组，大小唯一的文件不可能重复；
+//   2. 对同大小的文件计算快速哈希（只读文件头尾各 64 KB）；
+//   3. 快速哈希也相同的文件计算完整内容哈希，替换前再逐字节比较确认。
+// 哈希在多个线程中并行计算。确认重复的文件替换为指向同一份数据的硬链接（Linux 下可选 reflink），
+// 替换经由临时文件名加重命名完成，中途中断也不会留下缺失的文件。
+// 哈希结果按相对路径、大小与修改时间记录在 osu! 目录下，之后再运行时只需要为新文件或有变化的文件计算哈希。
+// .osu 与 .osb 会被编辑器原地修改，不参与去重。
+class SongsDeduplicator {
+public:
+    struct Options {
+        size_t threads = 0;             // 哈希线程数，0 表示按 CPU 核数
+        bool dryRun = false;            // 只统计，不修改文件
+        bool reflink = false;           // 使用 reflink（写时复制）代替硬链接，仅 Linux 上支持的文件系统可用
+        uint64_t minSize = 4096;        // 小于该大小的文件不值得处理
+    };
+
+    struct Result {
+        size_t files = 0;               // 扫描的文件数
+        size_t hashed = 0;              // 本次计算了哈希的文件数（其余来自记录）
+        size_t duplicateGroups = 0;     // 内容相同的文件组数
+        size_t linked = 0;              // 本次替换的文件数
+        size_t alreadyLinked = 0;       // 之前已经共享数据的文件数
+        uint64_t savedBytes = 0;        // 本次节省的空间
+        uint64_t totalBytes = 0;        // 扫描的文件总大小
+        size_t failed = 0;              // 替换失败的文件数
+    };
+
+    SongsDeduplicator(const fs::path& osuPath, Options options);
+
+    Result run();
+
+private:
+    fs::path songsPath_;
+    fs::path recordPath_;
+    Options options_;
+};
+
+} // namespace osu